@@ -4,6 +4,7 @@
 #include "framework.h"
 #include "FpsTracker.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <processthreadsapi.h>
 
@@ -120,7 +121,7 @@ void FpsTracker::Start()
 		throw std::runtime_error("FpsTracker::Start() : failed StartTraceSession(). ");
 	}
 
-	SubscribeOnPresentEvent(FpsTracker::OnPresentEvent, this);
+	SubscribeOnPresentBatch(FpsTracker::OnPresentBatch, this);
 }
 
 void FpsTracker::Stop()
@@ -130,46 +131,54 @@ void FpsTracker::Stop()
 
 FpsTracker::~FpsTracker()
 {
-	UnsubscribeOnPresentEvent(FpsTracker::OnPresentEvent, this);
+	UnsubscribeOnPresentBatch(FpsTracker::OnPresentBatch, this);
 	PresentEventTimes.clear();
 	SubscribersOnFpsChanged.clear();
 }
 
-void FpsTracker::OnPresentEvent(ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p)
+void FpsTracker::OnPresentBatch(PresentFrame const* frames, size_t frameCount)
 {
-	int fpsdelta = 0;
-	int oldfps = -1;
-	int fps = -1;
+	// fps changes in present order, reported once the lock is released
+	std::vector<std::pair<uint32_t, int>> fpsChanges;
 
 	// dump data into vectors... DX games will be using these 2 runtimes
-	if (true)
 	{
 		std::lock_guard<std::mutex> lock(PresentEventsLock);
-		auto v = PresentEventTimes.find(p.ProcessId);
-		if (v == PresentEventTimes.end()) {
-			// need to create entry in map
-			PresentEventTimes.insert(std::make_pair(p.ProcessId, std::unique_ptr<std::vector<uint64_t>>(new std::vector<uint64_t>())));
-		}
-		auto events = PresentEventTimes[p.ProcessId].get();
-		oldfps = (int)events->size(); // ok to go from size_t to int 
-
-		// remove any timestamp that is outside the 1sec time-frame
-		uint64_t qpcminus1sec = p.QpcTime - QpcFrequency();
-		while (events->size() > 0 && events->front() < qpcminus1sec) {
-			events->erase(events->begin());
-			fpsdelta--;
+		uint64_t qpcFrequency = QpcFrequency();
+		for (size_t i = 0; i < frameCount; ++i)
+		{
+			auto const& p = frames[i];
+			int fpsdelta = 0;
+
+			auto v = PresentEventTimes.find(p.mProcessId);
+			if (v == PresentEventTimes.end()) {
+				// need to create entry in map
+				v = PresentEventTimes.insert(std::make_pair(p.mProcessId, std::unique_ptr<std::vector<uint64_t>>(new std::vector<uint64_t>()))).first;
+			}
+			auto events = v->second.get();
+			int oldfps = (int)events->size(); // ok to go from size_t to int 
+
+			// remove any timestamp that is outside the 1sec time-frame
+			uint64_t qpcminus1sec = p.mQpcTime - qpcFrequency;
+			auto keep = std::find_if(events->begin(), events->end(), [=](uint64_t qpc) { return qpc >= qpcminus1sec; });
+			fpsdelta -= (int)(keep - events->begin());
+			events->erase(events->begin(), keep);
+
+			// add present event
+			events->push_back(p.mQpcTime);
+			fpsdelta++;
+
+			if (fpsdelta != 0)
+			{
+				fpsChanges.emplace_back(p.mProcessId, oldfps + fpsdelta);
+			}
 		}
-
-		// add present event
-		events->push_back(p.QpcTime);
-		fpsdelta++;
-		fps = oldfps + fpsdelta;
 	}
 
-	// report change to subscribers
-	if (fpsdelta != 0)
+	// report changes to subscribers
+	for (auto const& change : fpsChanges)
 	{
-		NotifySubscribers(p.ProcessId, fps);
+		NotifySubscribers(change.first, change.second);
 	}
 }
 
@@ -197,9 +206,9 @@ void FpsTracker::NotifySubscribers(uint32_t pid, int fps)
 	// doesn't accumulate a bunch of data in its vectors.
 }
 
-void FpsTracker::OnPresentEvent(void* context, ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p)
+void FpsTracker::OnPresentBatch(void* context, PresentFrame const* frames, size_t frameCount)
 {
 	FpsTracker* ft = (FpsTracker*)context;
-	ft->OnPresentEvent(processInfo, chain, p);
+	ft->OnPresentBatch(frames, frameCount);
 }
 
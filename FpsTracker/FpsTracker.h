@@ -49,10 +49,10 @@ private:
 
 	char** ExcludeProcessNames;
 
-	void OnPresentEvent(ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p);
+	void OnPresentBatch(PresentFrame const* frames, size_t frameCount);
 	void NotifySubscribers(uint32_t pid, int fps);
 	
 	static const int SESSION_NAME_SIZE = 128;
 	static char SessionName[SESSION_NAME_SIZE];
-	static void OnPresentEvent(void* context, ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p);
+	static void OnPresentBatch(void* context, PresentFrame const* frames, size_t frameCount);
 };
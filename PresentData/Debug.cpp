@@ -35,7 +35,7 @@ SOFTWARE.
 namespace {
 
 PresentEvent const* gModifiedPresent = nullptr;
-struct {
+struct PresentValues {
     uint64_t TimeTaken;
     uint64_t ReadyTime;
     uint64_t ScreenTime;
@@ -58,6 +58,28 @@ struct {
     bool Completed;
 } gOriginalPresentValues;
 
+void GetPresentValues(PresentEvent const& p, PresentValues* values)
+{
+    values->TimeTaken           = p.TimeTaken;
+    values->ReadyTime           = p.ReadyTime;
+    values->ScreenTime          = p.ScreenTime;
+    values->SwapChainAddress    = p.SwapChainAddress;
+    values->SyncInterval        = p.SyncInterval;
+    values->PresentFlags        = p.PresentFlags;
+    values->Hwnd                = p.Tracking == nullptr ? 0 : p.Tracking->Hwnd;
+    values->TokenPtr            = p.Tracking == nullptr ? 0 : p.Tracking->TokenPtr;
+    values->QueueSubmitSequence = p.Tracking == nullptr ? 0 : p.Tracking->QueueSubmitSequence;
+    values->DriverBatchThreadId = p.DriverBatchThreadId;
+    values->PresentMode         = p.PresentMode;
+    values->FinalState          = p.FinalState;
+    values->SupportsTearing     = p.SupportsTearing;
+    values->MMIO                = p.MMIO;
+    values->SeenDxgkPresent     = p.SeenDxgkPresent;
+    values->SeenWin32KEvents    = p.SeenWin32KEvents;
+    values->DwmNotified         = p.DwmNotified;
+    values->Completed           = p.Completed;
+}
+
 bool gDebugDone = false;
 bool gDebugTrace = false;
 LARGE_INTEGER* gFirstTimestamp = nullptr;
@@ -147,14 +169,17 @@ void FlushModifiedPresent()
 {
     if (gModifiedPresent == nullptr) return;
 
+    PresentValues modifiedValues;
+    GetPresentValues(*gModifiedPresent, &modifiedValues);
+
     uint32_t changedCount = 0;
 #define FLUSH_MEMBER(_Fn, _Name) \
-    if (gModifiedPresent->_Name != gOriginalPresentValues._Name) { \
+    if (modifiedValues._Name != gOriginalPresentValues._Name) { \
         if (changedCount++ == 0) PrintUpdateHeader(gModifiedPresent->Id); \
         printf(" " #_Name "="); \
         _Fn(gOriginalPresentValues._Name); \
         printf("->"); \
-        _Fn(gModifiedPresent->_Name); \
+        _Fn(modifiedValues._Name); \
     }
     FLUSH_MEMBER(PrintTimeDelta,     TimeTaken)
     FLUSH_MEMBER(PrintTimeDelta,     ReadyTime)
@@ -335,25 +360,7 @@ void DebugModifyPresent(PresentEvent const& p)
         FlushModifiedPresent();
 
         gModifiedPresent = &p;
-
-        gOriginalPresentValues.TimeTaken           = p.TimeTaken;
-        gOriginalPresentValues.ReadyTime           = p.ReadyTime;
-        gOriginalPresentValues.ScreenTime          = p.ScreenTime;
-        gOriginalPresentValues.SwapChainAddress    = p.SwapChainAddress;
-        gOriginalPresentValues.SyncInterval        = p.SyncInterval;
-        gOriginalPresentValues.PresentFlags        = p.PresentFlags;
-        gOriginalPresentValues.Hwnd                = p.Hwnd;
-        gOriginalPresentValues.TokenPtr            = p.TokenPtr;
-        gOriginalPresentValues.QueueSubmitSequence = p.QueueSubmitSequence;
-        gOriginalPresentValues.DriverBatchThreadId = p.DriverBatchThreadId;
-        gOriginalPresentValues.PresentMode         = p.PresentMode;
-        gOriginalPresentValues.FinalState          = p.FinalState;
-        gOriginalPresentValues.SupportsTearing     = p.SupportsTearing;
-        gOriginalPresentValues.MMIO                = p.MMIO;
-        gOriginalPresentValues.SeenDxgkPresent     = p.SeenDxgkPresent;
-        gOriginalPresentValues.SeenWin32KEvents    = p.SeenWin32KEvents;
-        gOriginalPresentValues.DwmNotified         = p.DwmNotified;
-        gOriginalPresentValues.Completed           = p.Completed;
+        GetPresentValues(p, &gOriginalPresentValues);
     }
 }
 
@@ -77,4 +77,20 @@ struct Present_Stop_Struct {
 #pragma pack(pop)
 #pragma warning(pop)
 
+// Event field layouts:
+#define EVENT_FIELD_LAYOUT(struct32_, struct64_, member_, name_) { name_, \
+    { (uint32_t) offsetof(struct32_, member_), (uint32_t) offsetof(struct64_, member_) }, \
+    { (uint32_t) sizeof(struct32_::member_), (uint32_t) sizeof(struct64_::member_) } },
+
+static constexpr EventFieldLayout Present_Start_Fields[] = {
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, pSwapchain, L"pSwapchain")
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, Flags, L"Flags")
+};
+
+static constexpr EventFieldLayout Present_Stop_Fields[] = {
+    EVENT_FIELD_LAYOUT(Present_Stop_Struct, Present_Stop_Struct, Result, L"Result")
+};
+
+#undef EVENT_FIELD_LAYOUT
+
 }
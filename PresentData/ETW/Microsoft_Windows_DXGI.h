@@ -99,4 +99,35 @@ struct PresentMultiplaneOverlay_Stop_Struct {
 #pragma pack(pop)
 #pragma warning(pop)
 
+// Event field layouts:
+#define EVENT_FIELD_LAYOUT(struct32_, struct64_, member_, name_) { name_, \
+    { (uint32_t) offsetof(struct32_, member_), (uint32_t) offsetof(struct64_, member_) }, \
+    { (uint32_t) sizeof(struct32_::member_), (uint32_t) sizeof(struct64_::member_) } },
+
+static constexpr EventFieldLayout Present_Start_Fields[] = {
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, pIDXGISwapChain, L"pIDXGISwapChain")
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, Flags, L"Flags")
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, SyncInterval, L"SyncInterval")
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, DirtyRects, L"DirtyRects")
+    EVENT_FIELD_LAYOUT(Present_Start_Struct<uint32_t>, Present_Start_Struct<uint64_t>, ScrollRects, L"ScrollRects")
+};
+
+static constexpr EventFieldLayout Present_Stop_Fields[] = {
+    EVENT_FIELD_LAYOUT(Present_Stop_Struct, Present_Stop_Struct, Result, L"Result")
+};
+
+static constexpr EventFieldLayout PresentMultiplaneOverlay_Start_Fields[] = {
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Start_Struct<uint32_t>, PresentMultiplaneOverlay_Start_Struct<uint64_t>, pIDXGISwapChain, L"pIDXGISwapChain")
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Start_Struct<uint32_t>, PresentMultiplaneOverlay_Start_Struct<uint64_t>, Flags, L"Flags")
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Start_Struct<uint32_t>, PresentMultiplaneOverlay_Start_Struct<uint64_t>, SyncInterval, L"SyncInterval")
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Start_Struct<uint32_t>, PresentMultiplaneOverlay_Start_Struct<uint64_t>, NumPlanes, L"NumPlanes")
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Start_Struct<uint32_t>, PresentMultiplaneOverlay_Start_Struct<uint64_t>, LayerMask, L"LayerMask")
+};
+
+static constexpr EventFieldLayout PresentMultiplaneOverlay_Stop_Fields[] = {
+    EVENT_FIELD_LAYOUT(PresentMultiplaneOverlay_Stop_Struct, PresentMultiplaneOverlay_Stop_Struct, Result, L"Result")
+};
+
+#undef EVENT_FIELD_LAYOUT
+
 }
@@ -382,6 +382,76 @@ struct VSyncDPC_Info_Struct {
 #pragma pack(pop)
 #pragma warning(pop)
 
+// Event field layouts:
+#define EVENT_FIELD_LAYOUT(struct32_, struct64_, member_, name_) { name_, \
+    { (uint32_t) offsetof(struct32_, member_), (uint32_t) offsetof(struct64_, member_) }, \
+    { (uint32_t) sizeof(struct32_::member_), (uint32_t) sizeof(struct64_::member_) } },
+
+static constexpr EventFieldLayout Flip_Info_Fields[] = {
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, pDmaBuffer, L"pDmaBuffer")
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, VidPnSourceId, L"VidPnSourceId")
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, FlipToAllocation, L"FlipToAllocation")
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, FlipInterval, L"FlipInterval")
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, FlipWithNoWait, L"FlipWithNoWait")
+    EVENT_FIELD_LAYOUT(Flip_Info_Struct<uint32_t>, Flip_Info_Struct<uint64_t>, MMIOFlip, L"MMIOFlip")
+};
+
+static constexpr EventFieldLayout MMIOFlip_Info_Fields[] = {
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, pDxgAdapter, L"pDxgAdapter")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, VidPnSourceId, L"VidPnSourceId")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipSubmitSequence, L"FlipSubmitSequence")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipToDriverAllocation, L"FlipToDriverAllocation")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipToPhysicalAddress, L"FlipToPhysicalAddress")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipToSegmentId, L"FlipToSegmentId")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipPresentId, L"FlipPresentId")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, FlipPhysicalAdapterMask, L"FlipPhysicalAdapterMask")
+    EVENT_FIELD_LAYOUT(MMIOFlip_Info_Struct<uint32_t>, MMIOFlip_Info_Struct<uint64_t>, Flags, L"Flags")
+};
+
+static constexpr EventFieldLayout PresentHistory_Info_Fields[] = {
+    EVENT_FIELD_LAYOUT(PresentHistory_Info_Struct<uint32_t>, PresentHistory_Info_Struct<uint64_t>, hAdapter, L"hAdapter")
+    EVENT_FIELD_LAYOUT(PresentHistory_Info_Struct<uint32_t>, PresentHistory_Info_Struct<uint64_t>, Token, L"Token")
+    EVENT_FIELD_LAYOUT(PresentHistory_Info_Struct<uint32_t>, PresentHistory_Info_Struct<uint64_t>, Model, L"Model")
+    EVENT_FIELD_LAYOUT(PresentHistory_Info_Struct<uint32_t>, PresentHistory_Info_Struct<uint64_t>, TokenSize, L"TokenSize")
+    EVENT_FIELD_LAYOUT(PresentHistory_Info_Struct<uint32_t>, PresentHistory_Info_Struct<uint64_t>, TokenData, L"TokenData")
+};
+
+static constexpr EventFieldLayout QueuePacket_Start_Fields[] = {
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, hContext, L"hContext")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, PacketType, L"PacketType")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, SubmitSequence, L"SubmitSequence")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, DmaBufferSize, L"DmaBufferSize")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, AllocationListSize, L"AllocationListSize")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, PatchLocationListSize, L"PatchLocationListSize")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, bPresent, L"bPresent")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, hDmaBuffer, L"hDmaBuffer")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, pQueuePacket, L"pQueuePacket")
+    EVENT_FIELD_LAYOUT(QueuePacket_Start_Struct<uint32_t>, QueuePacket_Start_Struct<uint64_t>, ProgressFenceValue, L"ProgressFenceValue")
+};
+
+static constexpr EventFieldLayout QueuePacket_Stop_Fields[] = {
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, hContext, L"hContext")
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, PacketType, L"PacketType")
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, SubmitSequence, L"SubmitSequence")
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, bPreempted, L"bPreempted")
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, bTimeouted, L"bTimeouted")
+    EVENT_FIELD_LAYOUT(QueuePacket_Stop_Struct<uint32_t>, QueuePacket_Stop_Struct<uint64_t>, pQueuePacket, L"pQueuePacket")
+};
+
+static constexpr EventFieldLayout VSyncDPC_Info_Fields[] = {
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, pDxgAdapter, L"pDxgAdapter")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, VidPnTargetId, L"VidPnTargetId")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, ScannedPhysicalAddress, L"ScannedPhysicalAddress")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, VidPnSourceId, L"VidPnSourceId")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, FrameNumber, L"FrameNumber")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, FrameQPCTime, L"FrameQPCTime")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, hFlipDevice, L"hFlipDevice")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, FlipType, L"FlipType")
+    EVENT_FIELD_LAYOUT(VSyncDPC_Info_Struct<uint32_t>, VSyncDPC_Info_Struct<uint64_t>, FlipFenceId, L"FlipFenceId")
+};
+
+#undef EVENT_FIELD_LAYOUT
+
 // Manually added:
 enum class FlipEntryStatus {
     FlipWaitVSync = 5,
@@ -139,6 +139,25 @@ struct TokenStateChanged_Info_Struct {
 #pragma pack(pop)
 #pragma warning(pop)
 
+// Event field layouts:
+#define EVENT_FIELD_LAYOUT(struct32_, struct64_, member_, name_) { name_, \
+    { (uint32_t) offsetof(struct32_, member_), (uint32_t) offsetof(struct64_, member_) }, \
+    { (uint32_t) sizeof(struct32_::member_), (uint32_t) sizeof(struct64_::member_) } },
+
+static constexpr EventFieldLayout TokenStateChanged_Info_Fields[] = {
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, pCompositionSurfaceObject, L"pCompositionSurfaceObject")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, SwapChainIndex, L"SwapChainIndex")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, PresentCount, L"PresentCount")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, FenceValue, L"FenceValue")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, NewState, L"NewState")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, IndependentFlip, L"IndependentFlip")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, SkipIndependentFlip, L"SkipIndependentFlip")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, CompositionSurfaceLuid, L"CompositionSurfaceLuid")
+    EVENT_FIELD_LAYOUT(TokenStateChanged_Info_Struct<uint32_t>, TokenStateChanged_Info_Struct<uint64_t>, BindId, L"BindId")
+};
+
+#undef EVENT_FIELD_LAYOUT
+
 // Manually added:
 enum class TokenState {
     Completed = 2,
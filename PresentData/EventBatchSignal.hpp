@@ -0,0 +1,184 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// EventBatchSignal lets the thread dequeuing a consumer's analyzed events
+// sleep until there is something to dequeue, instead of polling.  The
+// consumer thread calls Notify() after queuing events, and the waiting thread
+// is woken once either mBatchSize events are pending or mMaxLatency has passed
+// since the first of them was queued, whichever is first.
+//
+// Notify() only takes the mutex (to wake the waiter) for the first event of
+// each batch, so the waiter can start the latency deadline, and for the event
+// that fills the batch.  Every other Notify() is a single atomic add.
+//
+// The waiter also records how long each batch took from the first Notify()
+// to BatchDelivered(), i.e. the latency from an event being queued by the
+// consumer thread to the waiter being done with it.
+//
+// Notify() must only be called from one thread, and Wait() and
+// BatchDelivered() from one (other) thread.  Configure() must be called before
+// either thread starts, and GetLatencyStats() once the waiter has exited.
+//
+// This file has no platform dependencies.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+enum {
+    EVENT_BATCH_LATENCY_BUCKETS = 24,
+};
+
+struct EventBatchLatencyStats {
+    uint64_t BatchCount;
+    uint64_t TotalMicroseconds;
+    uint64_t MaxMicroseconds;
+    uint64_t Histogram[EVENT_BATCH_LATENCY_BUCKETS]; // [i] counts batches delivered in [2^i, 2^(i+1)) us; [0] also counts 0
+};
+
+class EventBatchSignal {
+    typedef std::chrono::steady_clock Clock;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::atomic<uint32_t> mPendingCount;
+    std::atomic<int64_t> mBatchStartTicks;  // Clock ticks of the batch's first Notify()
+    bool mStopped;                          // Protected by mMutex
+
+    // Read-only once the threads have started
+    uint32_t mBatchSize;
+    Clock::duration mMaxLatency;
+
+    // Waiter-only
+    bool mBatchPending;
+    int64_t mWaitBatchStartTicks;
+    EventBatchLatencyStats mLatencyStats;
+
+public:
+    EventBatchSignal()
+        : mPendingCount(0)
+        , mBatchStartTicks(0)
+        , mStopped(false)
+        , mBatchSize(1)
+        , mMaxLatency(0)
+        , mBatchPending(false)
+        , mWaitBatchStartTicks(0)
+        , mLatencyStats()
+    {
+    }
+
+    EventBatchSignal(EventBatchSignal const&) = delete;
+    EventBatchSignal& operator=(EventBatchSignal const&) = delete;
+
+    void Configure(uint32_t batchSize, uint32_t maxLatencyMs)
+    {
+        mBatchSize = batchSize == 0 ? 1 : batchSize;
+        mMaxLatency = std::chrono::milliseconds(maxLatencyMs);
+    }
+
+    // Consumer thread.  count events were just queued.
+    void Notify(uint32_t count = 1)
+    {
+        // The batch start time is stored before the count is published, so a
+        // waiter that sees the count sees the start time too.  If the waiter
+        // resets the count in between, the new batch keeps the previous start
+        // time and is only delivered early.
+        if (mPendingCount.load(std::memory_order_relaxed) == 0) {
+            mBatchStartTicks.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        }
+
+        auto pending = mPendingCount.fetch_add(count, std::memory_order_release) + count;
+        auto first = pending == count;
+        if (first || (pending >= mBatchSize && pending - count < mBatchSize)) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCondition.notify_one();
+        }
+    }
+
+    // Wake the waiter and make any later Wait() return immediately.  Can be
+    // called from any thread.
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopped = true;
+        mCondition.notify_one();
+    }
+
+    // Waiter thread.  Blocks until a batch is ready to dequeue, Stop() is
+    // called, or timeout passes with nothing queued.  Returns true if any
+    // events were queued, in which case the caller should dequeue them and
+    // then call BatchDelivered().
+    template<typename Rep, typename Period>
+    bool Wait(std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto queued = [this]() { return mPendingCount.load(std::memory_order_acquire) != 0; };
+        if (!mCondition.wait_for(lock, timeout, [&]() { return mStopped || queued(); })) {
+            return false;
+        }
+        if (!queued()) {
+            return false;
+        }
+
+        auto batchStartTicks = mBatchStartTicks.load(std::memory_order_relaxed);
+        auto deadline = Clock::time_point(Clock::duration(batchStartTicks)) + mMaxLatency;
+        mCondition.wait_until(lock, deadline, [this]() {
+            return mStopped || mPendingCount.load(std::memory_order_acquire) >= mBatchSize;
+        });
+
+        // Everything queued so far will be dequeued by the caller, so the
+        // next Notify() starts a new batch.
+        mPendingCount.exchange(0, std::memory_order_acquire);
+        mBatchPending = true;
+        mWaitBatchStartTicks = batchStartTicks;
+        return true;
+    }
+
+    // Waiter thread.  The batch returned by the last Wait() has been handled.
+    void BatchDelivered()
+    {
+        if (!mBatchPending) {
+            return;
+        }
+        mBatchPending = false;
+
+        auto elapsed = Clock::now() - Clock::time_point(Clock::duration(mWaitBatchStartTicks));
+        auto us = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+        uint32_t bucket = 0;
+        while (bucket + 1 < EVENT_BATCH_LATENCY_BUCKETS && (us >> (bucket + 1)) != 0) {
+            bucket += 1;
+        }
+
+        mLatencyStats.BatchCount += 1;
+        mLatencyStats.TotalMicroseconds += us;
+        if (mLatencyStats.MaxMicroseconds < us) {
+            mLatencyStats.MaxMicroseconds = us;
+        }
+        mLatencyStats.Histogram[bucket] += 1;
+    }
+
+    EventBatchLatencyStats const& GetLatencyStats() const { return mLatencyStats; }
+};
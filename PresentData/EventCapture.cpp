@@ -0,0 +1,490 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "EventCapture.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+char const CAPTURE_MAGIC[8] = { 'P', 'M', 'C', 'A', 'P', 'T', 'U', 'R' };
+
+enum {
+    WRITE_BUFFER_SIZE = 1024 * 1024,
+    DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024,
+};
+
+uint32_t RecordSize(uint32_t userDataLength)
+{
+    return ((uint32_t) sizeof(EventCaptureEvent) + userDataLength + 7u) & ~7u;
+}
+
+void UnmapView(uint8_t const* view, uint64_t size)
+{
+    if (view != nullptr) {
+#ifdef _WIN32
+        (void) size;
+        UnmapViewOfFile(view);
+#else
+        munmap((void*) view, (size_t) size);
+#endif
+    }
+}
+
+// std::push_heap() etc. build a max-heap, so the head that should be handed
+// out first has to compare as the largest.
+struct HeadIsLater {
+    template<typename Head>
+    bool operator()(Head const& lhs, Head const& rhs) const
+    {
+        return lhs.mKey != rhs.mKey ? lhs.mKey > rhs.mKey : lhs.mInput > rhs.mInput;
+    }
+};
+
+}
+
+EventCaptureWriter::EventCaptureWriter()
+    : mFile(nullptr)
+    , mStartQpc(0)
+    , mError(false)
+{
+}
+
+EventCaptureWriter::~EventCaptureWriter()
+{
+    Close();
+}
+
+bool EventCaptureWriter::Open(char const* path, int64_t qpcFrequency, int64_t startQpc)
+{
+    assert(mFile == nullptr);
+
+#ifdef _WIN32
+    if (fopen_s(&mFile, path, "wb") != 0) {
+        mFile = nullptr;
+    }
+#else
+    mFile = fopen(path, "wb");
+#endif
+    if (mFile == nullptr) {
+        return false;
+    }
+
+    mStartQpc = startQpc;
+    mError = false;
+    mBuffer.clear();
+    mBuffer.reserve(WRITE_BUFFER_SIZE);
+
+    EventCaptureFileHeader header = {};
+    memcpy(header.Magic, CAPTURE_MAGIC, sizeof(header.Magic));
+    header.Version      = EVENT_CAPTURE_VERSION;
+    header.HeaderSize   = sizeof(header);
+    header.QpcFrequency = qpcFrequency;
+    header.StartQpc     = startQpc;
+    mBuffer.insert(mBuffer.end(), (uint8_t const*) &header, (uint8_t const*) (&header + 1));
+    return true;
+}
+
+void EventCaptureWriter::Write(EventCaptureEvent* event, void const* userData)
+{
+    if (mFile == nullptr) {
+        return;
+    }
+
+    event->RecordSize = RecordSize(event->UserDataLength);
+    if (mBuffer.size() + event->RecordSize > WRITE_BUFFER_SIZE) {
+        Flush();
+    }
+
+    auto userDataBytes = (uint8_t const*) userData;
+    auto padding = event->RecordSize - sizeof(EventCaptureEvent) - event->UserDataLength;
+    mBuffer.insert(mBuffer.end(), (uint8_t const*) event, (uint8_t const*) (event + 1));
+    mBuffer.insert(mBuffer.end(), userDataBytes, userDataBytes + event->UserDataLength);
+    mBuffer.insert(mBuffer.end(), padding, (uint8_t) 0);
+}
+
+void EventCaptureWriter::Flush()
+{
+    if (!mBuffer.empty() && fwrite(mBuffer.data(), mBuffer.size(), 1, mFile) != 1) {
+        mError = true;
+    }
+    mBuffer.clear();
+}
+
+bool EventCaptureWriter::Close()
+{
+    if (mFile == nullptr) {
+        return !mError;
+    }
+
+    Flush();
+    if (fseek(mFile, offsetof(EventCaptureFileHeader, StartQpc), SEEK_SET) != 0 ||
+        fwrite(&mStartQpc, sizeof(mStartQpc), 1, mFile) != 1) {
+        mError = true;
+    }
+    if (fclose(mFile) != 0) {
+        mError = true;
+    }
+    mFile = nullptr;
+    return !mError;
+}
+
+EventCaptureReader::EventCaptureReader()
+    : mHeader()
+    , mView(nullptr)
+    , mPrevView(nullptr)
+    , mViewOffset(0)
+    , mViewSize(0)
+    , mPrevViewSize(0)
+    , mWindowSize(0)
+    , mGranularity(1)
+    , mSize(0)
+    , mOffset(0)
+#ifdef _WIN32
+    , mFileHandle(INVALID_HANDLE_VALUE)
+    , mMappingHandle(NULL)
+#else
+    , mFd(-1)
+#endif
+{
+}
+
+EventCaptureReader::~EventCaptureReader()
+{
+    Close();
+}
+
+EventCaptureReader::Status EventCaptureReader::Open(char const* path, uint64_t windowSize)
+{
+    assert(mView == nullptr);
+
+#ifdef _WIN32
+    mFileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mFileHandle == INVALID_HANDLE_VALUE) {
+        return FILE_NOT_FOUND;
+    }
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(mFileHandle, &size)) {
+        Close();
+        return INVALID_FILE;
+    }
+    mSize = (uint64_t) size.QuadPart;
+    if (mSize >= sizeof(EventCaptureFileHeader)) {
+        mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+
+    SYSTEM_INFO systemInfo = {};
+    GetSystemInfo(&systemInfo);
+    mGranularity = systemInfo.dwAllocationGranularity;
+#else
+    mFd = open(path, O_RDONLY);
+    if (mFd == -1) {
+        return FILE_NOT_FOUND;
+    }
+
+    struct stat st = {};
+    if (fstat(mFd, &st) != 0) {
+        Close();
+        return INVALID_FILE;
+    }
+    mSize = (uint64_t) st.st_size;
+
+    mGranularity = (uint64_t) sysconf(_SC_PAGESIZE);
+#endif
+
+    if (windowSize == 0) {
+        windowSize = sizeof(void*) < 8 ? (uint64_t) DEFAULT_WINDOW_SIZE : UINT64_MAX;
+    }
+
+    // A window starts up to mGranularity bytes before the record that needed
+    // it, and must still hold the largest possible record.
+    auto minWindowSize = mGranularity + RecordSize(UINT16_MAX);
+    mWindowSize = std::max(windowSize, minWindowSize);
+
+    // If the whole file doesn't fit in the address space, fall back to
+    // windows.
+    auto mapped = mSize >= sizeof(EventCaptureFileHeader) && MapView(0);
+    if (!mapped && mSize >= sizeof(EventCaptureFileHeader) && mWindowSize > DEFAULT_WINDOW_SIZE) {
+        mWindowSize = std::max((uint64_t) DEFAULT_WINDOW_SIZE, minWindowSize);
+        mapped = MapView(0);
+    }
+    if (!mapped) {
+        Close();
+        return INVALID_FILE;
+    }
+
+    memcpy(&mHeader, mView, sizeof(mHeader));
+    if (memcmp(mHeader.Magic, CAPTURE_MAGIC, sizeof(mHeader.Magic)) != 0 ||
+        mHeader.HeaderSize < sizeof(EventCaptureFileHeader) ||
+        mHeader.HeaderSize > mSize ||
+        (mHeader.HeaderSize & 7) != 0) {
+        Close();
+        return INVALID_FILE;
+    }
+
+    // Newer versions may add fields to the end of the header, but must bump
+    // the version if the event layout changes.
+    if (mHeader.Version != EVENT_CAPTURE_VERSION) {
+        Close();
+        return UNSUPPORTED_VERSION;
+    }
+
+    mOffset = mHeader.HeaderSize;
+    return SUCCESS;
+}
+
+void EventCaptureReader::Close()
+{
+    UnmapView(mView, mViewSize);
+    UnmapView(mPrevView, mPrevViewSize);
+#ifdef _WIN32
+    if (mMappingHandle != NULL) {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = NULL;
+    }
+    if (mFileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFileHandle);
+        mFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mFd != -1) {
+        close(mFd);
+        mFd = -1;
+    }
+#endif
+    mHeader = EventCaptureFileHeader();
+    mView = nullptr;
+    mPrevView = nullptr;
+    mViewOffset = 0;
+    mViewSize = 0;
+    mPrevViewSize = 0;
+    mSize = 0;
+    mOffset = 0;
+}
+
+// Maps the window holding offset.  The current view becomes mPrevView, so the
+// record handed out last is still mapped; the one before it is unmapped.
+bool EventCaptureReader::MapView(uint64_t offset)
+{
+    UnmapView(mPrevView, mPrevViewSize);
+    mPrevView = mView;
+    mPrevViewSize = mViewSize;
+    mView = nullptr;
+    mViewSize = 0;
+
+    auto viewOffset = offset - offset % mGranularity;
+    auto viewSize = std::min(mWindowSize, mSize - viewOffset);
+    if (viewSize > SIZE_MAX) {
+        return false;
+    }
+
+#ifdef _WIN32
+    if (mMappingHandle == NULL) {
+        return false;
+    }
+    auto view = MapViewOfFile(mMappingHandle, FILE_MAP_READ, (DWORD) (viewOffset >> 32), (DWORD) viewOffset, (SIZE_T) viewSize);
+    if (view == nullptr) {
+        return false;
+    }
+#else
+    auto view = mmap(nullptr, (size_t) viewSize, PROT_READ, MAP_PRIVATE, mFd, (off_t) viewOffset);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    madvise(view, (size_t) viewSize, MADV_SEQUENTIAL);
+#endif
+
+    mView = (uint8_t const*) view;
+    mViewOffset = viewOffset;
+    mViewSize = viewSize;
+    return true;
+}
+
+EventCaptureEvent const* EventCaptureReader::Next(void const** userData)
+{
+    if (mSize - mOffset < sizeof(EventCaptureEvent)) {
+        return nullptr;
+    }
+
+    // A new window holds any whole record, so at most one of these MapView()
+    // calls happens per record.
+    if (mOffset + sizeof(EventCaptureEvent) > mViewOffset + mViewSize && !MapView(mOffset)) {
+        return nullptr;
+    }
+
+    auto event = (EventCaptureEvent const*) (mView + (mOffset - mViewOffset));
+    if (event->RecordSize != RecordSize(event->UserDataLength) ||
+        event->RecordSize > mSize - mOffset) {
+        return nullptr;
+    }
+
+    if (mOffset + event->RecordSize > mViewOffset + mViewSize) {
+        if (!MapView(mOffset)) {
+            return nullptr;
+        }
+        event = (EventCaptureEvent const*) (mView + (mOffset - mViewOffset));
+    }
+
+    *userData = event + 1;
+    mOffset += event->RecordSize;
+    return event;
+}
+
+EventCaptureMergeReader::EventCaptureMergeReader()
+    : mLastTimeStamp(0)
+    , mQpcFrequency(0)
+    , mStartQpc(0)
+    , mDuplicateCount(0)
+{
+}
+
+EventCaptureMergeReader::~EventCaptureMergeReader()
+{
+    Close();
+}
+
+EventCaptureReader::Status EventCaptureMergeReader::Open(char const* const* paths, uint32_t pathCount)
+{
+    assert(mInputs.empty());
+    assert(pathCount > 0);
+
+    for (uint32_t i = 0; i < pathCount; ++i) {
+        auto reader = new EventCaptureReader;
+        auto status = reader->Open(paths[i]);
+        if (status != EventCaptureReader::SUCCESS) {
+            delete reader;
+            Close();
+            return status;
+        }
+        mInputs.emplace_back(reader);
+
+        auto header = reader->GetHeader();
+        if (i == 0) {
+            mQpcFrequency = header->QpcFrequency;
+            mStartQpc = header->StartQpc;
+        } else if (header->QpcFrequency != mQpcFrequency) {
+            Close();
+            return EventCaptureReader::INCOMPATIBLE_FILES;
+        } else if (mStartQpc != 0) {
+            mStartQpc = (header->StartQpc == 0 || header->StartQpc < mStartQpc) ? header->StartQpc : mStartQpc;
+        }
+    }
+
+    mHeap.reserve(pathCount);
+    for (uint32_t i = 0; i < pathCount; ++i) {
+        PushNext(i);
+    }
+    return EventCaptureReader::SUCCESS;
+}
+
+void EventCaptureMergeReader::Close()
+{
+    for (auto reader : mInputs) {
+        delete reader;
+    }
+    mInputs.clear();
+    mHeap.clear();
+    mSameTimeStamp.clear();
+    mLastTimeStamp = 0;
+    mQpcFrequency = 0;
+    mStartQpc = 0;
+    mDuplicateCount = 0;
+}
+
+void EventCaptureMergeReader::PushNext(uint32_t input)
+{
+    Head head;
+    head.mInput = input;
+    head.mEvent = mInputs[input]->Next(&head.mUserData);
+    if (head.mEvent == nullptr) {
+        return;
+    }
+
+    head.mKey = (head.mEvent->CaptureFlags & EVENT_CAPTURE_FLAG_METADATA) ? INT64_MIN : head.mEvent->TimeStamp;
+    mHeap.emplace_back(head);
+    std::push_heap(mHeap.begin(), mHeap.end(), HeadIsLater());
+}
+
+bool EventCaptureMergeReader::IsDuplicate(Head const& head) const
+{
+    for (size_t offset = 0; offset < mSameTimeStamp.size(); ) {
+        uint32_t input = 0;
+        memcpy(&input, &mSameTimeStamp[offset], sizeof(input));
+        auto other = (EventCaptureEvent const*) &mSameTimeStamp[offset + 8];
+        if (input != head.mInput &&
+            other->RecordSize == head.mEvent->RecordSize &&
+            memcmp(other, head.mEvent, head.mEvent->RecordSize) == 0) {
+            return true;
+        }
+        offset += 8 + other->RecordSize;
+    }
+    return false;
+}
+
+void EventCaptureMergeReader::AddSameTimeStamp(Head const& head)
+{
+    uint64_t input = head.mInput;
+    auto record = (uint8_t const*) head.mEvent;
+    mSameTimeStamp.insert(mSameTimeStamp.end(), (uint8_t const*) &input, (uint8_t const*) (&input + 1));
+    mSameTimeStamp.insert(mSameTimeStamp.end(), record, record + head.mEvent->RecordSize);
+}
+
+EventCaptureEvent const* EventCaptureMergeReader::Next(void const** userData)
+{
+    while (!mHeap.empty()) {
+        std::pop_heap(mHeap.begin(), mHeap.end(), HeadIsLater());
+        auto head = mHeap.back();
+        mHeap.pop_back();
+        PushNext(head.mInput);
+
+        // A single input has nothing to be a duplicate of.
+        if (mInputs.size() > 1 && (head.mEvent->CaptureFlags & EVENT_CAPTURE_FLAG_METADATA) == 0) {
+            if (mSameTimeStamp.empty() || head.mEvent->TimeStamp != mLastTimeStamp) {
+                mSameTimeStamp.clear();
+                mLastTimeStamp = head.mEvent->TimeStamp;
+            } else if (IsDuplicate(head)) {
+                mDuplicateCount += 1;
+                continue;
+            }
+            AddSameTimeStamp(head);
+        }
+
+        *userData = head.mUserData;
+        return head.mEvent;
+    }
+
+    return nullptr;
+}
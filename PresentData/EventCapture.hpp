@@ -0,0 +1,221 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// A PresentMon capture file records the events PMTraceConsumer and
+// MRTraceConsumer handle, so that analysis can be reproduced or benchmarked
+// without ETW.  Each event stores exactly the EVENT_HEADER fields the Handle*()
+// functions use plus the event's user data.  The TRACE_EVENT_INFO metadata
+// the consumers looked up to decode an event's properties is stored ahead of
+// the first event that needed it, as a record with
+// EVENT_CAPTURE_FLAG_METADATA set, so replay never needs TDH.
+//
+// File layout (little-endian):
+//
+//   EventCaptureFileHeader
+//   EventCaptureEvent, followed by UserDataLength bytes, padded to 8 bytes
+//   EventCaptureEvent, ...
+//
+// The reader maps the file and hands out pointers into the mapping, so replay
+// doesn't copy user data.  64-bit builds map the whole file in one view;
+// 32-bit builds don't have the address space for multi-GB captures, so they
+// map a window at a time and move it as reading crosses its end.  Either way
+// a returned record stays valid until the second Next() call after it.
+// EventCaptureMergeReader reads several
+// captures of the same system (e.g., split files from a rotating logger) as
+// one stream in timestamp order.  This file and EventCapture.cpp have no ETW
+// dependencies.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+enum {
+    EVENT_CAPTURE_VERSION = 1,
+};
+
+enum {
+    // The record isn't an event: it holds the TRACE_EVENT_INFO for events
+    // with this record's ProviderId and event descriptor.
+    EVENT_CAPTURE_FLAG_METADATA = 1 << 0,
+};
+
+struct EventCaptureFileHeader {
+    char     Magic[8];          // "PMCAPTUR"
+    uint32_t Version;           // EVENT_CAPTURE_VERSION
+    uint32_t HeaderSize;        // sizeof(EventCaptureFileHeader)
+    int64_t  QpcFrequency;
+    int64_t  StartQpc;          // 0 if the first event's timestamp should be used
+};
+
+struct EventCaptureEvent {
+    uint32_t RecordSize;        // This struct plus user data, rounded up to 8 bytes
+    uint16_t UserDataLength;
+    uint16_t HeaderFlags;       // EVENT_HEADER::Flags
+    uint8_t  ProviderId[16];    // GUID
+    uint16_t Id;                // EVENT_DESCRIPTOR
+    uint8_t  Version;
+    uint8_t  Channel;
+    uint8_t  Level;
+    uint8_t  Opcode;
+    uint16_t Task;
+    uint64_t Keyword;
+    uint32_t ThreadId;
+    uint32_t ProcessId;
+    int64_t  TimeStamp;
+    uint32_t CaptureFlags;      // EVENT_CAPTURE_FLAG_*
+    uint32_t Reserved;
+};
+
+static_assert(sizeof(EventCaptureFileHeader) == 32, "EventCaptureFileHeader layout is part of the file format");
+static_assert(sizeof(EventCaptureEvent) == 64, "EventCaptureEvent layout is part of the file format");
+
+class EventCaptureWriter {
+    FILE* mFile;
+    std::vector<uint8_t> mBuffer;
+    int64_t mStartQpc;
+    bool mError;
+
+    void Flush();
+
+public:
+    EventCaptureWriter();
+    ~EventCaptureWriter();
+
+    EventCaptureWriter(EventCaptureWriter const&) = delete;
+    EventCaptureWriter& operator=(EventCaptureWriter const&) = delete;
+
+    bool Open(char const* path, int64_t qpcFrequency, int64_t startQpc);
+    // Fills in event->RecordSize.
+    void Write(EventCaptureEvent* event, void const* userData);
+    // The header's StartQpc is rewritten on Close(), for sessions that only
+    // know their start time once the first event arrives.
+    void SetStartQpc(int64_t startQpc) { mStartQpc = startQpc; }
+    // Returns false if any write failed.
+    bool Close();
+};
+
+class EventCaptureReader {
+    EventCaptureFileHeader mHeader;
+    uint8_t const* mView;       // Maps [mViewOffset, mViewOffset + mViewSize) of the file
+    uint8_t const* mPrevView;   // Kept mapped so the previously returned record stays valid
+    uint64_t mViewOffset;
+    uint64_t mViewSize;
+    uint64_t mPrevViewSize;
+    uint64_t mWindowSize;
+    uint64_t mGranularity;      // Views must start at a multiple of this
+    uint64_t mSize;
+    uint64_t mOffset;
+#ifdef _WIN32
+    void* mFileHandle;
+    void* mMappingHandle;
+#else
+    int mFd;
+#endif
+
+    bool MapView(uint64_t offset);
+
+public:
+    enum Status {
+        SUCCESS,
+        FILE_NOT_FOUND,
+        INVALID_FILE,
+        UNSUPPORTED_VERSION,
+        INCOMPATIBLE_FILES,     // EventCaptureMergeReader inputs use different QPC frequencies
+    };
+
+    EventCaptureReader();
+    ~EventCaptureReader();
+
+    EventCaptureReader(EventCaptureReader const&) = delete;
+    EventCaptureReader& operator=(EventCaptureReader const&) = delete;
+
+    // windowSize is the most of the file to map at once; 0 uses the whole
+    // file on 64-bit builds and 64 MB on 32-bit builds.  It is rounded up so
+    // that any record fits in one window.
+    Status Open(char const* path, uint64_t windowSize = 0);
+    void Close();
+
+    EventCaptureFileHeader const* GetHeader() const { return &mHeader; }
+
+    // Returns the next event and points userData at its user data (inside the
+    // mapping), or returns nullptr at the end of the file, if the remaining
+    // data is truncated, or if the next window can't be mapped.
+    EventCaptureEvent const* Next(void const** userData);
+};
+
+// Merges the events of several captures into timestamp order with a k-way
+// merge: a min-heap holds the next record of each input, keyed by (TimeStamp,
+// input index), so ties keep the order the inputs were given in and each
+// Next() is O(log inputs).  Read-ahead is bounded to that one record per
+// input; the rest stay in the file mappings until needed.
+//
+// The inputs may cover overlapping time ranges.  Metadata records are handed
+// out as soon as they reach the front of their input, ahead of any event, so
+// they still precede the events that need them.  An event that is identical
+// (header and user data) to one already handed out from another input with
+// the same timestamp, i.e. was recorded in both captures, is skipped.
+class EventCaptureMergeReader {
+    struct Head {
+        int64_t mKey;               // TimeStamp, or INT64_MIN for metadata
+        uint32_t mInput;
+        EventCaptureEvent const* mEvent;
+        void const* mUserData;
+    };
+
+    std::vector<EventCaptureReader*> mInputs;
+    std::vector<Head> mHeap;
+    // Copies of the events handed out with mLastTimeStamp, each after an
+    // 8-byte input index, to find duplicates.  They are copied because a
+    // windowed input may have unmapped them.
+    std::vector<uint8_t> mSameTimeStamp;
+    int64_t mLastTimeStamp;
+    int64_t mQpcFrequency;
+    int64_t mStartQpc;
+    uint64_t mDuplicateCount;
+
+    void PushNext(uint32_t input);
+    bool IsDuplicate(Head const& head) const;
+    void AddSameTimeStamp(Head const& head);
+
+public:
+    EventCaptureMergeReader();
+    ~EventCaptureMergeReader();
+
+    EventCaptureMergeReader(EventCaptureMergeReader const&) = delete;
+    EventCaptureMergeReader& operator=(EventCaptureMergeReader const&) = delete;
+
+    // Fails if any input can't be opened, or if the inputs don't share a QPC
+    // frequency (i.e., weren't captured on the same system).
+    EventCaptureReader::Status Open(char const* const* paths, uint32_t pathCount);
+    void Close();
+
+    int64_t GetQpcFrequency() const { return mQpcFrequency; }
+    // The earliest input StartQpc, or 0 if any input uses its first event's
+    // timestamp.
+    int64_t GetStartQpc() const { return mStartQpc; }
+    uint64_t GetDuplicateCount() const { return mDuplicateCount; }
+
+    // Returns the next record of any input, as EventCaptureReader::Next()
+    // does, or nullptr once every input is done.
+    EventCaptureEvent const* Next(void const** userData);
+};
@@ -0,0 +1,189 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "EventMetadataCache.hpp"
+
+namespace {
+
+char const CACHE_MAGIC[8] = { 'P', 'M', 'M', 'E', 'T', 'A', 'D', 'C' };
+
+uint32_t RecordSize(uint32_t teiSize)
+{
+    return ((uint32_t) sizeof(EventMetadataCacheEntry) + teiSize + 7u) & ~7u;
+}
+
+// Only the parts of the TRACE_EVENT_INFO that are used to locate properties
+// are checked; a corrupt name offset is caught when the name is compared.
+bool IsValidTraceEventInfo(uint8_t const* data, uint32_t teiSize)
+{
+    auto propertiesOffset = (uint32_t) offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray);
+    if (teiSize < propertiesOffset) {
+        return false;
+    }
+
+    auto tei = (TRACE_EVENT_INFO const*) data;
+    return tei->TopLevelPropertyCount <= tei->PropertyCount &&
+           tei->PropertyCount <= (teiSize - propertiesOffset) / sizeof(EVENT_PROPERTY_INFO);
+}
+
+bool ReadCacheFile(char const* path, std::vector<uint8_t>* data)
+{
+    FILE* fp = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&fp, path, "rb") != 0) {
+        fp = nullptr;
+    }
+#else
+    fp = fopen(path, "rb");
+#endif
+    if (fp == nullptr) {
+        return false;
+    }
+
+    uint8_t buffer[64 * 1024];
+    for (;;) {
+        auto n = fread(buffer, 1, sizeof(buffer), fp);
+        data->insert(data->end(), buffer, buffer + n);
+        if (n < sizeof(buffer)) {
+            break;
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+}
+
+EventMetadataCacheStatus LoadEventMetadataCache(char const* path, EventMetadata* metadata)
+{
+    std::vector<uint8_t> data;
+    if (!ReadCacheFile(path, &data)) {
+        return EventMetadataCacheStatus::FILE_NOT_FOUND;
+    }
+
+    if (data.size() < sizeof(EventMetadataCacheFileHeader)) {
+        return EventMetadataCacheStatus::INVALID_FILE;
+    }
+
+    EventMetadataCacheFileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.Magic, CACHE_MAGIC, sizeof(header.Magic)) != 0 ||
+        header.HeaderSize < sizeof(EventMetadataCacheFileHeader) ||
+        header.HeaderSize > data.size() ||
+        (header.HeaderSize & 7) != 0) {
+        return EventMetadataCacheStatus::INVALID_FILE;
+    }
+
+    // Newer versions may add fields to the end of the header, but must bump
+    // the version if the entry layout changes.
+    if (header.Version != EVENT_METADATA_CACHE_VERSION) {
+        return EventMetadataCacheStatus::UNSUPPORTED_VERSION;
+    }
+
+    // Validate every entry before adding any, so a truncated file doesn't
+    // leave metadata partially loaded.
+    std::vector<size_t> entryOffsets;
+    entryOffsets.reserve(header.EntryCount);
+    size_t offset = header.HeaderSize;
+    for (uint32_t i = 0; i < header.EntryCount; ++i) {
+        if (data.size() - offset < sizeof(EventMetadataCacheEntry)) {
+            return EventMetadataCacheStatus::INVALID_FILE;
+        }
+
+        auto entry = (EventMetadataCacheEntry const*) (data.data() + offset);
+        if (entry->RecordSize != RecordSize(entry->TeiSize) ||
+            entry->RecordSize > data.size() - offset ||
+            !IsValidTraceEventInfo((uint8_t const*) (entry + 1), entry->TeiSize)) {
+            return EventMetadataCacheStatus::INVALID_FILE;
+        }
+
+        entryOffsets.emplace_back(offset);
+        offset += entry->RecordSize;
+    }
+
+    for (auto entryOffset : entryOffsets) {
+        auto entry = (EventMetadataCacheEntry const*) (data.data() + entryOffset);
+        EventMetadataKey key;
+        memcpy(&key, entry->Key, sizeof(key));
+        metadata->SetMetadata(key, (uint8_t const*) (entry + 1), entry->TeiSize);
+    }
+
+    return EventMetadataCacheStatus::SUCCESS;
+}
+
+bool SaveEventMetadataCache(char const* path, EventMetadata* const* metadata, uint32_t metadataCount)
+{
+    std::vector<uint8_t> data(sizeof(EventMetadataCacheFileHeader), 0);
+
+    uint32_t entryCount = 0;
+    for (uint32_t i = 0; i < metadataCount; ++i) {
+        for (auto const& pair : metadata[i]->metadata_) {
+            auto const& key = pair.first;
+            auto const& tei = pair.second.tei_;
+
+            auto written = false;
+            for (uint32_t j = 0; j < i && !written; ++j) {
+                written = metadata[j]->metadata_.find(key) != metadata[j]->metadata_.end();
+            }
+            if (written || tei.empty()) {
+                continue;
+            }
+
+            EventMetadataCacheEntry entry = {};
+            entry.RecordSize = RecordSize((uint32_t) tei.size());
+            entry.TeiSize    = (uint32_t) tei.size();
+            memcpy(entry.Key, &key, sizeof(key));
+
+            auto padding = entry.RecordSize - sizeof(EventMetadataCacheEntry) - entry.TeiSize;
+            data.insert(data.end(), (uint8_t const*) &entry, (uint8_t const*) (&entry + 1));
+            data.insert(data.end(), tei.begin(), tei.end());
+            data.insert(data.end(), padding, (uint8_t) 0);
+            entryCount += 1;
+        }
+    }
+
+    EventMetadataCacheFileHeader header = {};
+    memcpy(header.Magic, CACHE_MAGIC, sizeof(header.Magic));
+    header.Version    = EVENT_METADATA_CACHE_VERSION;
+    header.HeaderSize = sizeof(header);
+    header.EntryCount = entryCount;
+    memcpy(data.data(), &header, sizeof(header));
+
+    FILE* fp = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&fp, path, "wb") != 0) {
+        fp = nullptr;
+    }
+#else
+    fp = fopen(path, "wb");
+#endif
+    if (fp == nullptr) {
+        return false;
+    }
+
+    auto ok = fwrite(data.data(), data.size(), 1, fp) == 1;
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,79 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// A metadata cache file holds the TRACE_EVENT_INFO blobs an EventMetadata
+// collected, either from TDH or from Microsoft_Windows_EventMetadata events,
+// so that a later session can load them at startup instead of calling
+// TdhGetEventInformation() the first time each event type is seen.  Entries
+// are keyed by provider and event descriptor (which includes the event's
+// version) just like EventMetadata, so a cached entry is only used for events
+// with exactly the same manifest version.
+//
+// File layout (little-endian):
+//
+//   EventMetadataCacheFileHeader
+//   EventMetadataCacheEntry, followed by TeiSize bytes, padded to 8 bytes
+//   EventMetadataCacheEntry, ...
+//
+// TRACE_EVENT_INFO only contains offsets, not pointers, so the file can be
+// written and read by either 32-bit or 64-bit builds.
+
+#include "TraceConsumer.hpp"
+
+enum {
+    EVENT_METADATA_CACHE_VERSION = 1,
+};
+
+struct EventMetadataCacheFileHeader {
+    char     Magic[8];          // "PMMETADC"
+    uint32_t Version;           // EVENT_METADATA_CACHE_VERSION
+    uint32_t HeaderSize;        // sizeof(EventMetadataCacheFileHeader)
+    uint32_t EntryCount;
+    uint32_t Reserved;
+};
+
+struct EventMetadataCacheEntry {
+    uint32_t RecordSize;        // This struct plus TeiSize, rounded up to 8 bytes
+    uint32_t TeiSize;           // TRACE_EVENT_INFO size
+    uint8_t  Key[32];           // EventMetadataKey
+};
+
+static_assert(sizeof(EventMetadataCacheFileHeader) == 24, "EventMetadataCacheFileHeader layout is part of the file format");
+static_assert(sizeof(EventMetadataCacheEntry) == 40, "EventMetadataCacheEntry layout is part of the file format");
+static_assert(sizeof(EventMetadataKey) == sizeof(EventMetadataCacheEntry::Key), "EventMetadataKey layout is part of the file format");
+
+enum class EventMetadataCacheStatus {
+    SUCCESS,
+    FILE_NOT_FOUND,
+    INVALID_FILE,
+    UNSUPPORTED_VERSION,
+};
+
+// Adds every entry in the file to metadata, replacing any metadata it already
+// has for the same key.  Nothing is added unless the whole file is valid.
+EventMetadataCacheStatus LoadEventMetadataCache(char const* path, EventMetadata* metadata);
+
+// Writes the metadata from each of the metadataCount EventMetadata to the
+// file.  If more than one has metadata for the same key, the first one's is
+// written.  Returns false if the file couldn't be written.
+bool SaveEventMetadataCache(char const* path, EventMetadata* const* metadata, uint32_t metadataCount);
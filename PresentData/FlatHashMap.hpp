@@ -0,0 +1,230 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// FlatHashMap is an open-addressing hash table used for PMTraceConsumer's
+// per-event lookup maps.  Those maps are small (tens to hundreds of entries),
+// keyed by thread ids, submit sequences, and kernel pointers/tokens, and see
+// an insert/lookup/erase for nearly every present-related event, so a single
+// contiguous array with linear probing is much cheaper than std::map's node
+// allocations and pointer chasing.
+//
+// Deletion uses backward-shift, so there are no tombstones and probe sequences
+// never degrade as entries churn.  The trade-off is that erase() (and any
+// insert that grows the table) invalidates all iterators; don't hold an
+// iterator across a modification of the same map.
+//
+// The hasher only needs to produce well-distributed low-entropy input; the
+// table applies a Fibonacci multiply before taking the top bits as the slot
+// index, so identity hashing of small integers and aligned pointers is fine.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <iterator>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+template<typename Key>
+struct FlatHash {
+    uint64_t operator()(Key const& key) const { return (uint64_t) key; }
+};
+
+template<typename Key, typename Value, typename Hash = FlatHash<Key>>
+class FlatHashMap {
+public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+
+    class iterator {
+        FlatHashMap* mMap;
+        size_t mIndex;
+
+        friend class FlatHashMap;
+        iterator(FlatHashMap* map, size_t index) : mMap(map), mIndex(index) {}
+
+        void SkipEmpty()
+        {
+            while (mIndex < mMap->mOccupied.size() && !mMap->mOccupied[mIndex]) {
+                ++mIndex;
+            }
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename FlatHashMap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        value_type& operator*() const { return mMap->mSlots[mIndex]; }
+        value_type* operator->() const { return &mMap->mSlots[mIndex]; }
+        iterator& operator++() { ++mIndex; SkipEmpty(); return *this; }
+        bool operator==(iterator const& rhs) const { return mIndex == rhs.mIndex; }
+        bool operator!=(iterator const& rhs) const { return mIndex != rhs.mIndex; }
+    };
+
+    FlatHashMap()
+        : mSize(0)
+        , mShift(64)
+    {
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    iterator begin() { iterator iter(this, 0); iter.SkipEmpty(); return iter; }
+    iterator end() { return iterator(this, mOccupied.size()); }
+
+    iterator find(Key const& key)
+    {
+        if (mSize == 0) {
+            return end();
+        }
+        for (auto i = SlotIndex(key);; i = NextIndex(i)) {
+            if (!mOccupied[i]) {
+                return end();
+            }
+            if (mSlots[i].first == key) {
+                return iterator(this, i);
+            }
+        }
+    }
+
+    // Inserts (key, value) if key is not already present.  Like std::map,
+    // returns the entry for key and whether it was inserted.
+    std::pair<iterator, bool> emplace(Key const& key, Value const& value)
+    {
+        Reserve(mSize + 1);
+        for (auto i = SlotIndex(key);; i = NextIndex(i)) {
+            if (!mOccupied[i]) {
+                mOccupied[i] = 1;
+                mSlots[i].first = key;
+                mSlots[i].second = value;
+                mSize += 1;
+                return std::make_pair(iterator(this, i), true);
+            }
+            if (mSlots[i].first == key) {
+                return std::make_pair(iterator(this, i), false);
+            }
+        }
+    }
+
+    Value& operator[](Key const& key)
+    {
+        return emplace(key, Value()).first->second;
+    }
+
+    void erase(iterator iter)
+    {
+        assert(iter.mMap == this && iter.mIndex < mOccupied.size() && mOccupied[iter.mIndex]);
+
+        // Backward-shift deletion: walk the cluster following the hole and
+        // move back any entry whose probe sequence passes through the hole,
+        // so lookups never need to skip over deleted slots.
+        auto hole = iter.mIndex;
+        for (auto i = NextIndex(hole); mOccupied[i]; i = NextIndex(i)) {
+            auto ideal = SlotIndex(mSlots[i].first);
+            if (((i - ideal) & Mask()) >= ((i - hole) & Mask())) {
+                mSlots[hole] = std::move(mSlots[i]);
+                hole = i;
+            }
+        }
+
+        mOccupied[hole] = 0;
+        mSlots[hole] = value_type();
+        mSize -= 1;
+    }
+
+    size_t erase(Key const& key)
+    {
+        auto iter = find(key);
+        if (iter == end()) {
+            return 0;
+        }
+        erase(iter);
+        return 1;
+    }
+
+    void clear()
+    {
+        if (mSize > 0) {
+            for (size_t i = 0, n = mOccupied.size(); i < n; ++i) {
+                if (mOccupied[i]) {
+                    mOccupied[i] = 0;
+                    mSlots[i] = value_type();
+                }
+            }
+            mSize = 0;
+        }
+    }
+
+    // Ensure the table can hold count entries without growing.
+    void Reserve(size_t count)
+    {
+        // Keep the load factor at or below 3/4.
+        if (count * 4 <= mOccupied.size() * 3) {
+            return;
+        }
+
+        size_t capacity = mOccupied.empty() ? 16 : mOccupied.size();
+        while (count * 4 > capacity * 3) {
+            capacity *= 2;
+        }
+
+        std::vector<value_type> slots(capacity);
+        std::vector<uint8_t> occupied(capacity, 0);
+        mSlots.swap(slots);
+        mOccupied.swap(occupied);
+        mShift = 64;
+        for (auto c = capacity; c > 1; c >>= 1) {
+            mShift -= 1;
+        }
+
+        for (size_t i = 0, n = occupied.size(); i < n; ++i) {
+            if (occupied[i]) {
+                auto j = SlotIndex(slots[i].first);
+                while (mOccupied[j]) {
+                    j = NextIndex(j);
+                }
+                mOccupied[j] = 1;
+                mSlots[j] = std::move(slots[i]);
+            }
+        }
+    }
+
+private:
+    std::vector<value_type> mSlots;
+    std::vector<uint8_t> mOccupied;
+    size_t mSize;
+    uint32_t mShift;    // 64 - log2(capacity)
+
+    size_t Mask() const { return mOccupied.size() - 1; }
+    size_t NextIndex(size_t i) const { return (i + 1) & Mask(); }
+    size_t SlotIndex(Key const& key) const
+    {
+        return (size_t) ((Hash()(key) * 0x9E3779B97F4A7C15ull) >> mShift);
+    }
+};
@@ -0,0 +1,145 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// GenerationalPool is a slab allocator for objects that are created and
+// destroyed at a high rate by a single thread.  Objects are stored in
+// fixed-size chunks that are never released until the pool is destroyed, so
+// object addresses are stable and slots are recycled through a free list
+// without going back to the heap.
+//
+// Objects are referred to by a PoolHandle (slot index + generation).  The
+// slot's generation is incremented whenever an object is created or destroyed
+// in it, so a handle to a destroyed object is detected as stale by Get()
+// instead of aliasing whatever object reuses the slot.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct PoolHandle {
+    uint32_t Index;
+    uint32_t Generation;    // Odd while the object is alive, 0 for an invalid handle
+
+    PoolHandle() : Index(0), Generation(0) {}
+    PoolHandle(uint32_t index, uint32_t generation) : Index(index), Generation(generation) {}
+
+    bool IsValid() const { return Generation != 0; }
+    bool operator==(PoolHandle const& rhs) const { return Index == rhs.Index && Generation == rhs.Generation; }
+    bool operator!=(PoolHandle const& rhs) const { return !(*this == rhs); }
+};
+
+template<typename T, uint32_t CHUNK_SIZE = 1024>
+class GenerationalPool {
+    struct Slot {
+        alignas(T) unsigned char mStorage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> mChunks;
+    std::vector<uint32_t> mGenerations;     // [slot index]
+    std::vector<uint32_t> mFreeList;        // LIFO so recently freed (cache-warm) slots are reused first
+    uint32_t mLiveCount;
+
+    T* SlotPtr(uint32_t index) const
+    {
+        return reinterpret_cast<T*>(mChunks[index / CHUNK_SIZE][index % CHUNK_SIZE].mStorage);
+    }
+
+    void Grow()
+    {
+        auto base = (uint32_t) mGenerations.size();
+        mChunks.emplace_back(new Slot[CHUNK_SIZE]);
+        mGenerations.resize(base + CHUNK_SIZE, 0);
+        mFreeList.reserve(mGenerations.size());
+        for (uint32_t i = CHUNK_SIZE; i > 0; --i) {
+            mFreeList.push_back(base + i - 1);
+        }
+    }
+
+public:
+    explicit GenerationalPool(uint32_t initialCapacity = 0)
+        : mLiveCount(0)
+    {
+        while (mGenerations.size() < initialCapacity) {
+            Grow();
+        }
+    }
+
+    ~GenerationalPool()
+    {
+        for (uint32_t i = 0, n = (uint32_t) mGenerations.size(); i < n; ++i) {
+            if (mGenerations[i] & 1) {
+                SlotPtr(i)->~T();
+            }
+        }
+    }
+
+    GenerationalPool(GenerationalPool const&) = delete;
+    GenerationalPool& operator=(GenerationalPool const&) = delete;
+
+    template<typename... Args>
+    PoolHandle Create(Args&&... args)
+    {
+        if (mFreeList.empty()) {
+            Grow();
+        }
+
+        auto index = mFreeList.back();
+        new (SlotPtr(index)) T(std::forward<Args>(args)...);
+        mFreeList.pop_back();
+
+        auto& generation = mGenerations[index];
+        generation += 1;
+        assert(generation & 1);
+        mLiveCount += 1;
+
+        return PoolHandle(index, generation);
+    }
+
+    void Destroy(PoolHandle handle)
+    {
+        assert(Get(handle) != nullptr);
+
+        SlotPtr(handle.Index)->~T();
+        mGenerations[handle.Index] += 1;
+        mFreeList.push_back(handle.Index);
+        mLiveCount -= 1;
+    }
+
+    // Returns nullptr if the handle is invalid or its object has been
+    // destroyed.
+    T* Get(PoolHandle handle) const
+    {
+        if (handle.Index >= mGenerations.size() || mGenerations[handle.Index] != handle.Generation || !handle.IsValid()) {
+            return nullptr;
+        }
+        return SlotPtr(handle.Index);
+    }
+
+    uint32_t LiveCount() const { return mLiveCount; }
+    uint32_t Capacity() const { return (uint32_t) mGenerations.size(); }
+};
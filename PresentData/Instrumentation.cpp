@@ -0,0 +1,144 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Instrumentation.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+char const* GetInstrumentedCollectionName(InstrumentedCollection collection)
+{
+    switch (collection) {
+    case InstrumentedCollection::LivePresents:          return "LivePresents";
+    case InstrumentedCollection::SwapChains:            return "SwapChains";
+    case InstrumentedCollection::SwapChainPresents:     return "SwapChainPresents";
+    case InstrumentedCollection::ProcessPresents:       return "ProcessPresents";
+    case InstrumentedCollection::PresentsWaitingForDWM: return "PresentsWaitingForDWM";
+    default:                                            break;
+    }
+    return "Unknown";
+}
+
+#if PRESENTMON_INSTRUMENTATION
+
+namespace {
+
+uint32_t HistogramBucket(uint64_t cycles)
+{
+    unsigned long msb = 0;
+    if (!_BitScanReverse64(&msb, cycles)) {
+        return 0;
+    }
+    return std::min<uint32_t>(msb, INSTRUMENTATION_HISTOGRAM_BUCKETS - 1);
+}
+
+// Returns the upper bound of the histogram bucket containing the given
+// percentile.
+uint64_t HistogramPercentile(InstrumentedEventStats const& stats, double percentile)
+{
+    auto target = (uint64_t) (percentile * stats.Count);
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < INSTRUMENTATION_HISTOGRAM_BUCKETS; ++i) {
+        count += stats.CycleHistogram[i];
+        if (count > target) {
+            return std::min((2ull << i) - 1, stats.MaxCycles);
+        }
+    }
+    return stats.MaxCycles;
+}
+
+}
+
+ConsumerInstrumentation::ConsumerInstrumentation()
+{
+    memset(mHighWaterMarks, 0, sizeof(mHighWaterMarks));
+}
+
+void ConsumerInstrumentation::RecordEvent(GUID const& providerId, uint16_t eventId, uint64_t cycles)
+{
+    EventKey key;
+    key.ProviderId = providerId;
+    key.EventId = eventId;
+
+    auto ii = mEvents.find(key);
+    if (ii == mEvents.end()) {
+        InstrumentedEventStats stats;
+        memset(&stats, 0, sizeof(stats));
+        stats.ProviderId = providerId;
+        stats.EventId = eventId;
+        ii = mEvents.emplace(key, stats).first;
+    }
+
+    auto& stats = ii->second;
+    stats.Count += 1;
+    stats.TotalCycles += cycles;
+    stats.MaxCycles = std::max(stats.MaxCycles, cycles);
+    stats.CycleHistogram[HistogramBucket(cycles)] += 1;
+}
+
+void ConsumerInstrumentation::GetEventStats(std::vector<InstrumentedEventStats>* stats)
+{
+    stats->clear();
+    stats->reserve(mEvents.size());
+    for (auto const& pair : mEvents) {
+        stats->emplace_back(pair.second);
+    }
+    std::sort(stats->begin(), stats->end(), [](InstrumentedEventStats const& a, InstrumentedEventStats const& b) {
+        return a.TotalCycles > b.TotalCycles;
+    });
+}
+
+void ConsumerInstrumentation::Dump(FILE* fp)
+{
+    std::vector<InstrumentedEventStats> stats;
+    GetEventStats(&stats);
+
+    uint64_t totalCount = 0;
+    uint64_t totalCycles = 0;
+    for (auto const& s : stats) {
+        totalCount += s.Count;
+        totalCycles += s.TotalCycles;
+    }
+
+    fprintf(fp, "Consumer instrumentation: %llu events, %llu cycles\n", totalCount, totalCycles);
+    fprintf(fp, "  %-38s %5s %10s %6s %10s %10s %10s %10s\n", "Provider", "Id", "Count", "%Cyc", "Avg", "~p50", "~p99", "Max");
+    for (auto const& s : stats) {
+        auto const& g = s.ProviderId;
+        fprintf(fp, "  {%08lX-%04hX-%04hX-%02hhX%02hhX-%02hhX%02hhX%02hhX%02hhX%02hhX%02hhX} %5u %10llu %5.1lf%% %10llu %10llu %10llu %10llu\n",
+            g.Data1, g.Data2, g.Data3,
+            g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3], g.Data4[4], g.Data4[5], g.Data4[6], g.Data4[7],
+            s.EventId,
+            s.Count,
+            totalCycles == 0 ? 0.0 : 100.0 * s.TotalCycles / totalCycles,
+            s.TotalCycles / s.Count,
+            HistogramPercentile(s, 0.50),
+            HistogramPercentile(s, 0.99),
+            s.MaxCycles);
+    }
+
+    fprintf(fp, "  Collection high-water marks:\n");
+    for (size_t i = 0; i < (size_t) InstrumentedCollection::Count; ++i) {
+        fprintf(fp, "    %-22s %zu\n", GetInstrumentedCollectionName((InstrumentedCollection) i), mHighWaterMarks[i]);
+    }
+}
+
+#endif
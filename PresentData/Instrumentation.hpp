@@ -0,0 +1,148 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// ConsumerInstrumentation records what the consumer thread spends its time
+// on: how many events of each (provider, event id) were processed, a log2
+// histogram of the cycles spent handling each of them, and the high-water
+// marks of PMTraceConsumer's tracking collections.  This is intended to help
+// size ETW buffers and explain lost-event reports.
+//
+// It is compiled out unless PRESENTMON_INSTRUMENTATION is defined to 1 (e.g.
+// via the project's preprocessor definitions).  When compiled out, the class
+// is empty and every method is an inline no-op, so call sites don't need any
+// #if guards and cost nothing.
+//
+// All Record*() calls must be made from the consumer thread.  The Get*() and
+// Dump() methods are not synchronized with it, so only call them once the
+// consumer thread has exited (e.g., after ProcessTrace() returns).
+
+#ifndef PRESENTMON_INSTRUMENTATION
+#define PRESENTMON_INSTRUMENTATION 0
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <windows.h>
+
+#if PRESENTMON_INSTRUMENTATION
+#include <intrin.h>
+#include "FlatHashMap.hpp"
+#endif
+
+enum class InstrumentedCollection {
+    LivePresents,                   // Presents being tracked (mPresentTrackingPool occupancy)
+    SwapChains,                     // mPresentsByProcessAndSwapChain entries
+    SwapChainPresents,              // In-progress presents on a single swap chain
+    ProcessPresents,                // mPresentsByProcess entries for a single process
+    PresentsWaitingForDWM,          // mPresentsWaitingForDWM
+    Count
+};
+
+enum {
+    INSTRUMENTATION_HISTOGRAM_BUCKETS = 32,
+};
+
+struct InstrumentedEventStats {
+    GUID ProviderId;
+    uint16_t EventId;
+    uint64_t Count;
+    uint64_t TotalCycles;
+    uint64_t MaxCycles;
+    uint64_t CycleHistogram[INSTRUMENTATION_HISTOGRAM_BUCKETS]; // [i] counts events handled in [2^i, 2^(i+1)) cycles; [0] also counts 0
+};
+
+char const* GetInstrumentedCollectionName(InstrumentedCollection collection);
+
+#if PRESENTMON_INSTRUMENTATION
+
+class ConsumerInstrumentation {
+    struct EventKey {
+        GUID ProviderId;
+        uint16_t EventId;
+
+        bool operator==(EventKey const& rhs) const { return EventId == rhs.EventId && ProviderId == rhs.ProviderId; }
+    };
+
+    struct EventKeyHash {
+        uint64_t operator()(EventKey const& key) const
+        {
+            uint64_t const* g = (uint64_t const*) &key.ProviderId;
+            return g[0] ^ (g[1] * 0xC2B2AE3D27D4EB4Full) ^ key.EventId;
+        }
+    };
+
+    FlatHashMap<EventKey, InstrumentedEventStats, EventKeyHash> mEvents;
+    size_t mHighWaterMarks[(size_t) InstrumentedCollection::Count];
+
+public:
+    enum { ENABLED = 1 };
+
+    ConsumerInstrumentation();
+
+    static uint64_t Timestamp() { return __rdtsc(); }
+
+    void RecordEvent(GUID const& providerId, uint16_t eventId, uint64_t cycles);
+
+    void RecordCollectionSize(InstrumentedCollection collection, size_t size)
+    {
+        auto& highWaterMark = mHighWaterMarks[(size_t) collection];
+        if (highWaterMark < size) {
+            highWaterMark = size;
+        }
+    }
+
+    // For collections whose size() isn't O(1), so it is only evaluated when
+    // instrumentation is enabled.
+    template<typename Collection>
+    void RecordCollection(InstrumentedCollection collection, Collection const& c) { RecordCollectionSize(collection, c.size()); }
+
+    // Returns the stats for every event seen, sorted by total cycles
+    // (most expensive first).
+    void GetEventStats(std::vector<InstrumentedEventStats>* stats);
+    size_t GetHighWaterMark(InstrumentedCollection collection) const { return mHighWaterMarks[(size_t) collection]; }
+
+    void Dump(FILE* fp);
+};
+
+#else
+
+class ConsumerInstrumentation {
+public:
+    enum { ENABLED = 0 };
+
+    static uint64_t Timestamp() { return 0; }
+
+    void RecordEvent(GUID const& providerId, uint16_t eventId, uint64_t cycles) { (void) providerId, eventId, cycles; }
+    void RecordCollectionSize(InstrumentedCollection collection, size_t size) { (void) collection, size; }
+    template<typename Collection>
+    void RecordCollection(InstrumentedCollection collection, Collection const& c) { (void) collection, c; }
+
+    void GetEventStats(std::vector<InstrumentedEventStats>* stats) { stats->clear(); }
+    size_t GetHighWaterMark(InstrumentedCollection collection) const { (void) collection; return 0; }
+
+    void Dump(FILE* fp) { (void) fp; }
+};
+
+#endif
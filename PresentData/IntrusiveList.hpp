@@ -0,0 +1,152 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// IntrusiveList is a circular doubly-linked list whose links are embedded in
+// the elements themselves (by deriving from IntrusiveListNode), so insert,
+// remove, and splicing a whole list are O(1) and never allocate.
+//
+// An element can be in at most one list at a time, and removes itself with
+// Unlink() without needing to know which list it is in.  Elements must be
+// unlinked before they are destroyed; copying an element (or a list) never
+// copies its links, so the copy starts out unlinked (or empty).
+//
+// The list doesn't own its elements and doesn't track its size.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <stddef.h>
+
+class IntrusiveListNode {
+    IntrusiveListNode* mPrev;
+    IntrusiveListNode* mNext;
+
+    template<typename T> friend class IntrusiveList;
+
+    void InsertBefore(IntrusiveListNode* next)
+    {
+        assert(!IsLinked());
+        mPrev = next->mPrev;
+        mNext = next;
+        mPrev->mNext = this;
+        next->mPrev = this;
+    }
+
+public:
+    IntrusiveListNode() : mPrev(this), mNext(this) {}
+    IntrusiveListNode(IntrusiveListNode const&) : mPrev(this), mNext(this) {}
+    IntrusiveListNode& operator=(IntrusiveListNode const&) { return *this; }
+    ~IntrusiveListNode() { assert(!IsLinked()); }
+
+    bool IsLinked() const { return mNext != this; }
+
+    void Unlink()
+    {
+        mPrev->mNext = mNext;
+        mNext->mPrev = mPrev;
+        mPrev = this;
+        mNext = this;
+    }
+};
+
+template<typename T>
+class IntrusiveList {
+    IntrusiveListNode mHead;
+
+    static T* Element(IntrusiveListNode* node) { return static_cast<T*>(node); }
+
+public:
+    IntrusiveList() {}
+    IntrusiveList(IntrusiveList const&) {}
+    IntrusiveList& operator=(IntrusiveList const&) { return *this; }
+    ~IntrusiveList() { clear(); }
+
+    class iterator {
+        IntrusiveListNode* mNode;
+
+        friend class IntrusiveList;
+        explicit iterator(IntrusiveListNode* node) : mNode(node) {}
+
+    public:
+        T& operator*() const { return *Element(mNode); }
+        T* operator->() const { return Element(mNode); }
+        iterator& operator++() { mNode = mNode->mNext; return *this; }
+        bool operator==(iterator const& rhs) const { return mNode == rhs.mNode; }
+        bool operator!=(iterator const& rhs) const { return mNode != rhs.mNode; }
+    };
+
+    // Don't Unlink() the element an iterator refers to while iterating; use
+    // PopFront() to consume the list instead.
+    iterator begin() { return iterator(mHead.mNext); }
+    iterator end() { return iterator(&mHead); }
+
+    bool empty() const { return !mHead.IsLinked(); }
+
+    // O(n); intended for diagnostics.
+    size_t size() const
+    {
+        size_t count = 0;
+        for (auto node = mHead.mNext; node != &mHead; node = node->mNext) {
+            count += 1;
+        }
+        return count;
+    }
+
+    T* front() { return empty() ? nullptr : Element(mHead.mNext); }
+
+    void PushBack(T* element) { static_cast<IntrusiveListNode*>(element)->InsertBefore(&mHead); }
+
+    T* PopFront()
+    {
+        auto element = front();
+        if (element != nullptr) {
+            element->Unlink();
+        }
+        return element;
+    }
+
+    // Move all of other's elements to the end of this list.
+    void Splice(IntrusiveList* other)
+    {
+        if (other->empty()) {
+            return;
+        }
+
+        auto first = other->mHead.mNext;
+        auto last = other->mHead.mPrev;
+        other->mHead.mPrev = &other->mHead;
+        other->mHead.mNext = &other->mHead;
+
+        first->mPrev = mHead.mPrev;
+        last->mNext = &mHead;
+        mHead.mPrev->mNext = first;
+        mHead.mPrev = last;
+    }
+
+    // Unlink every element.
+    void clear()
+    {
+        while (PopFront() != nullptr) {
+        }
+    }
+};
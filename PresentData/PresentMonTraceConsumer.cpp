@@ -27,18 +27,35 @@ SOFTWARE.
 #include "ETW/Microsoft_Windows_DXGI.h"
 #include "ETW/Microsoft_Windows_DxgKrnl.h"
 #include "ETW/Microsoft_Windows_EventMetadata.h"
+#include "ETW/Microsoft_Windows_Kernel_Process.h"
 #include "ETW/Microsoft_Windows_Win32k.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <ctype.h>
 #include <d3d9.h>
 #include <dxgi.h>
 
-#ifdef DEBUG
-static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 32768;
-#else
-static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 8192;
-#endif
+// Defaults for mPresentExpiryMs and mMaxTrackedPresents.
+static constexpr uint32_t DEFAULT_PRESENT_EXPIRY_MS = 5000;
+static constexpr uint32_t DEFAULT_MAX_TRACKED_PRESENTS = 65536;
+
+// mPresentExpiryWheel resolution: presents are considered lost at most
+// 1/PRESENT_EXPIRY_TICKS of the expiry time late.  The wheel covers two
+// expiry periods so presents are normally visited only once.
+static constexpr uint32_t PRESENT_EXPIRY_TICKS = 64;
+
+// QPC frequency assumed until StartPresentAging() is called.
+static constexpr uint64_t DEFAULT_QPC_FREQUENCY = 10000000;
+
+// mPresentTrackingPool starts with this many slots and grows as needed.
+static constexpr uint32_t PRESENT_TRACKING_POOL_INITIAL_CAPACITY = 1024;
+
+// Capacity of the rings handing events to the dequeuing thread.  These only
+// need to cover the events produced between two dequeues.
+static constexpr uint32_t COMPLETED_PRESENT_RING_SIZE = 4096;
+static constexpr uint32_t LOST_PRESENT_RING_SIZE = 1024;
+static constexpr uint32_t PROCESS_EVENT_RING_SIZE = 1024;
 
 // These macros, when enabled, record what PresentMon analysis below was done
 // for each present.  The primary use case is to compute usage statistics and
@@ -66,26 +83,20 @@ static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 8192;
 #define TRACK_PRESENT_PATH_SAVE_GENERATED_ID(present) (void) present
 #endif
 
-PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
-    : QpcTime(*(uint64_t*) &hdr.TimeStamp)
-    , ProcessId(hdr.ProcessId)
-    , ThreadId(hdr.ThreadId)
+PresentEvent::PresentEvent()
+    : QpcTime(0)
+    , ProcessId(0)
+    , ThreadId(0)
     , TimeTaken(0)
     , ReadyTime(0)
     , ScreenTime(0)
     , SwapChainAddress(0)
     , SyncInterval(-1)
     , PresentFlags(0)
-    , Hwnd(0)
-    , TokenPtr(0)
-    , QueueSubmitSequence(0)
     , DriverBatchThreadId(0)
-    , Runtime(runtime)
+    , Runtime(::Runtime::Other)
     , PresentMode(PresentMode::Unknown)
     , FinalState(PresentResult::Unknown)
-    , DestWidth(0)
-    , DestHeight(0)
-    , CompositionSurfaceLuid(0)
     , SupportsTearing(false)
     , MMIO(false)
     , SeenDxgkPresent(false)
@@ -93,17 +104,25 @@ PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
     , DwmNotified(false)
     , Completed(false)
     , IsLost(false)
-    , mAllPresentsTrackingIndex(0)
-    , DxgKrnlHContext(0)
-    , Win32KPresentCount(0)
-    , Win32KBindId(0)
-    , LegacyBlitTokenData(0)
-    , PresentInDwmWaitingStruct(false)
+    , Tracking(nullptr)
 {
 #ifdef TRACK_PRESENT_PATHS
     AnalysisPath = 0ull;
 #endif
 
+#if DEBUG_VERBOSE
+    Id = 0;
+#endif
+}
+
+PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
+    : PresentEvent()
+{
+    QpcTime   = *(uint64_t*) &hdr.TimeStamp;
+    ProcessId = hdr.ProcessId;
+    ThreadId  = hdr.ThreadId;
+    Runtime   = runtime;
+
 #if DEBUG_VERBOSE
     static uint64_t presentCount = 0;
     presentCount += 1;
@@ -111,13 +130,41 @@ PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
 #endif
 }
 
+PresentTracking::PresentTracking()
+    : QueueSubmitSequence(0)
+    , Hwnd(0)
+    , TokenPtr(0)
+    , CompositionSurfaceLuid(0)
+    , Win32KPresentCount(0)
+    , Win32KBindId(0)
+    , DxgKrnlHContext(0)
+    , LegacyBlitTokenData(0)
+    , DestWidth(0)
+    , DestHeight(0)
+{
+}
+
 PMTraceConsumer::PMTraceConsumer(bool filteredEvents, bool simple, bool trackedFiltering)
     : mFilteredEvents(filteredEvents)
     , mSimpleMode(simple)
-    , mAllPresentsNextIndex(0)
-    , mAllPresents(PRESENTEVENT_CIRCULAR_BUFFER_SIZE)
+    , mPresentEvents(COMPLETED_PRESENT_RING_SIZE, SpscOverflowPolicy::Spill)
+    , mLostPresentEvents(LOST_PRESENT_RING_SIZE, SpscOverflowPolicy::Drop)
+    , mProcessEvents(PROCESS_EVENT_RING_SIZE, SpscOverflowPolicy::Spill)
+    , mPresentTrackingPool(PRESENT_TRACKING_POOL_INITIAL_CAPACITY)
+    , mPresentExpiryMs(DEFAULT_PRESENT_EXPIRY_MS)
+    , mMaxTrackedPresents(DEFAULT_MAX_TRACKED_PRESENTS)
+    , mPresentExpiryQpc(0)
     , mEnableTrackedProcessFiltering(trackedFiltering)
 {
+    StartPresentAging(DEFAULT_QPC_FREQUENCY);
+}
+
+void PMTraceConsumer::StartPresentAging(uint64_t qpcFrequency)
+{
+    mPresentExpiryQpc = qpcFrequency * mPresentExpiryMs / 1000;
+
+    auto tickDuration = std::max<uint64_t>(mPresentExpiryQpc / PRESENT_EXPIRY_TICKS, 1);
+    mPresentExpiryWheel.Initialize(tickDuration, 2 * PRESENT_EXPIRY_TICKS);
 }
 
 void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
@@ -126,22 +173,21 @@ void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
 
     auto const& hdr = pEventRecord->EventHeader;
 
-    if (!IsProcessTrackedForFiltering(hdr.ProcessId)) {
+    if (!IsProcessTrackedForFiltering(hdr)) {
         return;
     }
 
     switch (hdr.EventDescriptor.Id) {
     case Microsoft_Windows_D3D9::Present_Start::Id:
     {
-        EventDataDesc desc[] = {
-            { L"pSwapchain" },
-            { L"Flags" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto pSwapchain = desc[0].GetData<uint64_t>();
-        auto Flags      = desc[1].GetData<uint32_t>();
-
-        auto present = std::make_shared<PresentEvent>(hdr, Runtime::D3D9);
+        uint64_t pSwapchain = 0;
+        uint32_t Flags      = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_D3D9::Present_Start_Struct>(pEventRecord, Microsoft_Windows_D3D9::Present_Start_Fields, [&](auto const* e) {
+            pSwapchain = e->pSwapchain;
+            Flags      = e->Flags;
+        });
+
+        auto present = CreatePresent(hdr, Runtime::D3D9);
         present->SwapChainAddress = pSwapchain;
         present->PresentFlags =
             ((Flags & D3DPRESENT_DONOTFLIP) ? DXGI_PRESENT_DO_NOT_SEQUENCE : 0) |
@@ -157,7 +203,10 @@ void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
     }
     case Microsoft_Windows_D3D9::Present_Stop::Id:
     {
-        auto result = mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result");
+        uint32_t result = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_D3D9::Present_Stop_Struct>(pEventRecord, Microsoft_Windows_D3D9::Present_Stop_Fields, [&](auto const* e) {
+            result = e->Result;
+        });
 
         bool AllowBatching =
             SUCCEEDED(result) &&
@@ -178,7 +227,7 @@ void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
 
     auto const& hdr = pEventRecord->EventHeader;
 
-    if (!IsProcessTrackedForFiltering(hdr.ProcessId)) {
+    if (!IsProcessTrackedForFiltering(hdr)) {
         return;
     }
 
@@ -186,15 +235,19 @@ void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
     case Microsoft_Windows_DXGI::Present_Start::Id:
     case Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Start::Id:
     {
-        EventDataDesc desc[] = {
-            { L"pIDXGISwapChain" },
-            { L"Flags" },
-            { L"SyncInterval" },
+        uint64_t pIDXGISwapChain = 0;
+        uint32_t Flags           = 0;
+        int32_t SyncInterval     = 0;
+        auto read = [&](auto const* e) {
+            pIDXGISwapChain = e->pIDXGISwapChain;
+            Flags           = e->Flags;
+            SyncInterval    = (int32_t) e->SyncInterval;
         };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto pIDXGISwapChain = desc[0].GetData<uint64_t>();
-        auto Flags           = desc[1].GetData<uint32_t>();
-        auto SyncInterval    = desc[2].GetData<int32_t>();
+        if (hdr.EventDescriptor.Id == Microsoft_Windows_DXGI::Present_Start::Id) {
+            mMetadata.ReadEventStruct<Microsoft_Windows_DXGI::Present_Start_Struct>(pEventRecord, Microsoft_Windows_DXGI::Present_Start_Fields, read);
+        } else {
+            mMetadata.ReadEventStruct<Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Start_Struct>(pEventRecord, Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Start_Fields, read);
+        }
 
         // Ignore PRESENT_TEST: it's just to check if you're still fullscreen
         if ((Flags & DXGI_PRESENT_TEST) != 0) {
@@ -210,7 +263,7 @@ void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
             break;
         }
 
-        auto present = std::make_shared<PresentEvent>(hdr, Runtime::DXGI);
+        auto present = CreatePresent(hdr, Runtime::DXGI);
         present->SwapChainAddress = pIDXGISwapChain;
         present->PresentFlags     = Flags;
         present->SyncInterval     = SyncInterval;
@@ -222,7 +275,15 @@ void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
     case Microsoft_Windows_DXGI::Present_Stop::Id:
     case Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Stop::Id:
     {
-        auto result = mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result");
+        uint32_t result = 0;
+        auto read = [&](auto const* e) {
+            result = e->Result;
+        };
+        if (hdr.EventDescriptor.Id == Microsoft_Windows_DXGI::Present_Stop::Id) {
+            mMetadata.ReadEventStruct<Microsoft_Windows_DXGI::Present_Stop_Struct>(pEventRecord, Microsoft_Windows_DXGI::Present_Stop_Fields, read);
+        } else {
+            mMetadata.ReadEventStruct<Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Stop_Struct>(pEventRecord, Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Stop_Fields, read);
+        }
 
         bool AllowBatching =
             SUCCEEDED(result) &&
@@ -250,7 +311,7 @@ void PMTraceConsumer::HandleDxgkBlt(EVENT_HEADER const& hdr, uint64_t hwnd, bool
     }
 
     if (presentEvent->PresentMode != PresentMode::Unknown) {
-        RemoveLostPresent(presentEvent);
+        RemoveLostPresent(presentEvent, LostPresentReason::Inconsistent);
         presentEvent = FindOrCreatePresent(hdr);
         if (presentEvent == nullptr) {
             return;
@@ -262,7 +323,7 @@ void PMTraceConsumer::HandleDxgkBlt(EVENT_HEADER const& hdr, uint64_t hwnd, bool
 
     // This could be one of several types of presents. Further events will clarify.
     // For now, assume that this is a blt straight into a surface which is already on-screen.
-    presentEvent->Hwnd = hwnd;
+    presentEvent->Tracking->Hwnd = hwnd;
     if (redirectedPresent) {
         TRACK_PRESENT_PATH(presentEvent);
         presentEvent->PresentMode = PresentMode::Composed_Copy_CPU_GDI;
@@ -278,12 +339,13 @@ void PMTraceConsumer::HandleDxgkBltCancel(EVENT_HEADER const& hdr)
     // There are cases where a present blt can be optimized out in kernel.
     // In such cases, we return success to the caller, but issue no further work
     // for the present. Mark these cases as discarded.
-    auto eventIter = mPresentByThreadId.find(hdr.ThreadId);
+    auto eventIter = FindTrackedPresent(mPresentByThreadId, hdr.ThreadId);
 
     if (eventIter != mPresentByThreadId.end()) {
-        TRACK_PRESENT_PATH(eventIter->second);
-        eventIter->second->FinalState = PresentResult::Discarded;
-        CompletePresent(eventIter->second);
+        auto presentEvent = GetPresent(eventIter->second);
+        TRACK_PRESENT_PATH(presentEvent);
+        presentEvent->FinalState = PresentResult::Discarded;
+        CompletePresent(presentEvent);
     }
 }
 
@@ -304,13 +366,13 @@ void PMTraceConsumer::HandleDxgkFlip(EVENT_HEADER const& hdr, int32_t flipInterv
         return;
     }
 
-    if (presentEvent->QueueSubmitSequence != 0 || presentEvent->SeenDxgkPresent) {
-        RemoveLostPresent(presentEvent);
+    if (presentEvent->Tracking->QueueSubmitSequence != 0 || presentEvent->SeenDxgkPresent) {
+        RemoveLostPresent(presentEvent, LostPresentReason::Inconsistent);
         presentEvent = FindOrCreatePresent(hdr);
         if (presentEvent == nullptr) {
             return;
         }
-        assert(!(presentEvent->QueueSubmitSequence != 0 || presentEvent->SeenDxgkPresent));
+        assert(!(presentEvent->Tracking->QueueSubmitSequence != 0 || presentEvent->SeenDxgkPresent));
     }
 
     TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
@@ -332,10 +394,7 @@ void PMTraceConsumer::HandleDxgkFlip(EVENT_HEADER const& hdr, int32_t flipInterv
 
     // If this is the DWM thread, piggyback these pending presents on our fullscreen present
     if (hdr.ThreadId == DwmPresentThreadId) {
-        for (auto iter = mPresentsWaitingForDWM.begin(); iter != mPresentsWaitingForDWM.end(); iter++) {
-            iter->get()->PresentInDwmWaitingStruct = false;
-        }
-        std::swap(presentEvent->DependentPresents, mPresentsWaitingForDWM);
+        presentEvent->Tracking->DependentPresents.Splice(&mPresentsWaitingForDWM);
         DwmPresentThreadId = 0;
     }
 }
@@ -354,14 +413,15 @@ void PMTraceConsumer::HandleDxgkQueueSubmit(
     // event - the present will be considered completed once its work is done, or if the work is already done, complete it now.
     if (!supportsDxgkPresentEvent) {
         bool completedPresent = false;
-        auto eventIter = mBltsByDxgContext.find(context);
+        auto eventIter = FindTrackedPresent(mBltsByDxgContext, context);
         if (eventIter != mBltsByDxgContext.end()) {
-            TRACK_PRESENT_PATH(eventIter->second);
-            if (eventIter->second->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
-                DebugModifyPresent(*eventIter->second);
-                eventIter->second->SeenDxgkPresent = true;
-                if (eventIter->second->ScreenTime != 0) {
-                    CompletePresent(eventIter->second);
+            auto presentEvent = GetPresent(eventIter->second);
+            TRACK_PRESENT_PATH(presentEvent);
+            if (presentEvent->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
+                DebugModifyPresent(*presentEvent);
+                presentEvent->SeenDxgkPresent = true;
+                if (presentEvent->ScreenTime != 0) {
+                    CompletePresent(presentEvent);
                     completedPresent = true;
                 }
             }
@@ -378,20 +438,25 @@ void PMTraceConsumer::HandleDxgkQueueSubmit(
     if (packetType == DXGKETW_MMIOFLIP_COMMAND_BUFFER ||
         packetType == DXGKETW_SOFTWARE_COMMAND_BUFFER ||
         present) {
-        auto eventIter = mPresentByThreadId.find(hdr.ThreadId);
-        if (eventIter == mPresentByThreadId.end() || eventIter->second->QueueSubmitSequence != 0) {
+        auto eventIter = FindTrackedPresent(mPresentByThreadId, hdr.ThreadId);
+        if (eventIter == mPresentByThreadId.end()) {
+            return;
+        }
+
+        auto presentEvent = GetPresent(eventIter->second);
+        if (presentEvent->Tracking->QueueSubmitSequence != 0) {
             return;
         }
 
-        TRACK_PRESENT_PATH(eventIter->second);
-        DebugModifyPresent(*eventIter->second);
+        TRACK_PRESENT_PATH(presentEvent);
+        DebugModifyPresent(*presentEvent);
 
-        eventIter->second->QueueSubmitSequence = submitSequence;
-        mPresentsBySubmitSequence.emplace(submitSequence, eventIter->second);
+        presentEvent->Tracking->QueueSubmitSequence = submitSequence;
+        mPresentsBySubmitSequence.emplace(submitSequence, presentEvent->Tracking->Handle);
 
-        if (eventIter->second->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer && !supportsDxgkPresentEvent) {
-            mBltsByDxgContext[context] = eventIter->second;
-            eventIter->second->DxgKrnlHContext = context;
+        if (presentEvent->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer && !supportsDxgkPresentEvent) {
+            mBltsByDxgContext[context] = presentEvent->Tracking->Handle;
+            presentEvent->Tracking->DxgKrnlHContext = context;
         }
     }
 }
@@ -534,14 +599,14 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(
         return;
     }
 
-    if (presentEvent->TokenPtr != 0) {
-        RemoveLostPresent(presentEvent);
+    if (presentEvent->Tracking->TokenPtr != 0) {
+        RemoveLostPresent(presentEvent, LostPresentReason::Inconsistent);
         presentEvent = FindOrCreatePresent(hdr);
         if (presentEvent == nullptr) {
             return;
         }
 
-        assert(presentEvent->TokenPtr == 0);
+        assert(presentEvent->Tracking->TokenPtr == 0);
     }
 
     TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
@@ -550,10 +615,10 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(
     presentEvent->ScreenTime = 0;
     presentEvent->SupportsTearing = false;
     presentEvent->FinalState = PresentResult::Unknown;
-    presentEvent->TokenPtr = token;
+    presentEvent->Tracking->TokenPtr = token;
 
     assert(mDxgKrnlPresentHistoryTokens.find(token) == mDxgKrnlPresentHistoryTokens.end());
-    mDxgKrnlPresentHistoryTokens[token] = presentEvent;
+    mDxgKrnlPresentHistoryTokens[token] = presentEvent->Tracking->Handle;
 
     if (presentEvent->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
         presentEvent->PresentMode = PresentMode::Composed_Copy_GPU_GDI;
@@ -573,12 +638,12 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(
     } else if (presentEvent->PresentMode == PresentMode::Composed_Copy_CPU_GDI) {
         if (tokenData == 0) {
             // This is the best we can do, we won't be able to tell how many frames are actually displayed.
-            mPresentsWaitingForDWM.emplace_back(presentEvent);
-            presentEvent->PresentInDwmWaitingStruct = true;
+            mPresentsWaitingForDWM.PushBack(presentEvent->Tracking);
+            mInstrumentation.RecordCollection(InstrumentedCollection::PresentsWaitingForDWM, mPresentsWaitingForDWM);
         } else {
             assert(mPresentsByLegacyBlitToken.find(tokenData) == mPresentsByLegacyBlitToken.end());
-            mPresentsByLegacyBlitToken[tokenData] = presentEvent;
-            presentEvent->LegacyBlitTokenData = tokenData;
+            mPresentsByLegacyBlitToken[tokenData] = presentEvent->Tracking->Handle;
+            presentEvent->Tracking->LegacyBlitTokenData = tokenData;
         }
     }
 }
@@ -586,30 +651,31 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(
 void PMTraceConsumer::HandleDxgkPropagatePresentHistoryEventArgs(EVENT_HEADER const& hdr, uint64_t token)
 {
     // This event is emitted when a token is being handed off to DWM, and is a good way to indicate a ready state
-    auto eventIter = mDxgKrnlPresentHistoryTokens.find(token);
+    auto eventIter = FindTrackedPresent(mDxgKrnlPresentHistoryTokens, token);
     if (eventIter == mDxgKrnlPresentHistoryTokens.end()) {
         return;
     }
 
-    DebugModifyPresent(*eventIter->second);
-    TRACK_PRESENT_PATH_SAVE_GENERATED_ID(eventIter->second);
+    auto presentEvent = GetPresent(eventIter->second);
+    DebugModifyPresent(*presentEvent);
+    TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
 
-    eventIter->second->ReadyTime = eventIter->second->ReadyTime == 0
+    presentEvent->ReadyTime = presentEvent->ReadyTime == 0
         ? hdr.TimeStamp.QuadPart
-        : std::min(eventIter->second->ReadyTime, (uint64_t) hdr.TimeStamp.QuadPart);
+        : std::min(presentEvent->ReadyTime, (uint64_t) hdr.TimeStamp.QuadPart);
 
-    if (eventIter->second->PresentMode == PresentMode::Composed_Composition_Atlas ||
-        (eventIter->second->PresentMode == PresentMode::Composed_Flip && !eventIter->second->SeenWin32KEvents)) {
-        mPresentsWaitingForDWM.emplace_back(eventIter->second);
-        eventIter->second->PresentInDwmWaitingStruct = true;
+    if (presentEvent->PresentMode == PresentMode::Composed_Composition_Atlas ||
+        (presentEvent->PresentMode == PresentMode::Composed_Flip && !presentEvent->SeenWin32KEvents)) {
+        mPresentsWaitingForDWM.PushBack(presentEvent->Tracking);
+        mInstrumentation.RecordCollection(InstrumentedCollection::PresentsWaitingForDWM, mPresentsWaitingForDWM);
     }
 
-    if (eventIter->second->PresentMode == PresentMode::Composed_Copy_GPU_GDI) {
+    if (presentEvent->PresentMode == PresentMode::Composed_Copy_GPU_GDI) {
         // Manipulate the map here
         // When DWM is ready to present, we'll query for the most recent blt targeting this window and take it out of the map
 
         // Ok to overwrite existing presents in this Hwnd.
-        mLastWindowPresent[eventIter->second->Hwnd] = eventIter->second;
+        mLastWindowPresent[presentEvent->Tracking->Hwnd] = presentEvent->Tracking->Handle;
     }
 
     mDxgKrnlPresentHistoryTokens.erase(eventIter);
@@ -623,13 +689,12 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
     switch (hdr.EventDescriptor.Id) {
     case Microsoft_Windows_DxgKrnl::Flip_Info::Id:
     {
-        EventDataDesc desc[] = {
-            { L"FlipInterval" },
-            { L"MMIOFlip" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto FlipInterval = desc[0].GetData<uint32_t>();
-        auto MMIOFlip     = desc[1].GetData<BOOL>() != 0;
+        uint32_t FlipInterval = 0;
+        bool MMIOFlip         = false;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::Flip_Info_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::Flip_Info_Fields, [&](auto const* e) {
+            FlipInterval = e->FlipInterval;
+            MMIOFlip     = e->MMIOFlip != 0;
+        });
 
         TRACK_PRESENT_PATH_GENERATE_ID();
         HandleDxgkFlip(hdr, FlipInterval, MMIOFlip);
@@ -641,34 +706,39 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         break;
     case Microsoft_Windows_DxgKrnl::QueuePacket_Start::Id:
     {
-        EventDataDesc desc[] = {
-            { L"PacketType" },
-            { L"SubmitSequence" },
-            { L"hContext" },
-            { L"bPresent" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto PacketType     = desc[0].GetData<uint32_t>();
-        auto SubmitSequence = desc[1].GetData<uint32_t>();
-        auto hContext       = desc[2].GetData<uint64_t>();
-        auto bPresent       = desc[3].GetData<BOOL>() != 0;
+        uint32_t PacketType     = 0;
+        uint32_t SubmitSequence = 0;
+        uint64_t hContext       = 0;
+        bool bPresent           = false;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::QueuePacket_Start_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::QueuePacket_Start_Fields, [&](auto const* e) {
+            PacketType     = e->PacketType;
+            SubmitSequence = e->SubmitSequence;
+            hContext       = e->hContext;
+            bPresent       = e->bPresent != 0;
+        });
 
         HandleDxgkQueueSubmit(hdr, PacketType, SubmitSequence, hContext, bPresent, true);
         break;
     }
     case Microsoft_Windows_DxgKrnl::QueuePacket_Stop::Id:
+    {
+        uint32_t SubmitSequence = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::QueuePacket_Stop_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::QueuePacket_Stop_Fields, [&](auto const* e) {
+            SubmitSequence = e->SubmitSequence;
+        });
+
         TRACK_PRESENT_PATH_GENERATE_ID();
-        HandleDxgkQueueComplete(hdr, mMetadata.GetEventData<uint32_t>(pEventRecord, L"SubmitSequence"));
+        HandleDxgkQueueComplete(hdr, SubmitSequence);
         break;
+    }
     case Microsoft_Windows_DxgKrnl::MMIOFlip_Info::Id:
     {
-        EventDataDesc desc[] = {
-            { L"FlipSubmitSequence" },
-            { L"Flags" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto FlipSubmitSequence = desc[0].GetData<uint32_t>();
-        auto Flags              = desc[1].GetData<uint32_t>();
+        uint32_t FlipSubmitSequence = 0;
+        uint32_t Flags              = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::MMIOFlip_Info_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::MMIOFlip_Info_Fields, [&](auto const* e) {
+            FlipSubmitSequence = e->FlipSubmitSequence;
+            Flags              = e->Flags;
+        });
 
         TRACK_PRESENT_PATH_GENERATE_ID();
         HandleDxgkMMIOFlip(hdr, FlipSubmitSequence, Flags);
@@ -699,11 +769,17 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
 
         TRACK_PRESENT_PATH_GENERATE_ID();
 
-        auto FlipCount = mMetadata.GetEventData<uint32_t>(pEventRecord, L"FlipEntryCount");
+        EventDataDesc desc[] = {
+            { L"FlipEntryCount" },
+            { L"FlipSubmitSequence" },
+        };
+        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
+        auto FlipCount          = desc[0].GetData<uint32_t>();
+        auto FlipSubmitSequence = desc[1].GetArray<uint64_t>();
+        assert(FlipSubmitSequence.size() == FlipCount);
+
         for (uint32_t i = 0; i < FlipCount; i++) {
-            // TODO: Combine these into single GetEventData() call?
-            auto FlipId = mMetadata.GetEventData<uint64_t>(pEventRecord, L"FlipSubmitSequence", i);
-            HandleDxgkSyncDPC(hdr, (uint32_t)(FlipId >> 32u));
+            HandleDxgkSyncDPC(hdr, (uint32_t)(FlipSubmitSequence[i] >> 32u));
         }
         break;
     }
@@ -711,7 +787,10 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
     {
         TRACK_PRESENT_PATH_GENERATE_ID();
 
-        auto FlipFenceId = mMetadata.GetEventData<uint64_t>(pEventRecord, L"FlipFenceId");
+        uint64_t FlipFenceId = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::VSyncDPC_Info_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::VSyncDPC_Info_Fields, [&](auto const* e) {
+            FlipFenceId = e->FlipFenceId;
+        });
         HandleDxgkSyncDPC(hdr, (uint32_t)(FlipFenceId >> 32u));
         break;
     }
@@ -720,20 +799,20 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         // This event is emitted at the end of the kernel present, before returning.
         // The presence of this event is used with blt presents to indicate that no
         // PHT is to be expected.
-        auto eventIter = mPresentByThreadId.find(hdr.ThreadId);
+        auto eventIter = FindTrackedPresent(mPresentByThreadId, hdr.ThreadId);
         if (eventIter == mPresentByThreadId.end()) {
             return;
         }
 
-        DebugModifyPresent(*eventIter->second);
-        TRACK_PRESENT_PATH(eventIter->second);
+        // Keep a pointer to the present since we may erase the iterator before we are done with its data.
+        auto event = GetPresent(eventIter->second);
 
-        // Create a temporary copy of the shared_ptr since we may erase the iterator before we are done with its data.
-        std::shared_ptr<PresentEvent> event = eventIter->second;
+        DebugModifyPresent(*event);
+        TRACK_PRESENT_PATH(event);
 
         event->SeenDxgkPresent = true;
-        if (event->Hwnd == 0) {
-            event->Hwnd = mMetadata.GetEventData<uint64_t>(pEventRecord, L"hWindow");
+        if (event->Tracking->Hwnd == 0) {
+            event->Tracking->Hwnd = mMetadata.GetEventData<uint64_t>(pEventRecord, L"hWindow");
         }
 
         if (event->ThreadId != hdr.ThreadId) {
@@ -789,9 +868,16 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         break;
     }
     case Microsoft_Windows_DxgKrnl::PresentHistory_Info::Id:
+    {
+        uint64_t Token = 0;
+        mMetadata.ReadEventStruct<Microsoft_Windows_DxgKrnl::PresentHistory_Info_Struct>(pEventRecord, Microsoft_Windows_DxgKrnl::PresentHistory_Info_Fields, [&](auto const* e) {
+            Token = e->Token;
+        });
+
         TRACK_PRESENT_PATH_GENERATE_ID();
-        HandleDxgkPropagatePresentHistoryEventArgs(hdr, mMetadata.GetEventData<uint64_t>(pEventRecord, L"Token"));
+        HandleDxgkPropagatePresentHistoryEventArgs(hdr, Token);
         break;
+    }
     case Microsoft_Windows_DxgKrnl::Blit_Info::Id:
     {
         EventDataDesc desc[] = {
@@ -1042,7 +1128,7 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
         }
 
         if (PresentEvent->SeenWin32KEvents) {
-            RemoveLostPresent(PresentEvent);
+            RemoveLostPresent(PresentEvent, LostPresentReason::Inconsistent);
             PresentEvent = FindOrCreatePresent(hdr);
             if (PresentEvent == nullptr) {
                 return;
@@ -1057,71 +1143,75 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
         PresentEvent->SeenWin32KEvents = true;
 
         if (hdr.EventDescriptor.Version >= 1) {
-            PresentEvent->DestWidth  = desc[3].GetData<uint32_t>();
-            PresentEvent->DestHeight = desc[4].GetData<uint32_t>();
+            PresentEvent->Tracking->DestWidth  = desc[3].GetData<uint32_t>();
+            PresentEvent->Tracking->DestHeight = desc[4].GetData<uint32_t>();
         }
 
         PMTraceConsumer::Win32KPresentHistoryTokenKey key(CompositionSurfaceLuid, PresentCount, BindId);
         assert(mWin32KPresentHistoryTokens.find(key) == mWin32KPresentHistoryTokens.end());
-        mWin32KPresentHistoryTokens[key] = PresentEvent;
-        PresentEvent->CompositionSurfaceLuid = CompositionSurfaceLuid;
-        PresentEvent->Win32KPresentCount = PresentCount;
-        PresentEvent->Win32KBindId = BindId;
+        mWin32KPresentHistoryTokens[key] = PresentEvent->Tracking->Handle;
+        PresentEvent->Tracking->CompositionSurfaceLuid = CompositionSurfaceLuid;
+        PresentEvent->Tracking->Win32KPresentCount = PresentCount;
+        PresentEvent->Tracking->Win32KBindId = BindId;
         break;
     }
     case Microsoft_Windows_Win32k::TokenStateChanged_Info::Id:
     {
-        EventDataDesc desc[] = {
-            { L"CompositionSurfaceLuid" },
-            { L"PresentCount" },
-            { L"BindId" },
-            { L"NewState" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto CompositionSurfaceLuid = desc[0].GetData<uint64_t>();
-        auto PresentCount           = desc[1].GetData<uint32_t>();
-        auto BindId                 = desc[2].GetData<uint64_t>();
-        auto NewState               = desc[3].GetData<uint32_t>();
+        uint64_t CompositionSurfaceLuid = 0;
+        uint32_t PresentCount           = 0;
+        uint64_t BindId                 = 0;
+        uint32_t NewState               = 0;
+        bool IndependentFlip            = false;
+        mMetadata.ReadEventStruct<Microsoft_Windows_Win32k::TokenStateChanged_Info_Struct>(pEventRecord, Microsoft_Windows_Win32k::TokenStateChanged_Info_Fields, [&](auto const* e) {
+            CompositionSurfaceLuid = e->CompositionSurfaceLuid;
+            PresentCount           = e->PresentCount;
+            BindId                 = e->BindId;
+            NewState               = e->NewState;
+            IndependentFlip        = e->IndependentFlip != 0;
+        });
 
         PMTraceConsumer::Win32KPresentHistoryTokenKey key(CompositionSurfaceLuid, PresentCount, BindId);
-        auto eventIter = mWin32KPresentHistoryTokens.find(key);
+        auto eventIter = FindTrackedPresent(mWin32KPresentHistoryTokens, key);
         if (eventIter == mWin32KPresentHistoryTokens.end()) {
             return;
         }
 
-        auto &event = *eventIter->second;
+        auto present = GetPresent(eventIter->second);
+        auto &event = *present;
 
         DebugModifyPresent(event);
 
         switch (NewState) {
         case (uint32_t) Microsoft_Windows_Win32k::TokenState::InFrame: // Composition is starting
         {
-            TRACK_PRESENT_PATH(eventIter->second);
+            TRACK_PRESENT_PATH(present);
 
             // If we're compositing a newer present than the last known window
             // present, then the last known one was discarded.  We won't
             // necessarily see a transition to Discarded for it.
-            if (event.Hwnd) {
-                auto hWndIter = mLastWindowPresent.find(event.Hwnd);
+            if (event.Tracking->Hwnd) {
+                auto hWndIter = mLastWindowPresent.find(event.Tracking->Hwnd);
                 if (hWndIter == mLastWindowPresent.end()) {
-                    mLastWindowPresent.emplace(event.Hwnd, eventIter->second);
-                } else if (hWndIter->second != eventIter->second) {
-                    DebugModifyPresent(*hWndIter->second);
-                    hWndIter->second->FinalState = PresentResult::Discarded;
-                    hWndIter->second = eventIter->second;
+                    mLastWindowPresent.emplace(event.Tracking->Hwnd, event.Tracking->Handle);
+                } else if (hWndIter->second != event.Tracking->Handle) {
+                    auto lastWindowPresent = GetPresent(hWndIter->second);
+                    if (lastWindowPresent != nullptr) {
+                        DebugModifyPresent(*lastWindowPresent);
+                        lastWindowPresent->FinalState = PresentResult::Discarded;
+                    }
+                    hWndIter->second = event.Tracking->Handle;
                     DebugModifyPresent(event);
                 }
             }
 
-            bool iFlip = mMetadata.GetEventData<BOOL>(pEventRecord, L"IndependentFlip") != 0;
-            if (iFlip && event.PresentMode == PresentMode::Composed_Flip) {
+            if (IndependentFlip && event.PresentMode == PresentMode::Composed_Flip) {
                 event.PresentMode = PresentMode::Hardware_Independent_Flip;
             }
             break;
         }
 
         case (uint32_t) Microsoft_Windows_Win32k::TokenState::Confirmed: // Present has been submitted
-            TRACK_PRESENT_PATH(eventIter->second);
+            TRACK_PRESENT_PATH(present);
 
             // Handle DO_NOT_SEQUENCE presents, which may get marked as confirmed,
             // if a frame was composed when this token was completed
@@ -1129,13 +1219,13 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
                 (event.PresentFlags & DXGI_PRESENT_DO_NOT_SEQUENCE) != 0) {
                 event.FinalState = PresentResult::Discarded;
             }
-            if (event.Hwnd) {
-                mLastWindowPresent.erase(event.Hwnd);
+            if (event.Tracking->Hwnd) {
+                mLastWindowPresent.erase(event.Tracking->Hwnd);
             }
             break;
 
         case (uint32_t) Microsoft_Windows_Win32k::TokenState::Retired: // Present has been completed
-            TRACK_PRESENT_PATH(eventIter->second);
+            TRACK_PRESENT_PATH(present);
 
             if (event.FinalState == PresentResult::Unknown) {
                 event.ScreenTime = hdr.TimeStamp.QuadPart;
@@ -1145,16 +1235,15 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
 
         case (uint32_t) Microsoft_Windows_Win32k::TokenState::Discarded: // Present has been discarded
         {
-            TRACK_PRESENT_PATH(eventIter->second);
+            TRACK_PRESENT_PATH(present);
 
-            auto sharedPtr = eventIter->second;
             mWin32KPresentHistoryTokens.erase(eventIter);
 
             if (event.FinalState == PresentResult::Unknown || event.ScreenTime == 0) {
                 event.FinalState = PresentResult::Discarded;
             }
 
-            CompletePresent(sharedPtr);
+            CompletePresent(present);
             break;
         }
         }
@@ -1174,18 +1263,19 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
     switch (hdr.EventDescriptor.Id) {
     case Microsoft_Windows_Dwm_Core::MILEVENT_MEDIA_UCE_PROCESSPRESENTHISTORY_GetPresentHistory_Info::Id:
         for (auto& hWndPair : mLastWindowPresent) {
-            auto& present = hWndPair.second;
+            auto present = GetTrackedPresent(hWndPair.second);
             // Pickup the most recent present from a given window
-            if (present->PresentMode != PresentMode::Composed_Copy_GPU_GDI &&
-                present->PresentMode != PresentMode::Composed_Copy_CPU_GDI) {
+            if (present == nullptr ||
+                (present->PresentMode != PresentMode::Composed_Copy_GPU_GDI &&
+                 present->PresentMode != PresentMode::Composed_Copy_CPU_GDI)) {
                 continue;
             }
             TRACK_PRESENT_PATH(present);
             DebugModifyPresent(*present);
             present->DwmNotified = true;
-            mPresentsWaitingForDWM.emplace_back(present);
-            present->PresentInDwmWaitingStruct = true;
+            mPresentsWaitingForDWM.PushBack(present->Tracking);
         }
+        mInstrumentation.RecordCollection(InstrumentedCollection::PresentsWaitingForDWM, mPresentsWaitingForDWM);
         mLastWindowPresent.clear();
         break;
 
@@ -1215,17 +1305,18 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
         // The 64-bit token data from the PHT submission is actually two 32-bit
         // data chunks, corresponding to a "flip chain" id and present id
         auto token = ((uint64_t) ulFlipChain << 32ull) | ulSerialNumber;
-        auto flipIter = mPresentsByLegacyBlitToken.find(token);
+        auto flipIter = FindTrackedPresent(mPresentsByLegacyBlitToken, token);
         if (flipIter == mPresentsByLegacyBlitToken.end()) {
             return;
         }
 
-        TRACK_PRESENT_PATH(flipIter->second);
-        DebugModifyPresent(*flipIter->second);
+        auto present = GetPresent(flipIter->second);
+        TRACK_PRESENT_PATH(present);
+        DebugModifyPresent(*present);
 
         // Watch for multiple legacy blits completing against the same window		
         mLastWindowPresent[hwnd] = flipIter->second;
-        flipIter->second->DwmNotified = true;
+        present->DwmNotified = true;
         mPresentsByLegacyBlitToken.erase(flipIter);
         break;
     }
@@ -1242,11 +1333,12 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
         auto bindId       = desc[2].GetData<uint64_t>();
 
         PMTraceConsumer::Win32KPresentHistoryTokenKey key(luidSurface, PresentCount, bindId);
-        auto eventIter = mWin32KPresentHistoryTokens.find(key);
+        auto eventIter = FindTrackedPresent(mWin32KPresentHistoryTokens, key);
         if (eventIter != mWin32KPresentHistoryTokens.end()) {
-            TRACK_PRESENT_PATH(eventIter->second);
-            DebugModifyPresent(*eventIter->second);
-            eventIter->second->DwmNotified = true;
+            auto present = GetPresent(eventIter->second);
+            TRACK_PRESENT_PATH(present);
+            DebugModifyPresent(*present);
+            present->DwmNotified = true;
         }
         break;
     }
@@ -1257,97 +1349,105 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
     }
 }
 
-void PMTraceConsumer::RemovePresentFromTemporaryTrackingCollections(std::shared_ptr<PresentEvent> p)
+void PMTraceConsumer::RemovePresentFromTemporaryTrackingCollections(PresentEvent* p)
 {
+    auto t = p->Tracking;
+
     // Remove the present from any struct that would only host the event temporarily.
-    // Currently defined as all structures except for mPresentsByProcess, 
-    // mPresentsByProcessAndSwapChain, and mAllPresents.
+    // Currently defined as all structures except for mPresentsByProcess,
+    // mPresentsByProcessAndSwapChain, and mPresentExpiryWheel.
 
     // mPresentByThreadId
     auto threadEventIter = mPresentByThreadId.find(p->ThreadId);
-    if (threadEventIter != mPresentByThreadId.end() && threadEventIter->second == p) {
+    if (threadEventIter != mPresentByThreadId.end() && threadEventIter->second == t->Handle) {
         mPresentByThreadId.erase(threadEventIter);
     }
 
     if (p->DriverBatchThreadId != 0)
     {
         auto batchThreadEventIter = mPresentByThreadId.find(p->DriverBatchThreadId);
-        if (batchThreadEventIter != mPresentByThreadId.end() && batchThreadEventIter->second == p) {
+        if (batchThreadEventIter != mPresentByThreadId.end() && batchThreadEventIter->second == t->Handle) {
             mPresentByThreadId.erase(batchThreadEventIter);
         }
     }
 
     // mPresentsBySubmitSequence
-    if (p->QueueSubmitSequence != 0) {
-        auto eventIter = mPresentsBySubmitSequence.find(p->QueueSubmitSequence);
-        if (eventIter != mPresentsBySubmitSequence.end() && (eventIter->second == p)) {
+    if (t->QueueSubmitSequence != 0) {
+        auto eventIter = mPresentsBySubmitSequence.find(t->QueueSubmitSequence);
+        if (eventIter != mPresentsBySubmitSequence.end() && (eventIter->second == t->Handle)) {
             mPresentsBySubmitSequence.erase(eventIter);
         }
     }
 
     // mWin32KPresentHistoryTokens
-    if (p->CompositionSurfaceLuid != 0) {
+    if (t->CompositionSurfaceLuid != 0) {
         PMTraceConsumer::Win32KPresentHistoryTokenKey key(
-            p->CompositionSurfaceLuid,
-            p->Win32KPresentCount,
-            p->Win32KBindId
+            t->CompositionSurfaceLuid,
+            t->Win32KPresentCount,
+            t->Win32KBindId
         );
 
         auto eventIter = mWin32KPresentHistoryTokens.find(key);
-        if (eventIter != mWin32KPresentHistoryTokens.end() && (eventIter->second == p)) {
+        if (eventIter != mWin32KPresentHistoryTokens.end() && (eventIter->second == t->Handle)) {
             mWin32KPresentHistoryTokens.erase(eventIter);
         }
     }
 
     // mDxgKrnlPresentHistoryTokens
-    if (p->TokenPtr != 0) {
-        auto eventIter = mDxgKrnlPresentHistoryTokens.find(p->TokenPtr);
-        if (eventIter != mDxgKrnlPresentHistoryTokens.end() && eventIter->second == p) {
+    if (t->TokenPtr != 0) {
+        auto eventIter = mDxgKrnlPresentHistoryTokens.find(t->TokenPtr);
+        if (eventIter != mDxgKrnlPresentHistoryTokens.end() && eventIter->second == t->Handle) {
             mDxgKrnlPresentHistoryTokens.erase(eventIter);
         }
     }
 
     // mBltsByDxgContext
-    if (p->DxgKrnlHContext != 0) {
-        auto eventIter = mBltsByDxgContext.find(p->DxgKrnlHContext);
-        if (eventIter != mBltsByDxgContext.end() && eventIter->second == p) {
+    if (t->DxgKrnlHContext != 0) {
+        auto eventIter = mBltsByDxgContext.find(t->DxgKrnlHContext);
+        if (eventIter != mBltsByDxgContext.end() && eventIter->second == t->Handle) {
             mBltsByDxgContext.erase(eventIter);
         }
     }
 
     // mLastWindowPresent
     // 0 is a invalid hwnd
-    if (p->Hwnd != 0) {
-        auto eventIter = mLastWindowPresent.find(p->Hwnd);
-        if (eventIter != mLastWindowPresent.end() && eventIter->second == p) {
+    if (t->Hwnd != 0) {
+        auto eventIter = mLastWindowPresent.find(t->Hwnd);
+        if (eventIter != mLastWindowPresent.end() && eventIter->second == t->Handle) {
             mLastWindowPresent.erase(eventIter);
         }
     }
 
-    // mPresentsWaitingForDWM
-    if (p->PresentInDwmWaitingStruct) {
-        for (auto presentIter = mPresentsWaitingForDWM.begin(); presentIter != mPresentsWaitingForDWM.end(); presentIter++) {
-            // This loop should in theory be short because the present is old.
-            // If we are in this loop for dozens of times, something is likely wrong.
-            if (p == *presentIter) {
-                mPresentsWaitingForDWM.erase(presentIter);
-                p->PresentInDwmWaitingStruct = false;
-                break;
-            }
-        }
+    // mPresentsWaitingForDWM, or the DependentPresents of a DWM present
+    if (t->IsLinked()) {
+        t->Unlink();
     }
 
     // mPresentsByLegacyBlitToken
     // LegacyTokenData cannot be 0 if it's in mPresentsByLegacyBlitToken list.
-    if (p->LegacyBlitTokenData != 0) {
-        auto eventIter = mPresentsByLegacyBlitToken.find(p->LegacyBlitTokenData);
-        if (eventIter != mPresentsByLegacyBlitToken.end() && eventIter->second == p) {
+    if (t->LegacyBlitTokenData != 0) {
+        auto eventIter = mPresentsByLegacyBlitToken.find(t->LegacyBlitTokenData);
+        if (eventIter != mPresentsByLegacyBlitToken.end() && eventIter->second == t->Handle) {
             mPresentsByLegacyBlitToken.erase(eventIter);
         }
     }
 }
 
-void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p)
+// Called from AgePresents() for presents still in flight mPresentExpiryMs
+// (5 s by default) after their QpcTime, and from TrackPresent() for the
+// oldest presents once more than mMaxTrackedPresents (65536 by default) are
+// in flight.
+void PMTraceConsumer::ExpirePresent(PresentEventHandle const& handle, LostPresentReason reason)
+{
+    // Presents that completed or were already lost have released their
+    // tracking state, and are ignored here.
+    auto present = GetTrackedPresent(handle);
+    if (present != nullptr) {
+        RemoveLostPresent(present, reason);
+    }
+}
+
+void PMTraceConsumer::RemoveLostPresent(PresentEvent* p, LostPresentReason reason)
 {
     // This present has been timed out. Remove all references to it from all tracking structures.
     // mPresentsByProcessAndSwapChain and mPresentsByProcess should always track the present's lifetime,
@@ -1355,23 +1455,18 @@ void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p)
 
     DebugLostPresent(*p);
 
+    // Completed presents no longer have any tracking to remove.
+    assert(!p->Completed);
+
     p->IsLost = true;
 
-    // Presents dependent on this event can no longer be trakced.
-    auto dependentPresents = p->DependentPresents;
-    for (auto& dependentPresent : dependentPresents) {
-        if (!p->IsLost) {
-            RemoveLostPresent(dependentPresent);
-        }
-        // The only place a lost present could still exist outside of mLostPresentEvents is the dependents list.
-        // A lost present has already been added to mLostPresentEvents, we should never modify it.
+    // Presents dependent on this event (i.e. this one came from DWM) would
+    // have been displayed with it, so they are lost too.
+    while (auto t2 = p->Tracking->DependentPresents.PopFront()) {
+        RemoveLostPresent(GetPresent(t2->Handle), reason);
     }
 
-    // Completed Presented presents should make it here.
-    assert(!(p->Completed && p->FinalState == PresentResult::Presented));
-
     // Remove the present from any struct that would only host the event temporarily.
-    // Should we loop through and remove the dependent presents?
     RemovePresentFromTemporaryTrackingCollections(p);
 
     // mPresentsByProcess
@@ -1385,7 +1480,7 @@ void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p)
     for (auto presentIter = presentDeque.begin(); presentIter != presentDeque.end(); presentIter++) {
         // This loop should in theory be short because the present is old.
         // If we are in this loop for dozens of times, something is likely wrong.
-        if (p == *presentIter) {
+        if (p->Tracking->Handle == *presentIter) {
             hasRemovedElement = true;
             presentDeque.erase(presentIter);
             break;
@@ -1394,18 +1489,57 @@ void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p)
     // We expect an element to be removed here.
     assert(hasRemovedElement);
 
-
-    // Update the list of lost presents.
     {
-        std::lock_guard<std::mutex> lock(mLostPresentEventMutex);
-        mLostPresentEvents.push_back(mAllPresents[p->mAllPresentsTrackingIndex]);
+        std::lock_guard<std::mutex> lock(mLostPresentStatsMutex);
+        auto& stats = mLostPresentStats[p->ProcessId];
+        switch (reason) {
+        case LostPresentReason::Expired:      stats.Expired += 1; break;
+        case LostPresentReason::Evicted:      stats.Evicted += 1; break;
+        case LostPresentReason::Inconsistent: stats.Inconsistent += 1; break;
+        }
     }
 
-    // mAllPresents
-    mAllPresents[p->mAllPresentsTrackingIndex] = nullptr;
+    // Update the list of lost presents.  Any entry for it that remains in
+    // mPresentExpiryWheel is now stale.  (The reference held by its
+    // PresentTracking block may be the last one.)
+    auto handle = p->Tracking->Handle;
+    ReleasePresentTracking(p);
+    mLostPresentEvents.Push(*p);
+
+    // Later presents on the swap chain that completed while waiting for this
+    // one can now be released.
+    ReleaseCompletedPresents(&presentDeque);
 }
 
-void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> p, uint32_t recurseDepth)
+void PMTraceConsumer::ReleaseCompletedPresents(std::deque<PresentEventHandle>* presentDeque)
+{
+    uint32_t releasedCount = 0;
+    while (!presentDeque->empty()) {
+        auto present = GetPresent(presentDeque->front());
+        if (!present->Completed) {
+            break;
+        }
+
+        mPresentEvents.Push(*present);
+        presentDeque->pop_front();
+        releasedCount += 1;
+    }
+
+    if (releasedCount > 0) {
+        mDequeueSignal.Notify(releasedCount);
+    }
+}
+
+void PMTraceConsumer::ReleasePresentTracking(PresentEvent* p)
+{
+    auto t = p->Tracking;
+    assert(!t->IsLinked() && t->DependentPresents.empty());
+
+    mPresentTrackingPool.Destroy(t->TrackingHandle);
+    p->Tracking = nullptr;
+}
+
+void PMTraceConsumer::CompletePresent(PresentEvent* p, uint32_t recurseDepth)
 {
     DebugCompletePresent(*p, recurseDepth);
 
@@ -1415,17 +1549,15 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> p, uint32_t
     }
 
     // Complete all other presents that were riding along with this one (i.e. this one came from DWM)
-    for (auto& p2 : p->DependentPresents) {
-        if (!p2->IsLost) {
-            DebugModifyPresent(*p2);
-            p2->ScreenTime = p->ScreenTime;
-            p2->FinalState = p->FinalState;
-            CompletePresent(p2, recurseDepth + 1);
-        }
-        // The only place a lost present could still exist outside of mLostPresentEvents is the dependents list.
-        // A lost present has already been added to mLostPresentEvents, we should never modify it.
+    // (A dependent present that was completed or lost on its own has already
+    // unlinked itself.)
+    while (auto t2 = p->Tracking->DependentPresents.PopFront()) {
+        auto p2 = GetPresent(t2->Handle);
+        DebugModifyPresent(*p2);
+        p2->ScreenTime = p->ScreenTime;
+        p2->FinalState = p->FinalState;
+        CompletePresent(p2, recurseDepth + 1);
     }
-    p->DependentPresents.clear();
 
     // Remove it from any tracking maps that it may have been inserted into
     RemovePresentFromTemporaryTrackingCollections(p);
@@ -1438,52 +1570,48 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> p, uint32_t
     presentsByThisProcess.erase(p->QpcTime);
 
     auto& presentDeque = mPresentsByProcessAndSwapChain[std::make_tuple(p->ProcessId, p->SwapChainAddress)];
-    assert(!presentDeque.front()->Completed); // It wouldn't be here anymore if it was
+    assert(!GetPresent(presentDeque.front())->Completed); // It wouldn't be here anymore if it was
 
     if (p->FinalState == PresentResult::Presented) {
         auto presentIter = presentDeque.begin();
-        while (presentIter != presentDeque.end() && *presentIter != p) {
-            CompletePresent(*presentIter, recurseDepth + 1);
+        while (presentIter != presentDeque.end() && *presentIter != p->Tracking->Handle) {
+            CompletePresent(GetPresent(*presentIter), recurseDepth + 1);
             presentIter = presentDeque.begin();
         }
     }
 
+    // The present's tracking state is released now; the PresentEvent itself
+    // stays in presentDeque until it reaches the front.
+    ReleasePresentTracking(p);
     p->Completed = true;
 
     // Move presents to ready list.
-    {
-        std::lock_guard<std::mutex> lock(mPresentEventMutex);
-        while (!presentDeque.empty() && presentDeque.front()->Completed) {
-            mAllPresents[presentDeque.front()->mAllPresentsTrackingIndex] = nullptr;
-
-            mPresentEvents.push_back(presentDeque.front());
-            presentDeque.pop_front();
-        }
-    }
+    ReleaseCompletedPresents(&presentDeque);
 }
 
-std::shared_ptr<PresentEvent> PMTraceConsumer::FindBySubmitSequence(uint32_t submitSequence)
+PresentEvent* PMTraceConsumer::FindBySubmitSequence(uint32_t submitSequence)
 {
-    auto eventIter = mPresentsBySubmitSequence.find(submitSequence);
+    auto eventIter = FindTrackedPresent(mPresentsBySubmitSequence, submitSequence);
     if (eventIter == mPresentsBySubmitSequence.end()) {
         return nullptr;
     }
-    DebugModifyPresent(*eventIter->second);
-    return eventIter->second;
+    auto presentEvent = GetPresent(eventIter->second);
+    DebugModifyPresent(*presentEvent);
+    return presentEvent;
 }
 
-std::shared_ptr<PresentEvent> PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER const& hdr)
+PresentEvent* PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER const& hdr)
 {
     // Check if there is an in-progress present that this thread is already
     // working on and, if so, continue working on that.
-    auto threadEventIter = mPresentByThreadId.find(hdr.ThreadId);
+    auto threadEventIter = FindTrackedPresent(mPresentByThreadId, hdr.ThreadId);
     if (threadEventIter != mPresentByThreadId.end()) {
-        return threadEventIter->second;
+        return GetPresent(threadEventIter->second);
     }
 
     // If not, check if this event is from a process that is filtered out and,
     // if so, ignore it.
-    if (!IsProcessTrackedForFiltering(hdr.ProcessId)) {
+    if (!IsProcessTrackedForFiltering(hdr)) {
         return nullptr;
     }
 
@@ -1496,15 +1624,15 @@ std::shared_ptr<PresentEvent> PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER
     // batched presents are popped off the front of the driver queue by process
     // in order.
     auto& presentsByThisProcess = mPresentsByProcess[hdr.ProcessId];
-    auto processIter = std::find_if(presentsByThisProcess.begin(), presentsByThisProcess.end(), [](auto processIter) {
-        return processIter.second->PresentMode == PresentMode::Unknown;
+    auto processIter = std::find_if(presentsByThisProcess.begin(), presentsByThisProcess.end(), [this](auto processIter) {
+        return GetPresent(processIter.second)->PresentMode == PresentMode::Unknown;
     });
     if (processIter != presentsByThisProcess.end()) {
-        auto presentEvent = processIter->second;
+        auto presentEvent = GetPresent(processIter->second);
 
         // TODO: Do we need to move it to mPresentByThreadId anymore?
         presentsByThisProcess.erase(processIter);
-        mPresentByThreadId.emplace(hdr.ThreadId, presentEvent);
+        mPresentByThreadId.emplace(hdr.ThreadId, presentEvent->Tracking->Handle);
 
         return presentEvent;
     }
@@ -1519,39 +1647,57 @@ std::shared_ptr<PresentEvent> PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER
     // TODO: Why do we add it to presentsByThisProcess?  We're already past the
     // stage where we need to look it up by that mechanism...
     // mPresentByThreadId should be good enough at this point right?
-    auto presentEvent = std::make_shared<PresentEvent>(hdr, Runtime::Other);
+    auto presentEvent = CreatePresent(hdr, Runtime::Other);
     TrackPresent(presentEvent, presentsByThisProcess);
     return presentEvent;
 }
 
+PresentEvent* PMTraceConsumer::CreatePresent(EVENT_HEADER const& hdr, ::Runtime runtime)
+{
+    auto handle = std::make_shared<PresentEvent>(hdr, runtime);
+    auto trackingHandle = mPresentTrackingPool.Create();
+    auto present = handle.get();
+    present->Tracking = mPresentTrackingPool.Get(trackingHandle);
+    present->Tracking->Handle = std::move(handle);
+    present->Tracking->TrackingHandle = trackingHandle;
+    mInstrumentation.RecordCollectionSize(InstrumentedCollection::LivePresents, mPresentTrackingPool.LiveCount());
+    return present;
+}
+
 void PMTraceConsumer::TrackPresent(
-    std::shared_ptr<PresentEvent> present,
+    PresentEvent* present,
     decltype(PMTraceConsumer::mPresentsByProcess.begin()->second)& presentsByThisProcess)
 {
     DebugCreatePresent(*present);
 
-    // If there is an existing present that hasn't completed by the time the
-    // circular buffer has come around, consider it lost.
-    if (mAllPresents[mAllPresentsNextIndex] != nullptr) {
-        RemoveLostPresent(mAllPresents[mAllPresentsNextIndex]);
+    // If too many presents are in flight, consider the ones closest to
+    // expiring lost now, one at a time until back under the limit.  (Entries
+    // for presents that already completed are stale and just dropped.)
+    while (mPresentTrackingPool.LiveCount() > mMaxTrackedPresents &&
+           mPresentExpiryWheel.ExpireEarliest([this](PresentEventHandle const& handle) {
+               ExpirePresent(handle, LostPresentReason::Evicted);
+           })) {
     }
 
-    present->mAllPresentsTrackingIndex = mAllPresentsNextIndex;
-    mAllPresents[mAllPresentsNextIndex] = present;
-    mAllPresentsNextIndex = (mAllPresentsNextIndex + 1) % PRESENTEVENT_CIRCULAR_BUFFER_SIZE;
+    mPresentExpiryWheel.Schedule(present->QpcTime + mPresentExpiryQpc, present->Tracking->Handle);
+
+    presentsByThisProcess.emplace(present->QpcTime, present->Tracking->Handle);
+    auto& swapChainPresents = mPresentsByProcessAndSwapChain[std::make_tuple(present->ProcessId, present->SwapChainAddress)];
+    swapChainPresents.emplace_back(present->Tracking->Handle);
+    mPresentByThreadId.emplace(present->ThreadId, present->Tracking->Handle);
 
-    presentsByThisProcess.emplace(present->QpcTime, present);
-    mPresentsByProcessAndSwapChain[std::make_tuple(present->ProcessId, present->SwapChainAddress)].emplace_back(present);
-    mPresentByThreadId.emplace(present->ThreadId, present);
+    mInstrumentation.RecordCollectionSize(InstrumentedCollection::ProcessPresents, presentsByThisProcess.size());
+    mInstrumentation.RecordCollectionSize(InstrumentedCollection::SwapChains, mPresentsByProcessAndSwapChain.size());
+    mInstrumentation.RecordCollectionSize(InstrumentedCollection::SwapChainPresents, swapChainPresents.size());
 }
 
-void PMTraceConsumer::TrackPresentOnThread(std::shared_ptr<PresentEvent> present)
+void PMTraceConsumer::TrackPresentOnThread(PresentEvent* present)
 {
     // If there is an in-flight present on this thread already, then something
     // has gone wrong with it's tracking so consider it lost.
-    auto iter = mPresentByThreadId.find(present->ThreadId);
+    auto iter = FindTrackedPresent(mPresentByThreadId, present->ThreadId);
     if (iter != mPresentByThreadId.end()) {
-        RemoveLostPresent(iter->second);
+        RemoveLostPresent(GetPresent(iter->second), LostPresentReason::Inconsistent);
     }
 
     TrackPresent(present, mPresentsByProcess[present->ProcessId]);
@@ -1562,11 +1708,11 @@ void PMTraceConsumer::TrackPresentOnThread(std::shared_ptr<PresentEvent> present
 // for any completed present.
 void PMTraceConsumer::RuntimePresentStop(EVENT_HEADER const& hdr, bool AllowPresentBatching, Runtime runtime)
 {
-    auto eventIter = mPresentByThreadId.find(hdr.ThreadId);
+    auto eventIter = FindTrackedPresent(mPresentByThreadId, hdr.ThreadId);
     if (eventIter == mPresentByThreadId.end()) {
         return;
     }
-    auto &event = *eventIter->second;
+    auto &event = *GetPresent(eventIter->second);
 
     DebugModifyPresent(event);
 
@@ -1581,7 +1727,7 @@ void PMTraceConsumer::RuntimePresentStop(EVENT_HEADER const& hdr, bool AllowPres
 
     if (!AllowPresentBatching || mSimpleMode) {
         event.FinalState = AllowPresentBatching ? PresentResult::Presented : PresentResult::Discarded;
-        CompletePresent(eventIter->second);
+        CompletePresent(&event);
         // CompletePresent removes the entry in mPresentByThreadId.
     }
     else
@@ -1612,12 +1758,62 @@ void PMTraceConsumer::HandleNTProcessEvent(EVENT_RECORD* pEventRecord)
         event.IsStartEvent  = pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_START ||
                               pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_DC_START;
 
-        std::lock_guard<std::mutex> lock(mProcessEventMutex);
-        mProcessEvents.emplace_back(event);
+        if (mEnableTrackedProcessFiltering && !mTrackedProcessNames.empty()) {
+            if (event.IsStartEvent) {
+                UpdateProcessTrackedByName(event.ProcessId, event.ImageFileName.c_str());
+            } else {
+                RemoveProcessTrackedByName(event.ProcessId);
+            }
+        }
+
+        mProcessEvents.Push(std::move(event));
+        mDequeueSignal.Notify();
         return;
     }
 }
 
+// Microsoft_Windows_Kernel_Process events are enabled by realtime sessions
+// that track processes by name.  Unlike NT_Process events they aren't passed
+// on as ProcessEvents; they only keep mTrackedProcessFilter up to date.
+void PMTraceConsumer::HandleKernelProcessEvent(EVENT_RECORD* pEventRecord)
+{
+    if (!mEnableTrackedProcessFiltering || mTrackedProcessNames.empty()) {
+        return;
+    }
+
+    switch (pEventRecord->EventHeader.EventDescriptor.Id) {
+    case Microsoft_Windows_Kernel_Process::ProcessStart_Start::Id: {
+        EventDataDesc desc[] = {
+            { L"ProcessID" },
+            { L"ImageName" },
+        };
+        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
+        auto processID = desc[0].GetData<uint32_t>();
+        auto imagePath = desc[1].GetData<std::wstring>();
+
+        // ImageName is the full path of the executable; only its file name is
+        // compared.
+        auto fileNamePos = imagePath.find_last_of(L'\\');
+        auto fileName = imagePath.c_str() + (fileNamePos == std::wstring::npos ? 0 : fileNamePos + 1);
+        char processName[MAX_PATH];
+        if (WideCharToMultiByte(CP_ACP, 0, fileName, -1, processName, sizeof(processName), nullptr, nullptr) == 0) {
+            processName[0] = '\0';
+        }
+
+        UpdateProcessTrackedByName(processID, processName);
+        break;
+    }
+    case Microsoft_Windows_Kernel_Process::ProcessStop_Stop::Id: {
+        EventDataDesc desc[] = {
+            { L"ProcessID" },
+        };
+        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
+        RemoveProcessTrackedByName(desc[0].GetData<uint32_t>());
+        break;
+    }
+    }
+}
+
 void PMTraceConsumer::HandleMetadataEvent(EVENT_RECORD* pEventRecord)
 {
     mMetadata.AddMetadata(pEventRecord);
@@ -1625,35 +1821,67 @@ void PMTraceConsumer::HandleMetadataEvent(EVENT_RECORD* pEventRecord)
 
 void PMTraceConsumer::AddTrackedProcessForFiltering(uint32_t processID)
 {
-    std::unique_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
-    mTrackedProcessFilter.insert(processID);
+    mTrackedProcessFilter.Insert(processID);
 }
 
-void PMTraceConsumer::RemoveTrackedProcessForFiltering(uint32_t processID)
+static std::string ToLowerProcessName(char const* processName)
 {
-    std::unique_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
-    auto iterator = mTrackedProcessFilter.find(processID);
-    
-    if (iterator != mTrackedProcessFilter.end()) {
-        mTrackedProcessFilter.erase(processID);
-    }
-    else {
-        assert(false);
+    std::string lower(processName);
+    for (auto& c : lower) {
+        c = (char) tolower((unsigned char) c);
     }
+    return lower;
+}
+
+// Must be called before the trace session is started.
+void PMTraceConsumer::AddTrackedProcessNameForFiltering(char const* processName)
+{
+    mTrackedProcessNames.emplace(ToLowerProcessName(processName));
+}
+
+void PMTraceConsumer::RemoveTrackedProcessForFiltering(uint32_t processID)
+{
+    auto erased = mTrackedProcessFilter.Erase(processID);
+    assert(erased);
+    (void) erased;
 
     // Completion events will remove any currently tracked events for this process
     // from data structures, so we don't need to proactively remove them now.
 }
 
-bool PMTraceConsumer::IsProcessTrackedForFiltering(uint32_t processID)
+bool PMTraceConsumer::IsProcessTrackedForFiltering(EVENT_HEADER const& hdr) const
+{
+    auto processID = hdr.ProcessId;
+    return !mEnableTrackedProcessFiltering || processID == DwmProcessId || mTrackedProcessFilter.Contains(processID);
+}
+
+bool PMTraceConsumer::IsTrackedProcessName(char const* processName) const
+{
+    return mTrackedProcessNames.find(ToLowerProcessName(processName)) != mTrackedProcessNames.end();
+}
+
+// Called for process start events: track processID if processName is one of
+// mTrackedProcessNames.  If the id was reused by a process that doesn't
+// match, stop tracking it.
+void PMTraceConsumer::UpdateProcessTrackedByName(uint32_t processID, char const* processName)
 {
-    if (!mEnableTrackedProcessFiltering || processID == DwmProcessId) {
-        return true;
+    auto nameMatches = IsTrackedProcessName(processName);
+    auto tracked = mProcessesTrackedByName.find(processID) != mProcessesTrackedByName.end();
+    if (nameMatches && !tracked && mTrackedProcessFilter.Insert(processID)) {
+        mProcessesTrackedByName.insert(processID);
+    } else if (!nameMatches && tracked) {
+        mTrackedProcessFilter.Erase(processID);
+        mProcessesTrackedByName.erase(processID);
     }
+}
 
-    std::shared_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
-    auto iterator = mTrackedProcessFilter.find(processID);
-    return (iterator != mTrackedProcessFilter.end());
+// Called for process stop events: if processID was tracked because of its
+// name, stop tracking it so its id isn't tracked if it's reused.
+void PMTraceConsumer::RemoveProcessTrackedByName(uint32_t processID)
+{
+    if (mProcessesTrackedByName.erase(processID) != 0) {
+        mTrackedProcessFilter.Erase(processID);
+    }
 }
 
 #ifdef TRACK_PRESENT_PATHS
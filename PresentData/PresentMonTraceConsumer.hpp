@@ -28,19 +28,25 @@ SOFTWARE.
 #include <map>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
 #include <stdint.h>
 #include <string>
 #include <tuple>
+#include <unordered_set>
 #include <vector>
-#include <set>
 #include <windows.h>
 #include <evntcons.h> // must include after windows.h
 
 #include "Debug.hpp"
+#include "EventBatchSignal.hpp"
+#include "GenerationalPool.hpp"
+#include "Instrumentation.hpp"
+#include "IntrusiveList.hpp"
+#include "ProcessIdSet.hpp"
+#include "SpscRing.hpp"
+#include "TimerWheel.hpp"
 #include "TraceConsumer.hpp"
 
-enum class PresentMode
+enum class PresentMode : uint8_t
 {
     Unknown,
     Hardware_Legacy_Flip,
@@ -56,12 +62,12 @@ enum class PresentMode
     Hardware_Composed_Independent_Flip,
 };
 
-enum class PresentResult
+enum class PresentResult : uint8_t
 {
     Unknown, Presented, Discarded, Error
 };
 
-enum class Runtime
+enum class Runtime : uint8_t
 {
     DXGI, D3D9, Other
 };
@@ -74,6 +80,29 @@ struct ProcessEvent {
     bool IsStartEvent;
 };
 
+enum class LostPresentReason {
+    Expired,        // Not completed within PMTraceConsumer::mPresentExpiryMs
+    Evicted,        // Dropped early because PMTraceConsumer::mMaxTrackedPresents were in flight
+    Inconsistent,   // Its tracking was found to be inconsistent with a later event
+};
+
+struct LostPresentStats {
+    uint64_t Expired;
+    uint64_t Evicted;
+    uint64_t Inconsistent;
+};
+
+// In-progress presents are shared by PMTraceConsumer's tracking collections.
+struct PresentEvent;
+typedef std::shared_ptr<PresentEvent> PresentEventHandle;
+
+struct PresentTracking;
+
+// PresentEvent is the record handed to the consumer, and is kept in its
+// per-swapchain history, so it only holds what the consumer uses (72 bytes on
+// x64).  The state PMTraceConsumer needs to follow the present through the
+// pipeline is in a separate PresentTracking block that is released as soon
+// as the present is completed or lost.
 struct PresentEvent {
     // Initial event information (might be a kernel event if not presented
     // through DXGI or D3D9)
@@ -92,34 +121,21 @@ struct PresentEvent {
     uint32_t PresentFlags;
 
     // Properties deduced by watching events through present pipeline
-    uint64_t Hwnd;
-    uint64_t TokenPtr;
-    uint64_t CompositionSurfaceLuid;
-    uint32_t QueueSubmitSequence;
-    uint32_t DestWidth;
-    uint32_t DestHeight;
     uint32_t DriverBatchThreadId;
     Runtime Runtime;
     PresentMode PresentMode;
     PresentResult FinalState;
-    bool SupportsTearing;
-    bool MMIO;
-    bool SeenDxgkPresent;
-    bool SeenWin32KEvents;
-    bool DwmNotified;
-    bool Completed;
-
-    // Additional transient tracking state
-    bool IsLost;                        // Whether this present has been timed-out, unlikely to ever complete.
-    uint32_t mAllPresentsTrackingIndex; // Index in PMTraceConsumer's mAllPresents.
-    uint64_t DxgKrnlHContext;           // Key for mBltsByDxgContext
-    uint64_t Win32KPresentCount;        // Combine with CompositionSurfaceLuid and Win32KBindId as key into mWin32KPresentHistoryTokens
-    uint64_t Win32KBindId;              // Combine with CompositionSurfaceLuid and Win32KPresentCount as key into mWin32KPresentHistoryTokens
-    uint64_t LegacyBlitTokenData;       // Key for mPresentsByLegacyBlitToken
-    std::deque<std::shared_ptr<PresentEvent>> DependentPresents;
-    
-    // We need a signal to prevent us from looking fruitlessly through the WaitingForDwm list
-    bool PresentInDwmWaitingStruct;
+    bool SupportsTearing : 1;
+    bool MMIO : 1;
+    bool SeenDxgkPresent : 1;
+    bool SeenWin32KEvents : 1;
+    bool DwmNotified : 1;
+    bool Completed : 1;
+    bool IsLost : 1;                    // Whether this present has been timed-out, unlikely to ever complete.
+
+    // In-progress tracking state, or nullptr once the present is completed or
+    // lost (and so in every PresentEvent the consumer sees).
+    PresentTracking* Tracking;
 
     // Track the path the present took through the PresentMon analysis.
 #ifdef TRACK_PRESENT_PATHS
@@ -131,10 +147,29 @@ struct PresentEvent {
     uint64_t Id;
 #endif
 
+    PresentEvent();
     PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime);
+};
 
-private:
-    PresentEvent(PresentEvent const& copy); // dne
+// The IntrusiveListNode base links the present into either
+// PMTraceConsumer::mPresentsWaitingForDWM or the DependentPresents of the DWM
+// present it is riding along with.
+struct PresentTracking : IntrusiveListNode {
+    PresentEventHandle Handle;          // Reference to the present, for inserting it into tracking collections.
+    PoolHandle TrackingHandle;          // This block's handle in PMTraceConsumer's mPresentTrackingPool.
+    uint32_t QueueSubmitSequence;       // Key for mPresentsBySubmitSequence
+    uint64_t Hwnd;                      // Key for mLastWindowPresent
+    uint64_t TokenPtr;                  // Key for mDxgKrnlPresentHistoryTokens
+    uint64_t CompositionSurfaceLuid;    // Combine with Win32KPresentCount and Win32KBindId as key into mWin32KPresentHistoryTokens
+    uint64_t Win32KPresentCount;        // Combine with CompositionSurfaceLuid and Win32KBindId as key into mWin32KPresentHistoryTokens
+    uint64_t Win32KBindId;              // Combine with CompositionSurfaceLuid and Win32KPresentCount as key into mWin32KPresentHistoryTokens
+    uint64_t DxgKrnlHContext;           // Key for mBltsByDxgContext
+    uint64_t LegacyBlitTokenData;       // Key for mPresentsByLegacyBlitToken
+    uint32_t DestWidth;
+    uint32_t DestHeight;
+    IntrusiveList<PresentTracking> DependentPresents;
+
+    PresentTracking();
 };
 
 // A high-level description of the sequence of events for each present type,
@@ -188,6 +223,10 @@ struct PMTraceConsumer
 
     EventMetadata mMetadata;
 
+    // Only updated when built with PRESENTMON_INSTRUMENTATION; see
+    // Instrumentation.hpp.
+    ConsumerInstrumentation mInstrumentation;
+
     bool mFilteredEvents;
     bool mSimpleMode;
 
@@ -195,15 +234,27 @@ struct PMTraceConsumer
     // DequeuePresents().  Completed presents are those that have progressed as
     // far as they can through the pipeline before being either discarded or
     // hitting the screen.
-    std::mutex mPresentEventMutex;
-    std::vector<std::shared_ptr<PresentEvent>> mPresentEvents;
-
-    std::mutex mLostPresentEventMutex;
-    std::vector<std::shared_ptr<PresentEvent>> mLostPresentEvents;
+    //
+    // Completed and lost presents are copied out by value, so
+    // the consumer thread never shares storage with the in-progress presents.
+    //
+    // These are single-producer/single-consumer rings so the ETW callback
+    // thread never waits on, or takes a lock shared with, the thread dequeuing
+    // them.  If the dequeuing thread falls a full ring behind, completed
+    // presents and process events use SpscOverflowPolicy::Spill and continue
+    // in a new ring segment, so none are lost; lost presents are only
+    // informational, so they use SpscOverflowPolicy::Drop and are discarded
+    // (and counted) instead.
+    SpscRing<PresentEvent> mPresentEvents;
+    SpscRing<PresentEvent> mLostPresentEvents;
 
     // Process events
-    std::mutex mProcessEventMutex;
-    std::vector<ProcessEvent> mProcessEvents;
+    SpscRing<ProcessEvent> mProcessEvents;
+
+    // Notified whenever completed presents or process events are queued, so
+    // the thread dequeuing them can wait for a batch instead of polling.  Lost
+    // presents don't notify; they are picked up with the next batch.
+    EventBatchSignal mDequeueSignal;
 
 
     // These data structures store in-progress presents (i.e., ones that are
@@ -235,29 +286,54 @@ struct PMTraceConsumer
     // present count, and bind id).  mWin32KPresentHistoryTokens stores the
     // mapping from this token to in-progress present to optimize lookups
     // during Win32K events.
-
-    // Circular buffer of all Presents, older presents will be considered lost if not completed by the next visit.
-    unsigned int mAllPresentsNextIndex;
-    std::vector<std::shared_ptr<PresentEvent>> mAllPresents;
+    //
+    // Each present's PresentTracking block is allocated from
+    // mPresentTrackingPool and released as soon as the present is completed
+    // or lost, so the pool's LiveCount() is the number of presents in flight.
+    // A tracking collection entry for a present without a PresentTracking
+    // block is stale; FindTrackedPresent() drops these on lookup.
+    GenerationalPool<PresentTracking> mPresentTrackingPool;
+
+    // Presents that haven't completed mPresentExpiryMs (by default 5 seconds)
+    // after their QpcTime are considered lost.  As a bound on memory, if more
+    // than mMaxTrackedPresents (by default 65536) are in flight, the ones
+    // closest to expiring are considered lost early -- only as many as needed
+    // to get back under the limit.  Both may be changed before the trace
+    // session is started.
+    //
+    // mPresentExpiryWheel holds the handle of every tracked present keyed by
+    // its expiry time; presents that complete leave a stale entry behind.
+    // It is advanced by AgePresents() whenever an event's timestamp reaches
+    // the wheel's next tick, so expiry tracks the event timeline rather than
+    // how many presents have been seen.
+    uint32_t mPresentExpiryMs;
+    uint32_t mMaxTrackedPresents;
+    uint64_t mPresentExpiryQpc;
+    TimerWheel<PresentEventHandle> mPresentExpiryWheel;
+
+    // [process id] Count of presents considered lost, by reason.  Accessed by
+    // both the consumer thread and GetLostPresentStats().
+    std::mutex mLostPresentStatsMutex;
+    std::map<uint32_t, LostPresentStats> mLostPresentStats;
 
     // [thread id]
-    std::map<uint32_t, std::shared_ptr<PresentEvent>> mPresentByThreadId;
+    std::map<uint32_t, PresentEventHandle> mPresentByThreadId;
 
     // [process id][qpc time]
-    std::map<uint32_t, std::map<uint64_t, std::shared_ptr<PresentEvent>>> mPresentsByProcess;
+    std::map<uint32_t, std::map<uint64_t, PresentEventHandle>> mPresentsByProcess;
 
     // [(process id, swapchain address)]
     typedef std::tuple<uint32_t, uint64_t> ProcessAndSwapChainKey;
-    std::map<ProcessAndSwapChainKey, std::deque<std::shared_ptr<PresentEvent>>> mPresentsByProcessAndSwapChain;
+    std::map<ProcessAndSwapChainKey, std::deque<PresentEventHandle>> mPresentsByProcessAndSwapChain;
 
     // Maps from queue packet submit sequence
     // Used for Flip -> MMIOFlip -> VSyncDPC for FS, for PresentHistoryToken -> MMIOFlip -> VSyncDPC for iFlip,
     // and for Blit Submission -> Blit completion for FS Blit
-    std::map<uint32_t, std::shared_ptr<PresentEvent>> mPresentsBySubmitSequence;
+    std::map<uint32_t, PresentEventHandle> mPresentsBySubmitSequence;
 
     // [(composition surface pointer, present count, bind id)]
     typedef std::tuple<uint64_t, uint64_t, uint64_t> Win32KPresentHistoryTokenKey;
-    std::map<Win32KPresentHistoryTokenKey, std::shared_ptr<PresentEvent>> mWin32KPresentHistoryTokens;
+    std::map<Win32KPresentHistoryTokenKey, PresentEventHandle> mWin32KPresentHistoryTokens;
 
 
     // DxgKrnl present history tokens are uniquely identified and used for all
@@ -274,11 +350,11 @@ struct PMTraceConsumer
     // The following events lookup presents based on this token:
     // Dwm_Event_FlipChain_Pending, Dwm_Event_FlipChain_Complete,
     // Dwm_Event_FlipChain_Dirty,
-    std::map<uint64_t, std::shared_ptr<PresentEvent>> mDxgKrnlPresentHistoryTokens;
+    std::map<uint64_t, PresentEventHandle> mDxgKrnlPresentHistoryTokens;
 
     // For blt presents on Win7, it's not possible to distinguish between DWM-off or fullscreen blts, and the DWM-on blt to redirection bitmaps.
     // The best we can do is make the distinction based on the next packet submitted to the context. If it's not a PHT, it's not going to DWM.
-    std::map<uint64_t, std::shared_ptr<PresentEvent>> mBltsByDxgContext;
+    std::map<uint64_t, PresentEventHandle> mBltsByDxgContext;
 
     // mLastWindowPresent is used as storage for presents handed off to DWM.
     //
@@ -298,43 +374,86 @@ struct PMTraceConsumer
     // For Win32K-tracked events, Win32K_Event_TokenStateChanged InFrame will
     // set mLastWindowPresent (and set any current present as discarded), and
     // Win32K_Event_TokenStateChanged Confirmed will clear mLastWindowPresent.
-    std::map<uint64_t, std::shared_ptr<PresentEvent>> mLastWindowPresent;
+    std::map<uint64_t, PresentEventHandle> mLastWindowPresent;
 
     // Presents that will be completed by DWM's next present
-    std::deque<std::shared_ptr<PresentEvent>> mPresentsWaitingForDWM;
+    IntrusiveList<PresentTracking> mPresentsWaitingForDWM;
     // Used to understand that a flip event is coming from the DWM
     uint32_t DwmProcessId = 0;
     uint32_t DwmPresentThreadId = 0;
 
     // Yet another unique way of tracking present history tokens, this time from DxgKrnl -> DWM, only for legacy blit
-    std::map<uint64_t, std::shared_ptr<PresentEvent>> mPresentsByLegacyBlitToken;
+    std::map<uint64_t, PresentEventHandle> mPresentsByLegacyBlitToken;
 
-    // Limit tracking to specified processes
+    // Limit tracking to specified processes.
+    //
+    // mTrackedProcessFilter holds the ids of the processes to track.  It's
+    // checked against the event header before any of an event's properties
+    // are decoded, so it's read without taking a lock (see ProcessIdSet).
+    //
+    // Processes can also be tracked by image name (compared
+    // case-insensitively) by calling AddTrackedProcessNameForFiltering()
+    // before the trace session is started; mTrackedProcessNames holds the
+    // lower-cased names.  A process id is added to mTrackedProcessFilter when
+    // its start event has a matching name, and removed when its stop event
+    // arrives.  ETLs have NT_Process start, rundown, and end events, and
+    // realtime sessions enable Microsoft_Windows_Kernel_Process for its
+    // ProcessStart and ProcessStop events.  Processes already running when a
+    // realtime session starts have no start event, so the application passes
+    // those to UpdateProcessTrackedByName() itself (e.g., from a snapshot
+    // taken after the session is started but before events are processed).
+    //
+    // mProcessesTrackedByName holds the ids added because of their name, so
+    // they can be removed when the process exits.  Once events are being
+    // processed, both sets are only used by the consumer thread.
     bool mEnableTrackedProcessFiltering;
-    std::set<uint32_t> mTrackedProcessFilter;
-    std::shared_mutex mTrackedProcessFilterMutex;
+    ProcessIdSet mTrackedProcessFilter;
+    std::unordered_set<std::string> mTrackedProcessNames;
+    std::unordered_set<uint32_t> mProcessesTrackedByName;
 
     // Storage for passing present path tracking id to Handle...() functions.
 #ifdef TRACK_PRESENT_PATHS
     uint32_t mAnalysisPathID;
 #endif
 
+    // The Dequeue*() functions must all be called from the same thread.
     void DequeueProcessEvents(std::vector<ProcessEvent>& outProcessEvents)
     {
-        std::lock_guard<std::mutex> lock(mProcessEventMutex);
-        outProcessEvents.swap(mProcessEvents);
+        outProcessEvents.clear();
+        mProcessEvents.PopAll(outProcessEvents);
+    }
+
+    void DequeuePresentEvents(std::vector<PresentEvent>& outPresentEvents)
+    {
+        outPresentEvents.clear();
+        mPresentEvents.PopAll(outPresentEvents);
     }
 
-    void DequeuePresentEvents(std::vector<std::shared_ptr<PresentEvent>>& outPresentEvents)
+    void DequeueLostPresentEvents(std::vector<PresentEvent>& outPresentEvents)
     {
-        std::lock_guard<std::mutex> lock(mPresentEventMutex);
-        outPresentEvents.swap(mPresentEvents);
+        outPresentEvents.clear();
+        mLostPresentEvents.PopAll(outPresentEvents);
     }
 
-    void DequeueLostPresentEvents(std::vector<std::shared_ptr<PresentEvent>>& outPresentEvents)
+    // Copy the per-process lost present counts.  This can be called from any
+    // thread.
+    void GetLostPresentStats(std::map<uint32_t, LostPresentStats>* stats)
     {
-        std::lock_guard<std::mutex> lock(mLostPresentEventMutex);
-        outPresentEvents.swap(mLostPresentEvents);
+        std::lock_guard<std::mutex> lock(mLostPresentStatsMutex);
+        *stats = mLostPresentStats;
+    }
+
+    // Set up mPresentExpiryWheel (and the process name recheck interval) for
+    // the session's QPC frequency.  This is called by TraceSession before any
+    // events are processed.
+    void StartPresentAging(uint64_t qpcFrequency);
+
+    // Consider lost any presents that have expired by the given time.
+    void AgePresents(uint64_t qpcTime)
+    {
+        mPresentExpiryWheel.Advance(qpcTime, [this](PresentEventHandle const& handle) {
+            ExpirePresent(handle, LostPresentReason::Expired);
+        });
     }
 
     void HandleDxgkBlt(EVENT_HEADER const& hdr, uint64_t hwnd, bool redirectedPresent);
@@ -348,16 +467,45 @@ struct PMTraceConsumer
     void HandleDxgkSubmitPresentHistoryEventArgs(EVENT_HEADER const& hdr, uint64_t token, uint64_t tokenData, PresentMode knownPresentMode);
     void HandleDxgkPropagatePresentHistoryEventArgs(EVENT_HEADER const& hdr, uint64_t token);
 
-    void CompletePresent(std::shared_ptr<PresentEvent> p, uint32_t recurseDepth=0);
-    std::shared_ptr<PresentEvent> FindBySubmitSequence(uint32_t submitSequence);
-    std::shared_ptr<PresentEvent> FindOrCreatePresent(EVENT_HEADER const& hdr);
-    void TrackPresentOnThread(std::shared_ptr<PresentEvent> present);
-    void TrackPresent(std::shared_ptr<PresentEvent> present, decltype(mPresentsByProcess.begin()->second)& presentsByThisProcess);
-    void RemoveLostPresent(std::shared_ptr<PresentEvent> present);
-    void RemovePresentFromTemporaryTrackingCollections(std::shared_ptr<PresentEvent> present);
+    PresentEvent* CreatePresent(EVENT_HEADER const& hdr, ::Runtime runtime);
+    PresentEvent* GetPresent(PresentEventHandle const& handle) const { return handle.get(); }
+
+    // As GetPresent(), but also returns nullptr for presents that have been
+    // completed (and so no longer have a PresentTracking block).
+    PresentEvent* GetTrackedPresent(PresentEventHandle const& handle) const
+    {
+        auto present = handle.get();
+        return present != nullptr && present->Tracking != nullptr ? present : nullptr;
+    }
+
+    // Lookup an entry in one of the tracking maps above.  If the present it
+    // refers to has since been completed or lost, the stale entry is erased
+    // and map.end() is returned.
+    template<typename Map>
+    typename Map::iterator FindTrackedPresent(Map& map, typename Map::key_type const& key)
+    {
+        auto iter = map.find(key);
+        if (iter != map.end() && GetTrackedPresent(iter->second) == nullptr) {
+            map.erase(iter);
+            return map.end();
+        }
+        return iter;
+    }
+
+    void CompletePresent(PresentEvent* p, uint32_t recurseDepth=0);
+    PresentEvent* FindBySubmitSequence(uint32_t submitSequence);
+    PresentEvent* FindOrCreatePresent(EVENT_HEADER const& hdr);
+    void TrackPresentOnThread(PresentEvent* present);
+    void TrackPresent(PresentEvent* present, decltype(mPresentsByProcess.begin()->second)& presentsByThisProcess);
+    void ExpirePresent(PresentEventHandle const& handle, LostPresentReason reason);
+    void RemoveLostPresent(PresentEvent* present, LostPresentReason reason);
+    void ReleaseCompletedPresents(std::deque<PresentEventHandle>* presentDeque);
+    void ReleasePresentTracking(PresentEvent* present);
+    void RemovePresentFromTemporaryTrackingCollections(PresentEvent* present);
     void RuntimePresentStop(EVENT_HEADER const& hdr, bool AllowPresentBatching, ::Runtime runtime);
 
     void HandleNTProcessEvent(EVENT_RECORD* pEventRecord);
+    void HandleKernelProcessEvent(EVENT_RECORD* pEventRecord);
     void HandleDXGIEvent(EVENT_RECORD* pEventRecord);
     void HandleD3D9Event(EVENT_RECORD* pEventRecord);
     void HandleDXGKEvent(EVENT_RECORD* pEventRecord);
@@ -373,7 +521,11 @@ struct PMTraceConsumer
     void HandleWin7DxgkMMIOFlip(EVENT_RECORD* pEventRecord);
 
     void AddTrackedProcessForFiltering(uint32_t processID);
+    void AddTrackedProcessNameForFiltering(char const* processName);
     void RemoveTrackedProcessForFiltering(uint32_t processID);
-    bool IsProcessTrackedForFiltering(uint32_t processID);
+    bool IsProcessTrackedForFiltering(EVENT_HEADER const& hdr) const;
+    bool IsTrackedProcessName(char const* processName) const;
+    void UpdateProcessTrackedByName(uint32_t processID, char const* processName);
+    void RemoveProcessTrackedByName(uint32_t processID);
 };
 
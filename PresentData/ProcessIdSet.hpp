@@ -0,0 +1,219 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// ProcessIdSet is the set of process ids PMTraceConsumer tracks when process
+// filtering is enabled.  It's checked against the header of nearly every
+// event before any of the event's properties are decoded, so Contains() never
+// takes a lock: it's a few acquire loads over an open-addressed table with
+// linear probing.
+//
+// Insert() and Erase() may be called from any thread.  They're serialized by
+// a mutex, which is fine since processes start and exit rarely compared to how
+// often events arrive.  Erase() can't shift later entries back without
+// confusing a concurrent reader, so it leaves a marker that probes continue
+// past and that a later Insert() reuses.  When live entries plus markers fill
+// the table, it's rebuilt into a new table (larger if needed) that is
+// published with a release store.  Earlier tables are kept until the set is
+// destroyed because a reader may still be probing one.
+//
+// Process ids 0xfffffffe and 0xffffffff are reserved.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+class ProcessIdSet {
+    enum : uint32_t {
+        EMPTY_SLOT  = 0xffffffffu,
+        ERASED_SLOT = 0xfffffffeu,
+        NO_INDEX    = 0xffffffffu,
+        INITIAL_CAPACITY = 64,
+    };
+
+    struct Table {
+        std::unique_ptr<std::atomic<uint32_t>[]> mSlots;
+        uint32_t mMask;
+        uint32_t mShift;        // 32 - log2(capacity)
+        uint32_t mUsedCount;    // Live ids plus erase markers; writer-only
+        uint32_t mCount;        // Live ids; writer-only
+
+        explicit Table(uint32_t capacity)
+            : mSlots(new std::atomic<uint32_t>[capacity])
+            , mMask(capacity - 1)
+            , mShift(32)
+            , mUsedCount(0)
+            , mCount(0)
+        {
+            assert((capacity & (capacity - 1)) == 0);
+            for (uint32_t i = 0; i < capacity; ++i) {
+                mSlots[i].store(EMPTY_SLOT, std::memory_order_relaxed);
+            }
+            for (auto c = capacity; c > 1; c >>= 1) {
+                mShift -= 1;
+            }
+        }
+
+        // Process ids are multiples of 4, so use the top bits of a Fibonacci
+        // multiply instead of the low bits.
+        uint32_t HomeIndex(uint32_t id) const
+        {
+            return mShift == 32 ? 0 : (id * 0x9E3779B1u) >> mShift;
+        }
+
+        uint32_t NextIndex(uint32_t i) const
+        {
+            return (i + 1) & mMask;
+        }
+
+        // Keep at least a quarter of the slots empty so probes stay short and
+        // always terminate.
+        bool IsFull(uint32_t usedCount) const
+        {
+            return usedCount * 4 > (mMask + 1) * 3;
+        }
+    };
+
+    std::atomic<Table*> mTable;
+    std::vector<std::unique_ptr<Table>> mTables;    // mTables.back() is mTable
+    std::mutex mWriteMutex;
+
+    // Requires mWriteMutex.  Returns the new table.
+    Table* Rebuild(uint32_t count)
+    {
+        auto old = mTables.back().get();
+        auto capacity = old->mMask + 1;
+        while (count * 2 > capacity) {
+            capacity *= 2;
+        }
+
+        std::unique_ptr<Table> table(new Table(capacity));
+        for (uint32_t i = 0; i <= old->mMask; ++i) {
+            auto id = old->mSlots[i].load(std::memory_order_relaxed);
+            if (id != EMPTY_SLOT && id != ERASED_SLOT) {
+                auto j = table->HomeIndex(id);
+                while (table->mSlots[j].load(std::memory_order_relaxed) != EMPTY_SLOT) {
+                    j = table->NextIndex(j);
+                }
+                table->mSlots[j].store(id, std::memory_order_relaxed);
+                table->mUsedCount += 1;
+                table->mCount += 1;
+            }
+        }
+
+        auto result = table.get();
+        mTables.emplace_back(std::move(table));
+        mTable.store(result, std::memory_order_release);
+        return result;
+    }
+
+public:
+    ProcessIdSet()
+    {
+        mTables.emplace_back(new Table(INITIAL_CAPACITY));
+        mTable.store(mTables.back().get(), std::memory_order_release);
+    }
+
+    ProcessIdSet(ProcessIdSet const&) = delete;
+    ProcessIdSet& operator=(ProcessIdSet const&) = delete;
+
+    bool Contains(uint32_t id) const
+    {
+        auto table = mTable.load(std::memory_order_acquire);
+        for (auto i = table->HomeIndex(id); ; i = table->NextIndex(i)) {
+            auto slot = table->mSlots[i].load(std::memory_order_acquire);
+            if (slot == id) {
+                return true;
+            }
+            if (slot == EMPTY_SLOT) {
+                return false;
+            }
+        }
+    }
+
+    // Returns false if id was already in the set.
+    bool Insert(uint32_t id)
+    {
+        assert(id != EMPTY_SLOT && id != ERASED_SLOT);
+
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        auto table = mTables.back().get();
+
+        auto reuseIndex = (uint32_t) NO_INDEX;
+        auto i = table->HomeIndex(id);
+        for (;; i = table->NextIndex(i)) {
+            auto slot = table->mSlots[i].load(std::memory_order_relaxed);
+            if (slot == id) {
+                return false;
+            }
+            if (slot == EMPTY_SLOT) {
+                break;
+            }
+            if (slot == ERASED_SLOT && reuseIndex == NO_INDEX) {
+                reuseIndex = i;
+            }
+        }
+
+        if (reuseIndex != NO_INDEX) {
+            table->mSlots[reuseIndex].store(id, std::memory_order_release);
+            table->mCount += 1;
+            return true;
+        }
+
+        if (table->IsFull(table->mUsedCount + 1)) {
+            table = Rebuild(table->mCount + 1);
+            for (i = table->HomeIndex(id); table->mSlots[i].load(std::memory_order_relaxed) != EMPTY_SLOT; i = table->NextIndex(i)) {
+            }
+        }
+
+        table->mSlots[i].store(id, std::memory_order_release);
+        table->mUsedCount += 1;
+        table->mCount += 1;
+        return true;
+    }
+
+    // Returns false if id wasn't in the set.
+    bool Erase(uint32_t id)
+    {
+        assert(id != EMPTY_SLOT && id != ERASED_SLOT);
+
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        auto table = mTables.back().get();
+
+        for (auto i = table->HomeIndex(id); ; i = table->NextIndex(i)) {
+            auto slot = table->mSlots[i].load(std::memory_order_relaxed);
+            if (slot == id) {
+                table->mSlots[i].store(ERASED_SLOT, std::memory_order_release);
+                table->mCount -= 1;
+                return true;
+            }
+            if (slot == EMPTY_SLOT) {
+                return false;
+            }
+        }
+    }
+};
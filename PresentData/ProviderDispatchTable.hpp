@@ -0,0 +1,144 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// ProviderDispatchTable maps the ETW providers a session enabled to the
+// function that handles their events.  It is indexed by a perfect hash of the
+// first 32 bits of the provider GUID (i.e., GUID::Data1), which Build() finds
+// by trying multipliers until every provider lands in its own slot, so Find()
+// is a multiply, a shift, one load, and a full GUID compare no matter which
+// provider (or how many providers) the event is from.  Events from providers
+// that weren't added either land in an empty slot or fail the compare.
+//
+// If there is no perfect hash (two providers have the same Data1, or there
+// are more than 64 providers), the table falls back to a binary search over
+// the full GUIDs instead, so any set of providers can be dispatched.
+//
+// Guid only needs a 32-bit Data1 member, so this file has no platform
+// dependencies.
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+template<typename Guid, typename Handler>
+class ProviderDispatchTable {
+public:
+    enum {
+        MAX_BITS = 6,           // Up to 64 slots
+        MAX_ATTEMPTS = 4096,    // Multipliers tried for each table size
+    };
+
+    struct Entry {
+        Guid mProviderId;
+        Handler mHandler;
+    };
+
+private:
+    Entry mEntries[1 << MAX_BITS];
+    uint32_t mMultiplier;
+    uint32_t mShift;
+    std::vector<Entry> mSortedEntries;  // Only used if there's no perfect hash
+
+    uint32_t Slot(Guid const& providerId) const
+    {
+        return ((uint32_t) providerId.Data1 * mMultiplier) >> mShift;
+    }
+
+    static bool Less(Entry const& entry, Guid const& providerId)
+    {
+        return memcmp(&entry.mProviderId, &providerId, sizeof(Guid)) < 0;
+    }
+
+    Handler FindSorted(Guid const& providerId) const
+    {
+        auto ii = std::lower_bound(mSortedEntries.begin(), mSortedEntries.end(), providerId, &Less);
+        return ii != mSortedEntries.end() && memcmp(&ii->mProviderId, &providerId, sizeof(Guid)) == 0 ? ii->mHandler : Handler();
+    }
+
+public:
+    ProviderDispatchTable()
+        : mEntries()
+        , mMultiplier(0)
+        , mShift(31)
+    {
+    }
+
+    // Returns false if there are too many entries or no perfect hash was
+    // found (e.g., two entries have the same Data1).  The table still works
+    // in that case, but Find() uses the slower binary search.  Each provider
+    // should only be added once.
+    bool Build(Entry const* entries, uint32_t entryCount)
+    {
+        *this = ProviderDispatchTable();
+
+        uint32_t bits = 0;
+        while ((1u << bits) < entryCount) {
+            bits += 1;
+        }
+
+        for (; bits <= MAX_BITS; ++bits) {
+            mShift = bits == 0 ? 31 : 32 - bits;
+            for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+                // Keep the multiplier odd so no Data1 bits are discarded.
+                mMultiplier = bits == 0 ? 0 : 0x9E3779B1u + attempt * 0x6C8E9CF6u;
+
+                uint64_t used = 0;
+                uint32_t i = 0;
+                for (; i < entryCount; ++i) {
+                    auto bit = 1ull << Slot(entries[i].mProviderId);
+                    if (used & bit) {
+                        break;
+                    }
+                    used |= bit;
+                }
+
+                if (i == entryCount) {
+                    for (i = 0; i < entryCount; ++i) {
+                        mEntries[Slot(entries[i].mProviderId)] = entries[i];
+                    }
+                    return true;
+                }
+            }
+        }
+
+        *this = ProviderDispatchTable();
+        mSortedEntries.assign(entries, entries + entryCount);
+        std::sort(mSortedEntries.begin(), mSortedEntries.end(), [](Entry const& a, Entry const& b) {
+            return Less(a, b.mProviderId);
+        });
+        return false;
+    }
+
+    // Returns Handler() (e.g., nullptr) if the provider wasn't added.
+    Handler Find(Guid const& providerId) const
+    {
+        if (!mSortedEntries.empty()) {
+            return FindSorted(providerId);
+        }
+
+        auto const& entry = mEntries[Slot(providerId)];
+        return memcmp(&entry.mProviderId, &providerId, sizeof(Guid)) == 0 ? entry.mHandler : Handler();
+    }
+};
@@ -0,0 +1,244 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// SpscRing is a single-producer/single-consumer queue used to hand analyzed
+// events from the ETW consumer thread to the output thread.  The consumer
+// thread runs at THREAD_PRIORITY_TIME_CRITICAL and must keep up with ETW, so
+// Push() never waits on the output thread and never takes a lock: it writes
+// into a fixed-size ring and publishes the new tail with a release store, and
+// the reader does the same with the head.
+//
+// When the ring is full the configured overflow policy is applied:
+//
+//   Drop:  the new item is discarded and counted.
+//   Spill: the producer links a new ring segment after the full one and
+//          continues there.  The reader moves on to the new segment once it
+//          has drained the full one, so items are still delivered in push
+//          order, and the drained segment is kept as a spare for the next
+//          overflow.  A segment is only allocated if the reader falls a full
+//          ring behind and no spare is available.
+//
+// Push() must only be called from one thread, and PopAll() from one (other)
+// thread.  GetStats() can be called from any thread.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+enum class SpscOverflowPolicy {
+    Drop,
+    Spill,
+};
+
+struct SpscRingStats {
+    uint64_t Pushed;        // Items accepted, including spilled items
+    uint64_t Spilled;       // Times the ring was full and a new segment was linked
+    uint64_t Dropped;       // Items discarded because the ring was full
+    uint32_t HighWater;     // Most items ever waiting in one segment
+    uint32_t Capacity;      // Items per segment
+};
+
+template<typename T>
+class SpscRing {
+    enum { CACHE_LINE_SIZE = 64 };
+
+    struct Slot {
+        alignas(T) unsigned char mStorage[sizeof(T)];
+    };
+
+    struct Segment {
+        std::unique_ptr<Slot[]> mSlots;
+
+        // Producer-owned.  mTail is the next slot to write, and mNext is set
+        // once the producer has moved on to a later segment.
+        char mPad0[CACHE_LINE_SIZE];
+        std::atomic<uint32_t> mTail;
+        std::atomic<Segment*> mNext;
+
+        // Consumer-owned.  The consumer only writes mHead once per PopAll(),
+        // so the producer reading it on every Push() is almost always a
+        // cache hit.
+        char mPad1[CACHE_LINE_SIZE];
+        std::atomic<uint32_t> mHead;
+
+        explicit Segment(uint32_t size)
+            : mSlots(new Slot[size])
+            , mTail(0)
+            , mNext(nullptr)
+            , mHead(0)
+        {
+        }
+    };
+
+    // Read-only after construction
+    uint32_t mMask;
+    SpscOverflowPolicy mPolicy;
+
+    // Producer-owned
+    char mPad0[CACHE_LINE_SIZE];
+    Segment* mProducerSegment;
+    std::atomic<uint64_t> mPushed;
+    std::atomic<uint64_t> mSpilled;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<uint32_t> mHighWater;
+
+    // Consumer-owned
+    char mPad1[CACHE_LINE_SIZE];
+    Segment* mConsumerSegment;
+
+    // A drained segment, handed from the consumer back to the producer.
+    char mPad2[CACHE_LINE_SIZE];
+    std::atomic<Segment*> mSpareSegment;
+
+    T* SlotPtr(Segment* segment, uint32_t index) const
+    {
+        return reinterpret_cast<T*>(segment->mSlots[index & mMask].mStorage);
+    }
+
+public:
+    // capacity is rounded up to a power of two.
+    SpscRing(uint32_t capacity, SpscOverflowPolicy policy)
+        : mPolicy(policy)
+        , mPushed(0)
+        , mSpilled(0)
+        , mDropped(0)
+        , mHighWater(0)
+        , mSpareSegment(nullptr)
+    {
+        uint32_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mMask = size - 1;
+        mProducerSegment = new Segment(size);
+        mConsumerSegment = mProducerSegment;
+    }
+
+    ~SpscRing()
+    {
+        for (auto segment = mConsumerSegment; segment != nullptr; ) {
+            for (auto i = segment->mHead.load(), n = segment->mTail.load(); i != n; ++i) {
+                SlotPtr(segment, i)->~T();
+            }
+            auto next = segment->mNext.load();
+            delete segment;
+            segment = next;
+        }
+        delete mSpareSegment.load();
+    }
+
+    SpscRing(SpscRing const&) = delete;
+    SpscRing& operator=(SpscRing const&) = delete;
+
+    // Producer thread only.  Returns false if the item was dropped.
+    template<typename U>
+    bool Push(U&& item)
+    {
+        auto segment = mProducerSegment;
+        auto tail = segment->mTail.load(std::memory_order_relaxed);
+        auto count = tail - segment->mHead.load(std::memory_order_acquire);
+        if (count > mMask) {
+            if (mPolicy == SpscOverflowPolicy::Drop) {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            // The consumer resets a spare segment before handing it back, so
+            // it can be used as is.
+            auto next = mSpareSegment.exchange(nullptr, std::memory_order_acquire);
+            if (next == nullptr) {
+                next = new Segment(mMask + 1);
+            }
+            segment->mNext.store(next, std::memory_order_release);
+            mProducerSegment = next;
+            segment = next;
+            tail = 0;
+            count = 0;
+            mSpilled.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        new (SlotPtr(segment, tail)) T(std::forward<U>(item));
+        segment->mTail.store(tail + 1, std::memory_order_release);
+
+        if (count + 1 > mHighWater.load(std::memory_order_relaxed)) {
+            mHighWater.store(count + 1, std::memory_order_relaxed);
+        }
+        mPushed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer thread only.  Appends every queued item to out, in push order,
+    // and returns how many were appended.
+    size_t PopAll(std::vector<T>& out)
+    {
+        auto start = out.size();
+
+        for (auto segment = mConsumerSegment; ; ) {
+            // Read mNext before the tail: if it was set, the producer has
+            // moved on, and every item it put in this segment is visible
+            // below.
+            auto next = segment->mNext.load(std::memory_order_acquire);
+
+            auto head = segment->mHead.load(std::memory_order_relaxed);
+            auto tail = segment->mTail.load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                auto item = SlotPtr(segment, head);
+                out.emplace_back(std::move(*item));
+                item->~T();
+            }
+            segment->mHead.store(head, std::memory_order_release);
+
+            if (next == nullptr) {
+                break;
+            }
+
+            // The producer no longer touches this segment, so reset it and
+            // offer it back as a spare.
+            mConsumerSegment = next;
+            segment->mHead.store(0, std::memory_order_relaxed);
+            segment->mTail.store(0, std::memory_order_relaxed);
+            segment->mNext.store(nullptr, std::memory_order_relaxed);
+            delete mSpareSegment.exchange(segment, std::memory_order_release);
+            segment = next;
+        }
+
+        return out.size() - start;
+    }
+
+    SpscRingStats GetStats() const
+    {
+        SpscRingStats stats;
+        stats.Pushed    = mPushed.load(std::memory_order_relaxed);
+        stats.Spilled   = mSpilled.load(std::memory_order_relaxed);
+        stats.Dropped   = mDropped.load(std::memory_order_relaxed);
+        stats.HighWater = mHighWater.load(std::memory_order_relaxed);
+        stats.Capacity  = mMask + 1;
+        return stats;
+    }
+};
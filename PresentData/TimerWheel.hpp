@@ -0,0 +1,202 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// TimerWheel is a hashed timing wheel: items are scheduled with an absolute
+// deadline (e.g., a QPC timestamp) and handed back by Advance() once time
+// has moved past it.  Scheduling and expiring are O(1) per item, and
+// Advance() is a single compare when no tick boundary has been crossed, so it
+// is cheap enough to call for every event.
+//
+// Time is divided into ticks of a fixed duration and each tick maps to one of
+// SlotCount slots.  Deadlines further out than one rotation share a slot with
+// nearer ones and are simply kept when the slot is visited early.  Items are
+// expired at most one tick late.
+//
+// The wheel doesn't support cancellation; callers store something they can
+// validate on expiry (e.g., a PoolHandle) and ignore stale items.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class TimerWheel {
+    struct Item {
+        uint64_t mDeadline;
+        T mValue;
+    };
+
+    std::vector<std::vector<Item>> mSlots;
+    std::vector<T> mExpiring;   // Scratch space for VisitNextSlot()
+    uint64_t mTickDuration;
+    uint64_t mNextTick;         // First tick whose slot hasn't been visited yet
+    uint64_t mNextTickTime;     // Time at which mNextTick is complete, i.e. (mNextTick + 1) * mTickDuration
+    size_t mSize;
+
+    std::vector<Item>& Slot(uint64_t tick) { return mSlots[tick & (mSlots.size() - 1)]; }
+
+    // Visit the slot for mNextTick.  Items with a deadline before 'time' are
+    // passed to expire(), the rest are kept for a later rotation.
+    template<typename ExpireFn>
+    void VisitNextSlot(uint64_t time, ExpireFn& expire)
+    {
+        auto& slot = Slot(mNextTick);
+        mNextTick += 1;
+        mNextTickTime += mTickDuration;
+
+        // expire() may Schedule() new items, possibly into this slot, so
+        // expire a copy of the due items after compacting the slot.
+        size_t keep = 0;
+        size_t due = slot.size();
+        for (size_t i = 0; i < due; ++i) {
+            if (slot[i].mDeadline < time) {
+                mExpiring.emplace_back(std::move(slot[i].mValue));
+            } else {
+                if (keep != i) slot[keep] = std::move(slot[i]);
+                keep += 1;
+            }
+        }
+        slot.resize(keep);
+
+        mSize -= mExpiring.size();
+        for (auto& value : mExpiring) {
+            expire(value);
+        }
+        mExpiring.clear();
+    }
+
+public:
+    TimerWheel()
+        : mTickDuration(1)
+        , mNextTick(0)
+        , mNextTickTime(1)
+        , mSize(0)
+    {
+        mSlots.resize(1);
+    }
+
+    // Set the tick duration and slot count (rounded up to a power of two).
+    // A rotation (tickDuration * slotCount) should cover the typical
+    // deadline distance to avoid revisiting items.  Must be called while the
+    // wheel is empty.
+    void Initialize(uint64_t tickDuration, uint32_t slotCount, uint64_t startTime = 0)
+    {
+        assert(mSize == 0);
+        assert(tickDuration > 0);
+
+        uint32_t count = 1;
+        while (count < slotCount) {
+            count <<= 1;
+        }
+
+        mSlots.clear();
+        mSlots.resize(count);
+        mTickDuration = tickDuration;
+        mNextTick = startTime / tickDuration;
+        mNextTickTime = (mNextTick + 1) * tickDuration;
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    uint64_t TickDuration() const { return mTickDuration; }
+    // Advance() does nothing for times before this.
+    uint64_t NextTickTime() const { return mNextTickTime; }
+
+    void Schedule(uint64_t deadline, T const& value)
+    {
+        // Deadlines in already-visited ticks go in the next slot to visit.
+        auto tick = deadline / mTickDuration;
+        if (tick < mNextTick) {
+            tick = mNextTick;
+        }
+        Item item = { deadline, value };
+        Slot(tick).emplace_back(item);
+        mSize += 1;
+    }
+
+    // Expire every item whose deadline is before the start of the tick
+    // containing 'time'.  expire(T&) is called for each.
+    template<typename ExpireFn>
+    void Advance(uint64_t time, ExpireFn&& expire)
+    {
+        if (time < mNextTickTime) {
+            return;
+        }
+
+        // If time jumped by more than a rotation, visit every slot once and
+        // skip ahead.
+        auto tick = time / mTickDuration;
+        if (tick - mNextTick > mSlots.size()) {
+            for (size_t i = 0, n = mSlots.size(); i < n; ++i) {
+                VisitNextSlot(tick * mTickDuration, expire);
+            }
+            mNextTick = tick;
+            mNextTickTime = (tick + 1) * mTickDuration;
+            return;
+        }
+
+        while (mNextTick < tick) {
+            VisitNextSlot(tick * mTickDuration, expire);
+        }
+    }
+
+    // Expire the one item with the earliest deadline, regardless of the
+    // time, without advancing the wheel.  This lets a caller enforce a
+    // capacity limit by evicting the oldest items, only as many as needed.
+    // Returns false if the wheel is empty.
+    //
+    // Each item is in the slot for its deadline's tick, or in the next slot
+    // to visit if that tick was already visited, so the earliest item is in
+    // the first slot from there on that has an item due in that slot's
+    // rotation.  Items in a later rotation are skipped.
+    template<typename ExpireFn>
+    bool ExpireEarliest(ExpireFn&& expire)
+    {
+        if (mSize == 0) {
+            return false;
+        }
+
+        for (auto tick = mNextTick; ; ++tick) {
+            auto& slot = Slot(tick);
+            auto earliest = slot.size();
+            for (size_t i = 0, n = slot.size(); i < n; ++i) {
+                if (slot[i].mDeadline / mTickDuration <= tick &&
+                    (earliest == slot.size() || slot[i].mDeadline < slot[earliest].mDeadline)) {
+                    earliest = i;
+                }
+            }
+
+            if (earliest != slot.size()) {
+                auto value = std::move(slot[earliest].mValue);
+                slot.erase(slot.begin() + earliest);
+                mSize -= 1;
+                expire(value);
+                return true;
+            }
+        }
+    }
+};
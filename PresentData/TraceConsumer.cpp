@@ -146,6 +146,43 @@ void GetPropertySize(TRACE_EVENT_INFO const& tei, EVENT_RECORD const& eventRecor
     *outCount = count;
 }
 
+// Returns the element size of the property if it is the same for every event
+// with this metadata and pointer size, or 0 if it depends on the event data.
+uint32_t GetFixedPropertySize(TRACE_EVENT_INFO const& tei, uint32_t index, uint32_t pointerSize)
+{
+    auto const& epi = tei.EventPropertyInfoArray[index];
+    if (epi.Flags & (PropertyParamCount | PropertyParamLength)) {
+        return 0;
+    }
+
+    uint32_t size = epi.length;
+    if (epi.Flags & PropertyStruct) {
+        size = 0;
+        for (USHORT i = 0; i < epi.structType.NumOfStructMembers; ++i) {
+            auto memberIndex = epi.structType.StructStartIndex + i;
+            auto memberSize = GetFixedPropertySize(tei, memberIndex, pointerSize);
+            if (memberSize == 0) {
+                return 0;
+            }
+            size += memberSize * tei.EventPropertyInfoArray[memberIndex].count;
+        }
+    } else {
+        switch (epi.nonStructType.InType) {
+        case TDH_INTYPE_UNICODESTRING:
+        case TDH_INTYPE_ANSISTRING:
+        case TDH_INTYPE_WBEMSID:
+            return 0;
+
+        case TDH_INTYPE_POINTER:
+        case TDH_INTYPE_SIZET:
+            size = pointerSize;
+            break;
+        }
+    }
+
+    return size;
+}
+
 uint32_t GetPropertyDataOffset(TRACE_EVENT_INFO const& tei, EVENT_RECORD const& eventRecord, uint32_t index)
 {
     assert(index < tei.TopLevelPropertyCount);
@@ -160,7 +197,7 @@ uint32_t GetPropertyDataOffset(TRACE_EVENT_INFO const& tei, EVENT_RECORD const&
     return offset;
 }
 
-TRACE_EVENT_INFO* GetTraceEventInfo(EventMetadata* metadata, EVENT_RECORD* eventRecord)
+EventMetadataEntry* GetMetadataEntry(EventMetadata* metadata, EVENT_RECORD* eventRecord)
 {
     // Look up stored metadata
     EventMetadataKey key;
@@ -174,13 +211,76 @@ TRACE_EVENT_INFO* GetTraceEventInfo(EventMetadata* metadata, EVENT_RECORD* event
         auto status = TdhGetEventInformation(eventRecord, 0, nullptr, nullptr, &bufferSize);
         assert(status == ERROR_INSUFFICIENT_BUFFER);
 
-        ii = metadata->metadata_.emplace(key, std::vector<uint8_t>(bufferSize, 0)).first;
+        ii = metadata->metadata_.emplace(key, EventMetadataEntry()).first;
+        ii->second.tei_.resize(bufferSize, 0);
 
-        status = TdhGetEventInformation(eventRecord, 0, nullptr, (TRACE_EVENT_INFO*) ii->second.data(), &bufferSize);
+        status = TdhGetEventInformation(eventRecord, 0, nullptr, (TRACE_EVENT_INFO*) ii->second.tei_.data(), &bufferSize);
         assert(status == ERROR_SUCCESS);
     }
 
-    return (TRACE_EVENT_INFO*) ii->second.data();
+    return &ii->second;
+}
+
+// Find the property by name and work out as much of its location as doesn't
+// depend on the event data.  This is only done the first time each property
+// is requested for each event type.
+EventPropertyPlan BuildPropertyPlan(TRACE_EVENT_INFO const& tei, wchar_t const* name)
+{
+    EventPropertyPlan plan = {};
+    plan.name_ = name;
+    plan.lastName_ = name;
+    plan.index_ = UINT32_MAX;
+
+    uint32_t offset[2] = { 0, 0 };
+    for (uint32_t i = 0; i < tei.TopLevelPropertyCount; ++i) {
+        auto const& epi = tei.EventPropertyInfoArray[i];
+        uint32_t size[2] = {
+            GetFixedPropertySize(tei, i, 4),
+            GetFixedPropertySize(tei, i, 8),
+        };
+
+        if (wcscmp(TEI_PROPERTY_NAME(&tei, &epi), name) == 0) {
+            plan.index_ = i;
+            plan.count_ = epi.count;
+            plan.status_ = PROP_STATUS_FOUND;
+            if ((epi.Flags & PropertyStruct) == 0 &&
+                (epi.nonStructType.InType == TDH_INTYPE_POINTER || epi.nonStructType.InType == TDH_INTYPE_SIZET)) {
+                plan.status_ |= PROP_STATUS_POINTER_SIZE;
+            }
+            for (uint32_t j = 0; j < 2; ++j) {
+                plan.offset_[j] = offset[j];
+                plan.size_[j] = offset[j] == UINT32_MAX ? 0 : size[j];
+            }
+            break;
+        }
+
+        for (uint32_t j = 0; j < 2; ++j) {
+            offset[j] = (offset[j] == UINT32_MAX || size[j] == 0) ? UINT32_MAX : offset[j] + size[j] * epi.count;
+        }
+    }
+
+    return plan;
+}
+
+EventPropertyPlan const* GetPropertyPlan(EventMetadataEntry* entry, wchar_t const* name)
+{
+    // The address only identifies the name if the buffer hasn't been reused
+    // for a different name since, so it's confirmed by comparing too.
+    for (auto const& plan : entry->plans_) {
+        if (plan.lastName_ == name && wcscmp(plan.name_.c_str(), name) == 0) {
+            return &plan;
+        }
+    }
+
+    for (auto& plan : entry->plans_) {
+        if (wcscmp(plan.name_.c_str(), name) == 0) {
+            plan.lastName_ = name;
+            return &plan;
+        }
+    }
+
+    entry->plans_.emplace_back(BuildPropertyPlan(*(TRACE_EVENT_INFO const*) entry->tei_.data(), name));
+    return &entry->plans_.back();
 }
 
 }
@@ -215,43 +315,91 @@ void EventMetadata::AddMetadata(EVENT_RECORD* eventRecord)
         EventMetadataKey key;
         key.guid_ = tei->ProviderGuid;
         key.desc_ = tei->EventDescriptor;
-        metadata_[key].assign(userData, userData + eventRecord->UserDataLength);
+        SetMetadata(key, userData, eventRecord->UserDataLength);
+    }
+}
+
+void EventMetadata::SetMetadata(EventMetadataKey const& key, uint8_t const* tei, size_t teiSize)
+{
+    auto& entry = metadata_[key];
+    entry.tei_.assign(tei, tei + teiSize);
+    entry.plans_.clear();
+    entry.layout_ = nullptr;
+}
+
+bool EventMetadata::MatchesLayout(EVENT_RECORD* eventRecord, EventFieldLayout const* fields, uint32_t fieldCount)
+{
+    auto entry = GetMetadataEntry(this, eventRecord);
+    if (entry->layout_ != fields) {
+        entry->layout_ = fields;
+        entry->layoutMatches_ = true;
+        for (uint32_t i = 0; i < fieldCount && entry->layoutMatches_; ++i) {
+            auto plan = GetPropertyPlan(entry, fields[i].name_);
+            for (uint32_t j = 0; j < 2; ++j) {
+                if (plan->index_ == UINT32_MAX ||
+                    plan->offset_[j] != fields[i].offset_[j] ||
+                    plan->size_[j] * plan->count_ != fields[i].size_[j]) {
+                    entry->layoutMatches_ = false;
+                }
+            }
+        }
+    }
+    return entry->layoutMatches_;
+}
+
+void EventMetadata::CopyToLayout(EVENT_RECORD* eventRecord, EventFieldLayout const* fields, uint32_t fieldCount, void* data)
+{
+    for (uint32_t i = 0; i < fieldCount; ++i) {
+        EventDataDesc desc = { fields[i].name_, };
+        GetEventData(eventRecord, &desc, 1, 1);
+        if (desc.status_ & PROP_STATUS_FOUND) {
+            // A 32-bit pointer is zero-extended into the 64-bit field.
+            auto size = desc.size_ < fields[i].size_[1] ? desc.size_ : fields[i].size_[1];
+            memcpy((uint8_t*) data + fields[i].offset_[1], desc.data_, size);
+        }
     }
 }
 
 // Look up metadata for this provider/event and use it to look up the property.
 // If the metadata isn't found look it up using TDH.  Then, look up each
-// property in the metadata to obtain it's data pointer and size.
+// property's plan to obtain it's data pointer and size, only walking the
+// event data when the plan says the location varies by event.
 void EventMetadata::GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc, uint32_t descCount, uint32_t optionalCount /*=0*/)
 {
     // Look up metadata
-    auto tei = GetTraceEventInfo(this, eventRecord);
+    auto entry = GetMetadataEntry(this, eventRecord);
+    auto tei = (TRACE_EVENT_INFO const*) entry->tei_.data();
+    auto is64 = (eventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0 ? 1 : 0;
 
     // Lookup properties in metadata
     uint32_t foundCount = 0;
-    for (uint32_t i = 0, offset = 0; i < tei->TopLevelPropertyCount; ++i) {
-        uint32_t size   = 0;
-        uint32_t count  = 0;
-        uint32_t status = PROP_STATUS_FOUND;
-        GetPropertySize(*tei, *eventRecord, i, offset, &size, &count, &status);
-
-        auto propName = TEI_PROPERTY_NAME(tei, &tei->EventPropertyInfoArray[i]);
-        for (uint32_t j = 0; j < descCount; ++j) {
-            if (desc[j].status_ == PROP_STATUS_NOT_FOUND && wcscmp(propName, desc[j].name_) == 0) {
-                assert(desc[j].arrayIndex_ < count);
-
-                desc[j].data_   = (void*) ((uintptr_t) eventRecord->UserData + (offset + desc[j].arrayIndex_ * size));
-                desc[j].size_   = size;
-                desc[j].status_ = status;
-
-                foundCount += 1;
-                if (foundCount == descCount) {
-                    return;
-                }
+    for (uint32_t j = 0; j < descCount; ++j) {
+        auto plan = GetPropertyPlan(entry, desc[j].name_);
+        if (plan->index_ == UINT32_MAX) {
+            continue;
+        }
+
+        auto offset = plan->offset_[is64];
+        auto size   = plan->size_[is64];
+        auto count  = plan->count_;
+        auto status = plan->status_;
+        if (size == 0) {
+            if (offset == UINT32_MAX) {
+                offset = GetPropertyDataOffset(*tei, *eventRecord, plan->index_);
             }
+            status = PROP_STATUS_FOUND;
+            GetPropertySize(*tei, *eventRecord, plan->index_, offset, &size, &count, &status);
         }
 
-        offset += size * count;
+        // An empty array is found, with count_ == 0, if its start is requested
+        assert(desc[j].arrayIndex_ < count || desc[j].arrayIndex_ == 0);
+
+        desc[j].data_   = (void*) ((uintptr_t) eventRecord->UserData + (offset + desc[j].arrayIndex_ * size));
+        desc[j].size_   = size;
+        desc[j].status_ = status;
+        desc[j].count_  = count - desc[j].arrayIndex_;
+
+        foundCount += 1;
     }
 
     assert(foundCount >= descCount - optionalCount);
@@ -21,9 +21,11 @@ SOFTWARE.
 */
 #pragma once
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <string.h>
 #include <unordered_map>
 #include <vector>
 #include <windows.h>
@@ -46,17 +48,39 @@ enum PropertyStatus {
     PROP_STATUS_POINTER_SIZE    = 1 << 4,
 };
 
+// A strided view of an array property's elements in the event data.  A
+// 32-bit pointer/size_t element is promoted to u64, as with
+// EventDataDesc::GetData().
+template<typename T>
+struct EventDataArray {
+    uint8_t const* data_;   // Pointer to the first element
+    uint32_t stride_;       // Size of each element
+    uint32_t count_;        // Number of elements
+
+    uint32_t size() const { return count_; }
+
+    T operator[](uint32_t index) const
+    {
+        assert(index < count_);
+        T t {};
+        memcpy(&t, data_ + index * stride_, stride_);
+        return t;
+    }
+};
+
 struct EventDataDesc {
     wchar_t const* name_;   // Property name
     uint32_t arrayIndex_;   // Array index (optional)
     void* data_;            // OUT pointer to property data
     uint32_t size_;         // OUT size of property data
     uint32_t status_;       // OUT PropertyStatus result of search
+    uint32_t count_;        // OUT number of array elements from arrayIndex_ on
 
     template<typename T> T GetData() const
     {
         assert(status_ & PROP_STATUS_FOUND);
         assert(data_ != nullptr);
+        assert(count_ > 0);
 
         // Expect the correct size, except allow 32-bit pointer/size_t to promote to u64
         assert(
@@ -67,15 +91,66 @@ struct EventDataDesc {
         memcpy(&t, data_, size_);
         return t;
     }
+
+    // Returns the array elements from arrayIndex_ on.
+    template<typename T> EventDataArray<T> GetArray() const
+    {
+        assert(status_ & PROP_STATUS_FOUND);
+        assert(
+            size_ == sizeof(T) ||
+            ((status_ & PROP_STATUS_POINTER_SIZE) != 0 && size_ == 4 && sizeof(T) == 8));
+
+        EventDataArray<T> a = { (uint8_t const*) data_, size_, count_ };
+        return a;
+    }
 };
 
 template<> std::string EventDataDesc::GetData<std::string>() const;
 template<> std::wstring EventDataDesc::GetData<std::wstring>() const;
 
+// Where to find a requested property in events with a given metadata.  Plans
+// are looked up by the address of EventDataDesc::name_ first, which is
+// usually the same string literal for every event, and then by comparing
+// the name.  The plan keeps its own copy of the name, so a name may be in a
+// temporary or reused buffer; a plan found by comparing remembers the new
+// address for next time.
+//
+// The layout only depends on the event data when a string, a count-driven
+// array, or similar precedes or is the property.  Otherwise the offset and
+// size are the same for every event (given the pointer size, which is why
+// there are two of each) and are used as is.
+struct EventPropertyPlan {
+    std::wstring name_;         // Requested property name
+    wchar_t const* lastName_;   // Address name_ was last requested with
+    uint32_t index_;            // Top-level property index, or UINT32_MAX if the event doesn't have it
+    uint32_t offset_[2];        // [64-bit header] Data offset, or UINT32_MAX if it varies by event
+    uint32_t size_[2];          // [64-bit header] Element size, or 0 if it varies by event
+    uint32_t count_;            // Element count (valid if size_ is)
+    uint32_t status_;           // PropertyStatus result (valid if size_ is)
+};
+
+// Where a generated event struct (see ETW/*.h) expects each of its fields to
+// be, for events with 32-bit and 64-bit pointers.
+struct EventFieldLayout {
+    wchar_t const* name_;   // Property name
+    uint32_t offset_[2];    // [64-bit header] Data offset
+    uint32_t size_[2];      // [64-bit header] Total field size
+};
+
+struct EventMetadataEntry {
+    std::vector<uint8_t> tei_;              // TRACE_EVENT_INFO
+    std::vector<EventPropertyPlan> plans_;  // Built on first lookup of each property
+    EventFieldLayout const* layout_;        // Last generated layout checked against tei_
+    bool layoutMatches_;                    // Whether tei_ matches layout_
+
+    EventMetadataEntry() : layout_(nullptr), layoutMatches_(false) {}
+};
+
 struct EventMetadata {
-    std::unordered_map<EventMetadataKey, std::vector<uint8_t>, EventMetadataKeyHash, EventMetadataKeyEqual> metadata_;
+    std::unordered_map<EventMetadataKey, EventMetadataEntry, EventMetadataKeyHash, EventMetadataKeyEqual> metadata_;
 
     void AddMetadata(EVENT_RECORD* eventRecord);
+    void SetMetadata(EventMetadataKey const& key, uint8_t const* tei, size_t teiSize);
     void GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc, uint32_t descCount, uint32_t optionalCount=0);
 
     template<typename T> T GetEventData(EVENT_RECORD* eventRecord, wchar_t const* name, uint32_t arrayIndex = 0)
@@ -84,4 +159,49 @@ struct EventMetadata {
         GetEventData(eventRecord, &desc, 1);
         return desc.GetData<T>();
     }
+
+    // Returns true if the event's metadata has every field in the generated
+    // layout at the expected offset and size.  The result is kept with the
+    // metadata, so the check is only done the first time each event type
+    // (i.e., provider, id, and version) is seen.
+    bool MatchesLayout(EVENT_RECORD* eventRecord, EventFieldLayout const* fields, uint32_t fieldCount);
+
+    // Looks each field up by name and copies it to data, which is laid out as
+    // the generated struct for 64-bit pointers.  Fields the event doesn't have
+    // are left as is.
+    void CopyToLayout(EVENT_RECORD* eventRecord, EventFieldLayout const* fields, uint32_t fieldCount, void* data);
+
+    // Calls fn with a pointer to the event data as the generated struct.  If
+    // the event's version doesn't match the generated layout, fn is instead
+    // called with a copy of the fields that were found by name.
+    template<template<typename> class EventStruct, size_t FieldCount, typename Fn>
+    void ReadEventStruct(EVENT_RECORD* eventRecord, EventFieldLayout const (&fields)[FieldCount], Fn fn)
+    {
+        if (MatchesLayout(eventRecord, fields, FieldCount)) {
+            if (eventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) {
+                assert(eventRecord->UserDataLength >= sizeof(EventStruct<uint64_t>));
+                fn((EventStruct<uint64_t> const*) eventRecord->UserData);
+            } else {
+                assert(eventRecord->UserDataLength >= sizeof(EventStruct<uint32_t>));
+                fn((EventStruct<uint32_t> const*) eventRecord->UserData);
+            }
+        } else {
+            EventStruct<uint64_t> data = {};
+            CopyToLayout(eventRecord, fields, FieldCount, &data);
+            fn((EventStruct<uint64_t> const*) &data);
+        }
+    }
+
+    template<typename EventStruct, size_t FieldCount, typename Fn>
+    void ReadEventStruct(EVENT_RECORD* eventRecord, EventFieldLayout const (&fields)[FieldCount], Fn fn)
+    {
+        if (MatchesLayout(eventRecord, fields, FieldCount)) {
+            assert(eventRecord->UserDataLength >= sizeof(EventStruct));
+            fn((EventStruct const*) eventRecord->UserData);
+        } else {
+            EventStruct data = {};
+            CopyToLayout(eventRecord, fields, FieldCount, &data);
+            fn((EventStruct const*) &data);
+        }
+    }
 };
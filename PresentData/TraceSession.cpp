@@ -22,14 +22,19 @@ SOFTWARE.
 
 #define WIN32_LEAN_AND_MEAN
 #define VC_EXTRALEAN
+#include <algorithm>
 #include <assert.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_set>
 #include <windows.h>
 #include <evntcons.h> // must include after windows.h
 
 #include "TraceSession.hpp"
 
 #include "Debug.hpp"
+#include "EventCapture.hpp"
 #include "PresentMonTraceConsumer.hpp"
 #include "MixedRealityTraceConsumer.hpp"
 
@@ -38,9 +43,70 @@ SOFTWARE.
 #include "ETW/Microsoft_Windows_DXGI.h"
 #include "ETW/Microsoft_Windows_DxgKrnl.h"
 #include "ETW/Microsoft_Windows_EventMetadata.h"
+#include "ETW/Microsoft_Windows_Kernel_Process.h"
 #include "ETW/Microsoft_Windows_Win32k.h"
 #include "ETW/NT_Process.h"
 
+struct TraceCapture {
+    EventCaptureWriter mWriter;
+    std::unordered_set<EventMetadataKey, EventMetadataKeyHash, EventMetadataKeyEqual> mMetadataWritten;
+    uint32_t mSkippedMetadataCount = 0;
+};
+
+void AddProviderEnable(
+    std::vector<ProviderEnable>* providers,
+    GUID const& providerId, UCHAR level,
+    ULONGLONG anyKeywordMask, ULONGLONG allKeywordMask,
+    std::vector<USHORT> const& eventIds)
+{
+    ProviderEnable* provider = nullptr;
+    for (auto& p : *providers) {
+        if (p.mProviderId == providerId) {
+            provider = &p;
+            break;
+        }
+    }
+
+    if (provider == nullptr) {
+        ProviderEnable newProvider;
+        newProvider.mProviderId = providerId;
+        newProvider.mLevel = level;
+        newProvider.mAnyKeywordMask = anyKeywordMask;
+        newProvider.mAllKeywordMask = allKeywordMask;
+        newProvider.mEventIds = eventIds;
+        providers->emplace_back(std::move(newProvider));
+        provider = &providers->back();
+    } else {
+        provider->mLevel = level > provider->mLevel ? level : provider->mLevel;
+        provider->mAnyKeywordMask = (provider->mAnyKeywordMask == 0 || anyKeywordMask == 0) ? 0 : (provider->mAnyKeywordMask | anyKeywordMask);
+        provider->mAllKeywordMask &= allKeywordMask;
+        if (!provider->mEventIds.empty()) {
+            if (eventIds.empty()) {
+                provider->mEventIds.clear();
+            } else {
+                for (auto id : eventIds) {
+                    if (std::find(provider->mEventIds.begin(), provider->mEventIds.end(), id) == provider->mEventIds.end()) {
+                        provider->mEventIds.push_back(id);
+                    }
+                }
+            }
+        }
+    }
+
+    // Without an id filter every event is enabled, so also drop the filter
+    // if it's too big for ETW.  Consumers still only get the events they
+    // asked for (see TraceSession::ConsumerProvider::WantsEvent()), but the
+    // session now collects all of this provider's events.
+    if (provider->mEventIds.size() > MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+        auto const& g = providerId;
+        fprintf(stderr, "warning: {%08lX-%04hX-%04hX-%02hhX%02hhX-%02hhX%02hhX%02hhX%02hhX%02hhX%02hhX} needs %zu event ids, more than an ETW filter can hold (%u); enabling all of its events.\n",
+            g.Data1, g.Data2, g.Data3,
+            g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3], g.Data4[4], g.Data4[5], g.Data4[6], g.Data4[7],
+            provider->mEventIds.size(), (uint32_t) MAX_EVENT_FILTER_EVENT_ID_COUNT);
+        provider->mEventIds.clear();
+    }
+}
+
 namespace {
 
 struct TraceProperties : public EVENT_TRACE_PROPERTIES {
@@ -51,7 +117,7 @@ ULONG EnableFilteredProvider(
     TRACEHANDLE sessionHandle,
     GUID const& sessionGuid, GUID const& providerGuid, UCHAR level,
     ULONGLONG anyKeywordMask, ULONGLONG allKeywordMask,
-    std::initializer_list<USHORT> const& eventIds)
+    std::vector<USHORT> const& eventIds)
 {
     assert(eventIds.size() >= ANYSIZE_ARRAY);
     assert(eventIds.size() <= MAX_EVENT_FILTER_EVENT_ID_COUNT);
@@ -91,36 +157,38 @@ ULONG EnableProviders(
     TRACEHANDLE sessionHandle,
     GUID const& sessionGuid,
     bool simple,
-    bool includeWinMR)
+    bool includeWinMR,
+    bool trackProcessesByName,
+    std::vector<TraceSession::ConsumerProvider> const& consumerProviders)
 {
+    std::vector<ProviderEnable> providers;
+
     // Microsoft_Windows_DXGI
     auto keywordMask =
         (uint64_t) Microsoft_Windows_DXGI::Keyword::Microsoft_Windows_DXGI_Analytic |
         (uint64_t) Microsoft_Windows_DXGI::Keyword::Events;
-    auto status = EnableFilteredProvider(sessionHandle, sessionGuid, Microsoft_Windows_DXGI::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
+    AddProviderEnable(&providers, Microsoft_Windows_DXGI::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
         Microsoft_Windows_DXGI::Present_Start::Id,
         Microsoft_Windows_DXGI::Present_Stop::Id,
         Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Start::Id,
         Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Stop::Id,
     });
-    if (status != ERROR_SUCCESS) return status;
 
     // Microsoft_Windows_D3D9
     keywordMask =
         (uint64_t) Microsoft_Windows_D3D9::Keyword::Microsoft_Windows_Direct3D9_Analytic |
         (uint64_t) Microsoft_Windows_D3D9::Keyword::Events;
-    status = EnableFilteredProvider(sessionHandle, sessionGuid, Microsoft_Windows_D3D9::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
+    AddProviderEnable(&providers, Microsoft_Windows_D3D9::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
         Microsoft_Windows_D3D9::Present_Start::Id,
         Microsoft_Windows_D3D9::Present_Stop::Id,
     });
-    if (status != ERROR_SUCCESS) return status;
 
     if (!simple) {
         // Microsoft_Windows_DxgKrnl
         keywordMask =
             (uint64_t) Microsoft_Windows_DxgKrnl::Keyword::Microsoft_Windows_DxgKrnl_Performance |
             (uint64_t) Microsoft_Windows_DxgKrnl::Keyword::Base;
-        status = EnableFilteredProvider(sessionHandle, sessionGuid, Microsoft_Windows_DxgKrnl::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
+        AddProviderEnable(&providers, Microsoft_Windows_DxgKrnl::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {
                 Microsoft_Windows_DxgKrnl::Blit_Info::Id,
                 Microsoft_Windows_DxgKrnl::Flip_Info::Id,
                 Microsoft_Windows_DxgKrnl::FlipMultiPlaneOverlay_Info::Id,
@@ -135,27 +203,23 @@ ULONG EnableProviders(
                 Microsoft_Windows_DxgKrnl::QueuePacket_Stop::Id,
                 Microsoft_Windows_DxgKrnl::VSyncDPC_Info::Id,
             });
-        if (status != ERROR_SUCCESS) return status;
 
-        status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_DxgKrnl::Win7::GUID, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                                TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, 0, nullptr);
-        if (status != ERROR_SUCCESS) return status;
+        AddProviderEnable(&providers, Microsoft_Windows_DxgKrnl::Win7::GUID, TRACE_LEVEL_INFORMATION, keywordMask, keywordMask, {});
 
         // Microsoft_Windows_Win32k
         keywordMask =
             (uint64_t) Microsoft_Windows_Win32k::Keyword::Updates |
             (uint64_t) Microsoft_Windows_Win32k::Keyword::Visualization |
             (uint64_t) Microsoft_Windows_Win32k::Keyword::Microsoft_Windows_Win32k_Tracing;
-        status = EnableFilteredProvider(sessionHandle, sessionGuid, Microsoft_Windows_Win32k::GUID, TRACE_LEVEL_INFORMATION, keywordMask,
+        AddProviderEnable(&providers, Microsoft_Windows_Win32k::GUID, TRACE_LEVEL_INFORMATION, keywordMask,
             (uint64_t) Microsoft_Windows_Win32k::Keyword::Updates |
             (uint64_t) Microsoft_Windows_Win32k::Keyword::Microsoft_Windows_Win32k_Tracing, {
             Microsoft_Windows_Win32k::TokenCompositionSurfaceObject_Info::Id,
             Microsoft_Windows_Win32k::TokenStateChanged_Info::Id,
         });
-        if (status != ERROR_SUCCESS) return status;
 
         // Microsoft_Windows_Dwm_Core
-        status = EnableFilteredProvider(sessionHandle, sessionGuid, Microsoft_Windows_Dwm_Core::GUID, TRACE_LEVEL_VERBOSE, 0, 0, {
+        AddProviderEnable(&providers, Microsoft_Windows_Dwm_Core::GUID, TRACE_LEVEL_VERBOSE, 0, 0, {
             Microsoft_Windows_Dwm_Core::MILEVENT_MEDIA_UCE_PROCESSPRESENTHISTORY_GetPresentHistory_Info::Id,
             Microsoft_Windows_Dwm_Core::SCHEDULE_PRESENT_Start::Id,
             Microsoft_Windows_Dwm_Core::SCHEDULE_SURFACEUPDATE_Info::Id,
@@ -163,31 +227,50 @@ ULONG EnableProviders(
             Microsoft_Windows_Dwm_Core::FlipChain_Complete::Id,
             Microsoft_Windows_Dwm_Core::FlipChain_Dirty::Id,
         });
-        if (status != ERROR_SUCCESS) return status;
 
-        status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_Dwm_Core::Win7::GUID, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                                TRACE_LEVEL_VERBOSE, 0, 0, 0, nullptr);
-        if (status != ERROR_SUCCESS) return status;
+        AddProviderEnable(&providers, Microsoft_Windows_Dwm_Core::Win7::GUID, TRACE_LEVEL_VERBOSE, 0, 0, {});
+    }
+
+    // Microsoft_Windows_Kernel_Process
+    if (trackProcessesByName) {
+        keywordMask = (uint64_t) Microsoft_Windows_Kernel_Process::Keyword::WINEVENT_KEYWORD_PROCESS;
+        AddProviderEnable(&providers, Microsoft_Windows_Kernel_Process::GUID, TRACE_LEVEL_INFORMATION, keywordMask, 0, {
+            Microsoft_Windows_Kernel_Process::ProcessStart_Start::Id,
+            Microsoft_Windows_Kernel_Process::ProcessStop_Stop::Id,
+        });
     }
 
     if (includeWinMR) {
         // DHD
-        status = EnableTraceEx2(sessionHandle, &DHD_PROVIDER_GUID, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                                TRACE_LEVEL_VERBOSE, 0x1C00000, 0, 0, nullptr);
-        if (status != ERROR_SUCCESS) return status;
+        AddProviderEnable(&providers, DHD_PROVIDER_GUID, TRACE_LEVEL_VERBOSE, 0x1C00000, 0, {});
 
         if (!simple) {
             // SPECTRUMCONTINUOUS
-            status = EnableTraceEx2(sessionHandle, &SPECTRUMCONTINUOUS_PROVIDER_GUID, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                                    TRACE_LEVEL_VERBOSE, 0x800000, 0, 0, nullptr);
-            if (status != ERROR_SUCCESS) return status;
+            AddProviderEnable(&providers, SPECTRUMCONTINUOUS_PROVIDER_GUID, TRACE_LEVEL_VERBOSE, 0x800000, 0, {});
         }
     }
 
+    // Consumers added with TraceSession::AddConsumer()
+    for (auto const& consumerProvider : consumerProviders) {
+        AddProviderEnable(&providers, consumerProvider.mProviderId, consumerProvider.mLevel,
+            consumerProvider.mAnyKeywordMask, consumerProvider.mAllKeywordMask, consumerProvider.mEventIds);
+    }
+
+    for (auto const& provider : providers) {
+        auto status = provider.mEventIds.empty()
+            ? EnableTraceEx2(sessionHandle, &provider.mProviderId, EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                             provider.mLevel, provider.mAnyKeywordMask, provider.mAllKeywordMask, 0, nullptr)
+            : EnableFilteredProvider(sessionHandle, sessionGuid, provider.mProviderId, provider.mLevel,
+                                     provider.mAnyKeywordMask, provider.mAllKeywordMask, provider.mEventIds);
+        if (status != ERROR_SUCCESS) return status;
+    }
+
     return ERROR_SUCCESS;
 }
 
-void DisableProviders(TRACEHANDLE sessionHandle)
+void DisableProviders(
+    TRACEHANDLE sessionHandle,
+    std::vector<TraceSession::ConsumerProvider> const& consumerProviders)
 {
     ULONG status = 0;
     status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_DXGI::GUID,           EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
@@ -197,8 +280,88 @@ void DisableProviders(TRACEHANDLE sessionHandle)
     status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_Dwm_Core::GUID,       EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
     status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_Dwm_Core::Win7::GUID, EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
     status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_DxgKrnl::Win7::GUID,  EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
+    status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_Kernel_Process::GUID, EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
     status = EnableTraceEx2(sessionHandle, &DHD_PROVIDER_GUID,                      EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
     status = EnableTraceEx2(sessionHandle, &SPECTRUMCONTINUOUS_PROVIDER_GUID,       EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
+    for (auto const& consumerProvider : consumerProviders) {
+        status = EnableTraceEx2(sessionHandle, &consumerProvider.mProviderId, EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
+    }
+}
+
+void CaptureHeader(EVENT_HEADER const& hdr, EventCaptureEvent* event)
+{
+    memcpy(event->ProviderId, &hdr.ProviderId, sizeof(event->ProviderId));
+    event->HeaderFlags = hdr.Flags;
+    event->Id          = hdr.EventDescriptor.Id;
+    event->Version     = hdr.EventDescriptor.Version;
+    event->Channel     = hdr.EventDescriptor.Channel;
+    event->Level       = hdr.EventDescriptor.Level;
+    event->Opcode      = hdr.EventDescriptor.Opcode;
+    event->Task        = hdr.EventDescriptor.Task;
+    event->Keyword     = hdr.EventDescriptor.Keyword;
+    event->ThreadId    = hdr.ThreadId;
+    event->ProcessId   = hdr.ProcessId;
+    event->TimeStamp   = hdr.TimeStamp.QuadPart;
+}
+
+void ReplayHeader(EventCaptureEvent const& event, EVENT_HEADER* hdr)
+{
+    memcpy(&hdr->ProviderId, event.ProviderId, sizeof(event.ProviderId));
+    hdr->Flags                   = event.HeaderFlags;
+    hdr->EventDescriptor.Id      = event.Id;
+    hdr->EventDescriptor.Version = event.Version;
+    hdr->EventDescriptor.Channel = event.Channel;
+    hdr->EventDescriptor.Level   = event.Level;
+    hdr->EventDescriptor.Opcode  = event.Opcode;
+    hdr->EventDescriptor.Task    = event.Task;
+    hdr->EventDescriptor.Keyword = event.Keyword;
+    hdr->ThreadId                = event.ThreadId;
+    hdr->ProcessId               = event.ProcessId;
+    hdr->TimeStamp.QuadPart      = event.TimeStamp;
+}
+
+// Write the event, preceded by any metadata the consumers looked up to
+// decode it that hasn't been written yet.
+template<bool WMR>
+void CaptureEvent(TraceSession* session, EVENT_RECORD* pEventRecord)
+{
+    auto capture = session->mCapture;
+    auto const& hdr = pEventRecord->EventHeader;
+
+    EventCaptureEvent event = {};
+    CaptureHeader(hdr, &event);
+
+    EventMetadataKey key;
+    key.guid_ = hdr.ProviderId;
+    key.desc_ = hdr.EventDescriptor;
+    if (capture->mMetadataWritten.find(key) == capture->mMetadataWritten.end()) {
+        EventMetadata const* metadata[] = {
+            &session->mPMConsumer->mMetadata,
+            WMR ? &session->mMRConsumer->mMetadata : nullptr,
+        };
+        for (auto m : metadata) {
+            if (m == nullptr) continue;
+            auto ii = m->metadata_.find(key);
+            if (ii != m->metadata_.end()) {
+                // A record's UserDataLength is 16 bits, so a larger
+                // TRACE_EVENT_INFO can't be captured.  It's skipped (once)
+                // rather than truncated into a corrupt record.
+                if (ii->second.tei_.size() > UINT16_MAX) {
+                    capture->mSkippedMetadataCount += 1;
+                } else {
+                    auto metadataEvent = event;
+                    metadataEvent.CaptureFlags   = EVENT_CAPTURE_FLAG_METADATA;
+                    metadataEvent.UserDataLength = (uint16_t) ii->second.tei_.size();
+                    capture->mWriter.Write(&metadataEvent, ii->second.tei_.data());
+                }
+                capture->mMetadataWritten.insert(key);
+                break;
+            }
+        }
+    }
+
+    event.UserDataLength = pEventRecord->UserDataLength;
+    capture->mWriter.Write(&event, pEventRecord->UserData);
 }
 
 template<
@@ -217,26 +380,137 @@ void CALLBACK EventRecordCallback(EVENT_RECORD* pEventRecord)
         session->mStartQpc = hdr.TimeStamp;
     }
 
+    // Consider lost any presents that should have completed by now.  Nothing
+    // can have expired until the timestamp reaches the next wheel tick.
+    if ((uint64_t) hdr.TimeStamp.QuadPart >= session->mPMConsumer->mPresentExpiryWheel.NextTickTime()) {
+        session->mPMConsumer->AgePresents(hdr.TimeStamp.QuadPart);
+    }
+
     // TODO: specialize realtime callback to exclude NT_Process?
 
-         if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::GUID)                      session->mPMConsumer->HandleDXGKEvent              (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_Win32k::GUID)                       session->mPMConsumer->HandleWin32kEvent            (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_Dwm_Core::GUID)                     session->mPMConsumer->HandleDWMEvent               (pEventRecord);
-    else if (           hdr.ProviderId == Microsoft_Windows_DXGI::GUID)                         session->mPMConsumer->HandleDXGIEvent              (pEventRecord);
-    else if (           hdr.ProviderId == Microsoft_Windows_D3D9::GUID)                         session->mPMConsumer->HandleD3D9Event              (pEventRecord);
-    else if (           hdr.ProviderId == NT_Process::GUID)                                     session->mPMConsumer->HandleNTProcessEvent         (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_Dwm_Core::Win7::GUID)               session->mPMConsumer->HandleDWMEvent               (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::BLT_GUID)            session->mPMConsumer->HandleWin7DxgkBlt            (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::FLIP_GUID)           session->mPMConsumer->HandleWin7DxgkFlip           (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::PRESENTHISTORY_GUID) session->mPMConsumer->HandleWin7DxgkPresentHistory (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::QUEUEPACKET_GUID)    session->mPMConsumer->HandleWin7DxgkQueuePacket    (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::VSYNCDPC_GUID)       session->mPMConsumer->HandleWin7DxgkVSyncDPC       (pEventRecord);
-    else if (!SIMPLE && hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::MMIOFLIP_GUID)       session->mPMConsumer->HandleWin7DxgkMMIOFlip       (pEventRecord);
-    else if (           hdr.ProviderId == Microsoft_Windows_EventMetadata::GUID)                session->mPMConsumer->HandleMetadataEvent          (pEventRecord);
-    else if (           WMR && hdr.ProviderId == DHD_PROVIDER_GUID)                             session->mMRConsumer->HandleDHDEvent               (pEventRecord);
-    else if (!SIMPLE && WMR && hdr.ProviderId == SPECTRUMCONTINUOUS_PROVIDER_GUID)              session->mMRConsumer->HandleSpectrumContinuousEvent(pEventRecord);
+    // SIMPLE and WMR select which providers are in mProviderDispatch (see
+    // BuildProviderRoutes()), so the routing itself doesn't check them; WMR
+    // also decides whether captured events look up MRTraceConsumer metadata.
+    auto instrumentationStart = ConsumerInstrumentation::Timestamp();
+    auto route = session->mProviderDispatch.Find(hdr.ProviderId);
+    auto handled = route != nullptr;
+    if (handled) {
+        if (route->mHandler != nullptr) {
+            route->mHandler(session, pEventRecord);
+        }
+        for (auto consumerProvider : route->mConsumers) {
+            if (consumerProvider->WantsEvent(hdr.EventDescriptor)) {
+                consumerProvider->mConsumer->HandleEvent(pEventRecord);
+            }
+        }
+    }
 
 #pragma warning(pop)
+
+    // Unhandled events are counted too, since they still take up ETW buffer
+    // space.
+    session->mPMConsumer->mInstrumentation.RecordEvent(hdr.ProviderId, hdr.EventDescriptor.Id,
+        ConsumerInstrumentation::Timestamp() - instrumentationStart);
+
+    if (handled && session->mCapture != nullptr) {
+        CaptureEvent<WMR>(session, pEventRecord);
+    }
+}
+
+template<void (PMTraceConsumer::*Handle)(EVENT_RECORD*)>
+void DispatchToPMConsumer(TraceSession* session, EVENT_RECORD* pEventRecord)
+{
+    (session->mPMConsumer->*Handle)(pEventRecord);
+}
+
+template<void (MRTraceConsumer::*Handle)(EVENT_RECORD*)>
+void DispatchToMRConsumer(TraceSession* session, EVENT_RECORD* pEventRecord)
+{
+    (session->mMRConsumer->*Handle)(pEventRecord);
+}
+
+// Build the session's route for each provider: the PMTraceConsumer or
+// MRTraceConsumer handler, if any, plus the consumers added with
+// AddConsumer().  The built-in providers here must match the ones
+// EnableProviders() enables (plus NT_Process and EventMetadata, which are
+// always delivered).
+void BuildProviderRoutes(TraceSession* session, bool simple, bool includeWinMR)
+{
+    auto routes = &session->mProviderRoutes;
+    routes->clear();
+
+    auto add = [&](GUID const& providerId, ProviderEventHandler handler) {
+        TraceSession::ProviderRoute route;
+        route.mProviderId = providerId;
+        route.mHandler = handler;
+        routes->emplace_back(std::move(route));
+    };
+
+    add(Microsoft_Windows_DXGI::GUID,           &DispatchToPMConsumer<&PMTraceConsumer::HandleDXGIEvent>);
+    add(Microsoft_Windows_D3D9::GUID,           &DispatchToPMConsumer<&PMTraceConsumer::HandleD3D9Event>);
+    add(NT_Process::GUID,                       &DispatchToPMConsumer<&PMTraceConsumer::HandleNTProcessEvent>);
+    add(Microsoft_Windows_Kernel_Process::GUID, &DispatchToPMConsumer<&PMTraceConsumer::HandleKernelProcessEvent>);
+    add(Microsoft_Windows_EventMetadata::GUID,  &DispatchToPMConsumer<&PMTraceConsumer::HandleMetadataEvent>);
+    if (!simple) {
+        add(Microsoft_Windows_DxgKrnl::GUID,                      &DispatchToPMConsumer<&PMTraceConsumer::HandleDXGKEvent>);
+        add(Microsoft_Windows_Win32k::GUID,                       &DispatchToPMConsumer<&PMTraceConsumer::HandleWin32kEvent>);
+        add(Microsoft_Windows_Dwm_Core::GUID,                     &DispatchToPMConsumer<&PMTraceConsumer::HandleDWMEvent>);
+        add(Microsoft_Windows_Dwm_Core::Win7::GUID,               &DispatchToPMConsumer<&PMTraceConsumer::HandleDWMEvent>);
+        add(Microsoft_Windows_DxgKrnl::Win7::BLT_GUID,            &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkBlt>);
+        add(Microsoft_Windows_DxgKrnl::Win7::FLIP_GUID,           &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkFlip>);
+        add(Microsoft_Windows_DxgKrnl::Win7::PRESENTHISTORY_GUID, &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkPresentHistory>);
+        add(Microsoft_Windows_DxgKrnl::Win7::QUEUEPACKET_GUID,    &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkQueuePacket>);
+        add(Microsoft_Windows_DxgKrnl::Win7::VSYNCDPC_GUID,       &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkVSyncDPC>);
+        add(Microsoft_Windows_DxgKrnl::Win7::MMIOFLIP_GUID,       &DispatchToPMConsumer<&PMTraceConsumer::HandleWin7DxgkMMIOFlip>);
+    }
+    if (includeWinMR) {
+        add(DHD_PROVIDER_GUID, &DispatchToMRConsumer<&MRTraceConsumer::HandleDHDEvent>);
+        if (!simple) {
+            add(SPECTRUMCONTINUOUS_PROVIDER_GUID, &DispatchToMRConsumer<&MRTraceConsumer::HandleSpectrumContinuousEvent>);
+        }
+    }
+
+    for (auto const& consumerProvider : session->mConsumerProviders) {
+        auto ii = std::find_if(routes->begin(), routes->end(), [&](TraceSession::ProviderRoute const& route) {
+            return route.mProviderId == consumerProvider.mProviderId;
+        });
+        if (ii == routes->end()) {
+            add(consumerProvider.mProviderId, nullptr);
+            ii = routes->end() - 1;
+        }
+        ii->mConsumers.push_back(&consumerProvider);
+    }
+
+    // The table points into mProviderRoutes, which isn't modified again
+    // until the next session starts.
+    std::vector<ProviderDispatchTable<GUID, TraceSession::ProviderRoute const*>::Entry> entries(routes->size());
+    for (size_t i = 0, n = routes->size(); i < n; ++i) {
+        entries[i].mProviderId = (*routes)[i].mProviderId;
+        entries[i].mHandler = &(*routes)[i];
+    }
+
+    // If the providers have no perfect hash (e.g., an added consumer's
+    // provider has the same GUID::Data1 as another) the table falls back to
+    // a slower lookup by the full GUID, so this can't fail.
+    session->mProviderDispatch.Build(entries.data(), (uint32_t) entries.size());
+}
+
+PEVENT_RECORD_CALLBACK GetEventRecordCallback(bool saveFirstTimestamp, bool simple, bool includeWinMR)
+{
+    UINT callbackFlags =
+        (saveFirstTimestamp ? 4 : 0) |
+        (simple             ? 2 : 0) |
+        (includeWinMR       ? 1 : 0);
+    switch (callbackFlags) {
+    case 0: return &EventRecordCallback<false, false, false>;
+    case 1: return &EventRecordCallback<false, false, true>;
+    case 2: return &EventRecordCallback<false, true, false>;
+    case 3: return &EventRecordCallback<false, true, true>;
+    case 4: return &EventRecordCallback<true, false, false>;
+    case 5: return &EventRecordCallback<true, false, true>;
+    case 6: return &EventRecordCallback<true, true, false>;
+    default: return &EventRecordCallback<true, true, true>;
+    }
 }
 
 ULONG CALLBACK BufferCallback(EVENT_TRACE_LOGFILEA* pLogFile)
@@ -259,6 +533,7 @@ ULONG TraceSession::Start(
     mPMConsumer = pmConsumer;
     mMRConsumer = mrConsumer;
     mContinueProcessingBuffers = TRUE;
+    mReplayCallback = nullptr;
 
     // -------------------------------------------------------------------------
     // Configure session properties
@@ -313,20 +588,8 @@ ULONG TraceSession::Start(
     auto simple             = pmConsumer->mSimpleMode;
     auto includeWinMR       = mrConsumer != nullptr;
 
-    UINT callbackFlags =
-        (saveFirstTimestamp ? 4 : 0) |
-        (simple             ? 2 : 0) |
-        (includeWinMR       ? 1 : 0);
-    switch (callbackFlags) {
-    case 0: traceProps.EventRecordCallback = &EventRecordCallback<false, false, false>; break;
-    case 1: traceProps.EventRecordCallback = &EventRecordCallback<false, false, true>; break;
-    case 2: traceProps.EventRecordCallback = &EventRecordCallback<false, true, false>; break;
-    case 3: traceProps.EventRecordCallback = &EventRecordCallback<false, true, true>; break;
-    case 4: traceProps.EventRecordCallback = &EventRecordCallback<true, false, false>; break;
-    case 5: traceProps.EventRecordCallback = &EventRecordCallback<true, false, true>; break;
-    case 6: traceProps.EventRecordCallback = &EventRecordCallback<true, true, false>; break;
-    case 7: traceProps.EventRecordCallback = &EventRecordCallback<true, true, true>; break;
-    }
+    traceProps.EventRecordCallback = GetEventRecordCallback(saveFirstTimestamp, simple, includeWinMR);
+    BuildProviderRoutes(this, simple, includeWinMR);
 
     // When processing log files, we need to use the buffer callback in case
     // the user wants to stop processing before the entire log has been parsed.
@@ -349,7 +612,8 @@ ULONG TraceSession::Start(
     }
 
     // Enable desired providers
-    status = EnableProviders(mHandle, sessionProps.Wnode.Guid, simple, includeWinMR);
+    auto trackProcessesByName = pmConsumer->mEnableTrackedProcessFiltering && !pmConsumer->mTrackedProcessNames.empty();
+    status = EnableProviders(mHandle, sessionProps.Wnode.Guid, simple, includeWinMR, trackProcessesByName, mConsumerProviders);
     if (status != ERROR_SUCCESS) {
         Stop();
         return status;
@@ -373,6 +637,8 @@ ULONG TraceSession::Start(
         QueryPerformanceCounter(&mStartQpc);
     }
 
+    mPMConsumer->StartPresentAging(mQpcFrequency.QuadPart);
+
     DebugInitialize(&mStartQpc, mQpcFrequency);
 
     return ERROR_SUCCESS;
@@ -382,6 +648,13 @@ void TraceSession::Stop()
 {
     ULONG status = 0;
 
+    // When replaying, ProcessReplay() checks mContinueProcessingBuffers after
+    // every event and releases the capture itself.
+    if (mReplayCallback != nullptr) {
+        mContinueProcessingBuffers = FALSE;
+        return;
+    }
+
     // If collecting realtime events, CloseTrace() will cause ProcessTrace() to
     // stop filling buffers and it will return after it finishes processing
     // events already in it's buffers.
@@ -395,7 +668,7 @@ void TraceSession::Stop()
     status = CloseTrace(mTraceHandle);
     mTraceHandle = INVALID_PROCESSTRACE_HANDLE;
 
-    DisableProviders(mHandle);
+    DisableProviders(mHandle, mConsumerProviders);
 
     TraceProperties sessionProps = {};
     sessionProps.Wnode.BufferSize = (ULONG) sizeof(TraceProperties);
@@ -404,6 +677,112 @@ void TraceSession::Stop()
     mHandle = 0;
 }
 
+ULONG TraceSession::StartCapture(char const* capturePath)
+{
+    assert(mCapture == nullptr);
+
+    mCapture = new TraceCapture;
+    if (!mCapture->mWriter.Open(capturePath, mQpcFrequency.QuadPart, mStartQpc.QuadPart)) {
+        delete mCapture;
+        mCapture = nullptr;
+        return ERROR_OPEN_FAILED;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+ULONG TraceSession::StopCapture(uint32_t* skippedMetadataCount)
+{
+    if (skippedMetadataCount != nullptr) {
+        *skippedMetadataCount = mCapture == nullptr ? 0 : mCapture->mSkippedMetadataCount;
+    }
+
+    if (mCapture == nullptr) {
+        return ERROR_SUCCESS;
+    }
+
+    // For ETL sessions mStartQpc is only known once the first event arrives.
+    mCapture->mWriter.SetStartQpc(mStartQpc.QuadPart);
+    auto ok = mCapture->mWriter.Close();
+
+    delete mCapture;
+    mCapture = nullptr;
+    return ok ? ERROR_SUCCESS : ERROR_WRITE_FAULT;
+}
+
+ULONG TraceSession::StartReplay(
+    PMTraceConsumer* pmConsumer,
+    MRTraceConsumer* mrConsumer,
+    char const* const* capturePaths,
+    uint32_t capturePathCount)
+{
+    assert(mReplayReader == nullptr);
+
+    auto reader = new EventCaptureMergeReader;
+    switch (reader->Open(capturePaths, capturePathCount)) {
+    case EventCaptureReader::SUCCESS:             break;
+    case EventCaptureReader::FILE_NOT_FOUND:      delete reader; return ERROR_FILE_NOT_FOUND;
+    case EventCaptureReader::UNSUPPORTED_VERSION: delete reader; return ERROR_NOT_SUPPORTED;
+    case EventCaptureReader::INCOMPATIBLE_FILES:  delete reader; return ERROR_INVALID_DATA;
+    default:                                      delete reader; return ERROR_FILE_CORRUPT;
+    }
+
+    mStartQpc.QuadPart = reader->GetStartQpc();
+    mQpcFrequency.QuadPart = reader->GetQpcFrequency();
+    mPMConsumer = pmConsumer;
+    mMRConsumer = mrConsumer;
+    mContinueProcessingBuffers = TRUE;
+    BuildProviderRoutes(this, pmConsumer->mSimpleMode, mrConsumer != nullptr);
+
+    mReplayReader = reader;
+    mReplayCallback = GetEventRecordCallback(mStartQpc.QuadPart == 0, pmConsumer->mSimpleMode, mrConsumer != nullptr);
+
+    pmConsumer->StartPresentAging(mQpcFrequency.QuadPart);
+
+    DebugInitialize(&mStartQpc, mQpcFrequency);
+
+    return ERROR_SUCCESS;
+}
+
+void TraceSession::ProcessReplay()
+{
+    assert(mReplayReader != nullptr);
+
+    EVENT_RECORD eventRecord = {};
+    eventRecord.EventHeader.Size = sizeof(EVENT_HEADER);
+    eventRecord.UserContext = this;
+
+    void const* userData = nullptr;
+    while (mContinueProcessingBuffers) {
+        auto event = mReplayReader->Next(&userData);
+        if (event == nullptr) {
+            break;
+        }
+
+        ReplayHeader(*event, &eventRecord.EventHeader);
+
+        if (event->CaptureFlags & EVENT_CAPTURE_FLAG_METADATA) {
+            EventMetadataKey key;
+            key.guid_ = eventRecord.EventHeader.ProviderId;
+            key.desc_ = eventRecord.EventHeader.EventDescriptor;
+            auto data = (uint8_t const*) userData;
+            mPMConsumer->mMetadata.SetMetadata(key, data, event->UserDataLength);
+            if (mMRConsumer != nullptr) {
+                mMRConsumer->mMetadata.SetMetadata(key, data, event->UserDataLength);
+            }
+            continue;
+        }
+
+        // UserData points into the mapped capture; the handlers only read it.
+        eventRecord.UserDataLength = event->UserDataLength;
+        eventRecord.UserData = (void*) userData;
+        mReplayCallback(&eventRecord);
+    }
+
+    delete mReplayReader;
+    mReplayReader = nullptr;
+}
+
 ULONG TraceSession::StopNamedSession(char const* sessionName)
 {
     TraceProperties sessionProps = {};
@@ -413,6 +792,40 @@ ULONG TraceSession::StopNamedSession(char const* sessionName)
 }
 
 
+void TraceSession::AddConsumer(
+    TraceEventConsumer* consumer,
+    GUID const& providerId,
+    UCHAR level,
+    ULONGLONG anyKeywordMask,
+    ULONGLONG allKeywordMask,
+    std::vector<USHORT> const& eventIds)
+{
+    // mProviderRoutes points into mConsumerProviders.
+    assert(mHandle == 0);
+    assert(mReplayReader == nullptr);
+
+    ConsumerProvider consumerProvider;
+    consumerProvider.mConsumer = consumer;
+    consumerProvider.mProviderId = providerId;
+    consumerProvider.mLevel = level;
+    consumerProvider.mAnyKeywordMask = anyKeywordMask;
+    consumerProvider.mAllKeywordMask = allKeywordMask;
+    consumerProvider.mEventIds = eventIds;
+    std::sort(consumerProvider.mEventIds.begin(), consumerProvider.mEventIds.end());
+    consumerProvider.mEventIds.erase(std::unique(consumerProvider.mEventIds.begin(), consumerProvider.mEventIds.end()), consumerProvider.mEventIds.end());
+    mConsumerProviders.emplace_back(std::move(consumerProvider));
+}
+
+void TraceSession::RemoveConsumers()
+{
+    assert(mHandle == 0);
+    assert(mReplayReader == nullptr);
+
+    mConsumerProviders.clear();
+    mProviderRoutes.clear();
+    mProviderDispatch = ProviderDispatchTable<GUID, ProviderRoute const*>();
+}
+
 ULONG TraceSession::CheckLostReports(ULONG* eventsLost, ULONG* buffersLost) const
 {
     TraceProperties sessionProps = {};
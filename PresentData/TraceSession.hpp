@@ -19,11 +19,56 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "ProviderDispatchTable.hpp"
 
 struct PMTraceConsumer;
 struct MRTraceConsumer;
+struct TraceCapture;
+class EventCaptureMergeReader;
+struct TraceSession;
+
+typedef void (*ProviderEventHandler)(TraceSession* session, EVENT_RECORD* pEventRecord);
+
+// An additional consumer of a session's events, e.g. a custom analysis, that
+// is given events alongside PMTraceConsumer and MRTraceConsumer (see
+// TraceSession::AddConsumer()).  HandleEvent() is called on the thread
+// processing the session's events.
+struct TraceEventConsumer {
+    virtual ~TraceEventConsumer() {}
+    virtual void HandleEvent(EVENT_RECORD* pEventRecord) = 0;
+};
 
 struct TraceSession {
+    // The events a TraceEventConsumer needs from one provider.
+    struct ConsumerProvider {
+        TraceEventConsumer* mConsumer;
+        GUID mProviderId;
+        UCHAR mLevel;
+        ULONGLONG mAnyKeywordMask;          // 0 for every keyword
+        ULONGLONG mAllKeywordMask;
+        std::vector<USHORT> mEventIds;      // Sorted and unique; empty for every event
+
+        bool WantsEvent(EVENT_DESCRIPTOR const& desc) const
+        {
+            return (mLevel == 0 || desc.Level <= mLevel) &&
+                   (desc.Keyword == 0 || mAnyKeywordMask == 0 || (desc.Keyword & mAnyKeywordMask) != 0) &&
+                   (desc.Keyword == 0 || (desc.Keyword & mAllKeywordMask) == mAllKeywordMask) &&
+                   (mEventIds.empty() || std::binary_search(mEventIds.begin(), mEventIds.end(), desc.Id));
+        }
+    };
+
+    // Everything that handles events from one provider.
+    struct ProviderRoute {
+        GUID mProviderId;
+        ProviderEventHandler mHandler;                      // PMTraceConsumer/MRTraceConsumer handler, or nullptr
+        std::vector<ConsumerProvider const*> mConsumers;    // Added consumers, in the order they were added
+    };
+
     LARGE_INTEGER mStartQpc = {};
     LARGE_INTEGER mQpcFrequency = {};
     PMTraceConsumer* mPMConsumer = nullptr;
@@ -31,6 +76,15 @@ struct TraceSession {
     TRACEHANDLE mHandle = 0;                                // invalid session handles are 0
     TRACEHANDLE mTraceHandle = INVALID_PROCESSTRACE_HANDLE; // invalid trace handles are INVALID_PROCESSTRACE_HANDLE
     ULONG mContinueProcessingBuffers = TRUE;
+    TraceCapture* mCapture = nullptr;                       // non-null while writing a capture file
+    EventCaptureMergeReader* mReplayReader = nullptr;       // non-null while replaying capture files
+    PEVENT_RECORD_CALLBACK mReplayCallback = nullptr;
+
+    // Each provider's route, and a table to find it by provider id, built by
+    // Start() and StartReplay().
+    std::vector<ConsumerProvider> mConsumerProviders;
+    std::vector<ProviderRoute> mProviderRoutes;
+    ProviderDispatchTable<GUID, ProviderRoute const*> mProviderDispatch;
 
     ULONG Start(
         PMTraceConsumer* pmConsumer, // Required PMTraceConsumer instance
@@ -40,6 +94,75 @@ struct TraceSession {
 
     void Stop();
 
+    // Write every event the session handles to a PresentMon capture file (see
+    // EventCapture.hpp).  Call after Start() and before events are processed,
+    // and call StopCapture() once events are no longer being processed.
+    // StopCapture() returns ERROR_WRITE_FAULT if any of the capture couldn't
+    // be written.  Metadata too large for a capture record (over 64 KB) is
+    // left out, and the number of such event types is returned in
+    // skippedMetadataCount; replaying their events then relies on TDH.
+    ULONG StartCapture(char const* capturePath);
+    ULONG StopCapture(uint32_t* skippedMetadataCount = nullptr);
+
+    // Use PresentMon capture files as the event source instead of ETW.
+    // ProcessReplay() dispatches the captured events to the consumers, as
+    // ProcessTrace() would, and returns when the captures are done or Stop()
+    // is called.  Multiple captures of the same system are merged into one
+    // timeline (see EventCaptureMergeReader).
+    ULONG StartReplay(
+        PMTraceConsumer* pmConsumer,    // Required PMTraceConsumer instance
+        MRTraceConsumer* mrConsumer,    // If nullptr, no WinMR tracing
+        char const* const* capturePaths,
+        uint32_t capturePathCount);
+    void ProcessReplay();
+
+    // Also give consumer the events it needs from providerId.  The provider is
+    // enabled once for the session, with settings that include what every
+    // consumer of it (including PMTraceConsumer and MRTraceConsumer) needs,
+    // and consumer is only given the events that match its own level,
+    // keywords, and eventIds (empty for every event).  Call once per provider
+    // the consumer needs, before Start() or StartReplay(); consumers stay
+    // added for later sessions until RemoveConsumers() is called.
+    //
+    // If the consumers of a provider together need more event ids than an
+    // ETW filter can hold, Start() prints a warning and enables all of the
+    // provider's events (see AddProviderEnable()).
+    //
+    // Any provider can be added.  If it makes the session's providers
+    // impossible to perfect-hash (e.g., its GUID::Data1 matches another
+    // provider's), Start() and StartReplay() still succeed, but every event
+    // is found by a binary search over the full GUIDs instead (see
+    // ProviderDispatchTable).
+    void AddConsumer(
+        TraceEventConsumer* consumer,
+        GUID const& providerId,
+        UCHAR level,
+        ULONGLONG anyKeywordMask,
+        ULONGLONG allKeywordMask,
+        std::vector<USHORT> const& eventIds);
+    void RemoveConsumers();
+
     ULONG CheckLostReports(ULONG* eventsLost, ULONG* buffersLost) const;
     static ULONG StopNamedSession(char const* sessionName);
 };
+
+// How a provider is enabled for a session.  A provider needed by more than
+// one consumer is enabled once, with settings that include the events every
+// one of them needs.
+struct ProviderEnable {
+    GUID mProviderId;
+    UCHAR mLevel;
+    ULONGLONG mAnyKeywordMask;      // 0 for every keyword
+    ULONGLONG mAllKeywordMask;
+    std::vector<USHORT> mEventIds;  // Empty for every event
+};
+
+// Add providerId to providers, or widen its entry to include these settings
+// too.  If the event id filter would need more ids than ETW allows
+// (MAX_EVENT_FILTER_EVENT_ID_COUNT), a warning is printed and the filter is
+// dropped, so every event of the provider is enabled.
+void AddProviderEnable(
+    std::vector<ProviderEnable>* providers,
+    GUID const& providerId, UCHAR level,
+    ULONGLONG anyKeywordMask, ULONGLONG allKeywordMask,
+    std::vector<USHORT> const& eventIds);
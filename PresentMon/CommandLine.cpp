@@ -289,6 +289,9 @@ static void PrintHelp()
                                     " This argument can be repeated to exclude multiple processes.",
         "-process_id id",           "Record only the process specified by ID.",
         "-etl_file path",           "Consume events from an ETW log file instead of running processes.",
+        "-replay_capture path",     "Consume events from a file written with -write_capture instead of running processes."
+                                    " This argument can be repeated to merge captures of the same system into one timeline.",
+        "-write_capture path",      "Write the consumed events to a capture file that can later be used with -replay_capture.",
 
         "Output options (see README for file naming defaults)", nullptr,
         "-output_file path",        "Write CSV output to the provided path.",
@@ -331,6 +334,12 @@ static void PrintHelp()
         "-terminate_existing",      "Terminate any existing PresentMon realtime trace sessions, then exit."
                                     " Use with -session_name to target particular sessions.",
         "-include_mixed_reality",   "Capture Windows Mixed Reality data to a CSV file with \"_WMR\" suffix.",
+        "-metadata_cache path",     "Load event metadata from the provided file at startup, instead of"
+                                    " querying it from the system the first time each event is seen,"
+                                    " and write the metadata used back to the file on exit.",
+        "-output_batch_size n",     "Process presents as soon as n of them have completed (default 256).",
+        "-output_latency_ms ms",    "Process presents no later than ms milliseconds after the first of them"
+                                    " completes, even if fewer than -output_batch_size have (default 5).",
     };
 
     fprintf(stderr, "PresentMon %s\n", PRESENT_MON_VERSION);
@@ -395,12 +404,17 @@ bool ParseCommandLine(int argc, char** argv)
     args->mExcludeProcessNames.clear();
     args->mOutputCsvFileName = nullptr;
     args->mEtlFileName = nullptr;
+    args->mWriteCaptureFileName = nullptr;
+    args->mReplayCaptureFileNames.clear();
+    args->mMetadataCacheFileName = nullptr;
     args->mSessionName = "PresentMon";
     args->mTargetPid = 0;
     args->mDelay = 0;
     args->mTimer = 0;
     args->mHotkeyModifiers = MOD_NOREPEAT;
     args->mHotkeyVirtualKeyCode = 0;
+    args->mOutputBatchSize = 256;
+    args->mOutputLatencyMs = 5;
     args->mOutputCsvToFile = true;
     args->mOutputCsvToStdout = false;
     args->mOutputQpcTime = false;
@@ -428,6 +442,8 @@ bool ParseCommandLine(int argc, char** argv)
         else if (ParseArg(argv[i], "exclude"))      { if (ParseValue(argv, argc, &i, &args->mExcludeProcessNames)) continue; }
         else if (ParseArg(argv[i], "process_id"))   { if (ParseValue(argv, argc, &i, &args->mTargetPid))           continue; }
         else if (ParseArg(argv[i], "etl_file"))     { if (ParseValue(argv, argc, &i, &args->mEtlFileName))         continue; }
+        else if (ParseArg(argv[i], "replay_capture")) { if (ParseValue(argv, argc, &i, &args->mReplayCaptureFileNames)) continue; }
+        else if (ParseArg(argv[i], "write_capture"))  { if (ParseValue(argv, argc, &i, &args->mWriteCaptureFileName))  continue; }
 
         // Output options:
         else if (ParseArg(argv[i], "output_file"))   { if (ParseValue(argv, argc, &i, &args->mOutputCsvFileName)) continue; }
@@ -457,6 +473,9 @@ bool ParseCommandLine(int argc, char** argv)
         else if (ParseArg(argv[i], "qpc_time_s"))            { args->mOutputQpcTimeInSeconds     = true; continue; }
         else if (ParseArg(argv[i], "terminate_existing"))    { args->mTerminateExisting          = true; continue; }
         else if (ParseArg(argv[i], "include_mixed_reality")) { args->mIncludeWindowsMixedReality = true; continue; }
+        else if (ParseArg(argv[i], "metadata_cache"))        { if (ParseValue(argv, argc, &i, &args->mMetadataCacheFileName)) continue; }
+        else if (ParseArg(argv[i], "output_batch_size"))     { if (ParseValue(argv, argc, &i, &args->mOutputBatchSize)) continue; }
+        else if (ParseArg(argv[i], "output_latency_ms"))     { if (ParseValue(argv, argc, &i, &args->mOutputLatencyMs)) continue; }
 
         // Provided argument wasn't recognized
         else if (!(ParseArg(argv[i], "?") || ParseArg(argv[i], "h") || ParseArg(argv[i], "help"))) {
@@ -479,6 +498,20 @@ bool ParseCommandLine(int argc, char** argv)
         args->mVerbosity = Verbosity::Simple;
     }
 
+    // Only one event source can be used, and there's no point in re-writing
+    // a capture that is being replayed.
+    if (!args->mReplayCaptureFileNames.empty()) {
+        if (args->mEtlFileName != nullptr) {
+            fprintf(stderr, "error: only one of -etl_file or -replay_capture arguments can be used.\n");
+            PrintHelp();
+            return false;
+        }
+        if (args->mWriteCaptureFileName != nullptr) {
+            fprintf(stderr, "warning: -write_capture and -replay_capture are not compatible; ignoring -write_capture.\n");
+            args->mWriteCaptureFileName = nullptr;
+        }
+    }
+
     // Enable -qpc_time if only -qpc_time_s was provided, since we use that to
     // add the column.
     if (args->mOutputQpcTimeInSeconds) {
@@ -570,6 +603,9 @@ bool ParseCommandLine(int argc, char** argv)
         !args->mExcludeProcessNames.empty() ||
         args->mTargetPid != 0 ||
         args->mEtlFileName != nullptr ||
+        args->mWriteCaptureFileName != nullptr ||
+        !args->mReplayCaptureFileNames.empty() ||
+        args->mMetadataCacheFileName != nullptr ||
         args->mOutputCsvFileName != nullptr ||
         args->mOutputCsvToStdout ||
         args->mMultiCsv ||
@@ -166,38 +166,38 @@ void UpdateConsole(uint32_t processId, ProcessInfo const& processInfo)
             ConsolePrintLn("%s[%d]:", processInfo.mModuleName.c_str(), processId);
         }
 
-        auto const& present0 = *chain.mPresentHistory[(chain.mNextPresentIndex - chain.mPresentHistoryCount) % SwapChainData::PRESENT_HISTORY_MAX_COUNT];
-        auto const& presentN = *chain.mPresentHistory[(chain.mNextPresentIndex - 1) % SwapChainData::PRESENT_HISTORY_MAX_COUNT];
-        auto cpuAvg = QpcDeltaToSeconds(presentN.QpcTime - present0.QpcTime) / (chain.mPresentHistoryCount - 1);
+        auto const& present0 = chain.GetPresent(chain.mNextPresentIndex - chain.mPresentHistoryCount);
+        auto const& presentN = chain.GetPresent(chain.mNextPresentIndex - 1);
+        auto cpuAvg = QpcDeltaToSeconds(presentN.mQpcTime - present0.mQpcTime) / (chain.mPresentHistoryCount - 1);
 
         ConsolePrint("    %016llX (%s): SyncInterval=%d Flags=%d %.2lf ms/frame (%.1lf fps",
             address,
-            RuntimeToString(presentN.Runtime),
-            presentN.SyncInterval,
-            presentN.PresentFlags,
+            RuntimeToString(chain.mRuntime),
+            chain.mSyncInterval,
+            chain.mPresentFlags,
             1000.0 * cpuAvg,
             1.0 / cpuAvg);
 
         size_t displayCount = 0;
         uint64_t latencySum = 0;
         uint64_t display0ScreenTime = 0;
-        PresentEvent* displayN = nullptr;
+        PresentRecord const* displayN = nullptr;
         if (args.mVerbosity > Verbosity::Simple) {
             for (uint32_t i = 0; i < chain.mPresentHistoryCount; ++i) {
-                auto const& p = chain.mPresentHistory[(chain.mNextPresentIndex - chain.mPresentHistoryCount + i) % SwapChainData::PRESENT_HISTORY_MAX_COUNT];
-                if (p->FinalState == PresentResult::Presented) {
+                auto const& p = chain.GetPresent(chain.mNextPresentIndex - chain.mPresentHistoryCount + i);
+                if (p.mFinalState == PresentResult::Presented) {
                     if (displayCount == 0) {
-                        display0ScreenTime = p->ScreenTime;
+                        display0ScreenTime = p.mScreenTime;
                     }
-                    displayN = p.get();
-                    latencySum += p->ScreenTime - p->QpcTime;
+                    displayN = &p;
+                    latencySum += p.mScreenTime - p.mQpcTime;
                     displayCount += 1;
                 }
             }
         }
 
         if (displayCount >= 2) {
-            ConsolePrint(", %.1lf fps displayed", (double) (displayCount - 1) / QpcDeltaToSeconds(displayN->ScreenTime - display0ScreenTime));
+            ConsolePrint(", %.1lf fps displayed", (double) (displayCount - 1) / QpcDeltaToSeconds(displayN->mScreenTime - display0ScreenTime));
         }
 
         if (displayCount >= 1) {
@@ -207,7 +207,7 @@ void UpdateConsole(uint32_t processId, ProcessInfo const& processInfo)
         ConsolePrint(")");
 
         if (displayCount > 0) {
-            ConsolePrint(" %s", PresentModeToString(displayN->PresentMode));
+            ConsolePrint(" %s", PresentModeToString(displayN->mPresentMode));
         }
 
         ConsolePrintLn("");
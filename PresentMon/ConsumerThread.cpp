@@ -56,11 +56,28 @@ static void Consume(TRACEHANDLE traceHandle)
     ExitMainThread();
 }
 
+static void Replay(TraceSession* session)
+{
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    // ProcessReplay() returns once the whole capture has been delivered or
+    // TraceSession::Stop() is called.  As with an ETL file, signal MainThread
+    // to exit in the first case.
+    session->ProcessReplay();
+
+    ExitMainThread();
+}
+
 void StartConsumerThread(TRACEHANDLE traceHandle)
 {
     gThread = std::thread(Consume, traceHandle);
 }
 
+void StartReplayConsumerThread(TraceSession* session)
+{
+    gThread = std::thread(Replay, session);
+}
+
 void WaitForConsumerThreadToExit()
 {
     if (gThread.joinable()) {
@@ -21,6 +21,7 @@ SOFTWARE.
 */
 
 #include "PresentMon.hpp"
+#include "CsvRowWriter.hpp"
 
 static OutputCsv gSingleOutputCsv = {};
 static uint32_t gRecordingCount = 1;
@@ -110,11 +111,11 @@ void UpdateCsv(ProcessInfo* processInfo, SwapChainData const& chain, PresentEven
         return;
     }
 
-    auto lastPresented = chain.mPresentHistory[(chain.mNextPresentIndex - 1) % SwapChainData::PRESENT_HISTORY_MAX_COUNT].get();
+    auto const& lastPresented = chain.GetPresent(chain.mNextPresentIndex - 1);
 
     // Compute frame statistics.
     double timeInSeconds          = QpcToSeconds(p.QpcTime);
-    double msBetweenPresents      = 1000.0 * QpcDeltaToSeconds(p.QpcTime - lastPresented->QpcTime);
+    double msBetweenPresents      = 1000.0 * QpcDeltaToSeconds(p.QpcTime - lastPresented.mQpcTime);
     double msInPresentApi         = 1000.0 * QpcDeltaToSeconds(p.TimeTaken);
     double msUntilRenderComplete  = 0.0;
     double msUntilDisplayed       = 0.0;
@@ -128,37 +129,74 @@ void UpdateCsv(ProcessInfo* processInfo, SwapChainData const& chain, PresentEven
             msUntilDisplayed = 1000.0 * QpcDeltaToSeconds(p.ScreenTime - p.QpcTime);
 
             if (chain.mLastDisplayedPresentIndex > 0) {
-                auto lastDisplayed = chain.mPresentHistory[chain.mLastDisplayedPresentIndex % SwapChainData::PRESENT_HISTORY_MAX_COUNT].get();
-                msBetweenDisplayChange = 1000.0 * QpcDeltaToSeconds(p.ScreenTime - lastDisplayed->ScreenTime);
+                msBetweenDisplayChange = 1000.0 * QpcDeltaToSeconds(p.ScreenTime - chain.mLastDisplayedScreenTime);
             }
         }
     }
 
-    // Output in CSV format
-    fprintf(fp, "%s,%d,0x%016llX,%s,%d,%d", processInfo->mModuleName.c_str(), p.ProcessId, p.SwapChainAddress,
-        RuntimeToString(p.Runtime), p.SyncInterval, p.PresentFlags);
+    // Queue the row to be formatted and written by a CsvWriter thread.
+    CsvFrameRecord record;
+    record.mSwapChainAddress       = p.SwapChainAddress;
+    record.mQpcTime                = p.QpcTime;
+    record.mTimeInSeconds          = timeInSeconds;
+    record.mMsBetweenPresents      = msBetweenPresents;
+    record.mMsBetweenDisplayChange = msBetweenDisplayChange;
+    record.mMsInPresentApi         = msInPresentApi;
+    record.mMsUntilRenderComplete  = msUntilRenderComplete;
+    record.mMsUntilDisplayed       = msUntilDisplayed;
+    record.mQpcTimeInSeconds       = args.mOutputQpcTimeInSeconds ? QpcDeltaToSeconds(p.QpcTime) : 0.0;
+    record.mProcessId              = p.ProcessId;
+    record.mPresentFlags           = p.PresentFlags;
+    record.mSyncInterval           = p.SyncInterval;
+    record.mRuntime                = p.Runtime;
+    record.mPresentMode            = p.PresentMode;
+    record.mFinalState             = p.FinalState;
+    record.mSupportsTearing        = p.SupportsTearing;
+    record.mWasBatched             = p.DriverBatchThreadId != 0;
+    record.mDwmNotified            = p.DwmNotified;
+    QueueCsvRow(fp, processInfo->mModuleName, &record);
+}
+
+// Append the CSV row for r to text.  This is called from the CsvWriter
+// threads, so it must only read r and the command line arguments.
+void FormatCsvRow(CsvFrameRecord const& r, std::vector<char>* text)
+{
+    auto const& args = GetCommandLineArgs();
+
+    CsvRowWriter row(text);
+    row.String(r.mApplication->c_str());
+    row.Int((int32_t) r.mProcessId);
+    row.Hex64(r.mSwapChainAddress);
+    row.String(RuntimeToString(r.mRuntime));
+    row.Int(r.mSyncInterval);
+    row.Int((int32_t) r.mPresentFlags);
     if (args.mVerbosity > Verbosity::Simple) {
-        fprintf(fp, ",%d,%s", p.SupportsTearing, PresentModeToString(p.PresentMode));
+        row.Int(r.mSupportsTearing);
+        row.String(PresentModeToString(r.mPresentMode));
     }
     if (args.mVerbosity >= Verbosity::Verbose) {
-        fprintf(fp, ",%d,%d", (p.DriverBatchThreadId != 0), p.DwmNotified);
+        row.Int(r.mWasBatched);
+        row.Int(r.mDwmNotified);
     }
-    fprintf(fp, ",%s,%.6lf,%.3lf", FinalStateToDroppedString(p.FinalState), timeInSeconds, msBetweenPresents);
+    row.String(FinalStateToDroppedString(r.mFinalState));
+    row.Fixed(r.mTimeInSeconds, 6);
+    row.Fixed(r.mMsBetweenPresents, 3);
     if (args.mVerbosity > Verbosity::Simple) {
-        fprintf(fp, ",%.3lf", msBetweenDisplayChange);
+        row.Fixed(r.mMsBetweenDisplayChange, 3);
     }
-    fprintf(fp, ",%.3lf", msInPresentApi);
+    row.Fixed(r.mMsInPresentApi, 3);
     if (args.mVerbosity > Verbosity::Simple) {
-        fprintf(fp, ",%.3lf,%.3lf", msUntilRenderComplete, msUntilDisplayed);
+        row.Fixed(r.mMsUntilRenderComplete, 3);
+        row.Fixed(r.mMsUntilDisplayed, 3);
     }
     if (args.mOutputQpcTime) {
         if (args.mOutputQpcTimeInSeconds) {
-            fprintf(fp, ",%.9lf", QpcDeltaToSeconds(p.QpcTime));
+            row.Fixed(r.mQpcTimeInSeconds, 9);
         } else {
-            fprintf(fp, ",%llu", p.QpcTime);
+            row.UInt64(r.mQpcTime);
         }
     }
-    fprintf(fp, "\n");
+    row.EndRow();
 }
 
 /* This text is reproduced in the readme, modify both if there are changes:
@@ -291,6 +329,7 @@ void CloseOutputCsv(ProcessInfo* processInfo)
 
     if (closeFile) {
         if (csv->mFile != nullptr) {
+            FlushCsvRows(csv->mFile);
             fclose(csv->mFile);
         }
         if (csv->mWmrFile != nullptr) {
@@ -0,0 +1,210 @@
+/*
+Copyright 2017-2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+
+// CsvRowWriter appends one CSV row at a time to a text buffer.  Integers,
+// hex addresses and fixed-precision doubles are formatted by hand rather than
+// with printf, which spends most of its time parsing the format string and
+// handling cases CSV output never hits.  Each function produces the same
+// bytes as the printf conversion noted next to it.
+//
+// Doubles are rounded from value * 10^precision.  When that product is close
+// to halfway between two results, fma() recovers its rounding error to decide
+// the direction exactly.  Exact ties, and values that are too large,
+// infinite, or NaN, are formatted with snprintf instead, so the result always
+// matches printf's exactly-rounded output.
+//
+// This file has no platform dependencies.
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+class CsvRowWriter {
+    // Fields are formatted backwards from the end of a local buffer, leaving
+    // room in front for the separator, and then appended in one insert.
+    enum { FIELD_SIZE = 48 };
+
+    std::vector<char>* mText;
+    bool mFirstField;
+
+    // begin must not be the start of its buffer.
+    void AppendField(char* begin, char* end)
+    {
+        if (mFirstField) {
+            mFirstField = false;
+        } else {
+            *--begin = ',';
+        }
+        mText->insert(mText->end(), begin, end);
+    }
+
+    // Write the decimal digits of value so they end at end, and return where
+    // they start.
+    static char* WriteDigits(char* end, uint64_t value)
+    {
+        do {
+            *--end = (char) ('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        return end;
+    }
+
+    void AppendFixedWithPrintf(double value, uint32_t precision)
+    {
+        // Large enough for a separator and %.9f of DBL_MAX.
+        char text[400];
+        auto length = snprintf(text + 1, sizeof(text) - 1, "%.*f", (int) precision, value);
+        AppendField(text + 1, text + 1 + (length < 0 ? 0 : length));
+    }
+
+public:
+    enum { MAX_PRECISION = 9 };
+
+    explicit CsvRowWriter(std::vector<char>* text)
+        : mText(text)
+        , mFirstField(true)
+    {
+    }
+
+    // Append the row's line ending.  The writer can then start another row.
+    void EndRow()
+    {
+        mText->push_back('\n');
+        mFirstField = true;
+    }
+
+    // %s
+    void String(char const* value)
+    {
+        if (mFirstField) {
+            mFirstField = false;
+        } else {
+            mText->push_back(',');
+        }
+        mText->insert(mText->end(), value, value + strlen(value));
+    }
+
+    // %d
+    void Int(int32_t value)
+    {
+        char field[FIELD_SIZE];
+        auto end = field + FIELD_SIZE;
+        char* begin;
+        if (value < 0) {
+            begin = WriteDigits(end, 0ull - (uint64_t) (int64_t) value);
+            *--begin = '-';
+        } else {
+            begin = WriteDigits(end, (uint64_t) value);
+        }
+        AppendField(begin, end);
+    }
+
+    // %llu
+    void UInt64(uint64_t value)
+    {
+        char field[FIELD_SIZE];
+        auto end = field + FIELD_SIZE;
+        AppendField(WriteDigits(end, value), end);
+    }
+
+    // 0x%016llX
+    void Hex64(uint64_t value)
+    {
+        static char const HEX_DIGITS[] = "0123456789ABCDEF";
+
+        char field[FIELD_SIZE];
+        auto end = field + FIELD_SIZE;
+        auto begin = end;
+        for (int i = 0; i < 16; ++i) {
+            *--begin = HEX_DIGITS[value & 0xf];
+            value >>= 4;
+        }
+        *--begin = 'x';
+        *--begin = '0';
+        AppendField(begin, end);
+    }
+
+    // %.<precision>lf
+    void Fixed(double value, uint32_t precision)
+    {
+        static double const SCALE[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        };
+        static uint64_t const INT_SCALE[] = {
+            1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+            10000000ull, 100000000ull, 1000000000ull,
+        };
+
+        assert(precision <= MAX_PRECISION);
+
+        // Keep the scaled value below 2^52 so its fractional part is exact.
+        // This comparison is also false for NaN.
+        auto magnitude = fabs(value);
+        if (!(magnitude * SCALE[precision] < 4.0e15)) {
+            AppendFixedWithPrintf(value, precision);
+            return;
+        }
+
+        // scaled is within half an ulp (scaled * 2^-53) of the exact product,
+        // so the rounding direction is only in doubt if the fractional part
+        // is at least that close to one half.  In that case, add the exact
+        // rounding error of the product to see which side of one half it is
+        // on; the sign of that sum is exact.
+        auto scaled = magnitude * SCALE[precision];
+        auto whole = floor(scaled);
+        auto fromHalf = (scaled - whole) - 0.5;
+        if (fabs(fromHalf) <= scaled * 2.3e-16) {
+            fromHalf += fma(magnitude, SCALE[precision], -scaled);
+            if (fromHalf == 0.0) {
+                AppendFixedWithPrintf(value, precision);
+                return;
+            }
+        }
+
+        auto rounded = (uint64_t) whole + (fromHalf > 0.0 ? 1 : 0);
+
+        char field[FIELD_SIZE];
+        auto end = field + FIELD_SIZE;
+        auto begin = end;
+        if (precision > 0) {
+            auto decimals = rounded % INT_SCALE[precision];
+            for (auto i = precision; i > 0; --i) {
+                *--begin = (char) ('0' + decimals % 10);
+                decimals /= 10;
+            }
+            *--begin = '.';
+        }
+        begin = WriteDigits(begin, rounded / INT_SCALE[precision]);
+
+        // printf keeps the sign of negative values that round to zero.
+        if (signbit(value)) {
+            *--begin = '-';
+        }
+
+        AppendField(begin, end);
+    }
+};
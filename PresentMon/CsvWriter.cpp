@@ -0,0 +1,304 @@
+/*
+Copyright 2017-2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// CSV rows are formatted by a small pool of CsvWriter threads so the output
+// thread doesn't fall behind when many processes are recorded:
+//
+//   - The output thread computes each row's values into a CsvFrameRecord and
+//     appends it to its file's open chunk with QueueCsvRow().  Full chunks,
+//     and every open chunk at the end of each ProcessEvents() pass
+//     (SubmitCsvRows()), are numbered per file and put on a bounded queue.
+//     If the queue is full, the output thread waits (and counts the stall).
+//
+//   - Each CsvWriter thread takes a chunk off the queue, formats its rows,
+//     and then writes every formatted chunk of that file that is next in
+//     order.  Chunks of one file may be formatted in any order and on any
+//     thread, but are written in the order they were queued.
+//
+// FlushCsvRows() must be called before a CSV file is closed, to wait for its
+// queued rows to be written.  The threads are only started when CSV output is
+// enabled.
+
+#include "PresentMon.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+enum {
+    ROWS_PER_CHUNK    = 256,
+    MAX_QUEUED_CHUNKS = 64,
+    MAX_WORKER_COUNT  = 8,
+};
+
+struct CsvFile;
+
+struct CsvChunk {
+    CsvFile* mFile;
+    uint64_t mSequence;
+    std::vector<CsvFrameRecord> mRows;
+    std::vector<char> mText;
+};
+
+struct CsvFile {
+    FILE* mFile;
+
+    // Output thread only
+    std::unique_ptr<CsvChunk> mOpenChunk;
+    uint64_t mNextSequence;
+
+    // Formatted chunks waiting for an earlier chunk to be written, and the
+    // sequence number of the next chunk to write.
+    std::mutex mMutex;
+    std::condition_variable mWritten;
+    std::map<uint64_t, std::unique_ptr<CsvChunk>> mFormatted;
+    uint64_t mNextWriteSequence;
+};
+
+// Output thread only
+std::unordered_map<FILE*, std::unique_ptr<CsvFile>> gFiles;
+std::unordered_map<std::string, std::unique_ptr<std::string const>> gApplicationNames;
+std::vector<std::thread> gWorkers;
+
+// The chunk queue, and chunks that can be reused.  Protected by gQueueMutex.
+std::mutex gQueueMutex;
+std::condition_variable gQueueNotEmpty;
+std::condition_variable gQueueNotFull;
+std::deque<std::unique_ptr<CsvChunk>> gQueue;
+std::vector<std::unique_ptr<CsvChunk>> gFreeChunks;
+bool gStopWorkers = false;
+CsvWriterStats gStats = {};
+
+std::unique_ptr<CsvChunk> AllocateChunk(CsvFile* file)
+{
+    std::unique_ptr<CsvChunk> chunk;
+    {
+        std::lock_guard<std::mutex> lock(gQueueMutex);
+        if (!gFreeChunks.empty()) {
+            chunk = std::move(gFreeChunks.back());
+            gFreeChunks.pop_back();
+        }
+    }
+    if (!chunk) {
+        chunk.reset(new CsvChunk);
+        chunk->mRows.reserve(ROWS_PER_CHUNK);
+    }
+
+    chunk->mFile = file;
+    chunk->mSequence = 0;
+    chunk->mRows.clear();
+    chunk->mText.clear();
+    return chunk;
+}
+
+void SubmitChunk(CsvFile* file)
+{
+    auto chunk = std::move(file->mOpenChunk);
+    chunk->mSequence = file->mNextSequence++;
+
+    std::unique_lock<std::mutex> lock(gQueueMutex);
+    if (gQueue.size() >= MAX_QUEUED_CHUNKS) {
+        auto start = std::chrono::steady_clock::now();
+        gQueueNotFull.wait(lock, []() { return gQueue.size() < MAX_QUEUED_CHUNKS; });
+        gStats.mStallCount += 1;
+        gStats.mStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    gStats.mRowCount += chunk->mRows.size();
+    gStats.mChunkCount += 1;
+    gQueue.emplace_back(std::move(chunk));
+    if (gStats.mMaxQueuedChunks < gQueue.size()) {
+        gStats.mMaxQueuedChunks = (uint32_t) gQueue.size();
+    }
+    gQueueNotEmpty.notify_one();
+}
+
+// Write chunk once every earlier chunk of its file has been written, along
+// with any later chunks that were waiting for it.
+void WriteInOrder(std::unique_ptr<CsvChunk> chunk)
+{
+    auto file = chunk->mFile;
+    std::vector<std::unique_ptr<CsvChunk>> written;
+    {
+        std::lock_guard<std::mutex> lock(file->mMutex);
+        file->mFormatted.emplace(chunk->mSequence, std::move(chunk));
+        for (;;) {
+            auto ii = file->mFormatted.find(file->mNextWriteSequence);
+            if (ii == file->mFormatted.end()) {
+                break;
+            }
+            auto const& text = ii->second->mText;
+            fwrite(text.data(), 1, text.size(), file->mFile);
+            written.emplace_back(std::move(ii->second));
+            file->mFormatted.erase(ii);
+            file->mNextWriteSequence += 1;
+        }
+        if (!written.empty()) {
+            file->mWritten.notify_all();
+        }
+    }
+
+    if (!written.empty()) {
+        std::lock_guard<std::mutex> lock(gQueueMutex);
+        for (auto& c : written) {
+            gFreeChunks.emplace_back(std::move(c));
+        }
+    }
+}
+
+void Worker()
+{
+    for (;;) {
+        std::unique_ptr<CsvChunk> chunk;
+        {
+            std::unique_lock<std::mutex> lock(gQueueMutex);
+            gQueueNotEmpty.wait(lock, []() { return gStopWorkers || !gQueue.empty(); });
+            if (gQueue.empty()) {
+                return;
+            }
+            chunk = std::move(gQueue.front());
+            gQueue.pop_front();
+            gQueueNotFull.notify_one();
+        }
+
+        for (auto const& row : chunk->mRows) {
+            FormatCsvRow(row, &chunk->mText);
+        }
+        WriteInOrder(std::move(chunk));
+    }
+}
+
+}
+
+void StartCsvWriter()
+{
+    auto const& args = GetCommandLineArgs();
+
+    gStopWorkers = false;
+    gStats = {};
+    if (!args.mOutputCsvToFile && !args.mOutputCsvToStdout) {
+        return;
+    }
+
+    auto workerCount = std::thread::hardware_concurrency() / 2;
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > MAX_WORKER_COUNT) workerCount = MAX_WORKER_COUNT;
+
+    gStats.mWorkerCount = workerCount;
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        gWorkers.emplace_back(Worker);
+    }
+}
+
+// Write all queued rows and stop the CsvWriter threads.
+void StopCsvWriter()
+{
+    SubmitCsvRows();
+
+    {
+        std::lock_guard<std::mutex> lock(gQueueMutex);
+        gStopWorkers = true;
+        gQueueNotEmpty.notify_all();
+    }
+    for (auto& worker : gWorkers) {
+        worker.join();
+    }
+    gWorkers.clear();
+
+    gFiles.clear();
+    gFreeChunks.clear();
+    gApplicationNames.clear();
+}
+
+// Queue a CSV row for fp.  The application name is interned here, since the
+// row may be formatted after the process (and its ProcessInfo) is gone.
+void QueueCsvRow(FILE* fp, std::string const& application, CsvFrameRecord* record)
+{
+    auto name = gApplicationNames.find(application);
+    if (name == gApplicationNames.end()) {
+        name = gApplicationNames.emplace(application, std::unique_ptr<std::string const>(new std::string(application))).first;
+    }
+    record->mApplication = name->second.get();
+
+    auto& file = gFiles[fp];
+    if (!file) {
+        file.reset(new CsvFile);
+        file->mFile = fp;
+        file->mNextSequence = 0;
+        file->mNextWriteSequence = 0;
+    }
+    if (!file->mOpenChunk) {
+        file->mOpenChunk = AllocateChunk(file.get());
+    }
+
+    file->mOpenChunk->mRows.push_back(*record);
+    if (file->mOpenChunk->mRows.size() >= ROWS_PER_CHUNK) {
+        SubmitChunk(file.get());
+    }
+}
+
+// Queue every partially-filled chunk.  This is called at the end of each
+// ProcessEvents() pass, so rows aren't held back waiting for a chunk to fill.
+void SubmitCsvRows()
+{
+    for (auto& pair : gFiles) {
+        auto file = pair.second.get();
+        if (file->mOpenChunk) {
+            SubmitChunk(file);
+        }
+    }
+}
+
+// Wait for all the rows queued for fp to be written.  This must be called
+// before fp is closed.
+void FlushCsvRows(FILE* fp)
+{
+    auto ii = gFiles.find(fp);
+    if (ii == gFiles.end()) {
+        return;
+    }
+
+    auto file = ii->second.get();
+    if (file->mOpenChunk) {
+        SubmitChunk(file);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(file->mMutex);
+        file->mWritten.wait(lock, [file]() { return file->mNextWriteSequence == file->mNextSequence; });
+    }
+
+    // fp may be reused by the next file that's opened.
+    gFiles.erase(ii);
+}
+
+CsvWriterStats GetCsvWriterStats()
+{
+    std::lock_guard<std::mutex> lock(gQueueMutex);
+    return gStats;
+}
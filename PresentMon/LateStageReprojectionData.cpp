@@ -23,6 +23,7 @@ SOFTWARE.
 #include <algorithm>
 
 #include "PresentMon.hpp"
+#include "CsvRowWriter.hpp"
 
 enum {
     MAX_HISTORY_TIME = 3000,
@@ -248,7 +249,9 @@ FILE* CreateLsrCsvFile(char const* path)
     return fp;
 }
 
-void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageReprojectionEvent& p)
+// text is a scratch buffer for the row, kept by the caller so its storage is
+// reused from row to row.
+void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageReprojectionEvent& p, std::vector<char>* text)
 {
     auto const& args = GetCommandLineArgs();
 
@@ -271,11 +274,17 @@ void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageRe
     const double deltaMilliseconds = 1000.0 * QpcDeltaToSeconds(curr.QpcTime - prev.QpcTime);
     const double timeInSeconds = QpcToSeconds(p.QpcTime);
 
-    fprintf(fp, "%s,%d,%d", proc->mModuleName.c_str(), curr.GetAppProcessId(), curr.ProcessId);
+    // Format the row and write it with a single call.
+    text->clear();
+
+    CsvRowWriter row(text);
+    row.String(proc->mModuleName.c_str());
+    row.Int((int32_t) curr.GetAppProcessId());
+    row.Int((int32_t) curr.ProcessId);
     if (args.mVerbosity >= Verbosity::Verbose) {
-        fprintf(fp, ",%d", curr.GetAppFrameId());
+        row.Int((int32_t) curr.GetAppFrameId());
     }
-    fprintf(fp, ",%.6lf", timeInSeconds);
+    row.Fixed(timeInSeconds, 6);
     if (args.mVerbosity > Verbosity::Simple) {
         double appPresentDeltaMilliseconds = 0.0;
         double appPresentToLsrMilliseconds = 0.0;
@@ -288,37 +297,41 @@ void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageRe
                 appPresentDeltaMilliseconds = 1000.0 * QpcDeltaToSeconds(currAppPresentTime - prevAppPresentTime);
             }
         }
-        fprintf(fp, ",%.6lf,%.6lf", appPresentDeltaMilliseconds, appPresentToLsrMilliseconds);
+        row.Fixed(appPresentDeltaMilliseconds, 6);
+        row.Fixed(appPresentToLsrMilliseconds, 6);
     }
-    fprintf(fp, ",%.6lf,%d,%d", deltaMilliseconds, !curr.NewSourceLatched, curr.MissedVsyncCount);
+    row.Fixed(deltaMilliseconds, 6);
+    row.Int(!curr.NewSourceLatched);
+    row.Int((int32_t) curr.MissedVsyncCount);
     if (args.mVerbosity >= Verbosity::Verbose) {
-        fprintf(fp, ",%.6lf,%.6lf", 1000 * QpcDeltaToSeconds(curr.Source.GetReleaseFromRenderingToAcquireForPresentationTime()), 1000.0 * QpcDeltaToSeconds(curr.GetAppCpuRenderFrameTime()));
+        row.Fixed(1000 * QpcDeltaToSeconds(curr.Source.GetReleaseFromRenderingToAcquireForPresentationTime()), 6);
+        row.Fixed(1000.0 * QpcDeltaToSeconds(curr.GetAppCpuRenderFrameTime()), 6);
     }
-    fprintf(fp, ",%.6lf", curr.AppPredictionLatencyMs);
+    row.Fixed(curr.AppPredictionLatencyMs, 6);
     if (args.mVerbosity >= Verbosity::Verbose) {
-        fprintf(fp, ",%.6lf,%.6lf", curr.AppMispredictionMs, curr.GetLsrCpuRenderFrameMs());
+        row.Fixed(curr.AppMispredictionMs, 6);
+        row.Fixed(curr.GetLsrCpuRenderFrameMs(), 6);
     }
-    fprintf(fp, ",%.6lf,%.6lf,%.6lf,%.6lf,%.6lf",
-        curr.LsrPredictionLatencyMs,
-        curr.GetLsrMotionToPhotonLatencyMs(),
-        curr.TimeUntilVsyncMs,
-        curr.GetLsrThreadWakeupStartLatchToGpuEndMs(),
-        curr.TotalWakeupErrorMs);
+    row.Fixed(curr.LsrPredictionLatencyMs, 6);
+    row.Fixed(curr.GetLsrMotionToPhotonLatencyMs(), 6);
+    row.Fixed(curr.TimeUntilVsyncMs, 6);
+    row.Fixed(curr.GetLsrThreadWakeupStartLatchToGpuEndMs(), 6);
+    row.Fixed(curr.TotalWakeupErrorMs, 6);
     if (args.mVerbosity >= Verbosity::Verbose) {
-        fprintf(fp, ",%.6lf,%.6lf,%.6lf,%.6lf,%.6lf",
-            curr.ThreadWakeupStartLatchToCpuRenderFrameStartInMs,
-            curr.CpuRenderFrameStartToHeadPoseCallbackStartInMs,
-            curr.HeadPoseCallbackStartToHeadPoseCallbackStopInMs,
-            curr.HeadPoseCallbackStopToInputLatchInMs,
-            curr.InputLatchToGpuSubmissionInMs);
+        row.Fixed(curr.ThreadWakeupStartLatchToCpuRenderFrameStartInMs, 6);
+        row.Fixed(curr.CpuRenderFrameStartToHeadPoseCallbackStartInMs, 6);
+        row.Fixed(curr.HeadPoseCallbackStartToHeadPoseCallbackStopInMs, 6);
+        row.Fixed(curr.HeadPoseCallbackStopToInputLatchInMs, 6);
+        row.Fixed(curr.InputLatchToGpuSubmissionInMs, 6);
     }
-    fprintf(fp, ",%.6lf,%.6lf,%.6lf,%.6lf,%.6lf",
-        curr.GpuSubmissionToGpuStartInMs,
-        curr.GpuStartToGpuStopInMs,
-        curr.GpuStopToCopyStartInMs,
-        curr.CopyStartToCopyStopInMs,
-        curr.CopyStopToVsyncInMs);
-    fprintf(fp, "\n");
+    row.Fixed(curr.GpuSubmissionToGpuStartInMs, 6);
+    row.Fixed(curr.GpuStartToGpuStopInMs, 6);
+    row.Fixed(curr.GpuStopToCopyStartInMs, 6);
+    row.Fixed(curr.CopyStartToCopyStopInMs, 6);
+    row.Fixed(curr.CopyStopToVsyncInMs, 6);
+    row.EndRow();
+
+    fwrite(text->data(), 1, text->size(), fp);
 }
 
 void UpdateConsole(std::unordered_map<uint32_t, ProcessInfo> const& activeProcesses, LateStageReprojectionData& lsr)
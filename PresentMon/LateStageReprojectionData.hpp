@@ -27,6 +27,7 @@ SOFTWARE.
 #include <deque>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 struct LateStageReprojectionRuntimeStats {
     template <typename T>
@@ -105,5 +106,5 @@ private:
 };
 
 FILE* CreateLsrCsvFile(char const* path);
-void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageReprojectionEvent& p);
+void UpdateLsrCsv(LateStageReprojectionData& lsr, ProcessInfo* proc, LateStageReprojectionEvent& p, std::vector<char>* text);
 void UpdateConsole(std::unordered_map<uint32_t, ProcessInfo> const& activeProcesses, LateStageReprojectionData& lsr);
@@ -232,7 +232,8 @@ int main(int argc, char** argv)
     // 
     // RestartAsAdministrator() waits for the elevated process to complete in
     // order to report stderr and obtain it's exit code.
-    if (args.mEtlFileName == nullptr && // realtime analysis
+    if (args.mEtlFileName == nullptr &&           // realtime analysis
+        args.mReplayCaptureFileNames.empty() &&
         !EnableDebugPrivilege()) {      // failed to enable SeDebugPrivilege
         if (args.mTryToElevate) {
             return RestartAsAdministrator(argc, argv);
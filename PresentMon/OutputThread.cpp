@@ -23,13 +23,28 @@ SOFTWARE.
 #include "PresentMon.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <shlwapi.h>
 #include <thread>
 
 static std::thread gThread;
 static bool gQuit = false;
 
+// How often the console is updated and realtime processes are checked for
+// termination.  Presents themselves are processed as soon as the consumer
+// thread signals a batch (see WaitForAnalyzedInfo()).
+static constexpr uint32_t UPDATE_PERIOD_MS = 100;
+
 #ifdef BUILD_PRESENTMON_AS_LIB
+// Subscribers may be added and removed from any thread, including from within
+// a callback.  The lists are guarded by gSubscriberMutex, which is only held
+// while they're changed or copied: the output thread calls subscribers from
+// its own copy, which it refreshes before each present (and batch) whenever
+// gSubscriberGeneration shows the lists have changed.  So a callback is never
+// called with the lock held, and once Unsubscribe*() returns it's called at
+// most for the present or batch already being dispatched.
 struct SubscriberOnPresentEvent
 {
     fnCallbackOnPresentEvent Callback;
@@ -40,37 +55,124 @@ struct SubscriberOnPresentEvent
         Context = context;
     }
 };
+struct SubscriberOnPresentBatch
+{
+    fnCallbackOnPresentBatch Callback;
+    void* Context;
+    SubscriberOnPresentBatch(const fnCallbackOnPresentBatch callback, void* context)
+    {
+        Callback = callback;
+        Context = context;
+    }
+};
+static std::mutex gSubscriberMutex;
+static std::atomic<uint32_t> gSubscriberGeneration(0);
 static std::vector<SubscriberOnPresentEvent> TheSubscribersOnPresentEvent;
+static std::vector<SubscriberOnPresentBatch> TheSubscribersOnPresentBatch;
 
-void SubscribeOnPresentEvent(fnCallbackOnPresentEvent callback, void* context)
+// Output thread only:
+static uint32_t gDispatchGeneration = 0;
+static std::vector<SubscriberOnPresentEvent> gDispatchOnPresentEvent;
+static std::vector<SubscriberOnPresentBatch> gDispatchOnPresentBatch;
+static std::vector<PresentFrame> gPresentBatch;    // Presents for gDispatchOnPresentBatch
+
+template<typename Subscriber, typename Callback>
+static void AddSubscriber(std::vector<Subscriber>* subscribers, Callback callback, void* context)
+{
+    std::lock_guard<std::mutex> lock(gSubscriberMutex);
+    for (auto const& sub : *subscribers)
+    {
+        if ((sub.Callback == callback) &&
+            (sub.Context == context))
+        {
+            return;
+        }
+    }
+
+    subscribers->emplace_back(callback, context);
+    gSubscriberGeneration.fetch_add(1, std::memory_order_release);
+}
+
+template<typename Subscriber, typename Callback>
+static void RemoveSubscriber(std::vector<Subscriber>* subscribers, Callback callback, void* context)
 {
-    bool isduplicate = false;
-    for (auto sub = TheSubscribersOnPresentEvent.begin(); sub != TheSubscribersOnPresentEvent.end(); ++sub)
+    std::lock_guard<std::mutex> lock(gSubscriberMutex);
+    for (auto sub = subscribers->begin(); sub != subscribers->end(); ++sub)
     {
         if ((sub->Callback == callback) &&
             (sub->Context == context))
         {
-            isduplicate = true;
+            subscribers->erase(sub);
+            gSubscriberGeneration.fetch_add(1, std::memory_order_release);
             break;
         }
     }
+}
 
-    if (isduplicate == false)
-    { 
-        SubscriberOnPresentEvent sub(callback, context);
-        TheSubscribersOnPresentEvent.push_back(sub);
-    }
+void SubscribeOnPresentEvent(fnCallbackOnPresentEvent callback, void* context)
+{
+    AddSubscriber(&TheSubscribersOnPresentEvent, callback, context);
 }
 void UnsubscribeOnPresentEvent(fnCallbackOnPresentEvent callback, void* context)
 {
-    for (auto sub = TheSubscribersOnPresentEvent.begin(); sub != TheSubscribersOnPresentEvent.end(); ++sub)
+    RemoveSubscriber(&TheSubscribersOnPresentEvent, callback, context);
+}
+void SubscribeOnPresentBatch(fnCallbackOnPresentBatch callback, void* context)
+{
+    AddSubscriber(&TheSubscribersOnPresentBatch, callback, context);
+}
+void UnsubscribeOnPresentBatch(fnCallbackOnPresentBatch callback, void* context)
+{
+    RemoveSubscriber(&TheSubscribersOnPresentBatch, callback, context);
+}
+
+static void UpdateDispatchSubscribers()
+{
+    if (gSubscriberGeneration.load(std::memory_order_acquire) != gDispatchGeneration) {
+        std::lock_guard<std::mutex> lock(gSubscriberMutex);
+        gDispatchOnPresentEvent = TheSubscribersOnPresentEvent;
+        gDispatchOnPresentBatch = TheSubscribersOnPresentBatch;
+        gDispatchGeneration = gSubscriberGeneration.load(std::memory_order_relaxed);
+    }
+}
+
+static void NotifyPresentEventSubscribers(ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& presentEvent)
+{
+    UpdateDispatchSubscribers();
+
+    for (auto const& sub : gDispatchOnPresentEvent)
     {
-        if ((sub->Callback == callback) &&
-            (sub->Context == context))
+        sub.Callback(sub.Context, processInfo, chain, presentEvent);
+    }
+
+    if (!gDispatchOnPresentBatch.empty()) {
+        PresentFrame frame;
+        frame.mSwapChainAddress = presentEvent.SwapChainAddress;
+        frame.mQpcTime          = presentEvent.QpcTime;
+        frame.mTimeTaken        = presentEvent.TimeTaken;
+        frame.mReadyTime        = presentEvent.ReadyTime;
+        frame.mScreenTime       = presentEvent.ScreenTime;
+        frame.mProcessId        = presentEvent.ProcessId;
+        frame.mSyncInterval     = presentEvent.SyncInterval;
+        frame.mPresentFlags     = presentEvent.PresentFlags;
+        frame.mRuntime          = presentEvent.Runtime;
+        frame.mPresentMode      = presentEvent.PresentMode;
+        frame.mFinalState       = presentEvent.FinalState;
+        gPresentBatch.emplace_back(frame);
+    }
+}
+
+// Called once all of a ProcessEvents() pass's presents have been added.
+static void NotifyPresentBatchSubscribers()
+{
+    if (!gPresentBatch.empty()) {
+        UpdateDispatchSubscribers();
+
+        for (auto const& sub : gDispatchOnPresentBatch)
         {
-            TheSubscribersOnPresentEvent.erase(sub);
-            break;
+            sub.Callback(sub.Context, gPresentBatch.data(), gPresentBatch.size());
         }
+        gPresentBatch.clear();
     }
 }
 #endif
@@ -104,7 +206,7 @@ void SetOutputRecordingState(bool record)
     // When capturing from an ETL file, just use the current recording state.
     // It's not clear how best to map realtime to ETL QPC time, and there
     // aren't any realtime cues in this case.
-    if (args.mEtlFileName != nullptr) {
+    if (args.mEtlFileName != nullptr || !args.mReplayCaptureFileNames.empty()) {
         EnterCriticalSection(&gRecordingToggleCS);
         gIsRecording = record;
         LeaveCriticalSection(&gRecordingToggleCS);
@@ -153,6 +255,43 @@ static void UpdateRecordingToggles(size_t nextIndex)
 static std::unordered_map<uint32_t, ProcessInfo> gProcesses;
 static uint32_t gTargetProcessCount = 0;
 
+// Present history stored in SwapChainData is limited to 2 seconds, so that
+// processes that stop presenting are removed from the console display.
+// Rather than sweeping every swapchain each batch, each swapchain with
+// history has one entry in gSwapChainExpiry for when its oldest present gets
+// too old, so a batch only touches the swapchains that have presents
+// expiring.  Swapchains whose history becomes empty are evicted.
+//
+// This only applies to ConsoleOutput::Full, otherwise it's ok to just leave
+// the older presents in the history buffer since they aren't used for
+// anything.
+//
+// In realtime collection, processes that we couldn't open a handle to are
+// never noticed exiting.  These are scheduled in gProcessExpiry and evicted
+// once they stop presenting for the same duration; GetProcessInfo() will
+// recreate them the same way if they present again.
+struct SwapChainExpiry {
+    uint32_t mProcessId;
+    uint64_t mSwapChainAddress;
+    uint64_t mDeadline;
+};
+
+struct ProcessExpiry {
+    uint32_t mProcessId;
+    uint64_t mDeadline;
+};
+
+static constexpr double HISTORY_DURATION_SECONDS = 2.0;
+static constexpr double HISTORY_EXPIRY_TICK_SECONDS = 0.1;
+static constexpr uint32_t HISTORY_EXPIRY_SLOT_COUNT = 32;   // Covers HISTORY_DURATION_SECONDS
+
+static TimerWheel<SwapChainExpiry> gSwapChainExpiry;
+static TimerWheel<ProcessExpiry> gProcessExpiry;
+static uint64_t gHistoryDurationQpc = 0;
+static bool gPruneHistory = false;
+static bool gEvictIdleProcesses = false;
+static bool gKeepTargetProcesses = false;
+
 static bool IsTargetProcess(uint32_t processId, std::string const& processName)
 {
     auto const& args = GetCommandLineArgs();
@@ -192,6 +331,8 @@ static void InitProcessInfo(ProcessInfo* processInfo, uint32_t processId, HANDLE
     processInfo->mModuleName         = processName;
     processInfo->mOutputCsv.mFile    = nullptr;
     processInfo->mOutputCsv.mWmrFile = nullptr;
+    processInfo->mLastPresentQpc     = 0;
+    processInfo->mExpiryQpc          = 0;
     processInfo->mTargetProcess      = target;
 
     if (target) {
@@ -217,7 +358,7 @@ static ProcessInfo* GetProcessInfo(uint32_t processId)
         auto const& args = GetCommandLineArgs();
         HANDLE handle = NULL;
         char const* processName = "<error>";
-        if (args.mEtlFileName == nullptr) {
+        if (args.mEtlFileName == nullptr && args.mReplayCaptureFileNames.empty()) {
             char path[MAX_PATH];
             DWORD numChars = sizeof(path);
             handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
@@ -299,68 +440,137 @@ static void UpdateProcesses(std::vector<ProcessEvent> const& processEvents, std:
     }
 }
 
-static void AddPresents(std::vector<std::shared_ptr<PresentEvent>> const& presentEvents, size_t* presentEventIndex,
+static void InitializeHistoryExpiry()
+{
+    auto const& args = GetCommandLineArgs();
+
+    gPruneHistory = args.mConsoleOutputType == ConsoleOutput::Full;
+    gEvictIdleProcesses = args.mEtlFileName == nullptr && args.mReplayCaptureFileNames.empty();
+    gKeepTargetProcesses = args.mTerminateOnProcExit;
+    gHistoryDurationQpc = SecondsDeltaToQpc(HISTORY_DURATION_SECONDS);
+
+    auto tickDuration = max(SecondsDeltaToQpc(HISTORY_EXPIRY_TICK_SECONDS), (uint64_t) 1);
+    gSwapChainExpiry.Initialize(tickDuration, HISTORY_EXPIRY_SLOT_COUNT);
+    gProcessExpiry.Initialize(tickDuration, HISTORY_EXPIRY_SLOT_COUNT);
+}
+
+static void SchedulePresentExpiry(uint32_t processId, ProcessInfo* processInfo, uint64_t presentQpc)
+{
+    processInfo->mLastPresentQpc = presentQpc;
+    // Target processes are counted for -terminate_on_proc_exit, so are only
+    // removed once they exit.
+    if (gEvictIdleProcesses &&
+        processInfo->mHandle == NULL &&
+        processInfo->mExpiryQpc == 0 &&
+        !(gKeepTargetProcesses && processInfo->mTargetProcess)) {
+        processInfo->mExpiryQpc = presentQpc + gHistoryDurationQpc;
+        gProcessExpiry.Schedule(processInfo->mExpiryQpc, ProcessExpiry{ processId, processInfo->mExpiryQpc });
+    }
+}
+
+static void ScheduleSwapChainExpiry(uint32_t processId, uint64_t swapChainAddress, SwapChainData* chain)
+{
+    auto const& oldest = chain->GetPresent(chain->mNextPresentIndex - chain->mPresentHistoryCount);
+    chain->mExpiryQpc = oldest.mQpcTime + gHistoryDurationQpc;
+    gSwapChainExpiry.Schedule(chain->mExpiryQpc, SwapChainExpiry{ processId, swapChainAddress, chain->mExpiryQpc });
+}
+
+static void AddPresentToHistory(SwapChainData* chain, PresentEvent const& presentEvent)
+{
+    // If the history is full, grow it unless its oldest present is already
+    // older than the history duration (or it's at the maximum size), in
+    // which case the oldest present is replaced.
+    auto capacity = (uint32_t) chain->mPresentHistory.size();
+    if (chain->mPresentHistoryCount == capacity) {
+        if (capacity == 0 || (
+            capacity < SwapChainData::PRESENT_HISTORY_MAX_COUNT &&
+            chain->GetPresent(chain->mNextPresentIndex - capacity).mQpcTime + gHistoryDurationQpc > presentEvent.QpcTime)) {
+            auto newCapacity = max(2 * capacity, (uint32_t) SwapChainData::PRESENT_HISTORY_MIN_COUNT);
+            std::vector<PresentRecord> history(newCapacity);
+            for (auto index = chain->mNextPresentIndex - capacity; index != chain->mNextPresentIndex; ++index) {
+                history[index & (newCapacity - 1)] = chain->GetPresent(index);
+            }
+            chain->mPresentHistory.swap(history);
+        } else {
+            chain->mPresentHistoryCount -= 1;
+        }
+    }
+
+    auto record = &chain->mPresentHistory[chain->mNextPresentIndex & (chain->mPresentHistory.size() - 1)];
+    record->mQpcTime     = presentEvent.QpcTime;
+    record->mTimeTaken   = presentEvent.TimeTaken;
+    record->mReadyTime   = presentEvent.ReadyTime;
+    record->mScreenTime  = presentEvent.ScreenTime;
+    record->mFinalState  = presentEvent.FinalState;
+    record->mPresentMode = presentEvent.PresentMode;
+
+    chain->mRuntime      = presentEvent.Runtime;
+    chain->mSyncInterval = presentEvent.SyncInterval;
+    chain->mPresentFlags = presentEvent.PresentFlags;
+
+    if (presentEvent.FinalState == PresentResult::Presented) {
+        chain->mLastDisplayedPresentIndex = chain->mNextPresentIndex;
+        chain->mLastDisplayedScreenTime = presentEvent.ScreenTime;
+    } else if (chain->mLastDisplayedPresentIndex == chain->mNextPresentIndex) {
+        chain->mLastDisplayedPresentIndex = 0;
+    }
+
+    chain->mNextPresentIndex += 1;
+    chain->mPresentHistoryCount += 1;
+}
+
+static void AddPresents(std::vector<PresentEvent> const& presentEvents, size_t* presentEventIndex,
                         bool recording, bool checkStopQpc, uint64_t stopQpc, bool* hitStopQpc)
 {
     auto i = *presentEventIndex;
     for (auto n = presentEvents.size(); i < n; ++i) {
-        auto presentEvent = presentEvents[i];
-        assert(presentEvent->Completed);
+        auto const& presentEvent = presentEvents[i];
+        assert(presentEvent.Completed);
 
         // Stop processing events if we hit the next stop time.
-        if (checkStopQpc && presentEvent->QpcTime >= stopQpc) {
+        if (checkStopQpc && presentEvent.QpcTime >= stopQpc) {
             *hitStopQpc = true;
             break;
         }
 
         // Look up the swapchain this present belongs to.
-        auto processInfo = GetProcessInfo(presentEvent->ProcessId);
+        auto processInfo = GetProcessInfo(presentEvent.ProcessId);
+        SchedulePresentExpiry(presentEvent.ProcessId, processInfo, presentEvent.QpcTime);
         if (!processInfo->mTargetProcess) {
             continue;
         }
 
-        auto result = processInfo->mSwapChain.emplace(presentEvent->SwapChainAddress, SwapChainData());
+        auto result = processInfo->mSwapChain.emplace(presentEvent.SwapChainAddress, SwapChainData());
         auto chain = &result.first->second;
         if (result.second) {
             chain->mPresentHistoryCount = 0;
             chain->mNextPresentIndex = 1; // Start at 1 so that mLastDisplayedPresentIndex starts out invalid.
             chain->mLastDisplayedPresentIndex = 0;
+            chain->mLastDisplayedScreenTime = 0;
+            chain->mExpiryQpc = 0;
         }
 
         // Output CSV row if recording (need to do this before updating chain).
         if (recording) {
-            UpdateCsv(processInfo, *chain, *presentEvent);
+            UpdateCsv(processInfo, *chain, presentEvent);
         }
 
 #ifdef BUILD_PRESENTMON_AS_LIB
-        for (auto& sub : TheSubscribersOnPresentEvent)
-        {
-            if (sub.Callback != nullptr)
-            {
-                sub.Callback(sub.Context, processInfo, *chain, *presentEvent);
-            }
-        }
+        NotifyPresentEventSubscribers(processInfo, *chain, presentEvent);
 #endif
 
         // Add the present to the swapchain history.
-        chain->mPresentHistory[chain->mNextPresentIndex % SwapChainData::PRESENT_HISTORY_MAX_COUNT] = presentEvent;
-
-        if (presentEvent->FinalState == PresentResult::Presented) {
-            chain->mLastDisplayedPresentIndex = chain->mNextPresentIndex;
-        } else if (chain->mLastDisplayedPresentIndex == chain->mNextPresentIndex) {
-            chain->mLastDisplayedPresentIndex = 0;
-        }
+        AddPresentToHistory(chain, presentEvent);
 
-        chain->mNextPresentIndex += 1;
-        if (chain->mPresentHistoryCount < SwapChainData::PRESENT_HISTORY_MAX_COUNT) {
-            chain->mPresentHistoryCount += 1;
+        if (gPruneHistory && chain->mExpiryQpc == 0) {
+            ScheduleSwapChainExpiry(presentEvent.ProcessId, presentEvent.SwapChainAddress, chain);
         }
     }
 
     *presentEventIndex = i;
 }
 
-static void AddPresents(LateStageReprojectionData* lsrData,
+static void AddPresents(LateStageReprojectionData* lsrData, std::vector<char>* lsrCsvText,
                         std::vector<std::shared_ptr<LateStageReprojectionEvent>> const& presentEvents, size_t* presentEventIndex,
                         bool recording, bool checkStopQpc, uint64_t stopQpc, bool* hitStopQpc)
 {
@@ -381,6 +591,7 @@ static void AddPresents(LateStageReprojectionData* lsrData,
 
         const uint32_t appProcessId = presentEvent->GetAppProcessId();
         auto processInfo = GetProcessInfo(appProcessId);
+        SchedulePresentExpiry(appProcessId, processInfo, presentEvent->QpcTime);
         if (!processInfo->mTargetProcess) {
             continue;
         }
@@ -392,7 +603,7 @@ static void AddPresents(LateStageReprojectionData* lsrData,
         lsrData->AddLateStageReprojection(*presentEvent);
 
         if (recording) {
-            UpdateLsrCsv(*lsrData, processInfo, *presentEvent);
+            UpdateLsrCsv(*lsrData, processInfo, *presentEvent, lsrCsvText);
         }
 
         lsrData->UpdateLateStageReprojectionInfo();
@@ -401,54 +612,100 @@ static void AddPresents(LateStageReprojectionData* lsrData,
     *presentEventIndex = i;
 }
 
-// Limit the present history stored in SwapChainData to 2 seconds.
-static void PruneHistory(
+// Prune the history of swapchains whose oldest present is now older than
+// HISTORY_DURATION_SECONDS, and evict any swapchains and processes that have
+// gone idle.
+static void ExpireHistory(
+    LateStageReprojectionData const& lsrData,
     std::vector<ProcessEvent> const& processEvents,
-    std::vector<std::shared_ptr<PresentEvent>> const& presentEvents,
+    std::vector<PresentEvent> const& presentEvents,
     std::vector<std::shared_ptr<LateStageReprojectionEvent>> const& lsrEvents)
 {
     assert(processEvents.size() + presentEvents.size() + lsrEvents.size() > 0);
 
     auto latestQpc = max(max(
         processEvents.empty() ? 0ull : processEvents.back().QpcTime,
-        presentEvents.empty() ? 0ull : presentEvents.back()->QpcTime),
+        presentEvents.empty() ? 0ull : presentEvents.back().QpcTime),
         lsrEvents.empty()     ? 0ull : lsrEvents.back()->QpcTime);
 
-    auto minQpc = latestQpc - SecondsDeltaToQpc(2.0);
+    auto minQpc = latestQpc - gHistoryDurationQpc;
 
-    for (auto& pair : gProcesses) {
-        auto processInfo = &pair.second;
-        for (auto& pair2 : processInfo->mSwapChain) {
-            auto swapChain = &pair2.second;
-
-            auto count = swapChain->mPresentHistoryCount;
-            for (; count > 0; --count) {
-                auto index = swapChain->mNextPresentIndex - count;
-                auto const& presentEvent = swapChain->mPresentHistory[index % SwapChainData::PRESENT_HISTORY_MAX_COUNT];
-                if (presentEvent->QpcTime >= minQpc) {
-                    break;
-                }
-                if (index == swapChain->mLastDisplayedPresentIndex) {
-                    swapChain->mLastDisplayedPresentIndex = 0;
-                }
+    gSwapChainExpiry.Advance(latestQpc, [minQpc](SwapChainExpiry const& expiry) {
+        // Ignore the expiry if the process terminated, or if the swapchain
+        // was evicted and has been scheduled again since.
+        auto ii = gProcesses.find(expiry.mProcessId);
+        if (ii == gProcesses.end()) {
+            return;
+        }
+        auto processInfo = &ii->second;
+        auto jj = processInfo->mSwapChain.find(expiry.mSwapChainAddress);
+        if (jj == processInfo->mSwapChain.end() || jj->second.mExpiryQpc != expiry.mDeadline) {
+            return;
+        }
+        auto swapChain = &jj->second;
+
+        auto count = swapChain->mPresentHistoryCount;
+        for (; count > 0; --count) {
+            auto index = swapChain->mNextPresentIndex - count;
+            if (swapChain->GetPresent(index).mQpcTime >= minQpc) {
+                break;
+            }
+            if (index == swapChain->mLastDisplayedPresentIndex) {
+                swapChain->mLastDisplayedPresentIndex = 0;
             }
+        }
 
-            swapChain->mPresentHistoryCount = count;
+        if (count == 0) {
+            processInfo->mSwapChain.erase(jj);
+            return;
         }
+
+        swapChain->mPresentHistoryCount = count;
+        ScheduleSwapChainExpiry(expiry.mProcessId, expiry.mSwapChainAddress, swapChain);
+    });
+
+    // LateStageReprojectionData keeps referring to the processes of its most
+    // recent events, so don't evict any processes while it has data.
+    if (lsrData.HasData()) {
+        return;
     }
+
+    gProcessExpiry.Advance(latestQpc, [minQpc, latestQpc](ProcessExpiry const& expiry) {
+        auto ii = gProcesses.find(expiry.mProcessId);
+        if (ii == gProcesses.end() || ii->second.mExpiryQpc != expiry.mDeadline) {
+            return;
+        }
+        auto processInfo = &ii->second;
+
+        // Keep the process if it has presented since this was scheduled, or
+        // still has swapchain history or CSV files open, and check again
+        // later.
+        if (processInfo->mLastPresentQpc >= minQpc ||
+            !processInfo->mSwapChain.empty() ||
+            processInfo->mOutputCsv.mFile != nullptr ||
+            processInfo->mOutputCsv.mWmrFile != nullptr) {
+            processInfo->mExpiryQpc = max(processInfo->mLastPresentQpc, (uint64_t) latestQpc) + gHistoryDurationQpc;
+            gProcessExpiry.Schedule(processInfo->mExpiryQpc, ProcessExpiry{ expiry.mProcessId, processInfo->mExpiryQpc });
+            return;
+        }
+
+        if (processInfo->mTargetProcess) {
+            gTargetProcessCount -= 1;
+        }
+        gProcesses.erase(ii);
+    });
 }
 
 static void ProcessEvents(
     LateStageReprojectionData* lsrData,
+    std::vector<char>* lsrCsvText,
     std::vector<ProcessEvent>* processEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* presentEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* lostPresentEvents,
+    std::vector<PresentEvent>* presentEvents,
+    std::vector<PresentEvent>* lostPresentEvents,
     std::vector<std::shared_ptr<LateStageReprojectionEvent>>* lsrEvents,
     std::vector<uint64_t>* recordingToggleHistory,
     std::vector<std::pair<uint32_t, uint64_t>>* terminatedProcesses)
 {
-    auto const& args = GetCommandLineArgs();
-
     // Copy any analyzed information from ConsumerThread and early-out if there
     // isn't any.
     DequeueAnalyzedInfo(processEvents, presentEvents, lostPresentEvents, lsrEvents);
@@ -498,7 +755,7 @@ static void ProcessEvents(
 
             auto hitTerminatedProcess = false;
             AddPresents(*presentEvents, &presentEventIndex, recording, true, terminatedProcessQpc, &hitTerminatedProcess);
-            AddPresents(lsrData, *lsrEvents, &lsrEventIndex, recording, true, terminatedProcessQpc, &hitTerminatedProcess);
+            AddPresents(lsrData, lsrCsvText, *lsrEvents, &lsrEventIndex, recording, true, terminatedProcessQpc, &hitTerminatedProcess);
             if (!hitTerminatedProcess) {
                 goto done;
             }
@@ -510,7 +767,7 @@ static void ProcessEvents(
         // handling all the presents and any outstanding toggles will have to
         // wait for next batch of events.
         AddPresents(*presentEvents, &presentEventIndex, recording, checkRecordingToggle, nextRecordingToggleQpc, &hitNextRecordingToggle);
-        AddPresents(lsrData, *lsrEvents, &lsrEventIndex, recording, checkRecordingToggle, nextRecordingToggleQpc, &hitNextRecordingToggle);
+        AddPresents(lsrData, lsrCsvText, *lsrEvents, &lsrEventIndex, recording, checkRecordingToggle, nextRecordingToggleQpc, &hitNextRecordingToggle);
         if (!hitNextRecordingToggle) {
             break;
         }
@@ -529,14 +786,16 @@ static void ProcessEvents(
 
 done:
 
-    // Limit the present history stored in SwapChainData to 2 seconds, so that
-    // processes that stop presenting are removed from the console display.
-    // This only applies to ConsoleOutput::Full, otherwise it's ok to just
-    // leave the older presents in the history buffer since they aren't used
-    // for anything.
-    if (args.mConsoleOutputType == ConsoleOutput::Full) {
-        PruneHistory(*processEvents, *presentEvents, *lsrEvents);
-    }
+    // Hand this pass's rows to the CSV writers, including any chunks that
+    // aren't full yet.
+    SubmitCsvRows();
+
+#ifdef BUILD_PRESENTMON_AS_LIB
+    NotifyPresentBatchSubscribers();
+#endif
+
+    // Prune present history and evict idle swapchains and processes.
+    ExpireHistory(*lsrData, *processEvents, *presentEvents, *lsrEvents);
 
     // Clear events processed.
     processEvents->clear();
@@ -565,9 +824,10 @@ void Output()
 
     // Structures to track processes and statistics from recorded events.
     LateStageReprojectionData lsrData;
+    std::vector<char> lsrCsvText;
     std::vector<ProcessEvent> processEvents;
-    std::vector<std::shared_ptr<PresentEvent>> presentEvents;
-    std::vector<std::shared_ptr<PresentEvent>> lostPresentEvents;
+    std::vector<PresentEvent> presentEvents;
+    std::vector<PresentEvent> lostPresentEvents;
     std::vector<std::shared_ptr<LateStageReprojectionEvent>> lsrEvents;
     std::vector<uint64_t> recordingToggleHistory;
     std::vector<std::pair<uint32_t, uint64_t>> terminatedProcesses;
@@ -577,6 +837,10 @@ void Output()
     recordingToggleHistory.reserve(16);
     terminatedProcesses.reserve(16);
 
+    InitializeHistoryExpiry();
+    StartCsvWriter();
+
+    auto lastUpdate = std::chrono::steady_clock::now() - std::chrono::milliseconds(UPDATE_PERIOD_MS);
     for (;;) {
         // Read gQuit here, but then check it after processing queued events.
         // This ensures that we call DequeueAnalyzedInfo() at least once after
@@ -585,7 +849,16 @@ void Output()
 
         // Copy and process all the collected events, and update the various
         // tracking and statistics data structures.
-        ProcessEvents(&lsrData, &processEvents, &presentEvents, &lostPresentEvents, &lsrEvents, &recordingToggleHistory, &terminatedProcesses);
+        ProcessEvents(&lsrData, &lsrCsvText, &processEvents, &presentEvents, &lostPresentEvents, &lsrEvents, &recordingToggleHistory, &terminatedProcesses);
+        AnalyzedInfoDelivered();
+
+        // The rest only needs to happen every UPDATE_PERIOD_MS, and when
+        // quitting.
+        auto now = std::chrono::steady_clock::now();
+        auto update = quit || now - lastUpdate >= std::chrono::milliseconds(UPDATE_PERIOD_MS);
+        if (update) {
+            lastUpdate = now;
+        }
 
         // Display information to console if requested.  If debug build and
         // simple console, print a heartbeat if recording.
@@ -595,7 +868,7 @@ void Output()
         // don't need the critical section.
 #if !DEBUG_VERBOSE
         auto realtimeRecording = gIsRecording;
-        switch (args.mConsoleOutputType) {
+        switch (update ? args.mConsoleOutputType : ConsoleOutput::None) {
         case ConsoleOutput::None:
             break;
         case ConsoleOutput::Simple:
@@ -626,10 +899,14 @@ void Output()
         }
 
         // Update tracking information.
-        CheckForTerminatedRealtimeProcesses(&terminatedProcesses);
+        if (update) {
+            CheckForTerminatedRealtimeProcesses(&terminatedProcesses);
+        }
 
-        // Sleep to reduce overhead.
-        Sleep(100);
+        // Wait for the consumer thread to queue more events, or until the
+        // next update.
+        auto untilUpdate = std::chrono::milliseconds(UPDATE_PERIOD_MS) - (now - lastUpdate);
+        WaitForAnalyzedInfo((uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(untilUpdate).count());
     }
 
     // Output warning if events were lost.
@@ -643,7 +920,15 @@ void Output()
         fprintf(stderr, "warning: %lu ETW events were lost.\n", eventsLost);
     }
 
-    // Close all CSV and process handles
+    LostPresentStats lostPresents = {};
+    CheckLostPresents(&lostPresents);
+    if (lostPresents.Expired > 0 || lostPresents.Evicted > 0) {
+        fprintf(stderr, "warning: %llu presents timed out and %llu were dropped because too many were in flight.\n",
+            lostPresents.Expired, lostPresents.Evicted);
+    }
+
+    // Write any CSV rows still queued, then close all CSV and process handles
+    StopCsvWriter();
     for (auto& pair : gProcesses) {
         auto processInfo = &pair.second;
         if (processInfo->mHandle != NULL) {
@@ -667,6 +952,7 @@ void StopOutputThread()
 {
     if (gThread.joinable()) {
         gQuit = true;
+        StopWaitingForAnalyzedInfo();
         gThread.join();
 
         DeleteCriticalSection(&gRecordingToggleCS);
@@ -40,6 +40,9 @@ PresentMon Architecture:
     OutputThread: is controlled by the trace session, and outputs analyzed
     events to the CSV and/or console.
 
+    CsvWriter threads: format the CSV rows that OutputThread queues, and
+    write them to each CSV file in the order they were queued.
+
 The trace session and ETW analysis is always running, but whether or not
 collected data is written to the CSV file(s) is controlled by a recording state
 which is controlled from MainThread based on user input or timer.
@@ -47,8 +50,10 @@ which is controlled from MainThread based on user input or timer.
 
 #include "../PresentData/MixedRealityTraceConsumer.hpp"
 #include "../PresentData/PresentMonTraceConsumer.hpp"
+#include "../PresentData/TraceSession.hpp"
 
 #include <unordered_map>
+#include <vector>
 
 enum class Verbosity {
     Simple,
@@ -65,14 +70,19 @@ enum class ConsoleOutput {
 struct CommandLineArgs {
     std::vector<const char*> mTargetProcessNames;
     std::vector<const char*> mExcludeProcessNames;
+    std::vector<const char*> mReplayCaptureFileNames;
     const char *mOutputCsvFileName;
     const char *mEtlFileName;
+    const char *mWriteCaptureFileName;
+    const char *mMetadataCacheFileName;
     const char *mSessionName;
     UINT mTargetPid;
     UINT mDelay;
     UINT mTimer;
     UINT mHotkeyModifiers;
     UINT mHotkeyVirtualKeyCode;
+    UINT mOutputBatchSize;
+    UINT mOutputLatencyMs;
     ConsoleOutput mConsoleOutputType;
     Verbosity mVerbosity;
     bool mOutputCsvToFile;
@@ -92,16 +102,46 @@ struct CommandLineArgs {
     bool mStopExistingSession;
 };
 
+// The parts of a PresentEvent kept in a swapchain's present history.
+struct PresentRecord {
+    uint64_t mQpcTime;
+    uint64_t mTimeTaken;
+    uint64_t mReadyTime;
+    uint64_t mScreenTime;
+    PresentResult mFinalState;
+    PresentMode mPresentMode;
+};
+
 // CSV output only requires last presented/displayed event to compute frame
 // information, but if outputing to the console we maintain a longer history of
-// presents to compute averages, limited to 120 events (2 seconds @ 60Hz) to
-// reduce memory/compute overhead.
+// presents to compute averages.
+//
+// The history is a ring of PresentRecords indexed by present number, where
+// mNextPresentIndex - 1 is the latest present.  The ring starts small and
+// doubles whenever it is full while its oldest present is less than 2
+// seconds old, so it covers 2 seconds at any present rate up to
+// PRESENT_HISTORY_MAX_COUNT / 2 Hz.
 struct SwapChainData {
-    enum { PRESENT_HISTORY_MAX_COUNT = 120 };
-    std::shared_ptr<PresentEvent> mPresentHistory[PRESENT_HISTORY_MAX_COUNT];
+    enum {
+        PRESENT_HISTORY_MIN_COUNT = 16,
+        PRESENT_HISTORY_MAX_COUNT = 4096,
+    };
+    std::vector<PresentRecord> mPresentHistory; // Size is zero or a power of two
     uint32_t mPresentHistoryCount;
     uint32_t mNextPresentIndex;
     uint32_t mLastDisplayedPresentIndex;
+    uint64_t mLastDisplayedScreenTime;
+    uint64_t mExpiryQpc;    // Deadline scheduled to prune this history, or 0 if none
+
+    // Properties of the latest present
+    Runtime mRuntime;
+    int32_t mSyncInterval;
+    uint32_t mPresentFlags;
+
+    PresentRecord const& GetPresent(uint32_t presentIndex) const
+    {
+        return mPresentHistory[presentIndex & (mPresentHistory.size() - 1)];
+    }
 };
 
 struct OutputCsv {
@@ -109,11 +149,47 @@ struct OutputCsv {
     FILE* mWmrFile;
 };
 
+// The values for one CSV row, computed by the output thread and formatted by
+// a CsvWriter thread.  mApplication points to a name interned by
+// QueueCsvRow(), so it stays valid after the process exits.
+struct CsvFrameRecord {
+    std::string const* mApplication;
+    uint64_t mSwapChainAddress;
+    uint64_t mQpcTime;
+    double mTimeInSeconds;
+    double mMsBetweenPresents;
+    double mMsBetweenDisplayChange;
+    double mMsInPresentApi;
+    double mMsUntilRenderComplete;
+    double mMsUntilDisplayed;
+    double mQpcTimeInSeconds;
+    uint32_t mProcessId;
+    uint32_t mPresentFlags;
+    int32_t mSyncInterval;
+    Runtime mRuntime;
+    PresentMode mPresentMode;
+    PresentResult mFinalState;
+    bool mSupportsTearing;
+    bool mWasBatched;
+    bool mDwmNotified;
+};
+
+struct CsvWriterStats {
+    uint64_t mRowCount;
+    uint64_t mChunkCount;
+    uint64_t mStallCount;           // Times the output thread waited for a full queue
+    double mStallSeconds;           // Total time spent waiting
+    uint32_t mMaxQueuedChunks;
+    uint32_t mWorkerCount;
+};
+
 struct ProcessInfo {
     std::string mModuleName;
     std::unordered_map<uint64_t, SwapChainData> mSwapChain;
     HANDLE mHandle;
     OutputCsv mOutputCsv;
+    uint64_t mLastPresentQpc;
+    uint64_t mExpiryQpc;    // Deadline scheduled to check if the process is idle, or 0 if none
     bool mTargetProcess;
 };
 
@@ -132,6 +208,7 @@ void UpdateConsole(uint32_t processId, ProcessInfo const& processInfo);
 
 // ConsumerThread.cpp:
 void StartConsumerThread(TRACEHANDLE traceHandle);
+void StartReplayConsumerThread(TraceSession* session);
 void WaitForConsumerThreadToExit();
 
 // CsvOutput.cpp:
@@ -139,10 +216,19 @@ void IncrementRecordingCount();
 OutputCsv GetOutputCsv(ProcessInfo* processInfo);
 void CloseOutputCsv(ProcessInfo* processInfo);
 void UpdateCsv(ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p);
+void FormatCsvRow(CsvFrameRecord const& r, std::vector<char>* text);
 const char* FinalStateToDroppedString(PresentResult res);
 const char* PresentModeToString(PresentMode mode);
 const char* RuntimeToString(Runtime rt);
 
+// CsvWriter.cpp:
+void StartCsvWriter();
+void StopCsvWriter();
+void QueueCsvRow(FILE* fp, std::string const& application, CsvFrameRecord* record);
+void SubmitCsvRows();
+void FlushCsvRows(FILE* fp);
+CsvWriterStats GetCsvWriterStats();
+
 // MainThread.cpp:
 void ExitMainThread();
 
@@ -152,9 +238,37 @@ void StopOutputThread();
 void SetOutputRecordingState(bool record);
 #ifdef BUILD_PRESENTMON_AS_LIB
 CommandLineArgs* GetCommandLineArgsPtr();
+
+// Subscribers are called on the output thread, and may subscribe or
+// unsubscribe from within a callback.  Once Unsubscribe*() returns, the
+// callback may still be called for the present (or batch) already being
+// dispatched, so stop the trace session before destroying its context.
 typedef void (*fnCallbackOnPresentEvent) (void* context, ProcessInfo* processInfo, SwapChainData const& chain, PresentEvent const& p);
 void SubscribeOnPresentEvent(fnCallbackOnPresentEvent callback, void* context);
 void UnsubscribeOnPresentEvent(fnCallbackOnPresentEvent callback, void* context);
+
+// A present as delivered to batch subscribers.
+struct PresentFrame {
+    uint64_t mSwapChainAddress;
+    uint64_t mQpcTime;
+    uint64_t mTimeTaken;
+    uint64_t mReadyTime;
+    uint64_t mScreenTime;
+    uint32_t mProcessId;
+    int32_t mSyncInterval;
+    uint32_t mPresentFlags;
+    Runtime mRuntime;
+    PresentMode mPresentMode;
+    PresentResult mFinalState;
+};
+
+// Batch subscribers are called once per output thread pass with every
+// present from target processes that was handled in that pass, in the same
+// order as fnCallbackOnPresentEvent callbacks.  frames is only valid during
+// the call.
+typedef void (*fnCallbackOnPresentBatch) (void* context, PresentFrame const* frames, size_t frameCount);
+void SubscribeOnPresentBatch(fnCallbackOnPresentBatch callback, void* context);
+void UnsubscribeOnPresentBatch(fnCallbackOnPresentBatch callback, void* context);
 #endif
 
 // Privilege.cpp:
@@ -165,11 +279,15 @@ int RestartAsAdministrator(int argc, char** argv);
 bool StartTraceSession();
 void StopTraceSession();
 void CheckLostReports(ULONG* eventsLost, ULONG* buffersLost);
+void CheckLostPresents(LostPresentStats* lostPresents);
 void DequeueAnalyzedInfo(
     std::vector<ProcessEvent>* processEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* presentEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* lostPresentEvents,
+    std::vector<PresentEvent>* presentEvents,
+    std::vector<PresentEvent>* lostPresentEvents,
     std::vector<std::shared_ptr<LateStageReprojectionEvent>>* lsrs);
+bool WaitForAnalyzedInfo(uint32_t timeoutMs);
+void AnalyzedInfoDelivered();
+void StopWaitingForAnalyzedInfo();
 double QpcDeltaToSeconds(uint64_t qpcDelta);
 uint64_t SecondsDeltaToQpc(double secondsDelta);
 double QpcToSeconds(uint64_t qpc);
@@ -21,9 +21,10 @@ SOFTWARE.
 */
 
 #include "PresentMon.hpp"
+#include "../PresentData/EventMetadataCache.hpp"
 
-#include "../PresentData/TraceSession.hpp"
 #include <VersionHelpers.h>
+#include <tlhelp32.h>
 
 namespace {
 
@@ -31,6 +32,30 @@ TraceSession gSession;
 static PMTraceConsumer* gPMConsumer = nullptr;
 static MRTraceConsumer* gMRConsumer = nullptr;
 
+// When collecting realtime with -process_name, track the target processes
+// that are already running.  Processes that start later are tracked from
+// their process start events (see PMTraceConsumer::mTrackedProcessNames).
+// This is called once the session has started, so no process is missed, but
+// before the consumer thread is, so the consumer's process tracking isn't
+// updated concurrently.
+void TrackRunningProcessesByName()
+{
+    auto snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    PROCESSENTRY32W entry = {};
+    entry.dwSize = sizeof(entry);
+    for (auto ok = Process32FirstW(snapshot, &entry); ok; ok = Process32NextW(snapshot, &entry)) {
+        char processName[MAX_PATH];
+        if (WideCharToMultiByte(CP_ACP, 0, entry.szExeFile, -1, processName, sizeof(processName), nullptr, nullptr) != 0) {
+            gPMConsumer->UpdateProcessTrackedByName(entry.th32ProcessID, processName);
+        }
+    }
+    CloseHandle(snapshot);
+}
+
 }
 
 bool StartTraceSession()
@@ -39,9 +64,10 @@ bool StartTraceSession()
     auto simple = args.mVerbosity == Verbosity::Simple;
     auto includeWinMR = args.mIncludeWindowsMixedReality;
     auto expectFilteredEvents =
-        args.mEtlFileName == nullptr && // Scope filtering based on event ID only works for realtime collection
-        IsWindows8Point1OrGreater();    // and requires Win8.1+
-    auto filterProcessTracking = args.mTargetPid != 0; // Does not support process names at this point
+        args.mEtlFileName == nullptr &&           // Scope filtering based on event ID only works for realtime collection
+        args.mReplayCaptureFileNames.empty() &&
+        IsWindows8Point1OrGreater();              // and requires Win8.1+
+    auto filterProcessTracking = args.mTargetPid != 0 || !args.mTargetProcessNames.empty();
 
     // Create consumers
     gPMConsumer = new PMTraceConsumer(expectFilteredEvents, simple, filterProcessTracking);
@@ -49,8 +75,64 @@ bool StartTraceSession()
         gMRConsumer = new MRTraceConsumer(simple);
     }
 
+    gPMConsumer->mDequeueSignal.Configure(args.mOutputBatchSize, args.mOutputLatencyMs);
+
+    // Filter out events from other processes as early as possible.  Target
+    // processes are matched by name from their process start events (see
+    // TrackRunningProcessesByName() for the processes already running).
     if (filterProcessTracking) {
-        gPMConsumer->AddTrackedProcessForFiltering(args.mTargetPid);
+        if (args.mTargetPid != 0) {
+            gPMConsumer->AddTrackedProcessForFiltering(args.mTargetPid);
+        }
+        for (auto targetProcessName : args.mTargetProcessNames) {
+            gPMConsumer->AddTrackedProcessNameForFiltering(targetProcessName);
+        }
+    }
+
+    // Load any cached event metadata.  It's not an error if the cache doesn't
+    // exist yet, since it's written on exit.
+    if (args.mMetadataCacheFileName != nullptr) {
+        auto status = LoadEventMetadataCache(args.mMetadataCacheFileName, &gPMConsumer->mMetadata);
+        if (status == EventMetadataCacheStatus::SUCCESS && gMRConsumer != nullptr) {
+            status = LoadEventMetadataCache(args.mMetadataCacheFileName, &gMRConsumer->mMetadata);
+        }
+        switch (status) {
+        case EventMetadataCacheStatus::SUCCESS:
+        case EventMetadataCacheStatus::FILE_NOT_FOUND:
+            break;
+        case EventMetadataCacheStatus::UNSUPPORTED_VERSION:
+            fprintf(stderr, "warning: -metadata_cache file has an unsupported version; it will be replaced.\n");
+            break;
+        default:
+            fprintf(stderr, "warning: -metadata_cache file is invalid; it will be replaced.\n");
+            break;
+        }
+    }
+
+    // Replaying a capture doesn't involve ETW at all.
+    if (!args.mReplayCaptureFileNames.empty()) {
+        auto status = gSession.StartReplay(gPMConsumer, gMRConsumer, args.mReplayCaptureFileNames.data(), (uint32_t) args.mReplayCaptureFileNames.size());
+        if (status != ERROR_SUCCESS) {
+            fprintf(stderr, "error: failed to open -replay_capture file");
+            switch (status) {
+            case ERROR_FILE_NOT_FOUND: fprintf(stderr, " (file not found)"); break;
+            case ERROR_FILE_CORRUPT:   fprintf(stderr, " (not a PresentMon capture file)"); break;
+            case ERROR_NOT_SUPPORTED:  fprintf(stderr, " (unsupported capture version)"); break;
+            case ERROR_INVALID_DATA:   fprintf(stderr, " (captures are from different systems)"); break;
+            default:                   fprintf(stderr, " (error=%u)", status); break;
+            }
+            fprintf(stderr, ".\n");
+
+            delete gPMConsumer;
+            delete gMRConsumer;
+            gPMConsumer = nullptr;
+            gMRConsumer = nullptr;
+            return false;
+        }
+
+        StartReplayConsumerThread(&gSession);
+        StartOutputThread();
+        return true;
     }
 
     // Start the session;
@@ -104,6 +186,17 @@ bool StartTraceSession()
         return false;
     }
 
+    if (args.mWriteCaptureFileName != nullptr) {
+        status = gSession.StartCapture(args.mWriteCaptureFileName);
+        if (status != ERROR_SUCCESS) {
+            fprintf(stderr, "warning: failed to open -write_capture file; events will not be captured.\n");
+        }
+    }
+
+    if (!args.mTargetProcessNames.empty() && args.mEtlFileName == nullptr) {
+        TrackRunningProcessesByName();
+    }
+
     // -------------------------------------------------------------------------
     // Start the consumer and output threads
     StartConsumerThread(gSession.mTraceHandle);
@@ -114,6 +207,8 @@ bool StartTraceSession()
 
 void StopTraceSession()
 {
+    auto const& args = GetCommandLineArgs();
+
     // Stop the trace session.
     gSession.Stop();
 
@@ -122,6 +217,54 @@ void StopTraceSession()
     WaitForConsumerThreadToExit();
     StopOutputThread();
 
+    // Report what the consumer thread spent its time on (this does nothing
+    // unless built with PRESENTMON_INSTRUMENTATION).
+    gPMConsumer->mInstrumentation.Dump(stderr);
+
+#if PRESENTMON_INSTRUMENTATION
+    // Report how long completed presents waited to be handled by the output
+    // thread (including any SubscribeOnPresentEvent() callbacks).
+    {
+        auto const& latency = gPMConsumer->mDequeueSignal.GetLatencyStats();
+        fprintf(stderr, "Output latency: %llu batches, mean %.0lf us, max %llu us\n",
+            latency.BatchCount,
+            latency.BatchCount == 0 ? 0.0 : (double) latency.TotalMicroseconds / latency.BatchCount,
+            latency.MaxMicroseconds);
+        for (uint32_t i = 0; i < EVENT_BATCH_LATENCY_BUCKETS; ++i) {
+            if (latency.Histogram[i] > 0) {
+                fprintf(stderr, "    [%8llu, %8llu) us: %llu\n", i == 0 ? 0ull : 1ull << i, 2ull << i, latency.Histogram[i]);
+            }
+        }
+
+        auto csv = GetCsvWriterStats();
+        fprintf(stderr, "CSV writer: %u threads, %llu rows in %llu chunks, max %u chunks queued, %llu stalls (%.3lf s)\n",
+            csv.mWorkerCount, csv.mRowCount, csv.mChunkCount, csv.mMaxQueuedChunks, csv.mStallCount, csv.mStallSeconds);
+    }
+#endif
+
+    // The consumer thread was the only writer, so the capture can be finished
+    // now that it has exited.
+    uint32_t skippedMetadataCount = 0;
+    if (gSession.StopCapture(&skippedMetadataCount) != ERROR_SUCCESS) {
+        fprintf(stderr, "warning: failed to write -write_capture file; the capture is incomplete.\n");
+    }
+    if (skippedMetadataCount > 0) {
+        fprintf(stderr, "warning: metadata for %u event types was too large for the -write_capture file;\n"
+                        "         replaying their events will look it up on the replaying system.\n", skippedMetadataCount);
+    }
+
+    // Write the metadata the consumers used, including any they looked up
+    // during this session, for the next session to load.
+    if (args.mMetadataCacheFileName != nullptr) {
+        EventMetadata* metadata[] = {
+            &gPMConsumer->mMetadata,
+            gMRConsumer == nullptr ? nullptr : &gMRConsumer->mMetadata,
+        };
+        if (!SaveEventMetadataCache(args.mMetadataCacheFileName, metadata, gMRConsumer == nullptr ? 1 : 2)) {
+            fprintf(stderr, "warning: failed to write -metadata_cache file.\n");
+        }
+    }
+
     // Destruct the consumers
     delete gMRConsumer;
     delete gPMConsumer;
@@ -135,10 +278,23 @@ void CheckLostReports(ULONG* eventsLost, ULONG* buffersLost)
     (void) status;
 }
 
+void CheckLostPresents(LostPresentStats* lostPresents)
+{
+    std::map<uint32_t, LostPresentStats> stats;
+    gPMConsumer->GetLostPresentStats(&stats);
+
+    *lostPresents = {};
+    for (auto const& pair : stats) {
+        lostPresents->Expired      += pair.second.Expired;
+        lostPresents->Evicted      += pair.second.Evicted;
+        lostPresents->Inconsistent += pair.second.Inconsistent;
+    }
+}
+
 void DequeueAnalyzedInfo(
     std::vector<ProcessEvent>* processEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* presentEvents,
-    std::vector<std::shared_ptr<PresentEvent>>* lostPresentEvents,
+    std::vector<PresentEvent>* presentEvents,
+    std::vector<PresentEvent>* lostPresentEvents,
     std::vector<std::shared_ptr<LateStageReprojectionEvent>>* lsrs)
 {
     gPMConsumer->DequeueProcessEvents(*processEvents);
@@ -149,6 +305,27 @@ void DequeueAnalyzedInfo(
     }
 }
 
+// Wait for the consumer thread to queue a batch of analyzed information (see
+// -output_batch_size and -output_latency_ms), or for timeoutMs to pass.
+// Returns true if anything was queued.
+bool WaitForAnalyzedInfo(uint32_t timeoutMs)
+{
+    return gPMConsumer->mDequeueSignal.Wait(std::chrono::milliseconds(timeoutMs));
+}
+
+// The information dequeued after WaitForAnalyzedInfo() returned has been
+// output.
+void AnalyzedInfoDelivered()
+{
+    gPMConsumer->mDequeueSignal.BatchDelivered();
+}
+
+// Make WaitForAnalyzedInfo() return immediately from now on.
+void StopWaitingForAnalyzedInfo()
+{
+    gPMConsumer->mDequeueSignal.Stop();
+}
+
 double QpcDeltaToSeconds(uint64_t qpcDelta)
 {
     return (double) qpcDelta / gSession.mQpcFrequency.QuadPart;
@@ -0,0 +1,142 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PresentMonTests.h"
+#include "../PresentMon/CsvRowWriter.hpp"
+
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// The Gold CSV tests rely on CsvRowWriter producing exactly what printf
+// would, so these compare the two directly over values chosen to hit the
+// rounding edge cases.
+
+namespace {
+
+std::string FormatFixed(double value, uint32_t precision)
+{
+    std::vector<char> text;
+    CsvRowWriter row(&text);
+    row.Fixed(value, precision);
+    return std::string(text.begin(), text.end());
+}
+
+std::string PrintfFixed(double value, uint32_t precision)
+{
+    char text[400];
+    snprintf(text, sizeof(text), "%.*f", (int) precision, value);
+    return text;
+}
+
+// Compare count random values of the kinds CsvRowWriter is used for, plus
+// decimal ties and arbitrary bit patterns, at random precisions.
+void CheckRandomFixedValues(uint64_t seed, uint32_t count)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        auto precision = (uint32_t) (rng() % (CsvRowWriter::MAX_PRECISION + 1));
+        double value = 0.0;
+        switch (i % 4) {
+        case 0: value = unit(rng) * 100.0; break;    // Milliseconds
+        case 1: value = unit(rng) * 100000.0; break; // Seconds
+        case 2: {                                       // Halfway in decimal, but not in binary
+            auto digits = (double) (rng() % 100000000);
+            value = (digits + 0.5) / pow(10.0, precision);
+            break;
+        }
+        default: {                                      // Any bit pattern
+            auto bits = rng();
+            memcpy(&value, &bits, sizeof(value));
+            if (isnan(value)) continue;
+            break;
+        }
+        }
+        if (rng() & 1) {
+            value = -value;
+        }
+
+        ASSERT_EQ(PrintfFixed(value, precision), FormatFixed(value, precision)) << value << " precision " << precision;
+    }
+}
+
+}
+
+TEST(CsvRowWriterTests, FixedMatchesPrintfForSpecialValues)
+{
+    double const values[] = {
+        0.0, -0.0, 0.5, 1.5, 2.5, -0.5, 0.0005, 0.0015, 0.0025, -0.0004,
+        0.1, 0.7, 16.6665, 16.66666666665, 999.9995, 123456789.123456789,
+        0.125, 0.375, -0.625, 9.5, 10.5, 0.05, 0.0000000005, 0.0000000015,     // Exact binary ties
+        3999999.9999999995, 4000000.0, 4000000.0000000005, 3.9999999999999995e15,  // Near the snprintf fallback
+        1e-300, -1e-300, 4e15, 4.5e15, 1e20, -1e20,
+        std::numeric_limits<double>::max(),
+        std::numeric_limits<double>::denorm_min(),
+        std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(),
+    };
+
+    for (auto value : values) {
+        for (uint32_t precision = 0; precision <= CsvRowWriter::MAX_PRECISION; ++precision) {
+            EXPECT_EQ(PrintfFixed(value, precision), FormatFixed(value, precision)) << value << " precision " << precision;
+        }
+    }
+}
+
+TEST(CsvRowWriterTests, FixedMatchesPrintfForRandomValues)
+{
+    CheckRandomFixedValues(1, 10000);
+}
+
+// A longer sweep to run after changing CsvRowWriter::Fixed(), e.g. with
+// --gtest_also_run_disabled_tests --gtest_filter=*ManyRandomValues.
+TEST(CsvRowWriterTests, DISABLED_FixedMatchesPrintfForManyRandomValues)
+{
+    CheckRandomFixedValues(2, 20000000);
+}
+
+TEST(CsvRowWriterTests, IntegerFieldsMatchPrintf)
+{
+    std::mt19937_64 rng(2);
+
+    for (uint32_t i = 0; i < 100000; ++i) {
+        auto u = i < 2 ? (i == 0 ? 0ull : ~0ull) : rng();
+        auto d = i < 2 ? (i == 0 ? INT32_MIN : INT32_MAX) : (int32_t) u;
+
+        std::vector<char> text;
+        CsvRowWriter row(&text);
+        row.String("app.exe");
+        row.Int(d);
+        row.UInt64(u);
+        row.Hex64(u);
+        row.EndRow();
+        row.String("next");
+        row.EndRow();
+
+        char expected[128];
+        snprintf(expected, sizeof(expected), "app.exe,%d,%llu,0x%016llX\nnext\n", d, u, u);
+        ASSERT_EQ(std::string(expected), std::string(text.begin(), text.end()));
+    }
+}
@@ -0,0 +1,265 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PresentMonTests.h"
+#include "../PresentData/EventCapture.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// These tests write small capture files and check that
+// EventCaptureMergeReader reads them back as one timeline.  EventCapture has
+// no ETW dependencies, so they don't need ETW or an ETL.
+
+namespace {
+
+enum {
+    QPC_FREQUENCY = 10000000,
+};
+
+struct TestEvent {
+    int64_t  TimeStamp;
+    uint16_t Id;
+    uint32_t Data;
+    bool     Metadata;
+};
+
+// A path in the temp directory (%TEMP% on Windows, $TMPDIR or /tmp
+// elsewhere).  Only the C runtime is used, so these tests don't depend on the
+// platform any more than EventCapture does.
+std::string TempCapturePath(char const* name)
+{
+    std::string path;
+#ifdef _WIN32
+    char* dir = nullptr;
+    if (_dupenv_s(&dir, nullptr, "TEMP") == 0 && dir != nullptr) {
+        path = std::string(dir) + "\\";
+    }
+    free(dir);
+#else
+    auto dir = getenv("TMPDIR");
+    path = std::string(dir != nullptr ? dir : "/tmp") + "/";
+#endif
+    return path + "PresentMonTests_" + name + ".pmcapture";
+}
+
+template<typename T, size_t N>
+uint32_t CountOf(T const (&)[N])
+{
+    return (uint32_t) N;
+}
+
+std::string WriteCapture(char const* name, int64_t qpcFrequency, int64_t startQpc, std::vector<TestEvent> const& events)
+{
+    auto path = TempCapturePath(name);
+
+    EventCaptureWriter writer;
+    EXPECT_TRUE(writer.Open(path.c_str(), qpcFrequency, startQpc));
+    for (auto const& e : events) {
+        EventCaptureEvent event = {};
+        event.UserDataLength = sizeof(e.Data);
+        event.Id             = e.Id;
+        event.TimeStamp      = e.TimeStamp;
+        event.CaptureFlags   = e.Metadata ? EVENT_CAPTURE_FLAG_METADATA : 0;
+        writer.Write(&event, &e.Data);
+    }
+    EXPECT_TRUE(writer.Close());
+    return path;
+}
+
+std::vector<TestEvent> ReadMerged(EventCaptureMergeReader* reader)
+{
+    std::vector<TestEvent> events;
+    void const* userData = nullptr;
+    while (auto event = reader->Next(&userData)) {
+        TestEvent e = {};
+        e.TimeStamp = event->TimeStamp;
+        e.Id        = event->Id;
+        e.Metadata  = (event->CaptureFlags & EVENT_CAPTURE_FLAG_METADATA) != 0;
+        memcpy(&e.Data, userData, sizeof(e.Data));
+        events.emplace_back(e);
+    }
+    return events;
+}
+
+}
+
+TEST(EventCaptureTests, MergeOrdersOverlappingCapturesByTimeStamp)
+{
+    // b overlaps the middle of a, and c spans both.
+    std::string paths[] = {
+        WriteCapture("merge_a", QPC_FREQUENCY, 100, { { 100, 1, 0 }, { 200, 1, 1 }, { 300, 1, 2 }, { 400, 1, 3 } }),
+        WriteCapture("merge_b", QPC_FREQUENCY, 150, { { 150, 2, 0 }, { 250, 2, 1 }, { 300, 2, 2 } }),
+        WriteCapture("merge_c", QPC_FREQUENCY, 50,  { { 50, 3, 0 }, { 275, 3, 1 }, { 500, 3, 2 } }),
+    };
+    char const* pathPtrs[] = { paths[0].c_str(), paths[1].c_str(), paths[2].c_str() };
+
+    EventCaptureMergeReader reader;
+    ASSERT_EQ(reader.Open(pathPtrs, CountOf(pathPtrs)), EventCaptureReader::SUCCESS);
+    EXPECT_EQ(reader.GetQpcFrequency(), QPC_FREQUENCY);
+    EXPECT_EQ(reader.GetStartQpc(), 50);
+
+    auto events = ReadMerged(&reader);
+    ASSERT_EQ(events.size(), 10u);
+    for (size_t i = 1; i < events.size(); ++i) {
+        EXPECT_LE(events[i - 1].TimeStamp, events[i].TimeStamp);
+    }
+
+    // Events with the same timestamp come out in input order, and each
+    // input's events stay in order.
+    EXPECT_EQ(events[6].TimeStamp, 300);
+    EXPECT_EQ(events[6].Id, 1);
+    EXPECT_EQ(events[7].TimeStamp, 300);
+    EXPECT_EQ(events[7].Id, 2);
+    uint32_t nextData[4] = {};
+    for (auto const& e : events) {
+        EXPECT_EQ(e.Data, nextData[e.Id]);
+        nextData[e.Id] += 1;
+    }
+
+    reader.Close();
+    for (auto const& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+TEST(EventCaptureTests, MergeSkipsEventsRecordedInBothCaptures)
+{
+    // The captures overlap at 200..300, where both recorded the same events.
+    std::string paths[] = {
+        WriteCapture("dup_a", QPC_FREQUENCY, 100, { { 100, 1, 0 }, { 200, 1, 1 }, { 300, 1, 2 } }),
+        WriteCapture("dup_b", QPC_FREQUENCY, 200, { { 200, 1, 1 }, { 200, 1, 7 }, { 300, 1, 2 }, { 400, 1, 3 } }),
+    };
+    char const* pathPtrs[] = { paths[0].c_str(), paths[1].c_str() };
+
+    EventCaptureMergeReader reader;
+    ASSERT_EQ(reader.Open(pathPtrs, CountOf(pathPtrs)), EventCaptureReader::SUCCESS);
+
+    auto events = ReadMerged(&reader);
+    ASSERT_EQ(events.size(), 5u);
+    EXPECT_EQ(events[0].Data, 0u);
+    EXPECT_EQ(events[1].Data, 1u);
+    EXPECT_EQ(events[2].Data, 7u);  // Same timestamp but different data, so not a duplicate
+    EXPECT_EQ(events[3].Data, 2u);
+    EXPECT_EQ(events[4].Data, 3u);
+    EXPECT_EQ(reader.GetDuplicateCount(), 2u);
+
+    reader.Close();
+    for (auto const& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+TEST(EventCaptureTests, MergeHandsOutMetadataBeforeItsEvents)
+{
+    std::string paths[] = {
+        WriteCapture("meta_a", QPC_FREQUENCY, 100, { { 100, 1, 0 }, { 300, 1, 1 } }),
+        WriteCapture("meta_b", QPC_FREQUENCY, 100, { { 0, 9, 42, true }, { 200, 2, 0 } }),
+    };
+    char const* pathPtrs[] = { paths[0].c_str(), paths[1].c_str() };
+
+    EventCaptureMergeReader reader;
+    ASSERT_EQ(reader.Open(pathPtrs, CountOf(pathPtrs)), EventCaptureReader::SUCCESS);
+
+    auto events = ReadMerged(&reader);
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_TRUE(events[0].Metadata);
+    EXPECT_EQ(events[0].Data, 42u);
+    EXPECT_EQ(events[1].TimeStamp, 100);
+    EXPECT_EQ(events[2].TimeStamp, 200);
+    EXPECT_EQ(events[3].TimeStamp, 300);
+
+    reader.Close();
+    for (auto const& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+TEST(EventCaptureTests, MergeRejectsCapturesFromDifferentSystems)
+{
+    std::string paths[] = {
+        WriteCapture("freq_a", QPC_FREQUENCY,     100, { { 100, 1, 0 } }),
+        WriteCapture("freq_b", QPC_FREQUENCY / 2, 100, { { 100, 1, 0 } }),
+    };
+    char const* pathPtrs[] = { paths[0].c_str(), paths[1].c_str() };
+
+    EventCaptureMergeReader reader;
+    EXPECT_EQ(reader.Open(pathPtrs, CountOf(pathPtrs)), EventCaptureReader::INCOMPATIBLE_FILES);
+
+    for (auto const& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+TEST(EventCaptureTests, ReaderMovesItsWindowThroughLargeCaptures)
+{
+    // Records of varying size, so some straddle a window boundary.  Each
+    // user data byte is derived from the event index.
+    enum { EVENT_COUNT = 2000 };
+    auto path = TempCapturePath("window");
+    {
+        EventCaptureWriter writer;
+        ASSERT_TRUE(writer.Open(path.c_str(), QPC_FREQUENCY, 0));
+        std::vector<uint8_t> data;
+        for (uint32_t i = 0; i < EVENT_COUNT; ++i) {
+            data.assign(8 + (i * 997) % 3000, (uint8_t) i);
+            EventCaptureEvent event = {};
+            event.UserDataLength = (uint16_t) data.size();
+            event.TimeStamp      = i;
+            writer.Write(&event, data.data());
+        }
+        ASSERT_TRUE(writer.Close());
+    }
+
+    // A window size of 1 is rounded up to the smallest window that holds any
+    // record, which is far smaller than the file.
+    EventCaptureReader reader;
+    ASSERT_EQ(reader.Open(path.c_str(), 1), EventCaptureReader::SUCCESS);
+    EXPECT_EQ(reader.GetHeader()->QpcFrequency, QPC_FREQUENCY);
+
+    EventCaptureEvent const* prevEvent = nullptr;
+    uint8_t const* prevData = nullptr;
+    uint32_t count = 0;
+    void const* userData = nullptr;
+    while (auto event = reader.Next(&userData)) {
+        auto data = (uint8_t const*) userData;
+        ASSERT_EQ(event->TimeStamp, (int64_t) count);
+        ASSERT_EQ(event->UserDataLength, 8 + (count * 997) % 3000);
+        EXPECT_EQ(data[0], (uint8_t) count);
+        EXPECT_EQ(data[event->UserDataLength - 1], (uint8_t) count);
+
+        // The previous record is still mapped.
+        if (prevEvent != nullptr) {
+            EXPECT_EQ(prevEvent->TimeStamp, (int64_t) count - 1);
+            EXPECT_EQ(prevData[prevEvent->UserDataLength - 1], (uint8_t) (count - 1));
+        }
+        prevEvent = event;
+        prevData = data;
+        count += 1;
+    }
+    EXPECT_EQ(count, (uint32_t) EVENT_COUNT);
+
+    reader.Close();
+    remove(path.c_str());
+}
@@ -21,6 +21,9 @@ SOFTWARE.
 */
 #include "PresentMonTests.h"
 
+#include <map>
+#include <vector>
+
 namespace {
 
 struct TestArgs {
@@ -129,6 +132,111 @@ public:
     }
 };
 
+// Runs PresentMon with -multi_csv and checks that each process's CSV has the
+// gold CSV's rows for that process, in the same order.  Rows for all the
+// files are formatted and written by a pool of CsvWriter threads, so this
+// checks that each file's rows are still written in the order they were
+// queued.
+class MultiCsvTests : public ::testing::Test, TestArgs {
+    struct ApplicationRows {
+        std::string processId_;
+        bool multipleProcesses_;
+        std::vector<std::vector<std::string>> rows_;
+    };
+
+public:
+    explicit MultiCsvTests(TestArgs const& args)
+    {
+        TestArgs::operator=(args);
+    }
+
+    void TestBody() override
+    {
+        // Read the gold rows of each application.
+        PresentMonCsv goldCsv;
+        if (!goldCsv.CSVOPEN(goldCsv_)) {
+            return;
+        }
+
+        auto applicationIndex = goldCsv.GetColumnIndex("Application");
+        auto processIdIndex = goldCsv.GetColumnIndex("ProcessID");
+        std::map<std::string, ApplicationRows> goldRows;
+        while (goldCsv.ReadRow()) {
+            auto ii = goldRows.find(goldCsv.cols_[applicationIndex]);
+            if (ii == goldRows.end()) {
+                ii = goldRows.emplace(goldCsv.cols_[applicationIndex], ApplicationRows()).first;
+                ii->second.processId_ = goldCsv.cols_[processIdIndex];
+                ii->second.multipleProcesses_ = false;
+            } else if (ii->second.processId_ != goldCsv.cols_[processIdIndex]) {
+                ii->second.multipleProcesses_ = true;
+            }
+
+            std::vector<std::string> row;
+            for (size_t h = 0; h < _countof(PresentMonCsv::headerColumnIndex_); ++h) {
+                row.emplace_back(goldCsv.headerColumnIndex_[h] == SIZE_MAX ? "" : goldCsv.cols_[goldCsv.headerColumnIndex_[h]]);
+            }
+            ii->second.rows_.emplace_back(std::move(row));
+        }
+
+        // Make sure output directory exists.
+        {
+            auto i = testCsv_.find_last_of(L"/\\");
+            if (i != std::wstring::npos) {
+                ASSERT_TRUE(EnsureDirectoryCreated(testCsv_.substr(0, i)));
+            }
+        }
+
+        auto testCsvBase = testCsv_.substr(0, testCsv_.size() - 4) + L"_multi";
+
+        PresentMon pm;
+        pm.Add(L"-stop_existing_session");
+        pm.Add(L"-multi_csv");
+        pm.AddEtlPath(etl_);
+        pm.AddCsvPath(testCsvBase + L".csv");
+        if (goldCsv.simple_) pm.Add(L"-simple");
+        if (goldCsv.verbose_) pm.Add(L"-verbose");
+        if (goldCsv.GetColumnIndex("QPCTime") != SIZE_MAX) pm.Add(L"-qpc_time");
+        pm.PMSTART();
+        pm.PMEXITED();
+
+        // Processes with the same name write to the same file, so only
+        // applications with one process are checked.
+        for (auto const& pair : goldRows) {
+            auto const& application = pair.first;
+            auto const& gold = pair.second;
+            if (gold.multipleProcesses_ || application.find_first_of("<>:\"/\\|?*") != std::string::npos) {
+                continue;
+            }
+
+            PresentMonCsv testCsv;
+            if (!testCsv.CSVOPEN(testCsvBase + L"-" + Convert(application) + L".csv")) {
+                continue;
+            }
+
+            size_t rowCount = 0;
+            auto rowOk = true;
+            for (; rowOk && rowCount < gold.rows_.size() && testCsv.ReadRow(); ++rowCount) {
+                auto const& goldRow = gold.rows_[rowCount];
+                for (size_t h = 0; h < _countof(PresentMonCsv::headerColumnIndex_); ++h) {
+                    if (testCsv.headerColumnIndex_[h] != SIZE_MAX && goldCsv.headerColumnIndex_[h] != SIZE_MAX &&
+                        _stricmp(testCsv.cols_[testCsv.headerColumnIndex_[h]], goldRow[h].c_str()) != 0) {
+                        AddTestFailure(__FILE__, __LINE__, "%s: %s differs on line %zu", application.c_str(), testCsv.GetHeader(h), testCsv.line_);
+                        rowOk = false;
+                        break;
+                    }
+                }
+            }
+            if (rowOk && (rowCount != gold.rows_.size() || testCsv.ReadRow())) {
+                AddTestFailure(__FILE__, __LINE__, "%s: GOLD and TEST CSV had different number of rows", application.c_str());
+            }
+
+            testCsv.Close();
+        }
+
+        goldCsv.Close();
+    }
+};
+
 bool CheckGoldEtlCsvPair(
     std::wstring const& dir,
     size_t relIdx,
@@ -186,6 +294,9 @@ void AddGoldEtlCsvTests(
                 ::testing::RegisterTest(
                     "GoldEtlCsvTests", args.name_.c_str(), nullptr, nullptr, __FILE__, __LINE__,
                     [=]() -> ::testing::Test* { return new Tests(args); });
+                ::testing::RegisterTest(
+                    "GoldEtlMultiCsvTests", args.name_.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                    [=]() -> ::testing::Test* { return new MultiCsvTests(args); });
             }
         }
     } while (FindNextFile(h, &ff) != 0);
@@ -0,0 +1,341 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "PresentMonTests.h"
+#include "../PresentData/PresentMonTraceConsumer.hpp"
+
+// These tests drive PMTraceConsumer's present tracking directly, without an
+// ETL, to stress cases that are rare in real captures.
+
+namespace {
+
+enum {
+    PROCESS_ID       = 1000,
+    RUNTIME_THREAD   = 1001,
+    KERNEL_THREAD    = 1002,
+    BATCHED_COUNT    = 2000,
+    MIN_CLASSIFIED   = 16,
+    MAX_CLASSIFIED   = 4000,
+    QPC_FREQUENCY    = 1000,    // 1 ms per QPC tick
+};
+
+EVENT_HEADER MakeHeader(uint32_t threadId, uint64_t qpc)
+{
+    EVENT_HEADER hdr = {};
+    hdr.ProcessId = PROCESS_ID;
+    hdr.ThreadId = threadId;
+    hdr.TimeStamp.QuadPart = (LONGLONG) qpc;
+    return hdr;
+}
+
+// Put classifiedCount presents in flight whose PresentMode is already known
+// (e.g., presented on the runtime thread before DXGK saw them) followed by
+// BATCHED_COUNT batched DXGI presents whose PresentMode is still Unknown.
+// Then have a DXGK thread claim each of the batched presents, checking they
+// are handed out oldest first and that none of the classified presents are.
+void ClaimBatchedPresents(uint32_t classifiedCount)
+{
+    PMTraceConsumer pmConsumer(false, false);
+
+    // Nothing may be evicted as lost during the test.  (Nothing expires since
+    // AgePresents() isn't called.)
+    EXPECT_GT(pmConsumer.mMaxTrackedPresents, classifiedCount + BATCHED_COUNT);
+
+    uint64_t qpc = 1;
+    for (uint32_t i = 0; i < classifiedCount; ++i) {
+        auto present = pmConsumer.CreatePresent(MakeHeader(RUNTIME_THREAD, qpc++), Runtime::DXGI);
+        pmConsumer.TrackPresentOnThread(present);
+        present->PresentMode = PresentMode::Hardware_Legacy_Flip;
+        pmConsumer.mPresentByThreadId.erase(RUNTIME_THREAD);
+    }
+
+    auto firstBatchedQpc = qpc;
+    for (uint32_t i = 0; i < BATCHED_COUNT; ++i) {
+        auto present = pmConsumer.CreatePresent(MakeHeader(RUNTIME_THREAD, qpc++), Runtime::DXGI);
+        pmConsumer.TrackPresentOnThread(present);
+        pmConsumer.RuntimePresentStop(MakeHeader(RUNTIME_THREAD, qpc++), true, Runtime::DXGI);
+    }
+
+    for (uint32_t i = 0; i < BATCHED_COUNT; ++i) {
+        auto present = pmConsumer.FindOrCreatePresent(MakeHeader(KERNEL_THREAD, qpc));
+        EXPECT_EQ(present->QpcTime, firstBatchedQpc + 2 * i);
+        EXPECT_EQ(present->Runtime, Runtime::DXGI);
+
+        // The DXGK event would classify the present and later events would
+        // find it on another thread.
+        present->PresentMode = PresentMode::Hardware_Legacy_Flip;
+        pmConsumer.mPresentByThreadId.erase(KERNEL_THREAD);
+    }
+
+    // All batched presents have been claimed, so the next lookup creates a
+    // new present.
+    auto present = pmConsumer.FindOrCreatePresent(MakeHeader(KERNEL_THREAD, qpc));
+    EXPECT_EQ(present->Runtime, Runtime::Other);
+    EXPECT_EQ(present->QpcTime, qpc);
+}
+
+// Create and track a present on its own thread, so it isn't considered lost
+// by TrackPresentOnThread().
+PresentEvent* TrackNewPresent(PMTraceConsumer* pmConsumer, uint32_t threadId, uint64_t qpc)
+{
+    auto present = pmConsumer->CreatePresent(MakeHeader(threadId, qpc), Runtime::DXGI);
+    pmConsumer->TrackPresentOnThread(present);
+    return present;
+}
+
+LostPresentStats GetLostPresentStats(PMTraceConsumer* pmConsumer)
+{
+    std::map<uint32_t, LostPresentStats> stats;
+    pmConsumer->GetLostPresentStats(&stats);
+    auto ii = stats.find(PROCESS_ID);
+    if (ii == stats.end()) {
+        LostPresentStats none = {};
+        return none;
+    }
+    return ii->second;
+}
+
+}
+
+TEST(PMTraceConsumerTests, BatchedPresentsAreClaimedInOrder)
+{
+    ClaimBatchedPresents(MIN_CLASSIFIED);
+    ClaimBatchedPresents(MAX_CLASSIFIED);
+}
+
+TEST(PMTraceConsumerTests, StuckPresentsExpireByTime)
+{
+    PMTraceConsumer pmConsumer(false, false);
+    pmConsumer.StartPresentAging(QPC_FREQUENCY);
+    auto expiry = pmConsumer.mPresentExpiryMs;
+
+    // A present that never completes, followed by one every millisecond on
+    // other threads.  Only the stuck one should be lost, and only once the
+    // expiry time has passed (it may be up to one wheel tick late).
+    TrackNewPresent(&pmConsumer, RUNTIME_THREAD, 1);
+
+    std::vector<PresentEvent> lost;
+    for (uint64_t qpc = 2; qpc <= expiry; ++qpc) {
+        pmConsumer.AgePresents(qpc);
+        auto present = TrackNewPresent(&pmConsumer, KERNEL_THREAD, qpc);
+        pmConsumer.mPresentByThreadId.erase(KERNEL_THREAD);
+        present->FinalState = PresentResult::Discarded;
+        pmConsumer.CompletePresent(present);
+    }
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), 0u);
+
+    pmConsumer.AgePresents(1 + 2 * expiry);
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), 1u);
+    EXPECT_EQ(lost.empty() ? 0 : lost[0].QpcTime, 1u);
+    EXPECT_TRUE(lost.empty() || lost[0].IsLost);
+
+    auto stats = GetLostPresentStats(&pmConsumer);
+    EXPECT_EQ(stats.Expired, 1u);
+    EXPECT_EQ(stats.Evicted, 0u);
+    EXPECT_EQ(pmConsumer.mPresentTrackingPool.LiveCount(), 0u);
+}
+
+TEST(PMTraceConsumerTests, TrackedPresentsAreBounded)
+{
+    enum { MAX_TRACKED = 16, PRESENT_COUNT = 100 };
+
+    PMTraceConsumer pmConsumer(false, false);
+    pmConsumer.mMaxTrackedPresents = MAX_TRACKED;
+    pmConsumer.StartPresentAging(QPC_FREQUENCY);
+
+    for (uint32_t i = 0; i < PRESENT_COUNT; ++i) {
+        TrackNewPresent(&pmConsumer, RUNTIME_THREAD + 2 * i, 1 + i);
+        EXPECT_LE(pmConsumer.mPresentTrackingPool.LiveCount(), (uint32_t) MAX_TRACKED);
+    }
+
+    // Only as many presents as needed are evicted, oldest first.
+    std::vector<PresentEvent> lost;
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), (size_t) (PRESENT_COUNT - MAX_TRACKED));
+    for (size_t i = 0; i < lost.size(); ++i) {
+        EXPECT_EQ(lost[i].QpcTime, 1 + i);
+    }
+
+    auto stats = GetLostPresentStats(&pmConsumer);
+    EXPECT_EQ(stats.Evicted, lost.size());
+    EXPECT_EQ(stats.Expired, 0u);
+
+    // Evicting doesn't move the expiry time of the presents still in flight.
+    auto expiry = pmConsumer.mPresentExpiryMs;
+    pmConsumer.AgePresents(expiry);
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), 0u);
+
+    pmConsumer.AgePresents(PRESENT_COUNT + 2 * expiry);
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), (size_t) MAX_TRACKED);
+    EXPECT_EQ(GetLostPresentStats(&pmConsumer).Expired, (uint64_t) MAX_TRACKED);
+}
+
+TEST(PMTraceConsumerTests, DependentPresentsCompleteWithDwmPresent)
+{
+    enum { WINDOWED_COUNT = 8, LOST_INDEX = 3 };
+
+    PMTraceConsumer pmConsumer(false, false);
+
+    // Windowed presents waiting for DWM's next present.
+    PresentEvent* windowed[WINDOWED_COUNT] = {};
+    for (uint32_t i = 0; i < WINDOWED_COUNT; ++i) {
+        windowed[i] = TrackNewPresent(&pmConsumer, RUNTIME_THREAD + 2 * i, 1 + i);
+        pmConsumer.mPresentsWaitingForDWM.PushBack(windowed[i]->Tracking);
+    }
+
+    // DWM's present picks them all up.
+    auto dwmPresent = TrackNewPresent(&pmConsumer, KERNEL_THREAD + 1000, 100);
+    dwmPresent->Tracking->DependentPresents.Splice(&pmConsumer.mPresentsWaitingForDWM);
+    EXPECT_TRUE(pmConsumer.mPresentsWaitingForDWM.empty());
+
+    // One of them is lost before DWM's present completes; it must remove
+    // itself from the DWM present's dependents.
+    pmConsumer.RemoveLostPresent(windowed[LOST_INDEX], LostPresentReason::Inconsistent);
+    EXPECT_EQ(dwmPresent->Tracking->DependentPresents.size(), (size_t) WINDOWED_COUNT - 1);
+
+    dwmPresent->ScreenTime = 200;
+    dwmPresent->FinalState = PresentResult::Presented;
+    pmConsumer.CompletePresent(dwmPresent);
+
+    std::vector<PresentEvent> completed;
+    pmConsumer.DequeuePresentEvents(completed);
+    EXPECT_EQ(completed.size(), (size_t) WINDOWED_COUNT);
+    for (auto const& p : completed) {
+        EXPECT_EQ(p.ScreenTime, 200u);
+        EXPECT_EQ(p.FinalState, PresentResult::Presented);
+        EXPECT_TRUE(p.Tracking == nullptr);
+    }
+    EXPECT_EQ(pmConsumer.mPresentTrackingPool.LiveCount(), 0u);
+}
+
+TEST(PMTraceConsumerTests, DependentPresentsAreLostWithDwmPresent)
+{
+    enum { WINDOWED_COUNT = 8 };
+
+    PMTraceConsumer pmConsumer(false, false);
+
+    // Windowed presents picked up by a DWM present that never completes.
+    for (uint32_t i = 0; i < WINDOWED_COUNT; ++i) {
+        auto present = TrackNewPresent(&pmConsumer, RUNTIME_THREAD + 2 * i, 1 + i);
+        pmConsumer.mPresentsWaitingForDWM.PushBack(present->Tracking);
+    }
+    auto dwmPresent = TrackNewPresent(&pmConsumer, KERNEL_THREAD + 1000, 100);
+    dwmPresent->Tracking->DependentPresents.Splice(&pmConsumer.mPresentsWaitingForDWM);
+
+    // The windowed presents haven't expired on their own, but they can't be
+    // displayed without the DWM present, so they are lost with it.
+    pmConsumer.RemoveLostPresent(dwmPresent, LostPresentReason::Inconsistent);
+
+    std::vector<PresentEvent> lost;
+    pmConsumer.DequeueLostPresentEvents(lost);
+    EXPECT_EQ(lost.size(), (size_t) WINDOWED_COUNT + 1);
+    for (auto const& p : lost) {
+        EXPECT_TRUE(p.IsLost);
+        EXPECT_TRUE(p.Tracking == nullptr);
+    }
+    EXPECT_EQ(GetLostPresentStats(&pmConsumer).Inconsistent, (uint64_t) WINDOWED_COUNT + 1);
+    EXPECT_EQ(pmConsumer.mPresentTrackingPool.LiveCount(), 0u);
+
+    std::vector<PresentEvent> completed;
+    pmConsumer.DequeuePresentEvents(completed);
+    EXPECT_EQ(completed.size(), 0u);
+}
+
+TEST(PMTraceConsumerTests, CompletedPresentsReleaseTrackingEarly)
+{
+    PMTraceConsumer pmConsumer(false, false);
+
+    // Two presents on the same swapchain; the later one completes first, so
+    // it has to wait for the earlier one before it is handed out.
+    auto first  = TrackNewPresent(&pmConsumer, RUNTIME_THREAD, 1);
+    auto second = TrackNewPresent(&pmConsumer, KERNEL_THREAD, 2);
+
+    second->FinalState = PresentResult::Discarded;
+    pmConsumer.CompletePresent(second);
+
+    // Its tracking state is gone, and lookups no longer find it, but the
+    // PresentEvent itself is kept until the earlier present is done.
+    EXPECT_TRUE(second->Completed);
+    EXPECT_TRUE(second->Tracking == nullptr);
+    EXPECT_EQ(pmConsumer.mPresentsByProcessAndSwapChain.begin()->second.size(), 2u);
+    EXPECT_EQ(pmConsumer.mPresentTrackingPool.LiveCount(), 1u);
+    EXPECT_TRUE(pmConsumer.FindTrackedPresent(pmConsumer.mPresentByThreadId, KERNEL_THREAD) == pmConsumer.mPresentByThreadId.end());
+
+    std::vector<PresentEvent> completed;
+    pmConsumer.DequeuePresentEvents(completed);
+    EXPECT_EQ(completed.size(), 0u);
+
+    first->FinalState = PresentResult::Discarded;
+    pmConsumer.CompletePresent(first);
+
+    pmConsumer.DequeuePresentEvents(completed);
+    EXPECT_EQ(completed.size(), 2u);
+    for (size_t i = 0; i < completed.size(); ++i) {
+        EXPECT_EQ(completed[i].QpcTime, 1 + i);
+    }
+    EXPECT_EQ(pmConsumer.mPresentTrackingPool.LiveCount(), 0u);
+}
+
+TEST(PMTraceConsumerTests, ProcessNameFilterFollowsProcessLifetime)
+{
+    enum { OTHER_PROCESS_ID = PROCESS_ID + 4 };
+
+    PMTraceConsumer pmConsumer(false, false, true);
+    pmConsumer.AddTrackedProcessNameForFiltering("Game.exe");
+
+    auto hdr = MakeHeader(RUNTIME_THREAD, 1);
+    auto otherHdr = hdr;
+    otherHdr.ProcessId = OTHER_PROCESS_ID;
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(hdr));
+
+    // Process start events: names are compared case-insensitively.
+    pmConsumer.UpdateProcessTrackedByName(PROCESS_ID, "game.EXE");
+    pmConsumer.UpdateProcessTrackedByName(OTHER_PROCESS_ID, "Other.exe");
+    EXPECT_TRUE(pmConsumer.IsProcessTrackedForFiltering(hdr));
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(otherHdr));
+    EXPECT_TRUE(pmConsumer.FindOrCreatePresent(otherHdr) == nullptr);
+
+    // Once the process exits, its id is no longer tracked...
+    pmConsumer.RemoveProcessTrackedByName(PROCESS_ID);
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(hdr));
+
+    // ... and an id reused by another process is only tracked if its name
+    // matches too.
+    pmConsumer.UpdateProcessTrackedByName(PROCESS_ID, "Game.exe");
+    EXPECT_TRUE(pmConsumer.IsProcessTrackedForFiltering(hdr));
+    pmConsumer.UpdateProcessTrackedByName(PROCESS_ID, "Other.exe");
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(hdr));
+
+    // Stop events for processes that weren't tracked by name don't change
+    // anything.
+    pmConsumer.RemoveProcessTrackedByName(OTHER_PROCESS_ID);
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(otherHdr));
+
+    // Ids added explicitly are tracked regardless of name.
+    pmConsumer.AddTrackedProcessForFiltering(OTHER_PROCESS_ID);
+    EXPECT_TRUE(pmConsumer.IsProcessTrackedForFiltering(otherHdr));
+    pmConsumer.RemoveTrackedProcessForFiltering(OTHER_PROCESS_ID);
+    EXPECT_FALSE(pmConsumer.IsProcessTrackedForFiltering(otherHdr));
+}
@@ -0,0 +1,95 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "PresentMonTests.h"
+#include "../PresentData/ProviderDispatchTable.hpp"
+
+#include <vector>
+
+// TraceSession routes every event through a ProviderDispatchTable, so these
+// check that lookups work whether or not Build() finds a perfect hash.
+
+namespace {
+
+typedef ProviderDispatchTable<GUID, uint32_t> Table;
+
+GUID MakeGuid(uint32_t data1, uint8_t last)
+{
+    GUID guid = { data1, 0x1234, 0x5678, { 0x9a, 0xbc, 0xde, 0xf0, 0x12, 0x34, 0x56, last } };
+    return guid;
+}
+
+}
+
+TEST(ProviderDispatchTableTests, FindsAddedProviders)
+{
+    std::vector<Table::Entry> entries;
+    for (uint32_t i = 0; i < 12; ++i) {
+        entries.push_back({ MakeGuid(0x1000 + 0x101 * i, 0), i + 1 });
+    }
+
+    Table table;
+    EXPECT_TRUE(table.Build(entries.data(), (uint32_t) entries.size()));
+    for (auto const& entry : entries) {
+        EXPECT_EQ(table.Find(entry.mProviderId), entry.mHandler);
+    }
+    EXPECT_EQ(table.Find(MakeGuid(0x1000, 1)), 0u);
+    EXPECT_EQ(table.Find(MakeGuid(0x5555, 0)), 0u);
+}
+
+TEST(ProviderDispatchTableTests, FallsBackWhenData1IsShared)
+{
+    // Two providers that only differ after Data1 can't have a perfect hash.
+    Table::Entry entries[] = {
+        { MakeGuid(0x1000, 0), 1 },
+        { MakeGuid(0x2000, 0), 2 },
+        { MakeGuid(0x1000, 1), 3 },
+    };
+
+    Table table;
+    EXPECT_FALSE(table.Build(entries, _countof(entries)));
+    for (auto const& entry : entries) {
+        EXPECT_EQ(table.Find(entry.mProviderId), entry.mHandler);
+    }
+    EXPECT_EQ(table.Find(MakeGuid(0x1000, 2)), 0u);
+    EXPECT_EQ(table.Find(MakeGuid(0x3000, 0)), 0u);
+}
+
+TEST(ProviderDispatchTableTests, FallsBackWithTooManyProviders)
+{
+    std::vector<Table::Entry> entries;
+    for (uint32_t i = 0; i < 100; ++i) {
+        entries.push_back({ MakeGuid(0x1000 + i, (uint8_t) i), i + 1 });
+    }
+
+    Table table;
+    EXPECT_FALSE(table.Build(entries.data(), (uint32_t) entries.size()));
+    for (auto const& entry : entries) {
+        EXPECT_EQ(table.Find(entry.mProviderId), entry.mHandler);
+    }
+    EXPECT_EQ(table.Find(MakeGuid(0x1000, 1)), 0u);
+
+    // Rebuilding with a set that has a perfect hash stops using the
+    // fallback.
+    EXPECT_TRUE(table.Build(entries.data(), 4));
+    EXPECT_EQ(table.Find(entries[3].mProviderId), 4u);
+    EXPECT_EQ(table.Find(entries[4].mProviderId), 0u);
+}
@@ -0,0 +1,107 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PresentMonTests.h"
+#include <evntcons.h> // must include after windows.h
+#include "../PresentData/TraceSession.hpp"
+
+#include <vector>
+
+// A provider needed by several consumers is enabled once for the session,
+// so these check how AddProviderEnable() merges their settings, and that
+// each consumer still only wants its own events.
+
+namespace {
+
+GUID const PROVIDER_ID = { 0x12345678, 0x1234, 0x5678, { 0x9a, 0xbc, 0xde, 0xf0, 0x12, 0x34, 0x56, 0x78 } };
+
+struct NullConsumer : TraceEventConsumer {
+    void HandleEvent(EVENT_RECORD*) override {}
+};
+
+EVENT_DESCRIPTOR MakeDescriptor(USHORT id)
+{
+    EVENT_DESCRIPTOR desc = {};
+    desc.Id = id;
+    desc.Level = TRACE_LEVEL_INFORMATION;
+    return desc;
+}
+
+}
+
+TEST(TraceSessionTests, MergedEventIdFiltersIncludeEveryConsumersEvents)
+{
+    std::vector<ProviderEnable> providers;
+    AddProviderEnable(&providers, PROVIDER_ID, TRACE_LEVEL_INFORMATION, 0x1, 0, { 1, 2, 3 });
+    AddProviderEnable(&providers, PROVIDER_ID, TRACE_LEVEL_VERBOSE, 0x2, 0, { 3, 4 });
+
+    ASSERT_EQ(providers.size(), 1u);
+    EXPECT_EQ(providers[0].mLevel, TRACE_LEVEL_VERBOSE);
+    EXPECT_EQ(providers[0].mAnyKeywordMask, 0x3u);
+    EXPECT_EQ(providers[0].mEventIds, std::vector<USHORT>({ 1, 2, 3, 4 }));
+
+    // A consumer that wants every event removes the filter.
+    AddProviderEnable(&providers, PROVIDER_ID, TRACE_LEVEL_INFORMATION, 0x1, 0, {});
+    EXPECT_TRUE(providers[0].mEventIds.empty());
+}
+
+TEST(TraceSessionTests, EventIdFilterTooBigForEtwIsWidened)
+{
+    // Two consumers whose event ids only fit in a filter separately.
+    std::vector<USHORT> eventIds[2];
+    for (USHORT id = 0; id < MAX_EVENT_FILTER_EVENT_ID_COUNT; ++id) {
+        eventIds[id & 1].push_back(MAX_EVENT_FILTER_EVENT_ID_COUNT - id);
+    }
+    eventIds[1].push_back(MAX_EVENT_FILTER_EVENT_ID_COUNT + 1);
+
+    NullConsumer consumers[2];
+    TraceSession session;
+    std::vector<ProviderEnable> providers;
+    for (uint32_t i = 0; i < 2; ++i) {
+        session.AddConsumer(&consumers[i], PROVIDER_ID, TRACE_LEVEL_INFORMATION, 0, 0, eventIds[i]);
+        AddProviderEnable(&providers, PROVIDER_ID, TRACE_LEVEL_INFORMATION, 0, 0, eventIds[i]);
+        EXPECT_EQ(providers[0].mEventIds.size(), i == 0 ? eventIds[0].size() : 0u);
+    }
+
+    // The session collects every event of the provider, but each consumer
+    // still only wants its own.
+    ASSERT_EQ(session.mConsumerProviders.size(), 2u);
+    for (uint32_t i = 0; i < 2; ++i) {
+        auto const& consumerProvider = session.mConsumerProviders[i];
+        for (auto id : eventIds[i]) {
+            EXPECT_TRUE(consumerProvider.WantsEvent(MakeDescriptor(id)));
+        }
+        for (auto id : eventIds[i ^ 1]) {
+            EXPECT_FALSE(consumerProvider.WantsEvent(MakeDescriptor(id)));
+        }
+        EXPECT_FALSE(consumerProvider.WantsEvent(MakeDescriptor(0)));
+        EXPECT_FALSE(consumerProvider.WantsEvent(MakeDescriptor(MAX_EVENT_FILTER_EVENT_ID_COUNT + 2)));
+    }
+
+    // A single consumer that needs too many ids is widened too.
+    providers.clear();
+    eventIds[0].insert(eventIds[0].end(), eventIds[1].begin(), eventIds[1].end());
+    AddProviderEnable(&providers, PROVIDER_ID, TRACE_LEVEL_INFORMATION, 0, 0, eventIds[0]);
+    EXPECT_TRUE(providers[0].mEventIds.empty());
+
+    session.RemoveConsumers();
+}
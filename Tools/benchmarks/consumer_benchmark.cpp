@@ -0,0 +1,853 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Replays synthesized event streams through PMTraceConsumer, calling the
+// same Handle*Event() entry points TraceSession's callback does, and reports
+// the consumer's cost per event.  Changes to PresentData's present tracking
+// or event decoding are measured by running this before and after them.
+//
+// Each stream follows the events a capture of the workload contains (see the
+// present type descriptions in PresentMonTraceConsumer.hpp), including the
+// non-present GPU packets and VSync DPCs that dominate DxgKrnl's traffic:
+//
+//   fullscreen  A game doing hardware legacy flips from its render thread:
+//               Present_Start -> Flip -> QueuePacket_Start -> Present_Info
+//               -> Present_Stop, then MMIOFlip and VSyncDPC a few vsyncs later.
+//   batched     The same game, but the driver submits each flip from its own
+//               thread a few frames after Present_Stop, so Flip has to claim
+//               the oldest batched present of the process.
+//   composed    Several windowed flip-model apps (TokenCompositionSurfaceObject
+//               -> PresentHistoryDetailed -> ... -> PresentHistory and the
+//               TokenStateChanged transitions), plus DWM's own legacy flips,
+//               which have no runtime events.
+//
+// Metadata for every event is injected through HandleMetadataEvent(), as an
+// ETL's EventMetadata events are, so no TDH lookups are done.  A run fails if
+// any present is lost, not completed, or classified differently than the
+// workload intended; the printed checksum covers every completed present, so
+// two builds can be checked to produce the same output.
+//
+// "decode" times EventMetadata::GetEventData() against ReadEventStruct() for
+// the same fields of the composed stream's fixed-layout events.
+//
+// Build PresentData (Release|x64) first, then from this directory:
+//
+//     cl /O2 /std:c++17 /EHsc /DNDEBUG /I..\..\PresentData consumer_benchmark.cpp /link /LIBPATH:..\..\build\obj\PresentData-x64-Release PresentData.lib tdh.lib advapi32.lib
+
+#include "PresentMonTraceConsumer.hpp"
+#include "ETW/Microsoft_Windows_DXGI.h"
+#include "ETW/Microsoft_Windows_DxgKrnl.h"
+#include "ETW/Microsoft_Windows_EventMetadata.h"
+#include "ETW/Microsoft_Windows_Win32k.h"
+
+#include <chrono>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+enum : uint64_t {
+    QPC_FREQUENCY  = 10000000,
+    VSYNC_PERIOD   = QPC_FREQUENCY / 60,
+    EVENT_SPACING  = 200,       // QPC ticks between consecutive events
+};
+
+enum : uint32_t {
+    FRAME_COUNT    = 20000,     // vsyncs of presents per stream
+    DRAIN_FRAMES   = 8,         // vsyncs after the last present, so everything completes
+    RENDER_PACKETS = 6,         // non-present GPU packets per app per frame
+    FLIP_LATENCY   = 2,         // vsyncs from a flip's submission to its VSyncDPC
+    BATCH_DEPTH    = 3,         // presents the driver holds before submitting the oldest
+    COMPOSED_APPS  = 4,
+    DEQUEUE_EVENTS = 4096,      // events between output thread Dequeue*() calls
+    REPEAT_COUNT   = 9,
+
+    DWM_PROCESS    = 900,
+    GAME_PROCESS   = 1000,
+    APP_PROCESS    = 2000,
+    SYSTEM_PROCESS = 4,
+    SYSTEM_THREAD  = 40,
+};
+
+enum class Provider : uint8_t {
+    DXGI, DxgKrnl, Win32k,
+};
+
+// A top-level property of a synthesized TRACE_EVENT_INFO.  Events are
+// recorded with 64-bit pointers, and every property holds one element; if
+// countIndex_ is set, that one element is counted by another property.
+struct Property {
+    wchar_t const* name_;
+    USHORT inType_;
+    USHORT countIndex_;
+};
+
+enum : USHORT { NO_COUNT = 0 };
+
+uint32_t PropertySize(Property const& property)
+{
+    switch (property.inType_) {
+    case TDH_INTYPE_INT32:
+    case TDH_INTYPE_UINT32:
+    case TDH_INTYPE_HEXINT32: return 4;
+    default:                  return 8;
+    }
+}
+
+struct EventType {
+    Provider provider_;
+    GUID guid_;
+    EVENT_DESCRIPTOR desc_;
+    Property const* properties_;
+    uint32_t propertyCount_;
+};
+
+template<typename Event, size_t N>
+EventType MakeEventType(Provider provider, GUID const& guid, Property const (&properties)[N])
+{
+    EventType type = {};
+    type.provider_           = provider;
+    type.guid_               = guid;
+    type.desc_.Id            = Event::Id;
+    type.desc_.Version       = Event::Version;
+    type.desc_.Channel       = Event::Channel;
+    type.desc_.Level         = Event::Level;
+    type.desc_.Opcode        = Event::Opcode;
+    type.desc_.Task          = Event::Task;
+    type.desc_.Keyword       = (ULONGLONG) Event::Keyword;
+    type.properties_         = properties;
+    type.propertyCount_      = (uint32_t) N;
+    return type;
+}
+
+// The properties of each event, in manifest order.
+Property const DXGI_Present_Start[] = {
+    { L"pIDXGISwapChain",           TDH_INTYPE_POINTER },
+    { L"Flags",                     TDH_INTYPE_UINT32 },
+    { L"SyncInterval",              TDH_INTYPE_INT32 },
+    { L"DirtyRects",                TDH_INTYPE_UINT32 },
+    { L"ScrollRects",               TDH_INTYPE_UINT32 },
+};
+Property const DXGI_Present_Stop[] = {
+    { L"Result",                    TDH_INTYPE_UINT32 },
+};
+Property const DxgKrnl_Flip_Info[] = {
+    { L"pDmaBuffer",                TDH_INTYPE_POINTER },
+    { L"VidPnSourceId",             TDH_INTYPE_UINT32 },
+    { L"FlipToAllocation",          TDH_INTYPE_POINTER },
+    { L"FlipInterval",              TDH_INTYPE_UINT32 },
+    { L"FlipWithNoWait",            TDH_INTYPE_UINT32 },
+    { L"MMIOFlip",                  TDH_INTYPE_UINT32 },
+};
+Property const DxgKrnl_QueuePacket_Start[] = {
+    { L"hContext",                  TDH_INTYPE_POINTER },
+    { L"PacketType",                TDH_INTYPE_UINT32 },
+    { L"SubmitSequence",            TDH_INTYPE_UINT32 },
+    { L"DmaBufferSize",             TDH_INTYPE_UINT64 },
+    { L"AllocationListSize",        TDH_INTYPE_UINT32 },
+    { L"PatchLocationListSize",     TDH_INTYPE_UINT32 },
+    { L"bPresent",                  TDH_INTYPE_UINT32 },
+    { L"hDmaBuffer",                TDH_INTYPE_POINTER },
+    { L"pQueuePacket",              TDH_INTYPE_POINTER },
+    { L"ProgressFenceValue",        TDH_INTYPE_UINT64 },
+};
+Property const DxgKrnl_QueuePacket_Stop[] = {
+    { L"hContext",                  TDH_INTYPE_POINTER },
+    { L"PacketType",                TDH_INTYPE_UINT32 },
+    { L"SubmitSequence",            TDH_INTYPE_UINT32 },
+    { L"bPreempted",                TDH_INTYPE_UINT32 },
+    { L"bTimeouted",                TDH_INTYPE_UINT32 },
+    { L"pQueuePacket",              TDH_INTYPE_POINTER },
+};
+Property const DxgKrnl_MMIOFlip_Info[] = {
+    { L"pDxgAdapter",               TDH_INTYPE_POINTER },
+    { L"VidPnSourceId",             TDH_INTYPE_UINT32 },
+    { L"FlipSubmitSequence",        TDH_INTYPE_UINT32 },
+    { L"FlipToDriverAllocation",    TDH_INTYPE_POINTER },
+    { L"FlipToPhysicalAddress",     TDH_INTYPE_UINT64 },
+    { L"FlipToSegmentId",           TDH_INTYPE_UINT32 },
+    { L"FlipPresentId",             TDH_INTYPE_UINT32 },
+    { L"FlipPhysicalAdapterMask",   TDH_INTYPE_UINT32 },
+    { L"Flags",                     TDH_INTYPE_UINT32 },
+};
+Property const DxgKrnl_VSyncDPC_Info[] = {
+    { L"pDxgAdapter",               TDH_INTYPE_POINTER },
+    { L"VidPnTargetId",             TDH_INTYPE_UINT32 },
+    { L"ScannedPhysicalAddress",    TDH_INTYPE_UINT64 },
+    { L"VidPnSourceId",             TDH_INTYPE_UINT32 },
+    { L"FrameNumber",               TDH_INTYPE_UINT32 },
+    { L"FrameQPCTime",              TDH_INTYPE_INT64 },
+    { L"hFlipDevice",               TDH_INTYPE_POINTER },
+    { L"FlipType",                  TDH_INTYPE_UINT32 },
+    { L"FlipFenceId",               TDH_INTYPE_UINT64 },
+};
+Property const DxgKrnl_Present_Info[] = {
+    { L"hContext",                  TDH_INTYPE_UINT32 },
+    { L"hWindow",                   TDH_INTYPE_POINTER },
+    { L"VidPnSourceId",             TDH_INTYPE_UINT32 },
+    { L"Flags",                     TDH_INTYPE_UINT32 },
+    { L"ReturnStatus",              TDH_INTYPE_UINT32 },
+    { L"hSrcAllocHandle",           TDH_INTYPE_POINTER },
+    { L"hDstAllocHandle",           TDH_INTYPE_POINTER },
+};
+Property const DxgKrnl_PresentHistoryDetailed_Start[] = {
+    { L"hAdapter",                  TDH_INTYPE_POINTER },
+    { L"Token",                     TDH_INTYPE_POINTER },
+    { L"Model",                     TDH_INTYPE_UINT32 },
+    { L"TokenSize",                 TDH_INTYPE_UINT32 },
+    { L"TokenData",                 TDH_INTYPE_UINT64 },
+    { L"ScrollRect_left",           TDH_INTYPE_UINT32 },
+    { L"ScrollRect_right",          TDH_INTYPE_UINT32 },
+    { L"ScrollRect_top",            TDH_INTYPE_UINT32 },
+    { L"ScrollRect_bottom",         TDH_INTYPE_UINT32 },
+    { L"ScrollOffset_X",            TDH_INTYPE_UINT32 },
+    { L"ScrollOffset_Y",            TDH_INTYPE_UINT32 },
+    { L"DirtyRectCount",            TDH_INTYPE_UINT32 },
+    { L"Left",                      TDH_INTYPE_INT32, 11 },
+    { L"Right",                     TDH_INTYPE_INT32, 11 },
+    { L"Top",                       TDH_INTYPE_INT32, 11 },
+    { L"Bottom",                    TDH_INTYPE_INT32, 11 },
+    { L"SourceRect_left",           TDH_INTYPE_UINT32 },
+    { L"SourceRect_right",          TDH_INTYPE_UINT32 },
+    { L"SourceRect_top",            TDH_INTYPE_UINT32 },
+    { L"SourceRect_bottom",         TDH_INTYPE_UINT32 },
+    { L"DestWidth",                 TDH_INTYPE_UINT32 },
+    { L"DestHeight",                TDH_INTYPE_UINT32 },
+    { L"TargetRect_left",           TDH_INTYPE_UINT32 },
+    { L"TargetRect_right",          TDH_INTYPE_UINT32 },
+    { L"TargetRect_top",            TDH_INTYPE_UINT32 },
+    { L"TargetRect_bottom",         TDH_INTYPE_UINT32 },
+};
+Property const DxgKrnl_PresentHistory_Info[] = {
+    { L"hAdapter",                  TDH_INTYPE_POINTER },
+    { L"Token",                     TDH_INTYPE_POINTER },
+    { L"Model",                     TDH_INTYPE_UINT32 },
+    { L"TokenSize",                 TDH_INTYPE_UINT32 },
+    { L"TokenData",                 TDH_INTYPE_UINT64 },
+};
+Property const Win32k_TokenCompositionSurfaceObject_Info[] = {
+    { L"pToken",                    TDH_INTYPE_POINTER },
+    { L"pCompositionSurfaceObject", TDH_INTYPE_POINTER },
+    { L"SwapChainIndex",            TDH_INTYPE_UINT32 },
+    { L"PresentCount",              TDH_INTYPE_UINT64 },
+    { L"CompositionSurfaceLuid",    TDH_INTYPE_UINT64 },
+    { L"BindId",                    TDH_INTYPE_UINT64 },
+};
+Property const Win32k_TokenStateChanged_Info[] = {
+    { L"pCompositionSurfaceObject", TDH_INTYPE_POINTER },
+    { L"SwapChainIndex",            TDH_INTYPE_UINT32 },
+    { L"PresentCount",              TDH_INTYPE_UINT32 },
+    { L"FenceValue",                TDH_INTYPE_UINT64 },
+    { L"NewState",                  TDH_INTYPE_UINT32 },
+    { L"IndependentFlip",           TDH_INTYPE_UINT32 },
+    { L"SkipIndependentFlip",       TDH_INTYPE_UINT32 },
+    { L"CompositionSurfaceLuid",    TDH_INTYPE_UINT64 },
+    { L"BindId",                    TDH_INTYPE_UINT64 },
+};
+
+namespace DXGI    = Microsoft_Windows_DXGI;
+namespace DxgKrnl = Microsoft_Windows_DxgKrnl;
+namespace Win32k  = Microsoft_Windows_Win32k;
+
+EventType const PresentStart   = MakeEventType<DXGI::Present_Start>(Provider::DXGI, DXGI::GUID, DXGI_Present_Start);
+EventType const PresentStop    = MakeEventType<DXGI::Present_Stop>(Provider::DXGI, DXGI::GUID, DXGI_Present_Stop);
+EventType const Flip           = MakeEventType<DxgKrnl::Flip_Info>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_Flip_Info);
+EventType const QueueStart     = MakeEventType<DxgKrnl::QueuePacket_Start>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_QueuePacket_Start);
+EventType const QueueStop      = MakeEventType<DxgKrnl::QueuePacket_Stop>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_QueuePacket_Stop);
+EventType const MMIOFlip       = MakeEventType<DxgKrnl::MMIOFlip_Info>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_MMIOFlip_Info);
+EventType const VSyncDPC       = MakeEventType<DxgKrnl::VSyncDPC_Info>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_VSyncDPC_Info);
+EventType const DxgkPresent    = MakeEventType<DxgKrnl::Present_Info>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_Present_Info);
+EventType const PHTDetailed    = MakeEventType<DxgKrnl::PresentHistoryDetailed_Start>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_PresentHistoryDetailed_Start);
+EventType const PHT            = MakeEventType<DxgKrnl::PresentHistory_Info>(Provider::DxgKrnl, DxgKrnl::GUID, DxgKrnl_PresentHistory_Info);
+EventType const TokenSurface   = MakeEventType<Win32k::TokenCompositionSurfaceObject_Info>(Provider::Win32k, Win32k::GUID, Win32k_TokenCompositionSurfaceObject_Info);
+EventType const TokenState     = MakeEventType<Win32k::TokenStateChanged_Info>(Provider::Win32k, Win32k::GUID, Win32k_TokenStateChanged_Info);
+
+EventType const* const AllEventTypes[] = {
+    &PresentStart, &PresentStop, &Flip, &QueueStart, &QueueStop, &MMIOFlip,
+    &VSyncDPC, &DxgkPresent, &PHTDetailed, &PHT, &TokenSurface, &TokenState,
+};
+
+// Builds the TRACE_EVENT_INFO for type: the header, one EVENT_PROPERTY_INFO
+// per property, then the property names.
+std::vector<uint8_t> BuildTraceEventInfo(EventType const& type)
+{
+    auto propertiesSize = type.propertyCount_ * sizeof(EVENT_PROPERTY_INFO);
+    auto namesOffset = offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray) + propertiesSize;
+    auto size = namesOffset;
+    for (uint32_t i = 0; i < type.propertyCount_; ++i) {
+        size += (wcslen(type.properties_[i].name_) + 1) * sizeof(wchar_t);
+    }
+
+    std::vector<uint8_t> blob(size, 0);
+    auto tei = (TRACE_EVENT_INFO*) blob.data();
+    tei->ProviderGuid          = type.guid_;
+    tei->EventDescriptor       = type.desc_;
+    tei->PropertyCount         = type.propertyCount_;
+    tei->TopLevelPropertyCount = type.propertyCount_;
+
+    auto nameOffset = namesOffset;
+    for (uint32_t i = 0; i < type.propertyCount_; ++i) {
+        auto const& property = type.properties_[i];
+        auto nameSize = (wcslen(property.name_) + 1) * sizeof(wchar_t);
+        memcpy(blob.data() + nameOffset, property.name_, nameSize);
+
+        auto epi = &tei->EventPropertyInfoArray[i];
+        epi->NameOffset             = (ULONG) nameOffset;
+        epi->nonStructType.InType   = property.inType_;
+        if (property.countIndex_ == NO_COUNT) {
+            epi->count              = 1;
+        } else {
+            epi->Flags              = PropertyParamCount;
+            epi->countPropertyIndex = property.countIndex_;
+        }
+        epi->length                 = (USHORT) PropertySize(property);
+        nameOffset += nameSize;
+    }
+
+    return blob;
+}
+
+struct RecordedEvent {
+    EVENT_RECORD record_;
+    Provider provider_;
+    uint32_t dataOffset_;
+};
+
+struct Recording {
+    char const* name_;
+    std::vector<RecordedEvent> events_;
+    std::vector<uint8_t> data_;
+    uint32_t presentCount_[3];      // [PresentMode::Hardware_Legacy_Flip, Composed_Flip, other] expected
+
+    // Points each record at its data; call once data_ is complete.
+    void Finish()
+    {
+        for (auto& e : events_) {
+            e.record_.UserData = data_.data() + e.dataOffset_;
+        }
+    }
+};
+
+// Generates a stream one vsync at a time.  Work that happens on a later
+// vsync (GPU completion, scanout, composition) is scheduled with At().
+class StreamWriter {
+    Recording* recording_;
+    std::vector<std::vector<std::function<void()>>> scheduled_;
+    uint32_t frame_;
+    uint64_t qpc_;
+    uint32_t submitSequence_;
+
+public:
+    explicit StreamWriter(Recording* recording)
+        : recording_(recording)
+        , scheduled_(FRAME_COUNT + DRAIN_FRAMES)
+        , frame_(0)
+        , qpc_(0)
+        , submitSequence_(0)
+    {
+    }
+
+    uint32_t Frame() const { return frame_; }
+    uint64_t Qpc() const { return qpc_; }
+    uint32_t NextSubmitSequence() { return ++submitSequence_; }
+
+    void At(uint32_t frame, std::function<void()> fn)
+    {
+        if (frame < scheduled_.size()) {
+            scheduled_[frame].push_back(std::move(fn));
+        }
+    }
+
+    // Calls submit for each of the first FRAME_COUNT vsyncs, after that
+    // vsync's scheduled work, then runs the rest of the scheduled work.
+    void Run(std::function<void()> submit)
+    {
+        for (frame_ = 0; frame_ < scheduled_.size(); ++frame_) {
+            qpc_ = (frame_ + 1) * VSYNC_PERIOD;
+            for (size_t i = 0; i < scheduled_[frame_].size(); ++i) {
+                scheduled_[frame_][i]();
+            }
+            if (frame_ < FRAME_COUNT) {
+                submit();
+            }
+        }
+        recording_->Finish();
+    }
+
+    // Records one event; values has one entry per property of type.
+    void Emit(EventType const& type, uint32_t processId, uint32_t threadId, std::initializer_list<uint64_t> values)
+    {
+        assert(values.size() == type.propertyCount_);
+
+        qpc_ += EVENT_SPACING;
+
+        RecordedEvent e = {};
+        e.record_.EventHeader.Flags               = EVENT_HEADER_FLAG_64_BIT_HEADER;
+        e.record_.EventHeader.ProcessId           = processId;
+        e.record_.EventHeader.ThreadId            = threadId;
+        e.record_.EventHeader.TimeStamp.QuadPart  = (LONGLONG) qpc_;
+        e.record_.EventHeader.ProviderId          = type.guid_;
+        e.record_.EventHeader.EventDescriptor     = type.desc_;
+        e.provider_   = type.provider_;
+        e.dataOffset_ = (uint32_t) recording_->data_.size();
+
+        auto value = values.begin();
+        for (uint32_t i = 0; i < type.propertyCount_; ++i, ++value) {
+            auto size = PropertySize(type.properties_[i]);
+            auto p = (uint8_t const*) &*value;  // little endian
+            recording_->data_.insert(recording_->data_.end(), p, p + size);
+        }
+
+        e.record_.UserDataLength = (USHORT) (recording_->data_.size() - e.dataOffset_);
+        recording_->events_.push_back(e);
+    }
+};
+
+// A GPU packet that isn't a present.  It completes on the next vsync.
+void RenderPacket(StreamWriter* w, uint32_t processId, uint32_t threadId, uint64_t hContext)
+{
+    auto seq = w->NextSubmitSequence();
+    w->Emit(QueueStart, processId, threadId, { hContext, DXGKETW_RENDER_COMMAND_BUFFER, seq, 0x10000, 64, 32, 0, 0xD0000000 + seq, 0xE0000000 + seq, seq });
+    w->At(w->Frame() + 1, [=]() {
+        w->Emit(QueueStop, SYSTEM_PROCESS, SYSTEM_THREAD, { hContext, DXGKETW_RENDER_COMMAND_BUFFER, seq, 0, 0, 0xE0000000 + seq });
+    });
+}
+
+// The kernel side of a legacy flip: Flip -> MMIOFLIP packet -> Present_Info,
+// all on threadId, then the flip is latched and scanned out FLIP_LATENCY
+// vsyncs later.
+void SubmitLegacyFlip(StreamWriter* w, uint32_t processId, uint32_t threadId, uint64_t hContext)
+{
+    auto seq = w->NextSubmitSequence();
+    w->Emit(Flip, processId, threadId, { 0xA0000000 + seq, 0, 0xB0000000 + (seq & 3), 1, 0, 1 });
+    w->Emit(QueueStart, processId, threadId, { hContext, DXGKETW_MMIOFLIP_COMMAND_BUFFER, seq, 0, 0, 0, 0, 0xD0000000 + seq, 0xE0000000 + seq, seq });
+    w->Emit(DxgkPresent, processId, threadId, { 0, 0, 0, 0, 0, 0xB0000000 + (seq & 3), 0 });
+    w->At(w->Frame() + FLIP_LATENCY - 1, [=]() {
+        w->Emit(MMIOFlip, SYSTEM_PROCESS, SYSTEM_THREAD, { 0xC0000000, 0, seq, 0xB0000000 + (seq & 3), 0x100000000 + (seq & 3), 1, seq, 1, (uint32_t) DxgKrnl::MMIOFlip::OnNextVSync });
+        w->Emit(QueueStop, SYSTEM_PROCESS, SYSTEM_THREAD, { hContext, DXGKETW_MMIOFLIP_COMMAND_BUFFER, seq, 0, 0, 0xE0000000 + seq });
+    });
+    w->At(w->Frame() + FLIP_LATENCY, [=]() {
+        w->Emit(VSyncDPC, SYSTEM_PROCESS, SYSTEM_THREAD, { 0xC0000000, 0, 0x100000000 + (seq & 3), 0, w->Frame(), w->Qpc(), 0, 0, (uint64_t) seq << 32 });
+    });
+}
+
+// A VSyncDPC that doesn't flip anything new.
+void IdleVSync(StreamWriter* w)
+{
+    w->Emit(VSyncDPC, SYSTEM_PROCESS, SYSTEM_THREAD, { 0xC0000000, 0, 0x100000000, 0, w->Frame(), w->Qpc(), 0, 0, 0 });
+}
+
+Recording RecordFullscreen(bool batched)
+{
+    enum : uint32_t {
+        RENDER_THREAD = GAME_PROCESS + 1,
+        DRIVER_THREAD = GAME_PROCESS + 2,
+    };
+    uint64_t const swapChain = 0x7FF000001000;
+    uint64_t const hContext  = 0xFFFF000010000000;
+
+    Recording recording = {};
+    recording.name_ = batched ? "batched" : "fullscreen";
+    recording.presentCount_[0] = FRAME_COUNT;
+
+    StreamWriter w(&recording);
+    std::vector<uint32_t> batchedFrames;
+    w.Run([&]() {
+        for (uint32_t i = 0; i < RENDER_PACKETS; ++i) {
+            RenderPacket(&w, GAME_PROCESS, batched ? DRIVER_THREAD : RENDER_THREAD, hContext);
+        }
+
+        w.Emit(PresentStart, GAME_PROCESS, RENDER_THREAD, { swapChain, 0, 1, 0, 0 });
+        if (batched) {
+            w.Emit(PresentStop, GAME_PROCESS, RENDER_THREAD, { 0 });
+
+            // The driver submits the oldest present it is holding, and flushes
+            // what it holds at the end of the stream.
+            batchedFrames.push_back(w.Frame());
+            if (batchedFrames.size() > BATCH_DEPTH || w.Frame() + 1 == FRAME_COUNT) {
+                auto count = w.Frame() + 1 == FRAME_COUNT ? batchedFrames.size() : 1;
+                for (size_t i = 0; i < count; ++i) {
+                    SubmitLegacyFlip(&w, GAME_PROCESS, DRIVER_THREAD, hContext);
+                }
+                batchedFrames.erase(batchedFrames.begin(), batchedFrames.begin() + count);
+            }
+        } else {
+            SubmitLegacyFlip(&w, GAME_PROCESS, RENDER_THREAD, hContext);
+            w.Emit(PresentStop, GAME_PROCESS, RENDER_THREAD, { 0 });
+        }
+
+        if (w.Frame() < FLIP_LATENCY) {
+            IdleVSync(&w);
+        }
+    });
+
+    return recording;
+}
+
+Recording RecordComposed()
+{
+    enum : uint32_t {
+        DWM_THREAD    = DWM_PROCESS + 1,
+    };
+    uint64_t const dwmContext = 0xFFFF000020000000;
+
+    Recording recording = {};
+    recording.name_ = "composed";
+    recording.presentCount_[0] = FRAME_COUNT;
+    recording.presentCount_[1] = FRAME_COUNT * COMPOSED_APPS;
+
+    StreamWriter w(&recording);
+    uint64_t token = 0xFFFF800000000000;
+    w.Run([&]() {
+        for (uint32_t app = 0; app < COMPOSED_APPS; ++app) {
+            auto processId    = APP_PROCESS + 100 * app;
+            auto threadId     = processId + 1;
+            auto swapChain    = 0x7FF000002000 + 0x1000 * app;
+            auto hContext     = 0xFFFF000030000000 + 0x1000 * app;
+            auto hwnd         = 0x10000 + 0x100 * app;
+            auto surfaceLuid  = 0x100000 + app;
+            auto surface      = 0xFFFF900000000000 + 0x1000 * app;
+            auto presentCount = (uint64_t) w.Frame() + 1;
+            auto bindId       = presentCount % 3;
+            token += 0x100;
+
+            for (uint32_t i = 0; i < RENDER_PACKETS; ++i) {
+                RenderPacket(&w, processId, threadId, hContext);
+            }
+
+            auto seq = w.NextSubmitSequence();
+            w.Emit(PresentStart, processId, threadId, { swapChain, 0, 1, 0, 0 });
+            w.Emit(TokenSurface, processId, threadId, { token, surface, 0, presentCount, surfaceLuid, bindId });
+            w.Emit(PHTDetailed, processId, threadId, { 0xC0000000, token, D3DKMT_PM_REDIRECTED_FLIP, 0x100, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1920, 0, 1080, 0, 1920, 0, 1080, 1920, 1080, 0, 1920, 0, 1080 });
+            w.Emit(QueueStart, processId, threadId, { hContext, DXGKETW_RENDER_COMMAND_BUFFER, seq, 0x1000, 8, 0, 1, 0xD0000000 + seq, 0xE0000000 + seq, seq });
+            w.Emit(DxgkPresent, processId, threadId, { 0, hwnd, 0, 0, 0, 0, 0 });
+            w.Emit(PresentStop, processId, threadId, { 0 });
+
+            // The GPU finishes the frame and hands the token to DWM on the
+            // next vsync.  DWM composes it then, and it is retired and
+            // released when the app's next present is on screen.
+            w.At(w.Frame() + 1, [=, &w]() {
+                w.Emit(QueueStop, SYSTEM_PROCESS, SYSTEM_THREAD, { hContext, DXGKETW_RENDER_COMMAND_BUFFER, seq, 0, 0, 0xE0000000 + seq });
+                w.Emit(PHT, SYSTEM_PROCESS, SYSTEM_THREAD, { 0xC0000000, token, D3DKMT_PM_REDIRECTED_FLIP, 0x100, 0 });
+                w.Emit(TokenState, DWM_PROCESS, DWM_THREAD, { surface, 0, (uint32_t) presentCount, seq, (uint32_t) Win32k::TokenState::InFrame, 0, 0, surfaceLuid, bindId });
+                w.Emit(TokenState, DWM_PROCESS, DWM_THREAD, { surface, 0, (uint32_t) presentCount, seq, (uint32_t) Win32k::TokenState::Confirmed, 0, 0, surfaceLuid, bindId });
+            });
+            w.At(w.Frame() + 1 + FLIP_LATENCY, [=, &w]() {
+                w.Emit(TokenState, DWM_PROCESS, DWM_THREAD, { surface, 0, (uint32_t) presentCount, seq, (uint32_t) Win32k::TokenState::Retired, 0, 0, surfaceLuid, bindId });
+            });
+            w.At(w.Frame() + 2 + FLIP_LATENCY, [=, &w]() {
+                w.Emit(TokenState, DWM_PROCESS, DWM_THREAD, { surface, 0, (uint32_t) presentCount, seq, (uint32_t) Win32k::TokenState::Discarded, 0, 0, surfaceLuid, bindId });
+            });
+        }
+
+        // DWM's frame, which has no runtime events.
+        for (uint32_t i = 0; i < RENDER_PACKETS; ++i) {
+            RenderPacket(&w, DWM_PROCESS, DWM_THREAD, dwmContext);
+        }
+        SubmitLegacyFlip(&w, DWM_PROCESS, DWM_THREAD, dwmContext);
+
+        if (w.Frame() < FLIP_LATENCY) {
+            IdleVSync(&w);
+        }
+    });
+
+    return recording;
+}
+
+void AddMetadata(EventMetadata* metadata, PMTraceConsumer* pmConsumer)
+{
+    for (auto type : AllEventTypes) {
+        auto tei = BuildTraceEventInfo(*type);
+
+        EVENT_RECORD eventRecord = {};
+        eventRecord.EventHeader.ProviderId             = Microsoft_Windows_EventMetadata::GUID;
+        eventRecord.EventHeader.EventDescriptor.Opcode = Microsoft_Windows_EventMetadata::EventInfo::Opcode;
+        eventRecord.UserData                           = tei.data();
+        eventRecord.UserDataLength                     = (USHORT) tei.size();
+        if (metadata != nullptr) {
+            metadata->AddMetadata(&eventRecord);
+        }
+        if (pmConsumer != nullptr) {
+            pmConsumer->HandleMetadataEvent(&eventRecord);
+        }
+    }
+}
+
+struct ReplayResult {
+    uint32_t presentCount_[3];
+    uint32_t lostCount_;
+    uint32_t incompleteCount_;
+    uint64_t checksum_;
+};
+
+void CheckPresents(std::vector<PresentEvent> const& presents, ReplayResult* result)
+{
+    for (auto const& p : presents) {
+        auto mode = p.PresentMode == PresentMode::Hardware_Legacy_Flip ? 0 :
+                    p.PresentMode == PresentMode::Composed_Flip        ? 1 : 2;
+        auto expectedMode = p.ProcessId >= APP_PROCESS ? 1 : 0;
+        if (mode != expectedMode || p.FinalState != PresentResult::Presented || p.ScreenTime < p.QpcTime) {
+            result->incompleteCount_ += 1;
+        }
+        result->presentCount_[mode] += 1;
+        result->checksum_ = result->checksum_ * 31 + (p.QpcTime ^ (p.ScreenTime << 20) ^ ((uint64_t) p.ProcessId << 48));
+    }
+}
+
+// Replays the recording through a new PMTraceConsumer, dequeuing the way the
+// output thread does, and returns the seconds spent.
+double Replay(Recording* recording, ReplayResult* result)
+{
+    PMTraceConsumer pmConsumer(true, false);
+    pmConsumer.StartPresentAging(QPC_FREQUENCY);
+    AddMetadata(nullptr, &pmConsumer);
+
+    std::vector<ProcessEvent> processEvents;
+    std::vector<PresentEvent> presents;
+    std::vector<PresentEvent> lostPresents;
+    auto dequeue = [&]() {
+        pmConsumer.DequeueProcessEvents(processEvents);
+        pmConsumer.DequeuePresentEvents(presents);
+        pmConsumer.DequeueLostPresentEvents(lostPresents);
+        CheckPresents(presents, result);
+        result->lostCount_ += (uint32_t) lostPresents.size();
+        processEvents.clear();
+        presents.clear();
+        lostPresents.clear();
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    uint32_t sinceDequeue = 0;
+    for (auto& e : recording->events_) {
+        auto eventRecord = &e.record_;
+        pmConsumer.AgePresents(eventRecord->EventHeader.TimeStamp.QuadPart);
+        switch (e.provider_) {
+        case Provider::DXGI:    pmConsumer.HandleDXGIEvent(eventRecord); break;
+        case Provider::DxgKrnl: pmConsumer.HandleDXGKEvent(eventRecord); break;
+        case Provider::Win32k:  pmConsumer.HandleWin32kEvent(eventRecord); break;
+        }
+        if (++sinceDequeue == DEQUEUE_EVENTS) {
+            sinceDequeue = 0;
+            dequeue();
+        }
+    }
+    dequeue();
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+// Whether PMTraceConsumer reads the event through a generated struct.
+bool IsFixedLayout(RecordedEvent const& e)
+{
+    auto id = e.record_.EventHeader.EventDescriptor.Id;
+    switch (e.provider_) {
+    case Provider::DXGI:   return true;
+    case Provider::Win32k: return id == Win32k::TokenStateChanged_Info::Id;
+    default:               return id != DxgKrnl::Present_Info::Id && id != DxgKrnl::PresentHistoryDetailed_Start::Id;
+    }
+}
+
+// Decodes the fields PMTraceConsumer uses from a fixed-layout event, either
+// by name with GetEventData() or through the generated struct, and returns
+// their sum.
+uint64_t DecodeByName(EventMetadata* metadata, RecordedEvent* e)
+{
+    auto eventRecord = &e->record_;
+    auto id = eventRecord->EventHeader.EventDescriptor.Id;
+    if (e->provider_ == Provider::DXGI) {
+        if (id == DXGI::Present_Start::Id) {
+            EventDataDesc desc[] = { { L"pIDXGISwapChain" }, { L"Flags" }, { L"SyncInterval" } };
+            metadata->GetEventData(eventRecord, desc, _countof(desc));
+            return desc[0].GetData<uint64_t>() + desc[1].GetData<uint32_t>() + desc[2].GetData<int32_t>();
+        }
+        return metadata->GetEventData<uint32_t>(eventRecord, L"Result");
+    }
+    if (e->provider_ == Provider::Win32k) {
+        EventDataDesc desc[] = { { L"CompositionSurfaceLuid" }, { L"PresentCount" }, { L"BindId" }, { L"NewState" }, { L"IndependentFlip" } };
+        metadata->GetEventData(eventRecord, desc, _countof(desc));
+        return desc[0].GetData<uint64_t>() + desc[1].GetData<uint32_t>() + desc[2].GetData<uint64_t>() + desc[3].GetData<uint32_t>() + desc[4].GetData<uint32_t>();
+    }
+    switch (id) {
+    case DxgKrnl::Flip_Info::Id: {
+        EventDataDesc desc[] = { { L"FlipInterval" }, { L"MMIOFlip" } };
+        metadata->GetEventData(eventRecord, desc, _countof(desc));
+        return desc[0].GetData<uint32_t>() + desc[1].GetData<uint32_t>();
+    }
+    case DxgKrnl::QueuePacket_Start::Id: {
+        EventDataDesc desc[] = { { L"PacketType" }, { L"SubmitSequence" }, { L"hContext" }, { L"bPresent" } };
+        metadata->GetEventData(eventRecord, desc, _countof(desc));
+        return desc[0].GetData<uint32_t>() + desc[1].GetData<uint32_t>() + desc[2].GetData<uint64_t>() + desc[3].GetData<uint32_t>();
+    }
+    case DxgKrnl::QueuePacket_Stop::Id:
+        return metadata->GetEventData<uint32_t>(eventRecord, L"SubmitSequence");
+    case DxgKrnl::MMIOFlip_Info::Id: {
+        EventDataDesc desc[] = { { L"FlipSubmitSequence" }, { L"Flags" } };
+        metadata->GetEventData(eventRecord, desc, _countof(desc));
+        return desc[0].GetData<uint32_t>() + desc[1].GetData<uint32_t>();
+    }
+    case DxgKrnl::VSyncDPC_Info::Id:
+        return metadata->GetEventData<uint64_t>(eventRecord, L"FlipFenceId");
+    case DxgKrnl::PresentHistory_Info::Id:
+        return metadata->GetEventData<uint64_t>(eventRecord, L"Token");
+    }
+    return 0;
+}
+
+uint64_t DecodeByStruct(EventMetadata* metadata, RecordedEvent* e)
+{
+    auto eventRecord = &e->record_;
+    auto id = eventRecord->EventHeader.EventDescriptor.Id;
+    uint64_t sum = 0;
+    if (e->provider_ == Provider::DXGI) {
+        if (id == DXGI::Present_Start::Id) {
+            metadata->ReadEventStruct<DXGI::Present_Start_Struct>(eventRecord, DXGI::Present_Start_Fields, [&](auto const* s) {
+                sum = s->pIDXGISwapChain + s->Flags + (int32_t) s->SyncInterval;
+            });
+        } else {
+            metadata->ReadEventStruct<DXGI::Present_Stop_Struct>(eventRecord, DXGI::Present_Stop_Fields, [&](auto const* s) {
+                sum = s->Result;
+            });
+        }
+        return sum;
+    }
+    if (e->provider_ == Provider::Win32k) {
+        metadata->ReadEventStruct<Win32k::TokenStateChanged_Info_Struct>(eventRecord, Win32k::TokenStateChanged_Info_Fields, [&](auto const* s) {
+            sum = s->CompositionSurfaceLuid + s->PresentCount + s->BindId + s->NewState + s->IndependentFlip;
+        });
+        return sum;
+    }
+    switch (id) {
+    case DxgKrnl::Flip_Info::Id:
+        metadata->ReadEventStruct<DxgKrnl::Flip_Info_Struct>(eventRecord, DxgKrnl::Flip_Info_Fields, [&](auto const* s) {
+            sum = s->FlipInterval + s->MMIOFlip;
+        });
+        break;
+    case DxgKrnl::QueuePacket_Start::Id:
+        metadata->ReadEventStruct<DxgKrnl::QueuePacket_Start_Struct>(eventRecord, DxgKrnl::QueuePacket_Start_Fields, [&](auto const* s) {
+            sum = s->PacketType + s->SubmitSequence + s->hContext + s->bPresent;
+        });
+        break;
+    case DxgKrnl::QueuePacket_Stop::Id:
+        metadata->ReadEventStruct<DxgKrnl::QueuePacket_Stop_Struct>(eventRecord, DxgKrnl::QueuePacket_Stop_Fields, [&](auto const* s) {
+            sum = s->SubmitSequence;
+        });
+        break;
+    case DxgKrnl::MMIOFlip_Info::Id:
+        metadata->ReadEventStruct<DxgKrnl::MMIOFlip_Info_Struct>(eventRecord, DxgKrnl::MMIOFlip_Info_Fields, [&](auto const* s) {
+            sum = s->FlipSubmitSequence + s->Flags;
+        });
+        break;
+    case DxgKrnl::VSyncDPC_Info::Id:
+        metadata->ReadEventStruct<DxgKrnl::VSyncDPC_Info_Struct>(eventRecord, DxgKrnl::VSyncDPC_Info_Fields, [&](auto const* s) {
+            sum = s->FlipFenceId;
+        });
+        break;
+    case DxgKrnl::PresentHistory_Info::Id:
+        metadata->ReadEventStruct<DxgKrnl::PresentHistory_Info_Struct>(eventRecord, DxgKrnl::PresentHistory_Info_Fields, [&](auto const* s) {
+            sum = s->Token;
+        });
+        break;
+    }
+    return sum;
+}
+
+template<uint64_t (*Decode)(EventMetadata*, RecordedEvent*)>
+double DecodeAll(std::vector<RecordedEvent>* events, uint64_t* checksum)
+{
+    EventMetadata metadata;
+    AddMetadata(&metadata, nullptr);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t sum = 0;
+    for (auto& e : *events) {
+        sum += Decode(&metadata, &e);
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    *checksum = sum;
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+}
+
+int main()
+{
+    Recording recordings[] = {
+        RecordFullscreen(false),
+        RecordFullscreen(true),
+        RecordComposed(),
+    };
+
+    int error = 0;
+    for (auto& recording : recordings) {
+        auto best = 0.0;
+        ReplayResult result = {};
+        for (uint32_t i = 0; i < REPEAT_COUNT; ++i) {
+            result = {};
+            auto seconds = Replay(&recording, &result);
+            best = i == 0 ? seconds : std::min(best, seconds);
+        }
+
+        auto eventCount = (double) recording.events_.size();
+        auto presentCount = result.presentCount_[0] + result.presentCount_[1] + result.presentCount_[2];
+        printf("%-10s %8u events %7u presents: %.3lf s (%.1lf ns/event) checksum %016llx\n",
+            recording.name_, (uint32_t) eventCount, presentCount, best, 1e9 * best / eventCount,
+            (unsigned long long) result.checksum_);
+
+        if (result.presentCount_[0] != recording.presentCount_[0] ||
+            result.presentCount_[1] != recording.presentCount_[1] ||
+            result.presentCount_[2] != recording.presentCount_[2] ||
+            result.lostCount_ != 0 ||
+            result.incompleteCount_ != 0) {
+            fprintf(stderr, "error: %s: expected %u/%u/%u presents, got %u/%u/%u (%u lost, %u incomplete)\n",
+                recording.name_,
+                recording.presentCount_[0], recording.presentCount_[1], recording.presentCount_[2],
+                result.presentCount_[0], result.presentCount_[1], result.presentCount_[2],
+                result.lostCount_, result.incompleteCount_);
+            error = 1;
+        }
+    }
+
+    std::vector<RecordedEvent> fixedLayoutEvents;
+    for (auto const& e : recordings[2].events_) {
+        if (IsFixedLayout(e)) {
+            fixedLayoutEvents.push_back(e);
+        }
+    }
+
+    uint64_t checksum[2] = {};
+    auto nameSeconds   = DecodeAll<DecodeByName>(&fixedLayoutEvents, &checksum[0]);
+    auto structSeconds = DecodeAll<DecodeByStruct>(&fixedLayoutEvents, &checksum[1]);
+    auto eventCount = (double) fixedLayoutEvents.size();
+    printf("decode     GetEventData:    %.3lf s (%.1lf ns/event)\n", nameSeconds, 1e9 * nameSeconds / eventCount);
+    printf("decode     ReadEventStruct: %.3lf s (%.1lf ns/event)\n", structSeconds, 1e9 * structSeconds / eventCount);
+    if (checksum[0] != checksum[1]) {
+        fprintf(stderr, "error: decode checksum mismatch\n");
+        error = 1;
+    }
+
+    return error;
+}
@@ -0,0 +1,248 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Formats a million PresentMon CSV rows (-verbose columns plus -qpc_time)
+// three ways and checks that they produce identical bytes:
+//
+//   fprintf:      one fprintf per group of columns straight into the FILE, as
+//                 UpdateCsv() used to
+//   snprintf:     the same formats appended to a buffer with vsnprintf, as
+//                 FormatCsvRow() did before CsvRowWriter
+//   CsvRowWriter: hand-written number formatting into the buffer
+//
+// The buffered paths write the buffer with one fwrite at the end.  Output
+// goes to a temporary file, which is read back for the comparison:
+//
+//     g++ -O2 -std=c++17 csv_row_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc csv_row_benchmark.cpp
+
+#include "../../PresentMon/CsvRowWriter.hpp"
+
+#include <chrono>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum {
+    ROW_COUNT = 1000000,
+};
+
+struct Row {
+    char const* mApplication;
+    uint64_t mSwapChainAddress;
+    uint64_t mQpcTime;
+    double mTimeInSeconds;
+    double mMsBetweenPresents;
+    double mMsBetweenDisplayChange;
+    double mMsInPresentApi;
+    double mMsUntilRenderComplete;
+    double mMsUntilDisplayed;
+    uint32_t mProcessId;
+    uint32_t mPresentFlags;
+    int32_t mSyncInterval;
+    char const* mRuntime;
+    char const* mPresentMode;
+    char const* mDropped;
+    bool mSupportsTearing;
+    bool mWasBatched;
+    bool mDwmNotified;
+};
+
+std::vector<Row> GenerateRows()
+{
+    std::vector<Row> rows(ROW_COUNT);
+    uint64_t qpc = 123456789012ull;
+    uint32_t x = 1;
+    for (auto& r : rows) {
+        x = x * 1664525u + 1013904223u;
+        auto jitter = (double) (x >> 8) / (double) (1u << 24);  // [0, 1)
+        auto frameQpc = 166666 + (uint64_t) (jitter * 20000.0);
+        qpc += frameQpc;
+
+        r.mApplication            = (x & 0x100) ? "Game-Win64-Shipping.exe" : "dwm.exe";
+        r.mSwapChainAddress       = 0x1f3a2b4c000ull + (x & 0x3) * 0x1000;
+        r.mQpcTime                = qpc;
+        r.mTimeInSeconds          = (double) (qpc - 123456789012ull) / 10000000.0;
+        r.mMsBetweenPresents      = (double) frameQpc / 10000.0;
+        r.mMsBetweenDisplayChange = (x & 0x200) ? 16.666 + jitter : 0.0;
+        r.mMsInPresentApi         = 0.05 + jitter * 0.4;
+        r.mMsUntilRenderComplete  = 3.0 + jitter * 9.0;
+        r.mMsUntilDisplayed       = 10.0 + jitter * 30.0;
+        r.mProcessId              = 4000 + (x & 0x100);
+        r.mPresentFlags           = 0;
+        r.mSyncInterval           = (x & 0x400) ? 1 : 0;
+        r.mRuntime                = "DXGI";
+        r.mPresentMode            = "Hardware: Independent Flip";
+        r.mDropped                = (x & 0xf000) ? "0" : "1";
+        r.mSupportsTearing        = (x & 0x800) != 0;
+        r.mWasBatched             = false;
+        r.mDwmNotified            = (x & 0x2000) != 0;
+    }
+    return rows;
+}
+
+void WriteFprintf(FILE* fp, Row const& r)
+{
+    fprintf(fp, "%s,%d,0x%016llX,%s,%d,%d", r.mApplication, r.mProcessId, (unsigned long long) r.mSwapChainAddress,
+        r.mRuntime, r.mSyncInterval, r.mPresentFlags);
+    fprintf(fp, ",%d,%s", r.mSupportsTearing, r.mPresentMode);
+    fprintf(fp, ",%d,%d", r.mWasBatched, r.mDwmNotified);
+    fprintf(fp, ",%s,%.6lf,%.3lf", r.mDropped, r.mTimeInSeconds, r.mMsBetweenPresents);
+    fprintf(fp, ",%.3lf", r.mMsBetweenDisplayChange);
+    fprintf(fp, ",%.3lf", r.mMsInPresentApi);
+    fprintf(fp, ",%.3lf,%.3lf", r.mMsUntilRenderComplete, r.mMsUntilDisplayed);
+    fprintf(fp, ",%llu", (unsigned long long) r.mQpcTime);
+    fprintf(fp, "\n");
+}
+
+void AppendSnprintf(std::vector<char>* text, char const* format, ...)
+{
+    enum { INITIAL_SIZE = 256 };
+
+    va_list args;
+    va_start(args, format);
+    auto start = text->size();
+    text->resize(start + INITIAL_SIZE);
+    auto length = vsnprintf(text->data() + start, INITIAL_SIZE, format, args);
+    va_end(args);
+
+    if (length >= INITIAL_SIZE) {
+        text->resize(start + length + 1);
+        va_start(args, format);
+        vsnprintf(text->data() + start, length + 1, format, args);
+        va_end(args);
+    }
+
+    text->resize(start + (length < 0 ? 0 : length));
+}
+
+void FormatSnprintf(std::vector<char>* text, Row const& r)
+{
+    AppendSnprintf(text, "%s,%d,0x%016llX,%s,%d,%d", r.mApplication, r.mProcessId, (unsigned long long) r.mSwapChainAddress,
+        r.mRuntime, r.mSyncInterval, r.mPresentFlags);
+    AppendSnprintf(text, ",%d,%s", r.mSupportsTearing, r.mPresentMode);
+    AppendSnprintf(text, ",%d,%d", r.mWasBatched, r.mDwmNotified);
+    AppendSnprintf(text, ",%s,%.6lf,%.3lf", r.mDropped, r.mTimeInSeconds, r.mMsBetweenPresents);
+    AppendSnprintf(text, ",%.3lf", r.mMsBetweenDisplayChange);
+    AppendSnprintf(text, ",%.3lf", r.mMsInPresentApi);
+    AppendSnprintf(text, ",%.3lf,%.3lf", r.mMsUntilRenderComplete, r.mMsUntilDisplayed);
+    AppendSnprintf(text, ",%llu", (unsigned long long) r.mQpcTime);
+    text->push_back('\n');
+}
+
+void FormatRowWriter(std::vector<char>* text, Row const& r)
+{
+    CsvRowWriter row(text);
+    row.String(r.mApplication);
+    row.Int((int32_t) r.mProcessId);
+    row.Hex64(r.mSwapChainAddress);
+    row.String(r.mRuntime);
+    row.Int(r.mSyncInterval);
+    row.Int((int32_t) r.mPresentFlags);
+    row.Int(r.mSupportsTearing);
+    row.String(r.mPresentMode);
+    row.Int(r.mWasBatched);
+    row.Int(r.mDwmNotified);
+    row.String(r.mDropped);
+    row.Fixed(r.mTimeInSeconds, 6);
+    row.Fixed(r.mMsBetweenPresents, 3);
+    row.Fixed(r.mMsBetweenDisplayChange, 3);
+    row.Fixed(r.mMsInPresentApi, 3);
+    row.Fixed(r.mMsUntilRenderComplete, 3);
+    row.Fixed(r.mMsUntilDisplayed, 3);
+    row.UInt64(r.mQpcTime);
+    row.EndRow();
+}
+
+std::string ReadBack(FILE* fp)
+{
+    std::string text;
+    fflush(fp);
+    fseek(fp, 0, SEEK_END);
+    text.resize((size_t) ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    if (fread(&text[0], 1, text.size(), fp) != text.size()) {
+        text.clear();
+    }
+    return text;
+}
+
+template<typename WriteFn>
+double Run(std::vector<Row> const& rows, std::string* output, WriteFn&& write)
+{
+    auto fp = tmpfile();
+    if (fp == nullptr) {
+        fprintf(stderr, "error: failed to create temporary file\n");
+        return 0.0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    write(fp, rows);
+    fflush(fp);
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    *output = ReadBack(fp);
+    fclose(fp);
+    return seconds;
+}
+
+}
+
+int main()
+{
+    auto rows = GenerateRows();
+
+    std::string output[3];
+    auto fprintfSeconds = Run(rows, &output[0], [](FILE* fp, std::vector<Row> const& rows) {
+        for (auto const& r : rows) {
+            WriteFprintf(fp, r);
+        }
+    });
+    auto snprintfSeconds = Run(rows, &output[1], [](FILE* fp, std::vector<Row> const& rows) {
+        std::vector<char> text;
+        for (auto const& r : rows) {
+            FormatSnprintf(&text, r);
+        }
+        fwrite(text.data(), 1, text.size(), fp);
+    });
+    auto writerSeconds = Run(rows, &output[2], [](FILE* fp, std::vector<Row> const& rows) {
+        std::vector<char> text;
+        for (auto const& r : rows) {
+            FormatRowWriter(&text, r);
+        }
+        fwrite(text.data(), 1, text.size(), fp);
+    });
+
+    printf("rows:           %u (%zu bytes)\n", (uint32_t) ROW_COUNT, output[0].size());
+    printf("fprintf:        %.3lf s (%.0lf ns/row)\n", fprintfSeconds, 1e9 * fprintfSeconds / ROW_COUNT);
+    printf("snprintf:       %.3lf s (%.0lf ns/row)\n", snprintfSeconds, 1e9 * snprintfSeconds / ROW_COUNT);
+    printf("CsvRowWriter:   %.3lf s (%.0lf ns/row)\n", writerSeconds, 1e9 * writerSeconds / ROW_COUNT);
+    if (output[0].empty() || output[0] != output[1] || output[0] != output[2]) {
+        fprintf(stderr, "error: output mismatch\n");
+        return 1;
+    }
+    return 0;
+}
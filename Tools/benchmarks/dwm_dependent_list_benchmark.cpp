@@ -0,0 +1,180 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Replays the DWM piggybacking traffic of a windowed-composition workload
+// against the handle deques PMTraceConsumer used to use for
+// mPresentsWaitingForDWM/DependentPresents and against IntrusiveList.
+//
+// Every DWM frame, each windowed app's present is added to the waiting set.
+// A few of them are completed or lost on their own before DWM presents, which
+// removes them from the waiting set.  DWM's flip then takes the whole waiting
+// set as its dependents, and completing DWM's present completes them.
+//
+// Only the container traffic is modeled, so this builds and runs on any
+// platform:
+//
+//     g++ -O2 -std=c++17 -I../../PresentData dwm_dependent_list_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc /I..\..\PresentData dwm_dependent_list_benchmark.cpp
+
+#include "GenerationalPool.hpp"
+#include "IntrusiveList.hpp"
+
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum {
+    APP_COUNT    = 24,      // windowed apps composed by DWM
+    REMOVE_EVERY = 7,       // every Nth windowed present leaves the waiting set early
+    FRAME_COUNT  = 200000,
+};
+
+struct DequePresent {
+    uint64_t QpcTime;
+    uint64_t ScreenTime;
+    bool InWaitingSet;
+    std::deque<PoolHandle> DependentPresents;
+};
+
+struct ListPresent : IntrusiveListNode {
+    PoolHandle Handle;
+    uint64_t QpcTime;
+    uint64_t ScreenTime;
+    IntrusiveList<ListPresent> DependentPresents;
+};
+
+double RunDeque(uint64_t* checksum)
+{
+    GenerationalPool<DequePresent> pool(1024);
+    std::deque<PoolHandle> waiting;
+    std::vector<PoolHandle> apps(APP_COUNT);
+    uint64_t n = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame) {
+        for (uint32_t app = 0; app < APP_COUNT; ++app) {
+            auto h = pool.Create();
+            auto p = pool.Get(h);
+            p->QpcTime = ++n;
+            p->ScreenTime = 0;
+            p->InWaitingSet = true;
+            waiting.emplace_back(h);
+            apps[app] = h;
+        }
+
+        // RemovePresentFromTemporaryTrackingCollections
+        for (uint32_t app = frame % REMOVE_EVERY; app < APP_COUNT; app += REMOVE_EVERY) {
+            auto p = pool.Get(apps[app]);
+            for (auto ii = waiting.begin(); ii != waiting.end(); ++ii) {
+                if (*ii == apps[app]) {
+                    waiting.erase(ii);
+                    p->InWaitingSet = false;
+                    break;
+                }
+            }
+            *checksum += p->QpcTime;
+            pool.Destroy(apps[app]);
+        }
+
+        // DWM flip takes the waiting set, then completes.
+        auto dwmHandle = pool.Create();
+        auto dwm = pool.Get(dwmHandle);
+        dwm->ScreenTime = ++n;
+        std::swap(dwm->DependentPresents, waiting);
+        for (auto h : dwm->DependentPresents) {
+            auto p = pool.Get(h);
+            if (p != nullptr) {
+                p->ScreenTime = dwm->ScreenTime;
+                *checksum += p->QpcTime ^ p->ScreenTime;
+                pool.Destroy(h);
+            }
+        }
+        dwm->DependentPresents.clear();
+        pool.Destroy(dwmHandle);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double RunIntrusive(uint64_t* checksum)
+{
+    GenerationalPool<ListPresent> pool(1024);
+    IntrusiveList<ListPresent> waiting;
+    std::vector<PoolHandle> apps(APP_COUNT);
+    uint64_t n = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame) {
+        for (uint32_t app = 0; app < APP_COUNT; ++app) {
+            auto h = pool.Create();
+            auto p = pool.Get(h);
+            p->Handle = h;
+            p->QpcTime = ++n;
+            p->ScreenTime = 0;
+            waiting.PushBack(p);
+            apps[app] = h;
+        }
+
+        for (uint32_t app = frame % REMOVE_EVERY; app < APP_COUNT; app += REMOVE_EVERY) {
+            auto p = pool.Get(apps[app]);
+            if (p->IsLinked()) {
+                p->Unlink();
+            }
+            *checksum += p->QpcTime;
+            pool.Destroy(apps[app]);
+        }
+
+        auto dwmHandle = pool.Create();
+        auto dwm = pool.Get(dwmHandle);
+        dwm->ScreenTime = ++n;
+        dwm->DependentPresents.Splice(&waiting);
+        while (auto p = dwm->DependentPresents.PopFront()) {
+            p->ScreenTime = dwm->ScreenTime;
+            *checksum += p->QpcTime ^ p->ScreenTime;
+            pool.Destroy(p->Handle);
+        }
+        pool.Destroy(dwmHandle);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main()
+{
+    uint64_t checksum[2] = {};
+    auto dequeSeconds     = RunDeque(&checksum[0]);
+    auto intrusiveSeconds = RunIntrusive(&checksum[1]);
+
+    printf("DWM frames:    %u (%u windowed presents each)\n", (uint32_t) FRAME_COUNT, (uint32_t) APP_COUNT);
+    printf("handle deque:  %.3lf s (%.1lf ns/frame)\n", dequeSeconds, 1e9 * dequeSeconds / FRAME_COUNT);
+    printf("IntrusiveList: %.3lf s (%.1lf ns/frame)\n", intrusiveSeconds, 1e9 * intrusiveSeconds / FRAME_COUNT);
+    if (checksum[0] != checksum[1]) {
+        fprintf(stderr, "error: checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Models the output thread's present history pruning during an always-on
+// capture: a couple of swapchains present continuously while short-lived
+// ones (launchers, overlays, loading screens) come and go, each presenting
+// for a second and then going idle.  Compares the previous sweep over every
+// swapchain each batch against scheduling each swapchain in a TimerWheel for
+// when its oldest present expires, and evicting it once its history is
+// empty.
+//
+// The wheel's tick is set to the batch period so both prune at exactly the
+// same times and the checksums can be compared.  Only the history bookkeeping
+// is modeled, so this builds and runs on any platform:
+//
+//     g++ -O2 -std=c++17 -I../../PresentData history_expiry_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc /I..\..\PresentData history_expiry_benchmark.cpp
+
+#include "TimerWheel.hpp"
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+
+namespace {
+
+enum : uint64_t {
+    QPC_FREQUENCY       = 10000000,
+    HISTORY_DURATION    = 2 * QPC_FREQUENCY,
+    BATCH_PERIOD        = QPC_FREQUENCY / 100,      // 10ms
+    PRESENT_PERIOD      = QPC_FREQUENCY / 60,
+    CAPTURE_START       = 3600 * QPC_FREQUENCY,     // QPC counts from boot
+    CAPTURE_DURATION    = 600 * QPC_FREQUENCY,      // 10 minutes
+    CONTINUOUS_CHAINS   = 2,
+    SHORT_CHAIN_PERIOD  = QPC_FREQUENCY / 2,        // a new short-lived swapchain every 500ms
+    SHORT_CHAIN_LIFE    = QPC_FREQUENCY,            // that presents for 1s
+    HISTORY_MAX_COUNT   = 120,
+};
+
+struct Chain {
+    uint64_t mHistory[HISTORY_MAX_COUNT];
+    uint32_t mCount;
+    uint32_t mNext;
+    uint64_t mExpiry;
+};
+
+void AddPresent(Chain* chain, uint64_t qpc)
+{
+    chain->mHistory[chain->mNext % HISTORY_MAX_COUNT] = qpc;
+    chain->mNext += 1;
+    if (chain->mCount < HISTORY_MAX_COUNT) {
+        chain->mCount += 1;
+    }
+}
+
+uint64_t Oldest(Chain const& chain)
+{
+    return chain.mHistory[(chain.mNext - chain.mCount) % HISTORY_MAX_COUNT];
+}
+
+void Trim(Chain* chain, uint64_t minQpc)
+{
+    while (chain->mCount > 0 && Oldest(*chain) < minQpc) {
+        chain->mCount -= 1;
+    }
+}
+
+// Calls present(chainId, qpc) for each present in [begin, end).
+template<typename PresentFn>
+void GeneratePresents(uint64_t begin, uint64_t end, PresentFn&& present)
+{
+    auto first = (begin + PRESENT_PERIOD - 1) / PRESENT_PERIOD;
+    for (auto i = first; i * PRESENT_PERIOD < end; ++i) {
+        auto qpc = i * PRESENT_PERIOD;
+        for (uint64_t c = 0; c < CONTINUOUS_CHAINS; ++c) {
+            present(c, qpc);
+        }
+        auto lastShortChain = (qpc - CAPTURE_START) / SHORT_CHAIN_PERIOD;
+        auto firstShortChain = qpc - CAPTURE_START < SHORT_CHAIN_LIFE ? 0 : (qpc - CAPTURE_START - SHORT_CHAIN_LIFE) / SHORT_CHAIN_PERIOD + 1;
+        for (auto s = firstShortChain; s <= lastShortChain; ++s) {
+            present(CONTINUOUS_CHAINS + s, qpc);
+        }
+    }
+}
+
+struct SweepHistory {
+    std::unordered_map<uint64_t, Chain> mChains;
+
+    void Present(uint64_t id, uint64_t qpc)
+    {
+        auto result = mChains.emplace(id, Chain());
+        if (result.second) {
+            result.first->second.mCount = 0;
+            result.first->second.mNext = 1;
+        }
+        AddPresent(&result.first->second, qpc);
+    }
+
+    void Prune(uint64_t latestQpc, uint64_t* checksum)
+    {
+        auto minQpc = latestQpc - HISTORY_DURATION;
+        for (auto& pair : mChains) {
+            Trim(&pair.second, minQpc);
+            if (pair.second.mCount > 0) {
+                *checksum += pair.first * 131 + pair.second.mCount;
+            }
+        }
+    }
+};
+
+struct WheelHistory {
+    struct Expiry {
+        uint64_t mId;
+        uint64_t mDeadline;
+    };
+
+    std::unordered_map<uint64_t, Chain> mChains;
+    TimerWheel<Expiry> mWheel;
+
+    WheelHistory() { mWheel.Initialize(BATCH_PERIOD, 256); }
+
+    void Schedule(uint64_t id, Chain* chain)
+    {
+        chain->mExpiry = Oldest(*chain) + HISTORY_DURATION;
+        mWheel.Schedule(chain->mExpiry, Expiry{ id, chain->mExpiry });
+    }
+
+    void Present(uint64_t id, uint64_t qpc)
+    {
+        auto result = mChains.emplace(id, Chain());
+        auto chain = &result.first->second;
+        if (result.second) {
+            chain->mCount = 0;
+            chain->mNext = 1;
+            chain->mExpiry = 0;
+        }
+        AddPresent(chain, qpc);
+        if (chain->mExpiry == 0) {
+            Schedule(id, chain);
+        }
+    }
+
+    void Prune(uint64_t latestQpc, uint64_t* checksum)
+    {
+        auto minQpc = latestQpc - HISTORY_DURATION;
+        mWheel.Advance(latestQpc, [&](Expiry const& expiry) {
+            auto ii = mChains.find(expiry.mId);
+            if (ii == mChains.end() || ii->second.mExpiry != expiry.mDeadline) {
+                return;
+            }
+            Trim(&ii->second, minQpc);
+            if (ii->second.mCount == 0) {
+                mChains.erase(ii);
+            } else {
+                Schedule(expiry.mId, &ii->second);
+            }
+        });
+
+        // Not part of the pruning cost, but needed to compare results.
+        for (auto const& pair : mChains) {
+            *checksum += pair.first * 131 + pair.second.mCount;
+        }
+    }
+};
+
+template<typename History>
+double Run(uint64_t* checksum, size_t* finalChainCount)
+{
+    History history;
+    double seconds = 0.0;
+    for (uint64_t t = CAPTURE_START; t < CAPTURE_START + CAPTURE_DURATION; t += BATCH_PERIOD) {
+        GeneratePresents(t, t + BATCH_PERIOD, [&](uint64_t id, uint64_t qpc) {
+            history.Present(id, qpc);
+        });
+
+        // Prune as of the end of the batch, like the output thread does with
+        // the latest event time.
+        uint64_t pruneChecksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        history.Prune(t + BATCH_PERIOD, &pruneChecksum);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        *checksum += pruneChecksum;
+    }
+    *finalChainCount = history.mChains.size();
+    return seconds;
+}
+
+}
+
+int main()
+{
+    uint64_t checksum[2] = {};
+    size_t chainCount[2] = {};
+    auto sweepSeconds = Run<SweepHistory>(&checksum[0], &chainCount[0]);
+    auto wheelSeconds = Run<WheelHistory>(&checksum[1], &chainCount[1]);
+
+    auto batchCount = (double) (CAPTURE_DURATION / BATCH_PERIOD);
+    printf("batches:        %.0lf\n", batchCount);
+    printf("sweep:          %.3lf s (%.2lf us/batch, %zu swapchains kept)\n", sweepSeconds, 1e6 * sweepSeconds / batchCount, chainCount[0]);
+    printf("wheel:          %.3lf s (%.2lf us/batch, %zu swapchains kept)\n", wheelSeconds, 1e6 * wheelSeconds / batchCount, chainCount[1]);
+    if (checksum[0] != checksum[1]) {
+        fprintf(stderr, "error: checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
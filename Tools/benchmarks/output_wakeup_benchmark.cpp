@@ -0,0 +1,162 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Measures how long completed presents wait before the output thread handles
+// them, and how often the output thread wakes up, for the previous
+// Sleep(100) polling loop and for waiting on an EventBatchSignal.  A producer
+// thread stands in for the consumer thread, completing one present every
+// PRESENT_PERIOD_US (a ~500 fps game) into an SpscRing.
+//
+// Only the hand-off is modeled, so this builds and runs on any platform:
+//
+//     g++ -O2 -std=c++17 -pthread -I../../PresentData output_wakeup_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc /I..\..\PresentData output_wakeup_benchmark.cpp
+
+#include "EventBatchSignal.hpp"
+#include "SpscRing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum {
+    PRESENT_COUNT       = 1000,
+    PRESENT_PERIOD_US   = 2000,
+    POLL_PERIOD_MS      = 100,
+    BATCH_SIZE          = 256,
+    MAX_LATENCY_MS      = 5,
+};
+
+typedef std::chrono::steady_clock Clock;
+
+struct CompletedPresent {
+    uint32_t Index;
+    Clock::time_point CompletionTime;
+};
+
+struct Result {
+    uint64_t Checksum;
+    uint32_t Wakeups;
+    double MeanLatencyMs;
+    double MaxLatencyMs;
+};
+
+template<typename Wait>
+Result Run(EventBatchSignal* signal, Wait wait)
+{
+    SpscRing<CompletedPresent> ring(1024, SpscOverflowPolicy::Spill);
+    std::atomic<bool> done(false);
+
+    std::thread producer([&]() {
+        auto next = Clock::now();
+        for (uint32_t i = 0; i < PRESENT_COUNT; ++i) {
+            next += std::chrono::microseconds(PRESENT_PERIOD_US);
+            std::this_thread::sleep_until(next);
+
+            CompletedPresent p;
+            p.Index = i;
+            p.CompletionTime = Clock::now();
+            ring.Push(p);
+            if (signal != nullptr) {
+                signal->Notify();
+            }
+        }
+        done.store(true);
+        if (signal != nullptr) {
+            signal->Stop();
+        }
+    });
+
+    Result result = {};
+    double totalLatencyMs = 0.0;
+    uint32_t count = 0;
+    std::vector<CompletedPresent> presents;
+    for (;;) {
+        auto quit = done.load();
+
+        presents.clear();
+        ring.PopAll(presents);
+        auto now = Clock::now();
+        for (auto const& p : presents) {
+            auto latencyMs = std::chrono::duration<double, std::milli>(now - p.CompletionTime).count();
+            totalLatencyMs += latencyMs;
+            result.MaxLatencyMs = std::max(result.MaxLatencyMs, latencyMs);
+            result.Checksum += p.Index;
+            count += 1;
+        }
+        if (signal != nullptr) {
+            signal->BatchDelivered();
+        }
+
+        if (quit) {
+            break;
+        }
+        wait();
+        result.Wakeups += 1;
+    }
+
+    producer.join();
+    result.MeanLatencyMs = count == 0 ? 0.0 : totalLatencyMs / count;
+    return result;
+}
+
+void Print(char const* name, Result const& r)
+{
+    printf("%-16s %6u wakeups, latency mean %7.3lf ms, max %7.3lf ms\n", name, r.Wakeups, r.MeanLatencyMs, r.MaxLatencyMs);
+}
+
+}
+
+int main()
+{
+    auto polled = Run(nullptr, []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_PERIOD_MS));
+    });
+
+    EventBatchSignal signal;
+    signal.Configure(BATCH_SIZE, MAX_LATENCY_MS);
+    auto signaled = Run(&signal, [&]() {
+        signal.Wait(std::chrono::milliseconds(POLL_PERIOD_MS));
+    });
+
+    printf("presents:        %u (one every %u us)\n", (uint32_t) PRESENT_COUNT, (uint32_t) PRESENT_PERIOD_US);
+    Print("Sleep(100):", polled);
+    Print("EventBatchSignal:", signaled);
+
+    auto const& stats = signal.GetLatencyStats();
+    printf("EventBatchSignal batches: %llu, mean %.0lf us, max %llu us\n",
+        (unsigned long long) stats.BatchCount,
+        stats.BatchCount == 0 ? 0.0 : (double) stats.TotalMicroseconds / stats.BatchCount,
+        (unsigned long long) stats.MaxMicroseconds);
+
+    if (polled.Checksum != signaled.Checksum) {
+        fprintf(stderr, "error: checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
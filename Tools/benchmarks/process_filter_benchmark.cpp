@@ -0,0 +1,155 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Models the per-event process filter check PMTraceConsumer makes when
+// capturing one game on a busy desktop: DXGI/D3D9 events come from many
+// processes, only one of which is tracked, while another thread occasionally
+// adds and removes tracked process ids (as process start/exit handling
+// would).  Compares the previous std::set guarded by a std::shared_mutex
+// against ProcessIdSet.
+//
+// Only the filter is modeled, so this builds and runs on any platform:
+//
+//     g++ -O2 -std=c++17 -pthread -I../../PresentData process_filter_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc /I..\..\PresentData process_filter_benchmark.cpp
+
+#include "ProcessIdSet.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+
+namespace {
+
+enum {
+    PROCESS_COUNT   = 48,       // processes presenting on the desktop
+    TARGET_PROCESS  = 7,        // index of the tracked process
+    EVENT_COUNT     = 20000000,
+    WRITER_PERIOD   = 4096,     // events between writer updates (approx.)
+};
+
+uint32_t ProcessId(uint32_t index)
+{
+    return 0x1000 + index * 4;
+}
+
+struct StdSetFilter {
+    std::set<uint32_t> mIds;
+    std::shared_mutex mMutex;
+
+    void Insert(uint32_t id)
+    {
+        std::unique_lock<std::shared_mutex> lock(mMutex);
+        mIds.insert(id);
+    }
+    void Erase(uint32_t id)
+    {
+        std::unique_lock<std::shared_mutex> lock(mMutex);
+        mIds.erase(id);
+    }
+    bool Contains(uint32_t id)
+    {
+        std::shared_lock<std::shared_mutex> lock(mMutex);
+        return mIds.find(id) != mIds.end();
+    }
+};
+
+struct ProcessIdSetFilter {
+    ProcessIdSet mIds;
+
+    void Insert(uint32_t id) { mIds.Insert(id); }
+    void Erase(uint32_t id)  { mIds.Erase(id); }
+    bool Contains(uint32_t id) { return mIds.Contains(id); }
+};
+
+template<typename Filter>
+double Run(uint64_t* checksum)
+{
+    Filter filter;
+    filter.Insert(ProcessId(TARGET_PROCESS));
+
+    // The writer churns ids that never present, so the filter's answers (and
+    // the checksum) don't depend on how the threads interleave.
+    std::atomic<uint32_t> progress(0);
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        uint32_t lastProgress = 0;
+        uint32_t n = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            auto p = progress.load(std::memory_order_relaxed);
+            if (p - lastProgress < WRITER_PERIOD) {
+                std::this_thread::yield();
+                continue;
+            }
+            lastProgress = p;
+            auto id = ProcessId(PROCESS_COUNT + n % 200);
+            if ((n / 200) % 2 == 0) {
+                filter.Insert(id);
+            } else {
+                filter.Erase(id);
+            }
+            n += 1;
+        }
+    });
+
+    // Reader: the consumer thread checking each event's header.
+    uint32_t x = 1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < EVENT_COUNT; ++i) {
+        x = x * 1664525u + 1013904223u;
+        auto id = ProcessId((x >> 16) % PROCESS_COUNT);
+        if (filter.Contains(id)) {
+            *checksum += i;
+        }
+        if ((i & 255) == 0) {
+            progress.store(i, std::memory_order_relaxed);
+        }
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    done.store(true);
+    writer.join();
+    return seconds;
+}
+
+}
+
+int main()
+{
+    uint64_t checksum[2] = {};
+    auto setSeconds  = Run<StdSetFilter>(&checksum[0]);
+    auto fastSeconds = Run<ProcessIdSetFilter>(&checksum[1]);
+
+    printf("events:                    %u\n", (uint32_t) EVENT_COUNT);
+    printf("std::set + shared_mutex:   %.3lf s (%.1lf ns/event)\n", setSeconds, 1e9 * setSeconds / EVENT_COUNT);
+    printf("ProcessIdSet:              %.3lf s (%.1lf ns/event)\n", fastSeconds, 1e9 * fastSeconds / EVENT_COUNT);
+    if (checksum[0] != checksum[1]) {
+        fprintf(stderr, "error: checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+Copyright 2020 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Measures the per-event provider dispatch in TraceSession's
+// EventRecordCallback.  "chain" is the original if/else chain of GUID
+// compares, in the order the callback had them; "table" is
+// ProviderDispatchTable; "dxgkrnl+table" checks DxgKrnl inline before
+// falling back to the table.
+//
+// The provider GUIDs are the real ones the full (non-simple) session enables,
+// and the event stream is dominated by DxgKrnl, as in a trace of a GPU-bound
+// app, followed by Win32k, DWM, and DXGI, with the providers interleaved
+// pseudo-randomly.  Only the dispatch is modeled, so this builds and runs on
+// any platform:
+//
+//     g++ -O2 -std=c++17 -I../../PresentData provider_dispatch_benchmark.cpp
+//     cl /O2 /std:c++17 /EHsc /I..\..\PresentData provider_dispatch_benchmark.cpp
+
+#include "ProviderDispatchTable.hpp"
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+
+struct Guid {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+
+bool operator==(Guid const& lhs, Guid const& rhs)
+{
+    return memcmp(&lhs, &rhs, sizeof(Guid)) == 0;
+}
+
+enum Provider {
+    DXGKRNL,
+    WIN32K,
+    DWM_CORE,
+    DXGI,
+    D3D9,
+    NT_PROCESS,
+    DWM_CORE_WIN7,
+    DXGKRNL_WIN7_BLT,
+    DXGKRNL_WIN7_FLIP,
+    DXGKRNL_WIN7_PRESENTHISTORY,
+    DXGKRNL_WIN7_QUEUEPACKET,
+    DXGKRNL_WIN7_VSYNCDPC,
+    DXGKRNL_WIN7_MMIOFLIP,
+    EVENT_METADATA,
+    PROVIDER_COUNT,
+};
+
+Guid const PROVIDER_GUIDS[PROVIDER_COUNT] = {
+    { 0x802EC45A, 0x1E99, 0x4B83, { 0x99, 0x20, 0x87, 0xC9, 0x82, 0x77, 0xBA, 0x9D } },
+    { 0x8C416C79, 0xD49B, 0x4F01, { 0xA4, 0x67, 0xE5, 0x6D, 0x3A, 0xA8, 0x23, 0x4C } },
+    { 0x9E9BBA3C, 0x2E38, 0x40CB, { 0x99, 0xF4, 0x9E, 0x82, 0x81, 0x42, 0x51, 0x64 } },
+    { 0xCA11C036, 0x0102, 0x4A2D, { 0xA6, 0xAD, 0xF0, 0x3C, 0xFE, 0xD5, 0xD3, 0xC9 } },
+    { 0x783ACA0A, 0x790E, 0x4D7F, { 0x84, 0x51, 0xAA, 0x85, 0x05, 0x11, 0xC6, 0xB9 } },
+    { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } },
+    { 0x8c9dd1ad, 0xe6e5, 0x4b07, { 0xb4, 0x55, 0x68, 0x4a, 0x9d, 0x87, 0x99, 0x00 } },
+    { 0x069f67f2, 0xc380, 0x4a65, { 0x8a, 0x61, 0x07, 0x1c, 0xd4, 0xa8, 0x72, 0x75 } },
+    { 0x22412531, 0x670b, 0x4cd3, { 0x81, 0xd1, 0xe7, 0x09, 0xc1, 0x54, 0xae, 0x3d } },
+    { 0xc19f763a, 0xc0c1, 0x479d, { 0x9f, 0x74, 0x22, 0xab, 0xfc, 0x3a, 0x5f, 0x0a } },
+    { 0x295e0d8e, 0x51ec, 0x43b8, { 0x9c, 0xc6, 0x9f, 0x79, 0x33, 0x1d, 0x27, 0xd6 } },
+    { 0x5ccf1378, 0x6b2c, 0x4c0f, { 0xbd, 0x56, 0x8e, 0xeb, 0x9e, 0x4c, 0x5c, 0x77 } },
+    { 0x547820fe, 0x5666, 0x4b41, { 0x93, 0xdc, 0x6c, 0xfd, 0x5d, 0xea, 0x28, 0xcc } },
+    { 0xbbccf6c1, 0x6cd1, 0x48C4, { 0x80, 0xff, 0x83, 0x94, 0x82, 0xe3, 0x76, 0x71 } },
+};
+
+// Relative event counts per provider; the Win7 providers aren't seen on
+// Win8+ but are still enabled.
+uint32_t const PROVIDER_WEIGHTS[PROVIDER_COUNT] = {
+    60, 12, 10, 8, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1,
+};
+
+enum {
+    EVENT_COUNT = 4 * 1024 * 1024,
+    REPEAT      = 8,
+};
+
+struct Event {
+    Guid ProviderId;
+    uint16_t Id;
+};
+
+struct Consumer {
+    uint64_t mCounts[PROVIDER_COUNT];
+};
+
+typedef void (*Handler)(Consumer* consumer, Event const& event);
+
+template<int P>
+NOINLINE void Handle(Consumer* consumer, Event const& event)
+{
+    consumer->mCounts[P] += 1 + event.Id;
+}
+
+void DispatchChain(Consumer* c, Event const& e)
+{
+    auto const& id = e.ProviderId;
+         if (id == PROVIDER_GUIDS[DXGKRNL])                     Handle<DXGKRNL>                    (c, e);
+    else if (id == PROVIDER_GUIDS[WIN32K])                      Handle<WIN32K>                     (c, e);
+    else if (id == PROVIDER_GUIDS[DWM_CORE])                    Handle<DWM_CORE>                   (c, e);
+    else if (id == PROVIDER_GUIDS[DXGI])                        Handle<DXGI>                       (c, e);
+    else if (id == PROVIDER_GUIDS[D3D9])                        Handle<D3D9>                       (c, e);
+    else if (id == PROVIDER_GUIDS[NT_PROCESS])                  Handle<NT_PROCESS>                 (c, e);
+    else if (id == PROVIDER_GUIDS[DWM_CORE_WIN7])               Handle<DWM_CORE_WIN7>              (c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_BLT])            Handle<DXGKRNL_WIN7_BLT>           (c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_FLIP])           Handle<DXGKRNL_WIN7_FLIP>          (c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_PRESENTHISTORY]) Handle<DXGKRNL_WIN7_PRESENTHISTORY>(c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_QUEUEPACKET])    Handle<DXGKRNL_WIN7_QUEUEPACKET>   (c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_VSYNCDPC])       Handle<DXGKRNL_WIN7_VSYNCDPC>      (c, e);
+    else if (id == PROVIDER_GUIDS[DXGKRNL_WIN7_MMIOFLIP])       Handle<DXGKRNL_WIN7_MMIOFLIP>      (c, e);
+    else if (id == PROVIDER_GUIDS[EVENT_METADATA])              Handle<EVENT_METADATA>             (c, e);
+}
+
+typedef ProviderDispatchTable<Guid, Handler> Table;
+
+Table gTable;
+
+void DispatchTable(Consumer* c, Event const& e)
+{
+    auto handler = gTable.Find(e.ProviderId);
+    if (handler != nullptr) {
+        handler(c, e);
+    }
+}
+
+void DispatchDxgKrnlThenTable(Consumer* c, Event const& e)
+{
+    if (e.ProviderId == PROVIDER_GUIDS[DXGKRNL]) {
+        Handle<DXGKRNL>(c, e);
+    } else {
+        DispatchTable(c, e);
+    }
+}
+
+template<void (*Dispatch)(Consumer*, Event const&)>
+double Run(std::vector<Event> const& events, uint64_t* checksum)
+{
+    Consumer consumer = {};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < REPEAT; ++r) {
+        for (auto const& e : events) {
+            Dispatch(&consumer, e);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (uint32_t p = 0; p < PROVIDER_COUNT; ++p) {
+        *checksum = *checksum * 31 + consumer.mCounts[p];
+    }
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+}
+
+int main()
+{
+    Table::Entry entries[] = {
+        { PROVIDER_GUIDS[DXGKRNL],                     &Handle<DXGKRNL> },
+        { PROVIDER_GUIDS[WIN32K],                      &Handle<WIN32K> },
+        { PROVIDER_GUIDS[DWM_CORE],                    &Handle<DWM_CORE> },
+        { PROVIDER_GUIDS[DXGI],                        &Handle<DXGI> },
+        { PROVIDER_GUIDS[D3D9],                        &Handle<D3D9> },
+        { PROVIDER_GUIDS[NT_PROCESS],                  &Handle<NT_PROCESS> },
+        { PROVIDER_GUIDS[DWM_CORE_WIN7],               &Handle<DWM_CORE_WIN7> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_BLT],            &Handle<DXGKRNL_WIN7_BLT> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_FLIP],           &Handle<DXGKRNL_WIN7_FLIP> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_PRESENTHISTORY], &Handle<DXGKRNL_WIN7_PRESENTHISTORY> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_QUEUEPACKET],    &Handle<DXGKRNL_WIN7_QUEUEPACKET> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_VSYNCDPC],       &Handle<DXGKRNL_WIN7_VSYNCDPC> },
+        { PROVIDER_GUIDS[DXGKRNL_WIN7_MMIOFLIP],       &Handle<DXGKRNL_WIN7_MMIOFLIP> },
+        { PROVIDER_GUIDS[EVENT_METADATA],              &Handle<EVENT_METADATA> },
+    };
+    if (!gTable.Build(entries, (uint32_t) (sizeof(entries) / sizeof(entries[0])))) {
+        fprintf(stderr, "error: no perfect hash found\n");
+        return 1;
+    }
+
+    uint32_t weightSum = 0;
+    for (auto w : PROVIDER_WEIGHTS) {
+        weightSum += w;
+    }
+
+    std::vector<Event> events(EVENT_COUNT);
+    uint32_t rng = 1;
+    for (uint32_t i = 0; i < EVENT_COUNT; ++i) {
+        rng = rng * 1664525u + 1013904223u;
+        auto pick = (rng >> 8) % weightSum;
+        uint32_t p = 0;
+        while (pick >= PROVIDER_WEIGHTS[p]) {
+            pick -= PROVIDER_WEIGHTS[p];
+            p += 1;
+        }
+        events[i].ProviderId = PROVIDER_GUIDS[p];
+        events[i].Id = (uint16_t) (rng >> 24);
+    }
+
+    uint64_t checksum[3] = {};
+    auto chainSeconds = Run<DispatchChain>(events, &checksum[0]);
+    auto tableSeconds = Run<DispatchTable>(events, &checksum[1]);
+    auto dxgkSeconds  = Run<DispatchDxgKrnlThenTable>(events, &checksum[2]);
+
+    auto n = (double) EVENT_COUNT * REPEAT;
+    printf("events:        %u\n", (uint32_t) n);
+    printf("chain:         %.3lf s (%.2lf ns/event)\n", chainSeconds, 1e9 * chainSeconds / n);
+    printf("table:         %.3lf s (%.2lf ns/event)\n", tableSeconds, 1e9 * tableSeconds / n);
+    printf("dxgkrnl+table: %.3lf s (%.2lf ns/event)\n", dxgkSeconds,  1e9 * dxgkSeconds  / n);
+    if (checksum[0] != checksum[1] || checksum[0] != checksum[2]) {
+        fprintf(stderr, "error: checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
@@ -467,6 +467,15 @@ std::wstring GetMemberStructName(std::wstring const& name, size_t memberIndex)
     return name + append;
 }
 
+bool IsVariableSize(EventProperty const& member)
+{
+    return ((member.Flags & (PropertyParamLength | PropertyParamCount)) != 0) ||
+           ((member.Flags & (PropertyWBEMXmlFragment | PropertyHasCustomSchema | PropertyParamFixedLength | PropertyParamFixedCount)) == 0 &&
+            (member.nonStructType.InType == TDH_INTYPE_UNICODESTRING ||
+             member.nonStructType.InType == TDH_INTYPE_ANSISTRING ||
+             member.nonStructType.InType == TDH_INTYPE_SID));
+}
+
 void PrintCppStruct(std::vector<EventProperty> const& members, std::wstring const& name)
 {
     auto memberCount = members.size();
@@ -495,12 +504,7 @@ void PrintCppStruct(std::vector<EventProperty> const& members, std::wstring cons
                 hasPointerMember = true;
             }
             if (i == memberCount - 1) break;
-            // If is variable length ...
-            if (((member.Flags & (PropertyParamLength | PropertyParamCount)) != 0) ||
-                ((member.Flags & (PropertyWBEMXmlFragment | PropertyHasCustomSchema | PropertyParamFixedLength | PropertyParamFixedCount)) == 0 &&
-                 (member.nonStructType.InType == TDH_INTYPE_UNICODESTRING ||
-                  member.nonStructType.InType == TDH_INTYPE_ANSISTRING ||
-                  member.nonStructType.InType == TDH_INTYPE_SID))) {
+            if (IsVariableSize(member)) {
                 parts.emplace_back(i + 1, hasPointerMember);
                 hasPointerMember = false;
             }
@@ -627,6 +631,39 @@ void PrintCppStruct(std::vector<EventProperty> const& members, std::wstring cons
     printf("\n");
 }
 
+// Print the offset and size of each member of a fixed-layout event struct, for
+// 32-bit and 64-bit pointers, so a consumer can check them against the
+// event's metadata before reading the event data through the struct.  Events
+// with struct or variable-sized members don't get a layout.
+void PrintCppFieldLayout(std::vector<EventProperty> const& members, std::wstring const& name)
+{
+    if (members.empty()) {
+        return;
+    }
+    for (auto const& member : members) {
+        if ((member.Flags & PropertyStruct) != 0 || IsVariableSize(member)) {
+            return;
+        }
+    }
+
+    auto struct32 = name + L"_Struct";
+    auto struct64 = struct32;
+    if (HasPointer(members)) {
+        struct32 += L"<uint32_t>";
+        struct64 += L"<uint64_t>";
+    }
+
+    printf("static constexpr EventFieldLayout %ls_Fields[] = {\n", name.c_str());
+    for (auto const& member : members) {
+        printf("    EVENT_FIELD_LAYOUT(%ls, %ls, %ls, L\"%ls\")\n",
+            struct32.c_str(),
+            struct64.c_str(),
+            CppCondition(member.name_).c_str(),
+            member.name_.c_str());
+    }
+    printf("};\n\n");
+}
+
 void PrintEventProperty(EventProperty const& prop, uint32_t indentCount=0, uint32_t indentWidth=4)
 {
     // Name
@@ -990,6 +1027,21 @@ int wmain(
                     printf(
                         "#pragma pack(pop)\n"
                         "#pragma warning(pop)\n"
+                        "\n"
+                        "// Event field layouts:\n"
+                        "#define EVENT_FIELD_LAYOUT(struct32_, struct64_, member_, name_) { name_, \\\n"
+                        "    { (uint32_t) offsetof(struct32_, member_), (uint32_t) offsetof(struct64_, member_) }, \\\n"
+                        "    { (uint32_t) sizeof(struct32_::member_), (uint32_t) sizeof(struct64_::member_) } },\n"
+                        "\n");
+                    eventIdx = 0;
+                    for (auto const& pair : events) {
+                        for (auto const& event : pair.second) {
+                            PrintCppFieldLayout(event.properties_, eventName[eventIdx]);
+                            eventIdx += 1;
+                        }
+                    }
+                    printf(
+                        "#undef EVENT_FIELD_LAYOUT\n"
                         "\n");
                 }
             } else {